@@ -8,17 +8,20 @@
 #include "Engine/Core/DevConsole.hpp"
 #include "Engine/Core/EventSystem.hpp"
 #include "Engine/Core/Clock.hpp"
+#include "Engine/Core/JobSystem.hpp"
 #include "ThirdParty/ImGUI/imgui.h"
 #include "ThirdParty/ImGUI/imgui_impl_dx11.h"
 #include "ThirdParty/ImGUI/imgui_impl_win32.h"
 #include "Game/App.hpp"
 #include "Game/Game.hpp"
+#include <thread>
 
 Renderer* g_theRenderer = nullptr;
 App* g_theApp = nullptr;
 InputSystem* g_theInput = nullptr;
 AudioSystem* g_theAudio = nullptr;
 Window* g_theWindow = nullptr;
+JobSystem* g_theJobSystem = nullptr;
 
 void App::Startup()
 {
@@ -51,12 +54,18 @@ void App::Startup()
 	AudioSystemConfig audioConfig;
 	g_theAudio = new AudioSystem(audioConfig);
 
+	JobSystemConfig jobSystemConfig;
+	int numHardwareThreads = (int)std::thread::hardware_concurrency();
+	jobSystemConfig.m_numWorkerThreads = g_gameConfigBlackboard.GetValue("numWorkerThreads", numHardwareThreads > 1 ? numHardwareThreads - 1 : 1);
+	g_theJobSystem = new JobSystem(jobSystemConfig);
+
 	g_theEventSystem->Startup();
 	g_theInput->Startup();
 	g_theWindow->Startup();
 	g_theRenderer->Startup();
 	g_theConsole->Startup();
 	g_theAudio->Startup();
+	g_theJobSystem->Startup();
 
 	//initialize ImGUI
 	ImGui::CreateContext();
@@ -126,6 +135,10 @@ void App::Shutdown()
 	ImGui_ImplWin32_Shutdown();
 	ImGui::DestroyContext();
 
+	g_theJobSystem->Shutdown();
+	delete g_theJobSystem;
+	g_theJobSystem = nullptr;
+
 	g_theAudio->Shutdown();
 	delete g_theAudio;
 	g_theAudio = nullptr;
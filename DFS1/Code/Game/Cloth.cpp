@@ -1,4 +1,9 @@
 #include <vector>
+#include <algorithm>
+#include <mutex>
+#include <functional>
+#include <math.h>
+#include <string.h>
 #include "Engine/Core/Vertex_PCU.hpp"
 #include "Engine/Core/VertexUtils.hpp"
 #include "Engine/Renderer/Renderer.hpp"
@@ -6,212 +11,1858 @@
 #include "Engine/Core/EngineCommon.hpp"
 #include "Engine/Renderer/Texture.hpp"
 #include "Engine/Math/RandomNumberGenerator.hpp"
+#include "Engine/Core/JobSystem.hpp"
 #include "Game/Cloth.hpp"
 #include "Game/Game.hpp"
+#include "Game/ColliderSet.hpp"
+#include "Game/ParticleKernels.hpp"
+#include "Game/ClothGridKernels.hpp"
 
 constexpr float pointRadius = 0.5f;
 constexpr float lineThickness = 0.25f;
 //const Vec2 startPos = Vec2(50.f, 75.f);
-constexpr float errorRoom = 0.3f;
-constexpr int TOTAL_NUM_ITERATIONS = 2;
-constexpr float clothTotalMass = 2000.f;
+constexpr int DEFAULT_NUM_ITERATIONS = 2;
 constexpr float impulseInterval = 2.f;
+constexpr int MIN_CONSTRAINTS_PER_JOB = 2048;
+constexpr int MIN_PARTICLES_PER_COLLISION_JOB = 1024;
+constexpr float selfCollisionDistanceFraction = 0.5f;
+constexpr int PATCH_SIZE = 16;
+constexpr int MIN_PATCHES_PER_JOB = 16;
+constexpr int WIND_ROWS_PER_CHUNK = 16;
+//how far the wind at a sleeping patch may drift from the wind it fell asleep in, as a fraction of the wind speed
+constexpr float WIND_CHANGE_TO_WAKE_FRACTION = 0.05f;
+constexpr float particleCollisionRadius = 0.6f;
+constexpr int MULTIGRID_COARSE_ITERATIONS = 4;
+constexpr int MIN_PARTICLES_PER_TETHER_JOB = 4096;
+constexpr float unreachableTetherLength = 1e30f;
+constexpr int MIN_PARTICLES_PER_PROLONGATION_JOB = 4096;
+constexpr int MIN_PATCHES_PER_TILED_STEP_JOB = 4;
 
 extern Renderer* g_theRenderer;
+extern JobSystem* g_theJobSystem;
 
-Cloth::Cloth(Game* game, IntVec2 pointGrid, Vec2 linkLength, ClothMassType weightType)
-	:m_game(game), m_gridCoords(pointGrid), m_linkLength(linkLength)
+//catmull-rom along one line of the simulated grid at the full resolution line the sample describes. Past the ends of the line the
+//missing outer point is extrapolated, which keeps the edges of the cloth straight where they are
+template <typename GetLinePointFunction>
+static Vec2 SampleGridLine(const ClothGridLineSample& sample, int numLinePoints, const GetLinePointFunction& getLinePoint)
 {
-	m_clothParticles.reserve((size_t)pointGrid.x * pointGrid.y);
-	
-	InitializeParticles(weightType);
+	if (sample.m_lineIndex >= 0)
+		return getLinePoint(sample.m_lineIndex);
+
+	int index = sample.m_cellIndex;
+	Vec2 point1 = getLinePoint(index);
+	Vec2 point2 = getLinePoint(index + 1);
+	Vec2 point0 = (index > 0) ? getLinePoint(index - 1) : point1 * 2.f - point2;
+	Vec2 point3 = (index + 2 < numLinePoints) ? getLinePoint(index + 2) : point2 * 2.f - point1;
+	float t = sample.m_fraction;
+	float t2 = t * t;
+	float t3 = t2 * t;
+	return (point1 * 2.f + (point2 - point0) * t + (point0 * 2.f - point1 * 5.f + point2 * 4.f - point3) * t2 + (point1 * 3.f - point0 - point2 * 3.f + point3) * t3) * 0.5f;
+}
+
+Cloth::Cloth(Game* game, const ClothTopology* topology, const Vec2& topLeftPosition)
+	:m_game(game), m_fullResolutionTopology(topology), m_topology(topology), m_gridCoords(topology->m_gridCoords), m_linkLength(topology->m_linkLength)
+{
+	InitializeParticles(topLeftPosition);
+	InitializeConstraints();
+	InitializePatches();
+
+	std::string textureFile = g_gameConfigBlackboard.GetValue("clothTexture", "");
+	m_texture = g_theRenderer->CreateOrGetTextureFromFile(textureFile.c_str());
+	m_tearStretchRatio = g_gameConfigBlackboard.GetValue("clothTearStretchRatio", m_tearStretchRatio);
+	m_yieldStretchRatio = g_gameConfigBlackboard.GetValue("clothYieldStretchRatio", m_yieldStretchRatio);
+	UpdateSelfCollisionDistance();
+	m_gravity = -400.f;
+	m_numIterations = DEFAULT_NUM_ITERATIONS;
+	m_collisionRadius = particleCollisionRadius;
+}
+
+void Cloth::Update(float deltaSeconds)
+{
+	//IdentifyBadConstraints(deltaSeconds);
+	if (m_isSleepingEnabled && m_horizontalForce != m_sleepHorizontalForce)
+	{
+		WakeUp();
+	}
+	//the gusts move on while the cloth sleeps, the patches they reach wake up
+	if (IsWindBlowing())
+	{
+		m_windSeconds += deltaSeconds;
+		if (m_numSleepingPatches > 0)
+		{
+			WakePatchesInChangedWind();
+		}
+	}
+
+	//once every patch is asleep nothing can move until a collider or the user disturbs the cloth, which only collisions and input find
+	bool isClothAsleep = (m_numSleepingPatches == (int)m_patches.size());
+	bool useTiledStep = (!isClothAsleep && IsTiledStepUsed());
+	if (isClothAsleep)
+	{
+		m_solverStats = SolverStats();
+	}
+	else
+	{
+		if (useTiledStep)
+			SimulateTiled(deltaSeconds);
+		else
+			Simulate(deltaSeconds);
+		if (m_isSelfCollisionEnabled)
+		{
+			SolveSelfCollisions();
+		}
+		if (m_tearStretchRatio > 0.f && m_levelOfDetail == 0)
+		{
+			FindOverstretchedConstraints(GetHorizontalConstraints(), m_tearStretchRatio, true, m_pendingHorizontalBreaks);
+			FindOverstretchedConstraints(GetVerticalConstraints(), m_tearStretchRatio, true, m_pendingVerticalBreaks);
+			ApplyPendingBreaks();
+		}
+		if (m_yieldStretchRatio > 1.f && m_levelOfDetail == 0)
+		{
+			FindOverstretchedConstraints(GetHorizontalConstraints(), m_yieldStretchRatio, false, m_pendingHorizontalYields);
+			FindOverstretchedConstraints(GetVerticalConstraints(), m_yieldStretchRatio, false, m_pendingVerticalYields);
+			ApplyPendingYields(m_pendingHorizontalYields, true);
+			ApplyPendingYields(m_pendingVerticalYields, false);
+		}
+		if (!useTiledStep)
+		{
+			RefitPatchBounds();
+		}
+	}
+	if (useTiledStep)
+		RefitAndResolvePatches();
+	else
+		ResolveCollisions();
+	UpdatePatchSleepStates();
+}
+
+void Cloth::Render() const
+{
+	if (m_game->m_renderClothTexture)
+	{
+		RenderCloth();
+	}
+
+	if (m_game->m_renderClothGrid)
+	{
+		RenderClothStructureGrid();
+	}
+
+	DebugRender();
+}
+
+void Cloth::BreakConstraintsWithNeighbours(int particleIndex)
+{
+	if (particleIndex < 0 || particleIndex >= m_particles.GetNumParticles())
+		return;
+	if (GetHorizontalConstraintSlots()[particleIndex] < 0 && GetVerticalConstraintSlots()[particleIndex] < 0)
+		return;
+
+	MakeConstraintsUnique();
+	WakeParticle(particleIndex);
+	BreakConstraint(m_horizontalConstraints, m_numEvenHorizontalConstraints, m_horizontalConstraintSlots, m_brokenHorizontalLinkMask, particleIndex);
+	BreakConstraint(m_verticalConstraints, m_numEvenVerticalConstraints, m_verticalConstraintSlots, m_brokenVerticalLinkMask, particleIndex);
+}
+
+void Cloth::TearConstraintsInDisc(const Vec2& discCenter, float discRadius)
+{
+	//tearing needs the full resolution links, but a coarser cloth only switches once there is something to tear
+	if (m_levelOfDetail != 0 && !IsFullResolutionLinkInDisc(discCenter, discRadius))
+		return;
+
+	SetLevelOfDetail(0);
+	float discRadiusSquared = discRadius * discRadius;
+	for (int i = 0; i < m_particles.GetNumParticles(); i++)
+	{
+		float deltaX = m_particles.m_x[i] - discCenter.x;
+		float deltaY = m_particles.m_y[i] - discCenter.y;
+		if (deltaX * deltaX + deltaY * deltaY < discRadiusSquared)
+		{
+			BreakConstraintsWithNeighbours(i);
+		}
+	}
+}
+
+bool Cloth::IsFullResolutionLinkInDisc(const Vec2& discCenter, float discRadius) const
+{
+	std::vector<Vec2> fullResolutionPositions;
+	UpsampleToFullResolution(m_particles.m_x.data(), m_particles.m_y.data(), fullResolutionPositions);
+	float discRadiusSquared = discRadius * discRadius;
+	for (int i = 0; i < fullResolutionPositions.size(); i++)
+	{
+		if (GetDistanceSquared2D(fullResolutionPositions[i], discCenter) < discRadiusSquared &&
+			(m_fullResolutionTopology->m_horizontalConstraintSlots[i] >= 0 || m_fullResolutionTopology->m_verticalConstraintSlots[i] >= 0))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void Cloth::FindOverstretchedConstraints(const std::vector<DistanceConstraint>& constraints, float stretchRatio, bool isRatioOfOriginalRestLength,
+	std::vector<int>& out_pendingLinks) const
+{
+	//only records the links here, removing them would reorder the arrays the solver walks
+	float maxStretchRatioSquared = stretchRatio * stretchRatio;
+	for (int i = 0; i < constraints.size(); i++)
+	{
+		const DistanceConstraint& constraint = constraints[i];
+		float deltaX = m_particles.m_x[constraint.particleIndexB] - m_particles.m_x[constraint.particleIndexA];
+		float deltaY = m_particles.m_y[constraint.particleIndexB] - m_particles.m_y[constraint.particleIndexA];
+		float restLength = isRatioOfOriginalRestLength ? constraint.originalRestLength : constraint.restLength;
+		float maxLengthSquared = restLength * restLength * maxStretchRatioSquared;
+		if (deltaX * deltaX + deltaY * deltaY > maxLengthSquared)
+		{
+			out_pendingLinks.push_back((int)constraint.particleIndexA);
+		}
+	}
+}
+
+void Cloth::ApplyPendingBreaks()
+{
+	if (m_pendingHorizontalBreaks.empty() && m_pendingVerticalBreaks.empty())
+		return;
+
+	MakeConstraintsUnique();
+	for (int i = 0; i < m_pendingHorizontalBreaks.size(); i++)
+	{
+		WakeParticle(m_pendingHorizontalBreaks[i]);
+		BreakConstraint(m_horizontalConstraints, m_numEvenHorizontalConstraints, m_horizontalConstraintSlots, m_brokenHorizontalLinkMask, m_pendingHorizontalBreaks[i]);
+	}
+	for (int i = 0; i < m_pendingVerticalBreaks.size(); i++)
+	{
+		WakeParticle(m_pendingVerticalBreaks[i]);
+		BreakConstraint(m_verticalConstraints, m_numEvenVerticalConstraints, m_verticalConstraintSlots, m_brokenVerticalLinkMask, m_pendingVerticalBreaks[i]);
+	}
+	m_pendingHorizontalBreaks.clear();
+	m_pendingVerticalBreaks.clear();
+}
+
+void Cloth::ApplyPendingYields(std::vector<int>& pendingYields, bool isHorizontal)
+{
+	if (pendingYields.empty())
+		return;
+
+	//the explicit links carry their own rest length, the stencil links and the tiled step read it from the overrides
+	MakeConstraintsUnique();
+	std::vector<DistanceConstraint>& constraints = isHorizontal ? m_horizontalConstraints : m_verticalConstraints;
+	const std::vector<int>& constraintSlots = isHorizontal ? m_horizontalConstraintSlots : m_verticalConstraintSlots;
+	std::vector<float>& restLengthOverrides = isHorizontal ? m_horizontalRestLengthOverrides : m_verticalRestLengthOverrides;
+	for (int i = 0; i < pendingYields.size(); i++)
+	{
+		DistanceConstraint& constraint = constraints[constraintSlots[pendingYields[i]]];
+		float length = GetDistance2D(m_particles.GetPosition(constraint.particleIndexA), m_particles.GetPosition(constraint.particleIndexB));
+		constraint.restLength = length / m_yieldStretchRatio;
+		OverrideLinkRestLength(restLengthOverrides, isHorizontal, pendingYields[i], constraint.restLength);
+	}
+	pendingYields.clear();
+}
+
+void Cloth::SolveSelfCollisions()
+{
+	int numParticles = m_particles.GetNumParticles();
+	//with cells twice the collision distance, the neighbourhood of a particle never covers more than 2x2 cells
+	m_selfCollisionGrid.Build(m_particles.m_x.data(), m_particles.m_y.data(), numParticles, m_selfCollisionDistance * 2.f);
+	m_selfCollisionDeltasX.resize(numParticles);
+	m_selfCollisionDeltasY.resize(numParticles);
+
+	//every particle only reads positions and writes its own push, so the narrow phase splits into independent jobs
+	float minDistance = m_selfCollisionDistance;
+	ParallelForFunction resolveCollisions = [this, minDistance](int startIndex, int endIndex)
+	{
+		const float* positionsX = m_particles.m_x.data();
+		const float* positionsY = m_particles.m_y.data();
+		for (int i = startIndex; i < endIndex; i++)
+		{
+			float pushX = 0.f;
+			float pushY = 0.f;
+			if (!m_particles.IsFixed(i))
+			{
+				float positionX = positionsX[i];
+				float positionY = positionsY[i];
+				m_selfCollisionGrid.ForEachParticleNear(positionX, positionY, minDistance, [&](int otherIndex)
+					{
+						float offsetX = positionX - positionsX[otherIndex];
+						float offsetY = positionY - positionsY[otherIndex];
+						float distanceSquared = offsetX * offsetX + offsetY * offsetY;
+						if (otherIndex == i || distanceSquared >= minDistance * minDistance || distanceSquared <= 0.f || AreParticlesLinked(i, otherIndex))
+							return;
+
+						//both particles of a pair push themselves half of the overlap away from each other
+						float distance = sqrtf(distanceSquared);
+						float pushScale = 0.5f * (minDistance - distance) / distance;
+						pushX += offsetX * pushScale;
+						pushY += offsetY * pushScale;
+					});
+			}
+			m_selfCollisionDeltasX[i] = pushX;
+			m_selfCollisionDeltasY[i] = pushY;
+		}
+	};
+
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numParticles, MIN_PARTICLES_PER_COLLISION_JOB, resolveCollisions);
+	else
+		resolveCollisions(0, numParticles);
+
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_particles.m_x[i] += m_selfCollisionDeltasX[i];
+		m_particles.m_y[i] += m_selfCollisionDeltasY[i];
+	}
+}
+
+bool Cloth::AreParticlesLinked(int particleIndexA, int particleIndexB) const
+{
+	int lowerIndex = (particleIndexA < particleIndexB) ? particleIndexA : particleIndexB;
+	int higherIndex = (particleIndexA < particleIndexB) ? particleIndexB : particleIndexA;
+	if (higherIndex == lowerIndex + 1)
+		return GetHorizontalConstraintSlots()[lowerIndex] >= 0;
+	if (higherIndex == lowerIndex + m_gridCoords.x)
+		return GetVerticalConstraintSlots()[lowerIndex] >= 0;
+
+	return false;
+}
+
+void Cloth::TogglePinnedParticle(int particleIndex)
+{
+	if (particleIndex < 0 || particleIndex >= m_particles.GetNumParticles())
+		return;
+
+	ParticleSystem::TogglePinnedParticle(particleIndex);
+	if (!m_areTethersEnabled)
+	{
+		m_areTethersDirty = true;
+		return;
+	}
+
+	if (m_particles.IsPinned(particleIndex))
+		AddTetherAnchor(particleIndex);
+	else
+		RemoveTetherAnchor(particleIndex);
+}
+
+void Cloth::InitializeTethers()
+{
+	int numParticles = m_particles.GetNumParticles();
+	m_tetherAnchors.assign(numParticles, -1);
+	m_tetherLengths.assign(numParticles, unreachableTetherLength);
+	std::vector<std::pair<float, int>> queue;
+	for (int i = 0; i < numParticles; i++)
+	{
+		if (!m_particles.IsPinned(i))
+			continue;
+
+		m_tetherAnchors[i] = i;
+		m_tetherLengths[i] = 0.f;
+		queue.push_back(std::make_pair(0.f, i));
+	}
+	std::make_heap(queue.begin(), queue.end(), std::greater<std::pair<float, int>>());
+	RelaxTethers(queue);
+	m_areTethersDirty = false;
+}
+
+void Cloth::RelaxTethers(std::vector<std::pair<float, int>>& queue)
+{
+	const std::greater<std::pair<float, int>> isFartherAway;
+	while (!queue.empty())
+	{
+		std::pop_heap(queue.begin(), queue.end(), isFartherAway);
+		float tetherLength = queue.back().first;
+		int particleIndex = queue.back().second;
+		queue.pop_back();
+		//the particle was queued again with a shorter path since
+		if (tetherLength > m_tetherLengths[particleIndex])
+			continue;
+
+		int x = particleIndex % m_gridCoords.x;
+		int y = particleIndex / m_gridCoords.x;
+		int neighbourIndices[4] = { (x > 0) ? particleIndex - 1 : -1, (x + 1 < m_gridCoords.x) ? particleIndex + 1 : -1,
+			(y > 0) ? particleIndex - m_gridCoords.x : -1, (y + 1 < m_gridCoords.y) ? particleIndex + m_gridCoords.x : -1 };
+		for (int i = 0; i < 4; i++)
+		{
+			int neighbourIndex = neighbourIndices[i];
+			float linkRestLength = (neighbourIndex >= 0) ? GetLinkRestLength(particleIndex, neighbourIndex) : -1.f;
+			if (linkRestLength < 0.f || tetherLength + linkRestLength >= m_tetherLengths[neighbourIndex])
+				continue;
+
+			m_tetherLengths[neighbourIndex] = tetherLength + linkRestLength;
+			m_tetherAnchors[neighbourIndex] = m_tetherAnchors[particleIndex];
+			queue.push_back(std::make_pair(m_tetherLengths[neighbourIndex], neighbourIndex));
+			std::push_heap(queue.begin(), queue.end(), isFartherAway);
+		}
+	}
+}
+
+void Cloth::AddTetherAnchor(int particleIndex)
+{
+	//a rebuild is pending anyway
+	if (m_areTethersDirty)
+		return;
+
+	m_tetherAnchors[particleIndex] = particleIndex;
+	m_tetherLengths[particleIndex] = 0.f;
+	std::vector<std::pair<float, int>> queue;
+	queue.push_back(std::make_pair(0.f, particleIndex));
+	RelaxTethers(queue);
+}
+
+void Cloth::RemoveTetherAnchor(int particleIndex)
+{
+	if (m_areTethersDirty)
+		return;
+
+	//removing an anchor only makes paths longer, the particles tethered to other anchors keep their shortest paths
+	int numParticles = m_particles.GetNumParticles();
+	for (int i = 0; i < numParticles; i++)
+	{
+		if (m_tetherAnchors[i] == particleIndex)
+		{
+			m_tetherAnchors[i] = -1;
+			m_tetherLengths[i] = unreachableTetherLength;
+		}
+	}
+
+	std::vector<std::pair<float, int>> queue;
+	for (int i = 0; i < numParticles; i++)
+	{
+		if (m_tetherAnchors[i] < 0)
+			continue;
+
+		bool bordersCutParticle = false;
+		int x = i % m_gridCoords.x;
+		int y = i / m_gridCoords.x;
+		bordersCutParticle |= (x > 0 && m_tetherAnchors[i - 1] < 0 && GetLinkRestLength(i, i - 1) >= 0.f);
+		bordersCutParticle |= (x + 1 < m_gridCoords.x && m_tetherAnchors[i + 1] < 0 && GetLinkRestLength(i, i + 1) >= 0.f);
+		bordersCutParticle |= (y > 0 && m_tetherAnchors[i - m_gridCoords.x] < 0 && GetLinkRestLength(i, i - m_gridCoords.x) >= 0.f);
+		bordersCutParticle |= (y + 1 < m_gridCoords.y && m_tetherAnchors[i + m_gridCoords.x] < 0 && GetLinkRestLength(i, i + m_gridCoords.x) >= 0.f);
+		if (bordersCutParticle)
+		{
+			queue.push_back(std::make_pair(m_tetherLengths[i], i));
+		}
+	}
+	std::make_heap(queue.begin(), queue.end(), std::greater<std::pair<float, int>>());
+	RelaxTethers(queue);
+}
+
+float Cloth::GetLinkRestLength(int particleIndexA, int particleIndexB) const
+{
+	//-1 if the particles are not linked (any more)
+	int lowerIndex = (particleIndexA < particleIndexB) ? particleIndexA : particleIndexB;
+	int higherIndex = (particleIndexA < particleIndexB) ? particleIndexB : particleIndexA;
+	if (higherIndex == lowerIndex + 1)
+	{
+		int slot = GetHorizontalConstraintSlots()[lowerIndex];
+		return (slot >= 0) ? GetHorizontalConstraints()[slot].restLength : -1.f;
+	}
+	if (higherIndex == lowerIndex + m_gridCoords.x)
+	{
+		int slot = GetVerticalConstraintSlots()[lowerIndex];
+		return (slot >= 0) ? GetVerticalConstraints()[slot].restLength : -1.f;
+	}
+
+	return -1.f;
+}
+
+void Cloth::SatisfyTetherConstraints()
+{
+	if (!m_areTethersEnabled)
+		return;
+	if (m_areTethersDirty)
+	{
+		InitializeTethers();
+	}
+
+	//every tether moves only its own particle towards a pinned one, so the particles can be split between jobs freely
+	ParallelForFunction satisfyTethers = [this](int startIndex, int endIndex)
+	{
+		for (int i = startIndex; i < endIndex; i++)
+		{
+			SatisfyTetherConstraint(i);
+		}
+	};
+
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(m_particles.GetNumParticles(), MIN_PARTICLES_PER_TETHER_JOB, satisfyTethers);
+	else
+		satisfyTethers(0, m_particles.GetNumParticles());
+}
+
+void Cloth::SatisfyTetherConstraint(int particleIndex)
+{
+	int anchorIndex = m_tetherAnchors[particleIndex];
+	if (anchorIndex < 0 || anchorIndex == particleIndex || m_particles.IsFixed(particleIndex))
+		return;
+
+	Vec2 anchorPosition = m_particles.GetPosition(anchorIndex);
+	Vec2 anchorToParticle = m_particles.GetPosition(particleIndex) - anchorPosition;
+	float distance = anchorToParticle.GetLength();
+	if (distance > m_tetherLengths[particleIndex])
+	{
+		m_particles.SetPosition(particleIndex, anchorPosition + anchorToParticle * (m_tetherLengths[particleIndex] / distance));
+	}
+}
+
+void Cloth::SetConstraintCompliance(float compliance)
+{
+	m_linkCompliance = compliance;
+	//most instances never change the compliance they were built with, so only copy the shared links when it really differs
+	const std::vector<DistanceConstraint>& horizontalConstraints = GetHorizontalConstraints();
+	const std::vector<DistanceConstraint>& verticalConstraints = GetVerticalConstraints();
+	bool isComplianceChanged = false;
+	for (int i = 0; i < horizontalConstraints.size() && !isComplianceChanged; i++)
+	{
+		isComplianceChanged = (horizontalConstraints[i].compliance != compliance);
+	}
+	for (int i = 0; i < verticalConstraints.size() && !isComplianceChanged; i++)
+	{
+		isComplianceChanged = (verticalConstraints[i].compliance != compliance);
+	}
+	if (!isComplianceChanged)
+		return;
+
+	MakeConstraintsUnique();
+	for (int i = 0; i < m_horizontalConstraints.size(); i++)
+	{
+		m_horizontalConstraints[i].compliance = compliance;
+	}
+	for (int i = 0; i < m_verticalConstraints.size(); i++)
+	{
+		m_verticalConstraints[i].compliance = compliance;
+	}
+}
+
+void Cloth::InitializePatches()
+{
+	int numPatchesX = (m_gridCoords.x + PATCH_SIZE - 1) / PATCH_SIZE;
+	int numPatchesY = (m_gridCoords.y + PATCH_SIZE - 1) / PATCH_SIZE;
+	m_numPatchesX = numPatchesX;
+	m_patches.resize(numPatchesX * numPatchesY);
+	for (int patchY = 0; patchY < numPatchesY; patchY++)
+	{
+		for (int patchX = 0; patchX < numPatchesX; patchX++)
+		{
+			ClothPatch& patch = m_patches[patchX + patchY * numPatchesX];
+			patch.m_minGridCoords = IntVec2(patchX * PATCH_SIZE, patchY * PATCH_SIZE);
+			patch.m_maxGridCoords.x = (patch.m_minGridCoords.x + PATCH_SIZE < m_gridCoords.x) ? patch.m_minGridCoords.x + PATCH_SIZE : m_gridCoords.x;
+			patch.m_maxGridCoords.y = (patch.m_minGridCoords.y + PATCH_SIZE < m_gridCoords.y) ? patch.m_minGridCoords.y + PATCH_SIZE : m_gridCoords.y;
+		}
+	}
+	RefitPatchBounds();
+}
+
+void Cloth::RefitPatchBounds()
+{
+	//patches own disjoint particles, so every patch can be refitted by its own job. Sleeping patches have not moved
+	ParallelForFunction refitPatches = [this](int startIndex, int endIndex)
+	{
+		for (int patchIndex = startIndex; patchIndex < endIndex; patchIndex++)
+		{
+			ClothPatch& patch = m_patches[patchIndex];
+			if (patch.m_isAsleep)
+				continue;
+
+			patch.m_bounds = ComputePatchBounds(patch);
+			if (m_isSleepingEnabled)
+			{
+				patch.m_maxKineticEnergy = ComputePatchKineticEnergy(patch);
+			}
+		}
+	};
+
+	int numPatches = (int)m_patches.size();
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numPatches, MIN_PATCHES_PER_JOB, refitPatches);
+	else
+		refitPatches(0, numPatches);
+}
+
+AABB2 Cloth::ComputePatchBounds(const ClothPatch& patch) const
+{
+	int firstParticleIndex = GetIndexForPointFromGridCoordinates(patch.m_minGridCoords);
+	float minX = m_particles.m_x[firstParticleIndex];
+	float minY = m_particles.m_y[firstParticleIndex];
+	float maxX = minX;
+	float maxY = minY;
+	for (int y = patch.m_minGridCoords.y; y < patch.m_maxGridCoords.y; y++)
+	{
+		for (int x = patch.m_minGridCoords.x; x < patch.m_maxGridCoords.x; x++)
+		{
+			int particleIndex = GetIndexForPointFromGridCoordinates(IntVec2(x, y));
+			float positionX = m_particles.m_x[particleIndex];
+			float positionY = m_particles.m_y[particleIndex];
+			minX = (positionX < minX) ? positionX : minX;
+			maxX = (positionX > maxX) ? positionX : maxX;
+			minY = (positionY < minY) ? positionY : minY;
+			maxY = (positionY > maxY) ? positionY : maxY;
+		}
+	}
+	return AABB2(minX, minY, maxX, maxY);
+}
+
+void Cloth::ResolveCollisions()
+{
+	if (!m_colliderSet || m_colliderSet->GetNumColliders() == 0)
+		return;
+
+	//every patch only queries the colliders near its own bounds and pushes its own particles, so patches are resolved in parallel
+	ParallelForFunction resolvePatches = [this](int startIndex, int endIndex)
+	{
+		ColliderQuery query;
+		for (int patchIndex = startIndex; patchIndex < endIndex; patchIndex++)
+		{
+			ResolvePatchCollisions(m_patches[patchIndex], query);
+		}
+	};
+
+	int numPatches = (int)m_patches.size();
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numPatches, MIN_PATCHES_PER_JOB, resolvePatches);
+	else
+		resolvePatches(0, numPatches);
+}
+
+void Cloth::ResolvePatchCollisions(ClothPatch& patch, ColliderQuery& query)
+{
+	m_colliderSet->FindCollidersOverlapping(patch.m_bounds, m_collisionRadius, query);
+	if (query.IsEmpty())
+		return;
+
+	//each row of a patch is a contiguous run of particles that the collider kernels take as one batch. A sleeping patch compares its
+	//rows before and after, a collider that actually moved one of its particles wakes it up
+	float rowBeforePushX[PATCH_SIZE];
+	float rowBeforePushY[PATCH_SIZE];
+	int rowLength = patch.m_maxGridCoords.x - patch.m_minGridCoords.x;
+	size_t rowBytes = rowLength * sizeof(float);
+	for (int y = patch.m_minGridCoords.y; y < patch.m_maxGridCoords.y; y++)
+	{
+		int rowStartIndex = GetIndexForPointFromGridCoordinates(IntVec2(patch.m_minGridCoords.x, y));
+		float* rowX = m_particles.m_x.data() + rowStartIndex;
+		float* rowY = m_particles.m_y.data() + rowStartIndex;
+		if (patch.m_isAsleep)
+		{
+			memcpy(rowBeforePushX, rowX, rowBytes);
+			memcpy(rowBeforePushY, rowY, rowBytes);
+		}
+		m_colliderSet->PushParticlesOut(query, rowX, rowY, rowLength, m_collisionRadius, m_useSimdKernels);
+		if (patch.m_isAsleep && (memcmp(rowBeforePushX, rowX, rowBytes) != 0 || memcmp(rowBeforePushY, rowY, rowBytes) != 0))
+		{
+			patch.m_isDisturbed = true;
+		}
+	}
+	patch.m_bounds = ComputePatchBounds(patch);
+}
+
+void Cloth::WakeUp()
+{
+	ParticleSystem::WakeUp();
+	for (int i = 0; i < m_patches.size(); i++)
+	{
+		m_patches[i].m_isAsleep = false;
+		m_patches[i].m_isDisturbed = false;
+		m_patches[i].m_numRestingUpdates = 0;
+	}
+	m_numSleepingPatches = 0;
+}
+
+int Cloth::GetNumSleepingParticles() const
+{
+	int numSleepingParticles = 0;
+	for (int i = 0; i < m_patches.size(); i++)
+	{
+		const ClothPatch& patch = m_patches[i];
+		if (patch.m_isAsleep)
+		{
+			IntVec2 patchDimensions = patch.m_maxGridCoords - patch.m_minGridCoords;
+			numSleepingParticles += patchDimensions.x * patchDimensions.y;
+		}
+	}
+	return numSleepingParticles;
+}
+
+void Cloth::WakeParticle(int particleIndex)
+{
+	int patchIndex = GetPatchIndexForParticle(particleIndex);
+	if (m_patches[patchIndex].m_isAsleep)
+	{
+		WakePatchIsland(patchIndex);
+	}
+}
+
+int Cloth::GetPatchIndexForParticle(int particleIndex) const
+{
+	int x = particleIndex % m_gridCoords.x;
+	int y = particleIndex / m_gridCoords.x;
+	return (x / PATCH_SIZE) + (y / PATCH_SIZE) * m_numPatchesX;
+}
+
+float Cloth::ComputePatchKineticEnergy(const ClothPatch& patch) const
+{
+	float maxKineticEnergy = 0.f;
+	int rowLength = patch.m_maxGridCoords.x - patch.m_minGridCoords.x;
+	for (int y = patch.m_minGridCoords.y; y < patch.m_maxGridCoords.y; y++)
+	{
+		int rowStartIndex = GetIndexForPointFromGridCoordinates(IntVec2(patch.m_minGridCoords.x, y));
+		float rowKineticEnergy = GetMaxKineticEnergy(rowStartIndex, rowStartIndex + rowLength);
+		maxKineticEnergy = (rowKineticEnergy > maxKineticEnergy) ? rowKineticEnergy : maxKineticEnergy;
+	}
+	return maxKineticEnergy;
+}
+
+void Cloth::UpdatePatchSleepStates()
+{
+	m_sleepHorizontalForce = m_horizontalForce;
+	if (!m_isSleepingEnabled)
+		return;
+
+	int numPatches = (int)m_patches.size();
+	for (int patchIndex = 0; patchIndex < numPatches; patchIndex++)
+	{
+		if (m_patches[patchIndex].m_isDisturbed)
+		{
+			WakePatchIsland(patchIndex);
+		}
+	}
+
+	for (int patchIndex = 0; patchIndex < numPatches; patchIndex++)
+	{
+		ClothPatch& patch = m_patches[patchIndex];
+		if (patch.m_isAsleep)
+			continue;
+
+		if (patch.m_maxKineticEnergy < m_sleepKineticEnergy)
+		{
+			patch.m_numRestingUpdates++;
+		}
+		else
+		{
+			patch.m_numRestingUpdates = 0;
+		}
+	}
+
+	//the solver only converges part of the way each update, so a stretched cloth rests in a pose that depends on every particle
+	//it can move. Freezing one patch of a connected piece shifts that pose and jolts its neighbours, so patches only fall asleep
+	//together with every patch they are still linked to
+	m_isPatchInIsland.assign(numPatches, false);
+	for (int patchIndex = 0; patchIndex < numPatches; patchIndex++)
+	{
+		const ClothPatch& patch = m_patches[patchIndex];
+		if (patch.m_isAsleep || m_isPatchInIsland[patchIndex] || patch.m_numRestingUpdates < m_numRestingUpdatesToSleep)
+			continue;
+
+		FindPatchIsland(patchIndex, m_islandPatchIndices);
+		bool isIslandResting = true;
+		for (int i = 0; i < m_islandPatchIndices.size() && isIslandResting; i++)
+		{
+			isIslandResting = m_patches[m_islandPatchIndices[i]].m_numRestingUpdates >= m_numRestingUpdatesToSleep;
+		}
+		if (!isIslandResting)
+			continue;
+
+		for (int i = 0; i < m_islandPatchIndices.size(); i++)
+		{
+			SetPatchAsleep(m_islandPatchIndices[i], true);
+		}
+	}
+}
+
+void Cloth::SetPatchAsleep(int patchIndex, bool isAsleep)
+{
+	ClothPatch& patch = m_patches[patchIndex];
+	m_numSleepingPatches += isAsleep ? 1 : -1;
+	patch.m_isAsleep = isAsleep;
+	patch.m_isDisturbed = false;
+	patch.m_sleepWindVelocity = IsWindBlowing() ? GetWindVelocityAtPoint(patch.m_bounds.GetCenter()) : Vec2::ZERO;
+	patch.m_numRestingUpdates = 0;
+	patch.m_maxKineticEnergy = 0.f;
+	for (int y = patch.m_minGridCoords.y; y < patch.m_maxGridCoords.y; y++)
+	{
+		for (int x = patch.m_minGridCoords.x; x < patch.m_maxGridCoords.x; x++)
+		{
+			//nothing moves while asleep, so the particles have to wake up without the velocity they had
+			int particleIndex = GetIndexForPointFromGridCoordinates(IntVec2(x, y));
+			m_particles.SetSleeping(particleIndex, isAsleep);
+			m_particles.m_prevX[particleIndex] = m_particles.m_x[particleIndex];
+			m_particles.m_prevY[particleIndex] = m_particles.m_y[particleIndex];
+		}
+	}
+}
+
+void Cloth::WakePatchIsland(int patchIndex)
+{
+	m_isPatchInIsland.assign(m_patches.size(), false);
+	FindPatchIsland(patchIndex, m_islandPatchIndices);
+	for (int i = 0; i < m_islandPatchIndices.size(); i++)
+	{
+		if (m_patches[m_islandPatchIndices[i]].m_isAsleep)
+		{
+			SetPatchAsleep(m_islandPatchIndices[i], false);
+		}
+	}
+}
+
+void Cloth::FindPatchIsland(int patchIndex, std::vector<int>& out_patchIndices)
+{
+	//flood fill over the patch grid, the output doubles as the queue. Patches already in m_isPatchInIsland are skipped, so one
+	//sweep over all patches visits every island once
+	out_patchIndices.clear();
+	out_patchIndices.push_back(patchIndex);
+	m_isPatchInIsland[patchIndex] = true;
+	int numPatchesY = (int)m_patches.size() / m_numPatchesX;
+	for (int i = 0; i < out_patchIndices.size(); i++)
+	{
+		int currentIndex = out_patchIndices[i];
+		int patchX = currentIndex % m_numPatchesX;
+		int patchY = currentIndex / m_numPatchesX;
+		const IntVec2 neighbourOffsets[4] = { IntVec2(-1, 0), IntVec2(1, 0), IntVec2(0, -1), IntVec2(0, 1) };
+		for (int n = 0; n < 4; n++)
+		{
+			int neighbourX = patchX + neighbourOffsets[n].x;
+			int neighbourY = patchY + neighbourOffsets[n].y;
+			if (neighbourX < 0 || neighbourX >= m_numPatchesX || neighbourY < 0 || neighbourY >= numPatchesY)
+				continue;
+
+			int neighbourIndex = neighbourX + neighbourY * m_numPatchesX;
+			if (m_isPatchInIsland[neighbourIndex])
+				continue;
+
+			//links only run east and south, so always look at the border from the west or north patch
+			bool isLinked = (neighbourOffsets[n].x + neighbourOffsets[n].y > 0) ? AreNeighbourPatchesLinked(currentIndex, neighbourIndex) :
+				AreNeighbourPatchesLinked(neighbourIndex, currentIndex);
+			if (isLinked)
+			{
+				m_isPatchInIsland[neighbourIndex] = true;
+				out_patchIndices.push_back(neighbourIndex);
+			}
+		}
+	}
+}
+
+bool Cloth::AreNeighbourPatchesLinked(int westOrNorthPatchIndex, int eastOrSouthPatchIndex) const
+{
+	const ClothPatch& patch = m_patches[westOrNorthPatchIndex];
+	bool isEastNeighbour = (m_patches[eastOrSouthPatchIndex].m_minGridCoords.x == patch.m_maxGridCoords.x);
+	if (isEastNeighbour)
+	{
+		const std::vector<int>& horizontalSlots = GetHorizontalConstraintSlots();
+		for (int y = patch.m_minGridCoords.y; y < patch.m_maxGridCoords.y; y++)
+		{
+			if (horizontalSlots[GetIndexForPointFromGridCoordinates(IntVec2(patch.m_maxGridCoords.x - 1, y))] >= 0)
+				return true;
+		}
+		return false;
+	}
+
+	const std::vector<int>& verticalSlots = GetVerticalConstraintSlots();
+	for (int x = patch.m_minGridCoords.x; x < patch.m_maxGridCoords.x; x++)
+	{
+		if (verticalSlots[GetIndexForPointFromGridCoordinates(IntVec2(x, patch.m_maxGridCoords.y - 1))] >= 0)
+			return true;
+	}
+	return false;
+}
+
+void Cloth::InitializeParticles(const Vec2& topLeftPosition)
+{
+	int numParticles = m_topology->GetNumParticles();
+	m_particles.Reserve(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_particles.AddParticle(topLeftPosition + m_topology->m_restOffsets[i], m_topology->m_masses[i]);
+	}
+	for (int i = 0; i < m_topology->m_pinnedParticles.size(); i++)
+	{
+		m_particles.SetPinned(m_topology->m_pinnedParticles[i], true);
+	}
+}
+
+void Cloth::InitializeConstraints()
+{
+	//the links themselves stay in the topology until this instance changes them, only the state that starts out equal for
+	//every instance anyway is set up here
+	int numParticles = m_particles.GetNumParticles();
+	m_numEvenHorizontalConstraints = m_topology->m_numEvenHorizontalConstraints;
+	m_numEvenVerticalConstraints = m_topology->m_numEvenVerticalConstraints;
+	m_brokenHorizontalLinkMask.assign((numParticles + 31) / 32, 0u);
+	m_brokenVerticalLinkMask.assign((numParticles + 31) / 32, 0u);
+}
+
+void Cloth::MakeConstraintsUnique()
+{
+	if (m_ownsConstraints)
+		return;
+
+	m_horizontalConstraints = m_topology->m_horizontalConstraints;
+	m_verticalConstraints = m_topology->m_verticalConstraints;
+	m_horizontalConstraintSlots = m_topology->m_horizontalConstraintSlots;
+	m_verticalConstraintSlots = m_topology->m_verticalConstraintSlots;
+	m_ownsConstraints = true;
+}
+
+void Cloth::UpdateSelfCollisionDistance()
+{
+	//the links of a coarser level are about 2^level full resolution links long
+	float linkLength = (m_linkLength.x < m_linkLength.y) ? m_linkLength.x : m_linkLength.y;
+	m_selfCollisionDistance = linkLength * (float)(1 << m_levelOfDetail) * selfCollisionDistanceFraction;
+}
+
+void Cloth::SetLevelOfDetail(int levelOfDetail)
+{
+	//the coarser levels know neither the torn links nor the rest lengths links yielded to
+	if (m_hasTornLinks || !m_horizontalRestLengthOverrides.empty() || !m_verticalRestLengthOverrides.empty())
+		levelOfDetail = 0;
+	const ClothTopology* topology = m_fullResolutionTopology->GetLevelOfDetail(levelOfDetail);
+	if (topology == m_topology)
+		return;
+
+	//both levels are sampled from the full resolution grid, which also covers coarse to fine. The previous positions go through the
+	//same interpolation, so the velocities carry over as well
+	std::vector<Vec2> fullResolutionPositions;
+	std::vector<Vec2> fullResolutionPrevPositions;
+	UpsampleToFullResolution(m_particles.m_x.data(), m_particles.m_y.data(), fullResolutionPositions);
+	UpsampleToFullResolution(m_particles.m_prevX.data(), m_particles.m_prevY.data(), fullResolutionPrevPositions);
+
+	ParticleStore particles;
+	int numParticles = topology->GetNumParticles();
+	particles.Reserve(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		IntVec2 fullResolutionGridCoords(topology->m_fullResolutionColumns[i % topology->m_gridCoords.x], topology->m_fullResolutionRows[i / topology->m_gridCoords.x]);
+		int fullResolutionIndex = m_fullResolutionTopology->GetIndexForPointFromGridCoordinates(fullResolutionGridCoords);
+		particles.AddParticle(fullResolutionPositions[fullResolutionIndex], topology->m_masses[i]);
+		particles.m_prevX[i] = fullResolutionPrevPositions[fullResolutionIndex].x;
+		particles.m_prevY[i] = fullResolutionPrevPositions[fullResolutionIndex].y;
+
+		//pins carry over wherever both levels have a particle, which every level has for the pins of the topology
+		int currentParticleIndex = m_topology->GetIndexForFullResolutionPoint(fullResolutionGridCoords);
+		if (currentParticleIndex >= 0 && m_particles.IsPinned(currentParticleIndex))
+		{
+			particles.SetPinned(i, true);
+		}
+	}
+
+	//an untorn cloth only owns its links because of a compliance change, the new level's links get the same compliance
+	float compliance = GetHorizontalConstraints().empty() ? 0.f : GetHorizontalConstraints()[0].compliance;
+	m_particles = particles;
+	m_topology = topology;
+	m_levelOfDetail = topology->m_levelOfDetail;
+	m_gridCoords = topology->m_gridCoords;
+	m_ownsConstraints = false;
+	m_horizontalConstraints.clear();
+	m_verticalConstraints.clear();
+	m_horizontalConstraintSlots.clear();
+	m_verticalConstraintSlots.clear();
+	m_horizontalRestLengthOverrides.clear();
+	m_verticalRestLengthOverrides.clear();
 	InitializeConstraints();
+	SetConstraintCompliance(compliance);
+	UpdateSelfCollisionDistance();
+	m_pendingHorizontalBreaks.clear();
+	m_pendingVerticalBreaks.clear();
+	m_badPoints.clear();
+	m_patches.clear();
+	m_multigridLevels.clear();
+	m_areTethersDirty = true;
+	WakeUp();
+	InitializePatches();
+}
 
-	for (int i = 0; i < m_gridCoords.x; i++)
+AABB2 Cloth::GetBounds() const
+{
+	AABB2 bounds = m_patches[0].m_bounds;
+	for (int i = 1; i < m_patches.size(); i++)
 	{
-		if(i % 10 == 0)
-			m_clothParticles[i].m_isPinned = true;
+		bounds.StretchToIncludePoint(m_patches[i].m_bounds.m_mins);
+		bounds.StretchToIncludePoint(m_patches[i].m_bounds.m_maxs);
+	}
+	return bounds;
+}
 
-		if (i == m_gridCoords.x - 1)
-			m_clothParticles[i].m_isPinned = true;
+void Cloth::UpsampleToFullResolution(const float* positionsX, const float* positionsY, std::vector<Vec2>& out_positions) const
+{
+	//separable: along the simulated rows to every full resolution column first, then down those columns to every full resolution row
+	const IntVec2& fullResolutionGridCoords = m_topology->m_fullResolutionGridCoords;
+	std::vector<Vec2> rowPositions(m_gridCoords.y * fullResolutionGridCoords.x);
+	for (int y = 0; y < m_gridCoords.y; y++)
+	{
+		int rowStartIndex = GetIndexForPointFromGridCoordinates(IntVec2(0, y));
+		auto getRowPoint = [positionsX, positionsY, rowStartIndex](int x) { return Vec2(positionsX[rowStartIndex + x], positionsY[rowStartIndex + x]); };
+		for (int fullResolutionX = 0; fullResolutionX < fullResolutionGridCoords.x; fullResolutionX++)
+		{
+			rowPositions[y * fullResolutionGridCoords.x + fullResolutionX] = SampleGridLine(m_topology->m_columnSamples[fullResolutionX], m_gridCoords.x, getRowPoint);
+		}
 	}
 
-	std::string textureFile = g_gameConfigBlackboard.GetValue("clothTexture", "");
-	m_texture = g_theRenderer->CreateOrGetTextureFromFile(textureFile.c_str());
-	m_gravity = -400.f;
+	out_positions.resize(fullResolutionGridCoords.x * fullResolutionGridCoords.y);
+	for (int fullResolutionX = 0; fullResolutionX < fullResolutionGridCoords.x; fullResolutionX++)
+	{
+		int rowStride = fullResolutionGridCoords.x;
+		auto getColumnPoint = [&rowPositions, rowStride, fullResolutionX](int y) { return rowPositions[y * rowStride + fullResolutionX]; };
+		for (int fullResolutionY = 0; fullResolutionY < fullResolutionGridCoords.y; fullResolutionY++)
+		{
+			out_positions[fullResolutionY * rowStride + fullResolutionX] = SampleGridLine(m_topology->m_rowSamples[fullResolutionY], m_gridCoords.y, getColumnPoint);
+		}
+	}
 }
 
-void Cloth::Update(float deltaSeconds)
+void Cloth::BreakConstraint(std::vector<DistanceConstraint>& constraints, int& numEvenConstraints, std::vector<int>& constraintSlots,
+	std::vector<uint32_t>& brokenLinkMask, int particleIndex)
 {
-	//IdentifyBadConstraints(deltaSeconds);
-	UpdateParticles(deltaSeconds);
-	SatisfyConstraints();
+	int slot = constraintSlots[particleIndex];
+	if (slot < 0)
+		return;
+
+	constraintSlots[particleIndex] = -1;
+	brokenLinkMask[particleIndex >> 5] |= 1u << (particleIndex & 31);
+	m_hasTornLinks = true;
+	m_areTethersDirty = true;
+
+	//swap and pop while keeping the array laid out as [even colour | odd colour]. A removed even constraint is replaced by the last
+	//even one, whose slot is then filled by the last odd one.
+	int lastSlot = (int)constraints.size() - 1;
+	if (slot < numEvenConstraints)
+	{
+		int lastEvenSlot = numEvenConstraints - 1;
+		MoveConstraint(constraints, constraintSlots, lastEvenSlot, slot);
+		MoveConstraint(constraints, constraintSlots, lastSlot, lastEvenSlot);
+		numEvenConstraints--;
+	}
+	else
+	{
+		MoveConstraint(constraints, constraintSlots, lastSlot, slot);
+	}
+	constraints.pop_back();
 }
 
-void Cloth::Render() const
+void Cloth::MoveConstraint(std::vector<DistanceConstraint>& constraints, std::vector<int>& constraintSlots, int fromSlot, int toSlot)
 {
-	if (m_game->m_renderClothTexture)
+	if (fromSlot == toSlot)
+		return;
+
+	constraints[toSlot] = constraints[fromSlot];
+	constraintSlots[constraints[toSlot].particleIndexA] = toSlot;
+}
+
+void Cloth::SetWind(const ClothWind& wind)
+{
+	bool isWindChanged = (wind.m_velocity != m_wind.m_velocity || wind.m_dragCoefficient != m_wind.m_dragCoefficient ||
+		wind.m_liftCoefficient != m_wind.m_liftCoefficient || wind.m_gustAmplitude != m_wind.m_gustAmplitude || wind.m_gustWavelength != m_wind.m_gustWavelength);
+	m_wind = wind;
+	if (isWindChanged)
 	{
-		RenderCloth();
+		WakeUp();
 	}
+}
 
-	if (m_game->m_renderClothGrid)
+bool Cloth::IsWindBlowing() const
+{
+	return m_wind.m_velocity != Vec2::ZERO && (m_wind.m_dragCoefficient != 0.f || m_wind.m_liftCoefficient != 0.f);
+}
+
+Vec2 Cloth::GetWindVelocityAtPoint(const Vec2& point) const
+{
+	if (m_wind.m_gustAmplitude == 0.f || m_wind.m_gustWavelength <= 0.f)
+		return m_wind.m_velocity;
+
+	float speed = m_wind.m_velocity.GetLength();
+	float distanceAlongWind = DotProduct2D(point, m_wind.m_velocity) / speed;
+	float gustPhaseDegrees = 360.f * (distanceAlongWind - speed * m_windSeconds) / m_wind.m_gustWavelength;
+	return m_wind.m_velocity * (1.f + m_wind.m_gustAmplitude * SinDegrees(gustPhaseDegrees));
+}
+
+void Cloth::ApplyExternalForces(float deltaSeconds)
+{
+	if (!IsWindBlowing())
+		return;
+
+	int numParticles = m_particles.GetNumParticles();
+	int rowStride = m_gridCoords.x;
+	if ((int)m_horizontalWindForcesX.size() != rowStride + numParticles)
 	{
-		RenderClothStructureGrid();
+		m_horizontalWindForcesX.assign(rowStride + numParticles, 0.f);
+		m_horizontalWindForcesY.assign(rowStride + numParticles, 0.f);
+		m_verticalWindForcesX.assign(rowStride + numParticles, 0.f);
+		m_verticalWindForcesY.assign(rowStride + numParticles, 0.f);
 	}
 
-	DebugRender();
+	//the wind is sampled once per patch, a patch is small next to a gust
+	int numPatches = (int)m_patches.size();
+	m_patchWindVelocities.resize(numPatches);
+	for (int patchIndex = 0; patchIndex < numPatches; patchIndex++)
+	{
+		const ClothPatch& patch = m_patches[patchIndex];
+		m_patchWindVelocities[patchIndex] = patch.m_isAsleep ? Vec2::ZERO : GetWindVelocityAtPoint(patch.m_bounds.GetCenter());
+	}
+
+	//each row's edges are applied right after they are computed, while the row is still in cache. Applying a row only moves the previous
+	//positions of that row and computing a row only reads it and the row below, so walking down the rows gives the same result as
+	//computing every edge first. Chunks of rows run as their own jobs: the edges of a chunk's last row read the next chunk's first row,
+	//so they are computed before the barrier. The chunks have a fixed size, so the result does not depend on the number of threads
+	AerodynamicUniforms uniforms;
+	uniforms.m_dragCoefficient = m_wind.m_dragCoefficient;
+	uniforms.m_liftCoefficient = m_wind.m_liftCoefficient;
+	uniforms.m_inverseDeltaSeconds = 1.f / deltaSeconds;
+	int numRows = m_gridCoords.y;
+	int numChunks = (numRows + WIND_ROWS_PER_CHUNK - 1) / WIND_ROWS_PER_CHUNK;
+	ParallelForFunction computeChunkLastRows = [this, numRows, &uniforms](int startChunk, int endChunk)
+	{
+		for (int chunk = startChunk; chunk < endChunk; chunk++)
+		{
+			int endRow = ((chunk + 1) * WIND_ROWS_PER_CHUNK < numRows) ? (chunk + 1) * WIND_ROWS_PER_CHUNK : numRows;
+			ComputeRowWindForces(endRow - 1, uniforms);
+		}
+	};
+	ParallelForFunction applyChunkWindForces = [this, numRows, &uniforms, deltaSeconds](int startChunk, int endChunk)
+	{
+		for (int chunk = startChunk; chunk < endChunk; chunk++)
+		{
+			int startRow = chunk * WIND_ROWS_PER_CHUNK;
+			int endRow = (startRow + WIND_ROWS_PER_CHUNK < numRows) ? startRow + WIND_ROWS_PER_CHUNK : numRows;
+			for (int y = startRow; y < endRow; y++)
+			{
+				if (y + 1 < endRow)
+				{
+					ComputeRowWindForces(y, uniforms);
+				}
+				ApplyRowWindForces(y, deltaSeconds);
+			}
+		}
+	};
+
+	if (g_theJobSystem)
+	{
+		g_theJobSystem->ParallelFor(numChunks, 1, computeChunkLastRows);
+		g_theJobSystem->ParallelFor(numChunks, 1, applyChunkWindForces);
+	}
+	else
+	{
+		computeChunkLastRows(0, numChunks);
+		applyChunkWindForces(0, numChunks);
+	}
 }
 
-void Cloth::BreakConstraintsWithNeighbours(Particle* referencePoint)
+void Cloth::ComputeRowWindForces(int y, AerodynamicUniforms uniforms)
 {
-	for (int i = 0; i < m_clothParticles.size(); i++)
+	//patch by patch along the row, each with the wind sampled for it
+	int rowStride = m_gridCoords.x;
+	float* horizontalForcesX = m_horizontalWindForcesX.data() + rowStride;
+	float* horizontalForcesY = m_horizontalWindForcesY.data() + rowStride;
+	float* verticalForcesX = m_verticalWindForcesX.data() + rowStride;
+	float* verticalForcesY = m_verticalWindForcesY.data() + rowStride;
+	bool hasSouthEdges = (y + 1 < m_gridCoords.y);
+	int firstPatchIndex = (y / PATCH_SIZE) * m_numPatchesX;
+	for (int patchIndex = firstPatchIndex; patchIndex < firstPatchIndex + m_numPatchesX; patchIndex++)
 	{
-		if (&m_clothParticles[i] == referencePoint)
+		const ClothPatch& patch = m_patches[patchIndex];
+		int numColumns = patch.m_maxGridCoords.x - patch.m_minGridCoords.x;
+		int rowStartIndex = GetIndexForPointFromGridCoordinates(IntVec2(patch.m_minGridCoords.x, y));
+		if (patch.m_isAsleep)
 		{
-			m_particleIndiciesWithBrokenVerticalConstraint.push_back(i);
+			//nothing in a sleeping patch moves, but its awake neighbours still read the edges it owns
+			memset(horizontalForcesX + rowStartIndex, 0, numColumns * sizeof(float));
+			memset(horizontalForcesY + rowStartIndex, 0, numColumns * sizeof(float));
+			memset(verticalForcesX + rowStartIndex, 0, numColumns * sizeof(float));
+			memset(verticalForcesY + rowStartIndex, 0, numColumns * sizeof(float));
+			continue;
 		}
+
+		uniforms.m_windVelocityX = m_patchWindVelocities[patchIndex].x;
+		uniforms.m_windVelocityY = m_patchWindVelocities[patchIndex].y;
+		bool hasLastEastEdge = (patch.m_maxGridCoords.x < m_gridCoords.x);
+		ComputeAerodynamicEdgeForces(m_particles.m_x.data(), m_particles.m_y.data(), m_particles.m_prevX.data(), m_particles.m_prevY.data(), m_particles.m_invMass.data(),
+			rowStartIndex, numColumns, rowStride, hasLastEastEdge, hasSouthEdges, uniforms, horizontalForcesX, horizontalForcesY, verticalForcesX, verticalForcesY,
+			m_useSimdKernels);
+	}
+
+	if (m_hasTornLinks)
+	{
+		int rowStartIndex = y * rowStride;
+		ClearTornLinkWindForces(m_brokenHorizontalLinkMask, rowStartIndex, rowStartIndex + rowStride, horizontalForcesX, horizontalForcesY);
+		ClearTornLinkWindForces(m_brokenVerticalLinkMask, rowStartIndex, rowStartIndex + rowStride, verticalForcesX, verticalForcesY);
+	}
+}
+
+void Cloth::ApplyRowWindForces(int y, float deltaSeconds)
+{
+	//reads the edges of this row and the south edges of the row above
+	int rowStride = m_gridCoords.x;
+	AerodynamicEdgeForces edgeForces;
+	edgeForces.m_horizontalX = m_horizontalWindForcesX.data() + rowStride;
+	edgeForces.m_horizontalY = m_horizontalWindForcesY.data() + rowStride;
+	edgeForces.m_verticalX = m_verticalWindForcesX.data() + rowStride;
+	edgeForces.m_verticalY = m_verticalWindForcesY.data() + rowStride;
+	int firstPatchIndex = (y / PATCH_SIZE) * m_numPatchesX;
+	for (int patchIndex = firstPatchIndex; patchIndex < firstPatchIndex + m_numPatchesX; patchIndex++)
+	{
+		const ClothPatch& patch = m_patches[patchIndex];
+		if (patch.m_isAsleep)
+			continue;
+
+		int numColumns = patch.m_maxGridCoords.x - patch.m_minGridCoords.x;
+		int rowStartIndex = GetIndexForPointFromGridCoordinates(IntVec2(patch.m_minGridCoords.x, y));
+		ApplyAerodynamicEdgeForces(m_particles.m_prevX.data(), m_particles.m_prevY.data(), m_particles.m_invMass.data(), m_particles.m_fixedMask.data(),
+			rowStartIndex, numColumns, rowStride, edgeForces, deltaSeconds, m_useSimdKernels);
 	}
+}
 
-	for (auto iter = m_verticalConstraints.begin(); iter != m_verticalConstraints.end();)
+void Cloth::WakePatchesInChangedWind()
+{
+	//a patch that fell asleep in the wind rests against the force it felt then. It only has to move again once the wind there changed
+	//noticeably, e.g. a gust front reached it, and only its island wakes for it
+	float maxWindChange = WIND_CHANGE_TO_WAKE_FRACTION * m_wind.m_velocity.GetLength();
+	int numPatches = (int)m_patches.size();
+	for (int patchIndex = 0; patchIndex < numPatches; patchIndex++)
 	{
-		if (iter->particleA == referencePoint)
+		const ClothPatch& patch = m_patches[patchIndex];
+		if (!patch.m_isAsleep)
+			continue;
+
+		Vec2 windVelocity = GetWindVelocityAtPoint(patch.m_bounds.GetCenter());
+		if (GetDistanceSquared2D(windVelocity, patch.m_sleepWindVelocity) > maxWindChange * maxWindChange)
 		{
-			iter = m_verticalConstraints.erase(iter);
+			WakePatchIsland(patchIndex);
 		}
-		else
-			++iter;
 	}
+}
 
-	for (auto iter = m_horizontalConstraints.begin(); iter != m_horizontalConstraints.end();)
+void Cloth::ClearTornLinkWindForces(const std::vector<uint32_t>& brokenLinkMask, int startIndex, int endIndex, float* windForcesX, float* windForcesY)
+{
+	//the kernels run over whole rows, torn links are few so their forces are cleared afterwards
+	int i = startIndex;
+	while (i < endIndex)
 	{
-		if (iter->particleA == referencePoint)
+		uint32_t brokenBits = brokenLinkMask[i >> 5] >> (i & 31);
+		if (brokenBits == 0u)
 		{
-			iter = m_horizontalConstraints.erase(iter);
+			//nothing else is torn in this mask word
+			i = (i | 31) + 1;
+			continue;
 		}
-		else
-			++iter;
+
+		if ((brokenBits & 1u) != 0u)
+		{
+			windForcesX[i] = 0.f;
+			windForcesY[i] = 0.f;
+		}
+		i++;
 	}
 }
 
-void Cloth::MovePoint(const Vec2& screenMousePos, Particle*& grabbedParticle)
+void Cloth::IntegrateImplicit(float deltaSeconds)
 {
-	GrabAndMovePoint(screenMousePos, m_clothParticles, grabbedParticle);
+	VerletIntegrationUniforms uniforms;
+	GetIntegrationUniforms(deltaSeconds, uniforms);
+	const std::vector<DistanceConstraint>* linkSets[] = { &GetHorizontalConstraints(), &GetVerticalConstraints() };
+	ImplicitStepResult result;
+	m_implicitIntegrator.Step(m_particles, linkSets, 2, uniforms, result);
+	RecordImplicitStep(result);
 }
 
-void Cloth::CollideWithCircle(const Vec2& circleCenter, float circleRadius)
+void Cloth::SatisfyConstraints(float deltaSeconds)
 {
-	for (int i = 0; i < m_clothParticles.size(); i++)
+	bool useXpbd = (m_solverType == ConstraintSolverType::XPBD);
+	bool useStencilLinks = (m_useStencilLinks && m_solverType != ConstraintSolverType::JACOBI);
+	float inverseDeltaSecondsSquared = 1.f / (deltaSeconds * deltaSeconds);
+	const std::vector<DistanceConstraint>& horizontalConstraints = GetHorizontalConstraints();
+	const std::vector<DistanceConstraint>& verticalConstraints = GetVerticalConstraints();
+	if (useXpbd)
+	{
+		int numParticles = m_particles.GetNumParticles();
+		ResetLagrangeMultipliers(m_horizontalLambdas, useStencilLinks ? numParticles : (int)horizontalConstraints.size());
+		ResetLagrangeMultipliers(m_verticalLambdas, useStencilLinks ? numParticles : (int)verticalConstraints.size());
+	}
+	SatisfyTetherConstraints();
+	//the implicit integrator already solved the links as springs, only the tethers are projected on top
+	if (m_solverType == ConstraintSolverType::IMPLICIT_EULER)
+		return;
+	if (SatisfyConstraintsFixedGrid())
+		return;
+
+	//the coarse grids only take the low frequency error out, the grid itself is then solved like the coloured gauss seidel
+	bool useMultigrid = (m_solverType == ConstraintSolverType::MULTIGRID);
+	if (useMultigrid)
+	{
+		SolveMultigridLevels();
+	}
+
+	if (useStencilLinks)
+	{
+		SatisfyConstraintsStencil(inverseDeltaSecondsSquared);
+		return;
+	}
+	if ((m_solverType == ConstraintSolverType::PARALLEL_GAUSS_SEIDEL || useXpbd || useMultigrid) && g_theJobSystem)
+	{
+		SatisfyConstraintsParallel(inverseDeltaSecondsSquared);
+		return;
+	}
+	if (m_solverType == ConstraintSolverType::JACOBI)
+	{
+		SatisfyConstraintsJacobi();
+		return;
+	}
+
+	for (int j = 0; j < m_numIterations; j++)
 	{
-		PushDiscOutOfDisc2D(m_clothParticles[i].m_currentPos, 0.f, circleCenter, circleRadius);
+		ConstraintResidual residual;
+		for (int i = 0; i < horizontalConstraints.size(); i++)
+		{
+			if (useXpbd)
+				residual.Add(SatisfyDistanceConstraintXPBD(horizontalConstraints[i], m_horizontalLambdas[i], inverseDeltaSecondsSquared));
+			else
+				residual.Add(SatisfyDistanceConstraint(horizontalConstraints[i]));
+		}
+
+		for (int i = 0; i < verticalConstraints.size(); i++)
+		{
+			if (useXpbd)
+				residual.Add(SatisfyDistanceConstraintXPBD(verticalConstraints[i], m_verticalLambdas[i], inverseDeltaSecondsSquared));
+			else
+				residual.Add(SatisfyDistanceConstraint(verticalConstraints[i]));
+		}
+
+		if (RecordSolverIteration(j, residual))
+			break;
 	}
 }
 
-void Cloth::CollideWithBox(const AABB2& collisionBox)
+bool Cloth::SatisfyConstraintsFixedGrid()
 {
-	for (int i = 0; i < m_clothParticles.size(); i++)
+	//the fixed grid solvers only know the plain gauss seidel projection over every link of the grid, with the rest lengths of the
+	//topology, and always run all of their iterations
+	bool isGaussSeidel = (m_solverType == ConstraintSolverType::SERIAL_GAUSS_SEIDEL || m_solverType == ConstraintSolverType::PARALLEL_GAUSS_SEIDEL);
+	if (!isGaussSeidel || m_hasTornLinks || m_residualTolerance > 0.f || m_stallTolerance > 0.f || !m_horizontalRestLengthOverrides.empty() || !m_verticalRestLengthOverrides.empty())
+		return false;
+
+	FixedGridLinkSolver fixedGridLinkSolver = GetFixedGridLinkSolver(m_gridCoords.x, m_gridCoords.y, m_numIterations);
+	if (!fixedGridLinkSolver)
+		return false;
+
+	FixedGridLinkArrays arrays;
+	arrays.m_positionsX = m_particles.m_x.data();
+	arrays.m_positionsY = m_particles.m_y.data();
+	arrays.m_invMasses = m_particles.m_invMass.data();
+	arrays.m_fixedMask = m_particles.m_fixedMask.data();
+	arrays.m_horizontalRestLengths = m_topology->m_horizontalRestLengths.data();
+	arrays.m_verticalRestLengths = m_topology->m_verticalRestLengths.data();
+	ConstraintResidual iterationResiduals[MAX_FIXED_GRID_SOLVER_ITERATIONS];
+	fixedGridLinkSolver(arrays, iterationResiduals);
+	for (int j = 0; j < m_numIterations; j++)
 	{
-		PushDiscOutOfAABB2D(m_clothParticles[i].m_currentPos, 0.6f, collisionBox);
+		RecordSolverIteration(j, iterationResiduals[j]);
 	}
+	return true;
 }
 
-void Cloth::UpdateParticles(float deltaSeconds)
+void Cloth::SatisfyConstraintsParallel(float inverseDeltaSecondsSquared)
 {
-	for (int i = 0; i < m_clothParticles.size(); i++)
+	const std::vector<DistanceConstraint>& horizontalConstraints = GetHorizontalConstraints();
+	const std::vector<DistanceConstraint>& verticalConstraints = GetVerticalConstraints();
+	int numHorizontalConstraints = (int)horizontalConstraints.size();
+	int numVerticalConstraints = (int)verticalConstraints.size();
+	for (int j = 0; j < m_numIterations; j++)
 	{
-		UpdateParticle(m_clothParticles[i], deltaSeconds);
+		//every ParallelFor returns only when its whole set is solved, which is the barrier between dependent sets
+		ConstraintResidual residual;
+		SatisfyConstraintRangeParallel(horizontalConstraints, m_horizontalLambdas, 0, m_numEvenHorizontalConstraints, inverseDeltaSecondsSquared, residual);
+		SatisfyConstraintRangeParallel(horizontalConstraints, m_horizontalLambdas, m_numEvenHorizontalConstraints, numHorizontalConstraints, inverseDeltaSecondsSquared, residual);
+		SatisfyConstraintRangeParallel(verticalConstraints, m_verticalLambdas, 0, m_numEvenVerticalConstraints, inverseDeltaSecondsSquared, residual);
+		SatisfyConstraintRangeParallel(verticalConstraints, m_verticalLambdas, m_numEvenVerticalConstraints, numVerticalConstraints, inverseDeltaSecondsSquared, residual);
+		if (RecordSolverIteration(j, residual))
+			break;
 	}
 }
 
-void Cloth::InitializeParticles(ClothMassType weightType)
+void Cloth::SatisfyConstraintsJacobi()
 {
-	float topToBottomMassSplitFactor = 0.5f;
-	if (weightType == ClothMassType::TOP_HEAVY)
-		topToBottomMassSplitFactor = 0.75f;
-	else if (weightType == ClothMassType::BOTTOM_HEAVY)
-		topToBottomMassSplitFactor = 0.25f;
+	PrepareJacobiSolve();
+	for (int j = 0; j < m_numIterations; j++)
+	{
+		ConstraintResidual residual;
+		AccumulateJacobiCorrections(GetHorizontalConstraints(), residual);
+		AccumulateJacobiCorrections(GetVerticalConstraints(), residual);
+		ApplyJacobiCorrections();
+		if (RecordSolverIteration(j, residual))
+			break;
+	}
+}
 
-	float totalMassOfTopPoints = clothTotalMass * topToBottomMassSplitFactor;
-	float totalMassOfBottomPoints = clothTotalMass - totalMassOfTopPoints;
-	int numberOfTopPoints = (m_gridCoords.y / 2) * m_gridCoords.x;
-	float massOfEachTopPoint = totalMassOfTopPoints / float(numberOfTopPoints);
-	int numberOfBottomPoints = (m_gridCoords.x * m_gridCoords.y) - numberOfTopPoints;
-	float massOfEachBottomPoint = totalMassOfBottomPoints / numberOfBottomPoints;
-	Vec2 worldSize = m_game->m_worldSize;
-	float xStart = (worldSize.x - ((m_gridCoords.x - 1) * m_linkLength.x)) / 2.f;
-	float yStart = worldSize.y -((worldSize.y - ((m_gridCoords.y - 1) * m_linkLength.y)) / 2.f);
-	Vec2 startPos(xStart, yStart);
+void Cloth::SatisfyConstraintsStencil(float inverseDeltaSecondsSquared)
+{
+	//the same 4 colours in the same order as the constraint arrays, the links of a colour never share a particle so the order within
+	//a colour does not matter
+	for (int j = 0; j < m_numIterations; j++)
+	{
+		ConstraintResidual residual;
+		SatisfyStencilColor(true, 0, inverseDeltaSecondsSquared, residual);
+		SatisfyStencilColor(true, 1, inverseDeltaSecondsSquared, residual);
+		SatisfyStencilColor(false, 0, inverseDeltaSecondsSquared, residual);
+		SatisfyStencilColor(false, 1, inverseDeltaSecondsSquared, residual);
+		if (RecordSolverIteration(j, residual))
+			break;
+	}
+}
 
-	//initialize points
-	for (int y = 0; y < m_gridCoords.y; y++)
+void Cloth::SatisfyStencilColor(bool isHorizontal, int firstLine, float inverseDeltaSecondsSquared, ConstraintResidual& residual)
+{
+	//a colour of horizontal links has links in every row, one of vertical links only in every other row
+	bool useXpbd = (m_solverType == ConstraintSolverType::XPBD);
+	int numColumns = m_gridCoords.x;
+	int firstRow = isHorizontal ? 0 : firstLine;
+	int rowStep = isHorizontal ? 1 : 2;
+	int endRow = isHorizontal ? m_gridCoords.y : m_gridCoords.y - 1;
+	int numLinkRows = (endRow > firstRow) ? (endRow - firstRow + rowStep - 1) / rowStep : 0;
+	int firstColumn = isHorizontal ? firstLine : 0;
+	int columnStep = isHorizontal ? 2 : 1;
+	int endColumn = isHorizontal ? numColumns - 1 : numColumns;
+	int endpointOffset = isHorizontal ? 1 : numColumns;
+	const std::vector<uint32_t>& brokenLinkMask = isHorizontal ? m_brokenHorizontalLinkMask : m_brokenVerticalLinkMask;
+	const std::vector<float>& restLengthOverrides = isHorizontal ? m_horizontalRestLengthOverrides : m_verticalRestLengthOverrides;
+	std::vector<float>& lambdas = isHorizontal ? m_horizontalLambdas : m_verticalLambdas;
+	std::mutex residualMutex;
+	ParallelForFunction satisfyRows = [this, &brokenLinkMask, &restLengthOverrides, &lambdas, &residual, &residualMutex, isHorizontal, useXpbd, numColumns,
+		firstRow, rowStep, firstColumn, columnStep, endColumn, endpointOffset, inverseDeltaSecondsSquared](int startLinkRow, int endLinkRow)
 	{
-		for (int x = 0; x < m_gridCoords.x; x++)
+		//the rest length of a link is restLengths[x * restLengthStride] along its row
+		DistanceConstraint link;
+		link.compliance = m_linkCompliance;
+		ConstraintResidual jobResidual;
+		for (int linkRow = startLinkRow; linkRow < endLinkRow; linkRow++)
+		{
+			int y = firstRow + linkRow * rowStep;
+			int rowStartIndex = y * numColumns;
+			const float* restLengths = isHorizontal ? m_topology->m_horizontalRestLengths.data() : &m_topology->m_verticalRestLengths[y];
+			int restLengthStride = isHorizontal ? 1 : 0;
+			if (!restLengthOverrides.empty())
+			{
+				restLengths = &restLengthOverrides[rowStartIndex];
+				restLengthStride = 1;
+			}
+
+			for (int x = firstColumn; x < endColumn; x += columnStep)
+			{
+				int particleIndex = rowStartIndex + x;
+				if (m_hasTornLinks && IsLinkBroken(brokenLinkMask, particleIndex))
+					continue;
+
+				link.particleIndexA = (uint32_t)particleIndex;
+				link.particleIndexB = (uint32_t)(particleIndex + endpointOffset);
+				link.restLength = restLengths[x * restLengthStride];
+				if (useXpbd)
+					jobResidual.Add(SatisfyDistanceConstraintXPBD(link, lambdas[particleIndex], inverseDeltaSecondsSquared));
+				else
+					jobResidual.Add(SatisfyDistanceConstraint(link));
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(residualMutex);
+		residual.Merge(jobResidual);
+	};
+
+	int linksPerRow = (endColumn - firstColumn + columnStep - 1) / columnStep;
+	int minRowsPerJob = (linksPerRow > 0) ? MIN_CONSTRAINTS_PER_JOB / linksPerRow : 1;
+	if (m_solverType != ConstraintSolverType::SERIAL_GAUSS_SEIDEL && g_theJobSystem)
+		g_theJobSystem->ParallelFor(numLinkRows, (minRowsPerJob > 1) ? minRowsPerJob : 1, satisfyRows);
+	else
+		satisfyRows(0, numLinkRows);
+}
+
+bool Cloth::IsTiledStepUsed() const
+{
+	//the jacobi solver needs every link projected against the same positions, and the multigrid levels span the whole grid
+	return m_useTiledStep && (m_solverType == ConstraintSolverType::SERIAL_GAUSS_SEIDEL || m_solverType == ConstraintSolverType::PARALLEL_GAUSS_SEIDEL ||
+		m_solverType == ConstraintSolverType::XPBD);
+}
+
+void Cloth::SimulateTiled(float deltaSeconds)
+{
+	m_solverStats = SolverStats();
+	m_solverStats.m_numSubsteps = m_numSubsteps;
+	m_solverStats.m_maxIterations = m_numSubsteps * m_numIterations;
+
+	float substepSeconds = deltaSeconds / (float)m_numSubsteps;
+	m_substepSeconds = substepSeconds;
+	VerletIntegrationUniforms uniforms;
+	GetIntegrationUniforms(substepSeconds, uniforms);
+	if (m_areTethersEnabled && m_areTethersDirty)
+	{
+		InitializeTethers();
+	}
+	for (int substep = 0; substep < m_numSubsteps; substep++)
+	{
+		//the wind forces gather from neighbouring patches, they are applied by their own passes before the patches are stepped
+		ApplyExternalForces(substepSeconds);
+		if (m_solverType == ConstraintSolverType::XPBD)
 		{
-			Particle particle;
-			particle.m_currentPos = startPos + Vec2(x * m_linkLength.x, -y * m_linkLength.y);
-			particle.m_prevPos = particle.m_currentPos;
-			particle.m_mass = (y < int(m_gridCoords.y / 2)) ? massOfEachTopPoint : massOfEachBottomPoint;
-			m_clothParticles.push_back(particle);
+			ResetLagrangeMultipliers(m_horizontalLambdas, m_particles.GetNumParticles());
+			ResetLagrangeMultipliers(m_verticalLambdas, m_particles.GetNumParticles());
 		}
-	}	
+		StepPatchesTiled(uniforms, 1.f / (substepSeconds * substepSeconds));
+	}
 }
 
-void Cloth::InitializeConstraints()
+void Cloth::StepPatchesTiled(const VerletIntegrationUniforms& uniforms, float inverseDeltaSecondsSquared)
 {
-	//initialize stick constraints
-	for (int y = 0; y < m_gridCoords.y; y++)
+	//a patch owns the east and south links of its particles, so it writes to its own particles and the first column and row of its
+	//east and south neighbours. Patches of the same colour (parity of their x and y) are at least one patch apart and never share a
+	//particle. The colours run in order: every patch integrates the patches whose particles it is the first to touch, then iterates
+	//all of its links while its particles are in cache
+	int numPatchesX = m_numPatchesX;
+	int numPatchesY = (int)m_patches.size() / numPatchesX;
+	std::vector<ConstraintResidual> iterationResiduals(m_numIterations);
+	std::mutex residualMutex;
+	for (int colorIndex = 0; colorIndex < 4; colorIndex++)
 	{
-		for (int x = 0; x < m_gridCoords.x; x++)
+		int firstPatchX = colorIndex & 1;
+		int firstPatchY = colorIndex >> 1;
+		int numColorPatchesX = (numPatchesX - firstPatchX + 1) / 2;
+		int numColorPatchesY = (numPatchesY - firstPatchY + 1) / 2;
+		ParallelForFunction stepPatches = [this, &uniforms, &iterationResiduals, &residualMutex, colorIndex, firstPatchX, firstPatchY, numColorPatchesX,
+			numPatchesX, numPatchesY, inverseDeltaSecondsSquared](int startIndex, int endIndex)
 		{
-			int indexOfAdjacentEastPoint = 0;
-			int indexOfAdjacentSouthPoint = 0;
-			//no east link for the last point
-			if (x < m_gridCoords.x - 1)
+			std::vector<ConstraintResidual> jobResiduals(m_numIterations);
+			int numConvergedPatches = 0;
+			int numStalledPatches = 0;
+			for (int i = startIndex; i < endIndex; i++)
 			{
-				//constraint from current point to the point on east of it.
-				DistanceConstraint constraintA;
-				constraintA.particleA = &m_clothParticles[GetIndexForPointFromGridCoordinates(IntVec2(x, y))];
-				indexOfAdjacentEastPoint = GetIndexForPointFromGridCoordinates(IntVec2(x, y) + IntVec2(1, 0));
-				if (indexOfAdjacentEastPoint < m_clothParticles.size())
+				int patchX = firstPatchX + 2 * (i % numColorPatchesX);
+				int patchY = firstPatchY + 2 * (i / numColorPatchesX);
+				int patchIndex = patchX + patchY * numPatchesX;
+				//patches of the first colour come before their east and south neighbours, the second colour before its south neighbours
+				if (colorIndex == 0)
 				{
-					constraintA.particleB = &m_clothParticles[indexOfAdjacentEastPoint];
-					constraintA.restLength = m_linkLength.x - errorRoom;
-					constraintA.originalRestLength = constraintA.restLength;
-					m_horizontalConstraints.push_back(constraintA);
+					IntegratePatch(m_patches[patchIndex], uniforms);
+					if (patchX + 1 < numPatchesX)
+					{
+						IntegratePatch(m_patches[patchIndex + 1], uniforms);
+					}
 				}
+				if (colorIndex <= 1 && patchY + 1 < numPatchesY)
+				{
+					IntegratePatch(m_patches[patchIndex + numPatchesX], uniforms);
+				}
+				SatisfyPatchLinks(m_patches[patchIndex], inverseDeltaSecondsSquared, jobResiduals, numConvergedPatches, numStalledPatches);
+			}
+
+			std::lock_guard<std::mutex> lock(residualMutex);
+			for (int j = 0; j < m_numIterations; j++)
+			{
+				iterationResiduals[j].Merge(jobResiduals[j]);
+			}
+			m_solverStats.m_numConvergedSolves += numConvergedPatches;
+			m_solverStats.m_numStalledSolves += numStalledPatches;
+		};
+
+		int numColorPatches = numColorPatchesX * numColorPatchesY;
+		if (m_solverType != ConstraintSolverType::SERIAL_GAUSS_SEIDEL && g_theJobSystem)
+			g_theJobSystem->ParallelFor(numColorPatches, MIN_PATCHES_PER_TILED_STEP_JOB, stepPatches);
+		else
+			stepPatches(0, numColorPatches);
+	}
+
+	//every patch decides on its own when to stop, so only the residuals are recorded here
+	for (int j = 0; j < m_numIterations; j++)
+	{
+		if (iterationResiduals[j].m_numConstraints > 0)
+		{
+			m_solverStats.m_numIterations++;
+			m_solverStats.m_maxResidual = iterationResiduals[j].m_maxViolation;
+			m_solverStats.m_rmsResidual = iterationResiduals[j].GetRms();
+		}
+	}
+}
+
+void Cloth::IntegratePatch(const ClothPatch& patch, const VerletIntegrationUniforms& uniforms)
+{
+	if (patch.m_isAsleep)
+		return;
+
+	int rowLength = patch.m_maxGridCoords.x - patch.m_minGridCoords.x;
+	for (int y = patch.m_minGridCoords.y; y < patch.m_maxGridCoords.y; y++)
+	{
+		int rowStartIndex = GetIndexForPointFromGridCoordinates(IntVec2(patch.m_minGridCoords.x, y));
+		IntegrateVerletRange(m_particles.m_x.data(), m_particles.m_y.data(), m_particles.m_prevX.data(), m_particles.m_prevY.data(), m_particles.m_fixedMask.data(),
+			rowStartIndex, rowLength, uniforms, m_useSimdKernels);
+	}
+}
+
+void Cloth::SatisfyPatchLinks(const ClothPatch& patch, float inverseDeltaSecondsSquared, std::vector<ConstraintResidual>& iterationResiduals,
+	int& out_numConvergedPatches, int& out_numStalledPatches)
+{
+	bool useXpbd = (m_solverType == ConstraintSolverType::XPBD);
+	int numColumns = m_gridCoords.x;
+	int endColumn = (patch.m_maxGridCoords.x < numColumns - 1) ? patch.m_maxGridCoords.x : numColumns - 1;
+	int endRow = (patch.m_maxGridCoords.y < m_gridCoords.y - 1) ? patch.m_maxGridCoords.y : m_gridCoords.y - 1;
+	if (m_areTethersEnabled)
+	{
+		for (int y = patch.m_minGridCoords.y; y < patch.m_maxGridCoords.y; y++)
+		{
+			for (int x = patch.m_minGridCoords.x; x < patch.m_maxGridCoords.x; x++)
+			{
+				SatisfyTetherConstraint(GetIndexForPointFromGridCoordinates(IntVec2(x, y)));
 			}
+		}
+	}
+
+	//the links are built on the fly like the stencil links, and the patch stops on its own once its links are within the tolerance or,
+	//when a stall tolerance is set, once an iteration no longer improves them
+	DistanceConstraint link;
+	link.compliance = m_linkCompliance;
+	float previousMaxViolation = 0.f;
+	for (int j = 0; j < m_numIterations; j++)
+	{
+		ConstraintResidual residual;
+		for (int y = patch.m_minGridCoords.y; y < patch.m_maxGridCoords.y; y++)
+		{
+			int rowStartIndex = y * numColumns;
+			for (int x = patch.m_minGridCoords.x; x < endColumn; x++)
+			{
+				int particleIndex = rowStartIndex + x;
+				if (m_hasTornLinks && IsLinkBroken(m_brokenHorizontalLinkMask, particleIndex))
+					continue;
 
-			//constraint from current point to the point on south of it.
-			DistanceConstraint constraintB;
-			constraintB.particleA = &m_clothParticles[GetIndexForPointFromGridCoordinates(IntVec2(x, y))];
-			indexOfAdjacentSouthPoint = GetIndexForPointFromGridCoordinates(IntVec2(x, y) + IntVec2(0, 1));
-			if (indexOfAdjacentSouthPoint < m_clothParticles.size())
+				link.particleIndexA = (uint32_t)particleIndex;
+				link.particleIndexB = (uint32_t)(particleIndex + 1);
+				link.restLength = m_horizontalRestLengthOverrides.empty() ? m_topology->m_horizontalRestLengths[x] : m_horizontalRestLengthOverrides[particleIndex];
+				if (useXpbd)
+					residual.Add(SatisfyDistanceConstraintXPBD(link, m_horizontalLambdas[particleIndex], inverseDeltaSecondsSquared));
+				else
+					residual.Add(SatisfyDistanceConstraint(link));
+			}
+		}
+		for (int y = patch.m_minGridCoords.y; y < endRow; y++)
+		{
+			int rowStartIndex = y * numColumns;
+			for (int x = patch.m_minGridCoords.x; x < patch.m_maxGridCoords.x; x++)
 			{
-				constraintB.particleB = &m_clothParticles[indexOfAdjacentSouthPoint];
-				constraintB.restLength = m_linkLength.y - errorRoom;
-				constraintB.originalRestLength = constraintB.restLength;
-				m_verticalConstraints.push_back(constraintB);
+				int particleIndex = rowStartIndex + x;
+				if (m_hasTornLinks && IsLinkBroken(m_brokenVerticalLinkMask, particleIndex))
+					continue;
+
+				link.particleIndexA = (uint32_t)particleIndex;
+				link.particleIndexB = (uint32_t)(particleIndex + numColumns);
+				link.restLength = m_verticalRestLengthOverrides.empty() ? m_topology->m_verticalRestLengths[y] : m_verticalRestLengthOverrides[particleIndex];
+				if (useXpbd)
+					residual.Add(SatisfyDistanceConstraintXPBD(link, m_verticalLambdas[particleIndex], inverseDeltaSecondsSquared));
+				else
+					residual.Add(SatisfyDistanceConstraint(link));
 			}
 		}
+
+		iterationResiduals[j].Merge(residual);
+		if (m_residualTolerance > 0.f && residual.m_maxViolation < m_residualTolerance)
+		{
+			out_numConvergedPatches++;
+			break;
+		}
+		if (m_stallTolerance > 0.f && j > 0 && previousMaxViolation - residual.m_maxViolation < m_stallTolerance)
+		{
+			out_numStalledPatches++;
+			break;
+		}
+		previousMaxViolation = residual.m_maxViolation;
 	}
 }
 
-void Cloth::SatisfyConstraints()
+void Cloth::RefitAndResolvePatches()
 {
-	for (int j = 0; j < TOTAL_NUM_ITERATIONS; j++)
+	//the refit and the collisions of the tiled step in one pass, every patch is refitted and pushed out of the colliders while its
+	//particles are in cache
+	bool hasColliders = (m_colliderSet && m_colliderSet->GetNumColliders() > 0);
+	ParallelForFunction refitAndResolvePatches = [this, hasColliders](int startIndex, int endIndex)
 	{
-		for (int i = 0; i < m_horizontalConstraints.size(); i++)
+		ColliderQuery query;
+		for (int patchIndex = startIndex; patchIndex < endIndex; patchIndex++)
 		{
-			SatisfyDistanceConstraint(m_horizontalConstraints[i]);
+			ClothPatch& patch = m_patches[patchIndex];
+			if (!patch.m_isAsleep)
+			{
+				patch.m_bounds = ComputePatchBounds(patch);
+				if (m_isSleepingEnabled)
+				{
+					patch.m_maxKineticEnergy = ComputePatchKineticEnergy(patch);
+				}
+			}
+			if (hasColliders)
+			{
+				ResolvePatchCollisions(patch, query);
+			}
 		}
+	};
 
-		for (int i = 0; i < m_verticalConstraints.size(); i++)
+	int numPatches = (int)m_patches.size();
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numPatches, MIN_PATCHES_PER_JOB, refitAndResolvePatches);
+	else
+		refitAndResolvePatches(0, numPatches);
+}
+
+void Cloth::SatisfyConstraintRangeParallel(const std::vector<DistanceConstraint>& constraints, std::vector<float>& lambdas, int startIndex, int endIndex,
+	float inverseDeltaSecondsSquared, ConstraintResidual& residual)
+{
+	//a constraint's lagrange multiplier is only touched by the job that owns the constraint, so XPBD is as safe to split as plain gauss seidel
+	bool useXpbd = (m_solverType == ConstraintSolverType::XPBD);
+	std::mutex residualMutex;
+	g_theJobSystem->ParallelFor(endIndex - startIndex, MIN_CONSTRAINTS_PER_JOB,
+		[this, &constraints, &lambdas, startIndex, useXpbd, inverseDeltaSecondsSquared, &residual, &residualMutex](int jobStartIndex, int jobEndIndex)
+		{
+			ConstraintResidual jobResidual;
+			for (int i = startIndex + jobStartIndex; i < startIndex + jobEndIndex; i++)
+			{
+				if (useXpbd)
+					jobResidual.Add(SatisfyDistanceConstraintXPBD(constraints[i], lambdas[i], inverseDeltaSecondsSquared));
+				else
+					jobResidual.Add(SatisfyDistanceConstraint(constraints[i]));
+			}
+
+			std::lock_guard<std::mutex> lock(residualMutex);
+			residual.Merge(jobResidual);
+		});
+}
+
+void Cloth::InitializeMultigridLevels()
+{
+	m_multigridLevels.clear();
+	for (int levelOfDetail = m_levelOfDetail + 1; levelOfDetail < NUM_CLOTH_LEVELS_OF_DETAIL; levelOfDetail++)
+	{
+		//small grids run out of lines to drop, a level that is no coarser than the one before would only repeat its solve
+		const ClothTopology* topology = m_fullResolutionTopology->GetLevelOfDetail(levelOfDetail);
+		const ClothTopology* finerTopology = m_multigridLevels.empty() ? m_topology : m_multigridLevels.back().m_topology;
+		if (topology->m_gridCoords == finerTopology->m_gridCoords)
+			break;
+
+		m_multigridLevels.emplace_back();
+		ClothMultigridLevel& level = m_multigridLevels.back();
+		level.m_topology = topology;
+		int numParticles = topology->GetNumParticles();
+		level.m_particles.Reserve(numParticles);
+		level.m_fineParticleIndices.resize(numParticles);
+		level.m_restrictedX.resize(numParticles);
+		level.m_restrictedY.resize(numParticles);
+		for (int i = 0; i < numParticles; i++)
+		{
+			//the levels keep every 2nd line of the one before plus the same extra lines, so every coarse node is also a simulated particle
+			IntVec2 fullResolutionGridCoords(topology->m_fullResolutionColumns[i % topology->m_gridCoords.x], topology->m_fullResolutionRows[i / topology->m_gridCoords.x]);
+			int fineParticleIndex = m_topology->GetIndexForFullResolutionPoint(fullResolutionGridCoords);
+			level.m_fineParticleIndices[i] = fineParticleIndex;
+			level.m_particles.AddParticle(m_particles.GetPosition(fineParticleIndex), topology->m_masses[i]);
+		}
+	}
+}
+
+void Cloth::SolveMultigridLevels()
+{
+	//the coarse grids have no idea where the cloth was torn, they would pull the pieces back together
+	if (m_hasTornLinks)
+		return;
+
+	if (m_multigridLevels.empty())
+	{
+		InitializeMultigridLevels();
+	}
+
+	for (int levelIndex = (int)m_multigridLevels.size() - 1; levelIndex >= 0; levelIndex--)
+	{
+		ClothMultigridLevel& level = m_multigridLevels[levelIndex];
+		//restriction: the nodes take the current positions of the particles they sit on, whatever the simulated grid leaves
+		//in place (pinned or asleep) stays in place on the coarse grid as well
+		ParticleStore& coarseParticles = level.m_particles;
+		for (int i = 0; i < coarseParticles.GetNumParticles(); i++)
 		{
-			SatisfyDistanceConstraint(m_verticalConstraints[i]);
+			int fineParticleIndex = level.m_fineParticleIndices[i];
+			coarseParticles.m_x[i] = m_particles.m_x[fineParticleIndex];
+			coarseParticles.m_y[i] = m_particles.m_y[fineParticleIndex];
+			level.m_restrictedX[i] = coarseParticles.m_x[i];
+			level.m_restrictedY[i] = coarseParticles.m_y[i];
+			bool isFixed = m_particles.IsFixed(fineParticleIndex);
+			if (coarseParticles.IsPinned(i) != isFixed)
+			{
+				coarseParticles.SetPinned(i, isFixed);
+			}
 		}
+
+		SolveMultigridLevel(level);
+		ProlongateMultigridCorrection(level);
+	}
+}
+
+void Cloth::SolveMultigridLevel(ClothMultigridLevel& level)
+{
+	//same colouring as the simulated grid, a coarse link spans several fine links and its rest length does too
+	const ClothTopology* topology = level.m_topology;
+	ParticleStore& particles = level.m_particles;
+	auto satisfyRange = [&particles](const std::vector<DistanceConstraint>& constraints, int startIndex, int endIndex)
+	{
+		ParallelForFunction satisfyConstraints = [&particles, &constraints, startIndex](int jobStartIndex, int jobEndIndex)
+		{
+			for (int i = startIndex + jobStartIndex; i < startIndex + jobEndIndex; i++)
+			{
+				SatisfyDistanceConstraint(particles, constraints[i]);
+			}
+		};
+
+		if (g_theJobSystem)
+			g_theJobSystem->ParallelFor(endIndex - startIndex, MIN_CONSTRAINTS_PER_JOB, satisfyConstraints);
+		else
+			satisfyConstraints(0, endIndex - startIndex);
+	};
+
+	for (int j = 0; j < MULTIGRID_COARSE_ITERATIONS; j++)
+	{
+		satisfyRange(topology->m_horizontalConstraints, 0, topology->m_numEvenHorizontalConstraints);
+		satisfyRange(topology->m_horizontalConstraints, topology->m_numEvenHorizontalConstraints, (int)topology->m_horizontalConstraints.size());
+		satisfyRange(topology->m_verticalConstraints, 0, topology->m_numEvenVerticalConstraints);
+		satisfyRange(topology->m_verticalConstraints, topology->m_numEvenVerticalConstraints, (int)topology->m_verticalConstraints.size());
 	}
 }
 
+void Cloth::ProlongateMultigridCorrection(const ClothMultigridLevel& level)
+{
+	//prolongation: every simulated particle moves by the bilinear interpolation of the corrections of the coarse cell it lies in,
+	//the cell is looked up through the coarse grid's samples of the full resolution lines the particle sits on
+	const ClothTopology* coarseTopology = level.m_topology;
+	const ParticleStore& coarseParticles = level.m_particles;
+	int numCoarseColumns = coarseTopology->m_gridCoords.x;
+	int numCoarseRows = coarseTopology->m_gridCoords.y;
+	ParallelForFunction prolongateRows = [this, &level, coarseTopology, &coarseParticles, numCoarseColumns, numCoarseRows](int startRow, int endRow)
+	{
+		for (int y = startRow; y < endRow; y++)
+		{
+			const ClothGridLineSample& rowSample = coarseTopology->m_rowSamples[m_topology->m_fullResolutionRows[y]];
+			int coarseRow0 = rowSample.m_cellIndex;
+			int coarseRow1 = (coarseRow0 + 1 < numCoarseRows) ? coarseRow0 + 1 : coarseRow0;
+			for (int x = 0; x < m_gridCoords.x; x++)
+			{
+				int particleIndex = GetIndexForPointFromGridCoordinates(IntVec2(x, y));
+				if (m_particles.IsFixed(particleIndex))
+					continue;
+
+				const ClothGridLineSample& columnSample = coarseTopology->m_columnSamples[m_topology->m_fullResolutionColumns[x]];
+				int coarseColumn0 = columnSample.m_cellIndex;
+				int coarseColumn1 = (coarseColumn0 + 1 < numCoarseColumns) ? coarseColumn0 + 1 : coarseColumn0;
+				int corners[4] = { coarseRow0 * numCoarseColumns + coarseColumn0, coarseRow0 * numCoarseColumns + coarseColumn1,
+					coarseRow1 * numCoarseColumns + coarseColumn0, coarseRow1 * numCoarseColumns + coarseColumn1 };
+				float weights[4] = { (1.f - columnSample.m_fraction) * (1.f - rowSample.m_fraction), columnSample.m_fraction * (1.f - rowSample.m_fraction),
+					(1.f - columnSample.m_fraction) * rowSample.m_fraction, columnSample.m_fraction * rowSample.m_fraction };
+				float correctionX = 0.f;
+				float correctionY = 0.f;
+				for (int corner = 0; corner < 4; corner++)
+				{
+					correctionX += (coarseParticles.m_x[corners[corner]] - level.m_restrictedX[corners[corner]]) * weights[corner];
+					correctionY += (coarseParticles.m_y[corners[corner]] - level.m_restrictedY[corners[corner]]) * weights[corner];
+				}
+				m_particles.m_x[particleIndex] += correctionX;
+				m_particles.m_y[particleIndex] += correctionY;
+			}
+		}
+	};
+
+	int minRowsPerJob = MIN_PARTICLES_PER_PROLONGATION_JOB / m_gridCoords.x;
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(m_gridCoords.y, (minRowsPerJob > 1) ? minRowsPerJob : 1, prolongateRows);
+	else
+		prolongateRows(0, m_gridCoords.y);
+}
+
 int Cloth::GetIndexForPointFromGridCoordinates(const IntVec2& gridCoords) const
 {
 	return gridCoords.x + (gridCoords.y * m_gridCoords.x);
@@ -244,11 +1895,11 @@ void Cloth::IdentifyBadPoints(float deltaSeconds)
 		{
 			if (y < m_gridCoords.y - 1)
 			{
-				Particle& currentPoint = m_clothParticles[GetIndexForPointFromGridCoordinates(IntVec2(x, y))];
-				Particle& pointSouthOfCurrentPoint = m_clothParticles[GetIndexForPointFromGridCoordinates(IntVec2(x, y + 1))];
-				if(IsPointBad(&currentPoint, &pointSouthOfCurrentPoint))
+				int currentPointIndex = GetIndexForPointFromGridCoordinates(IntVec2(x, y));
+				int pointSouthOfCurrentPointIndex = GetIndexForPointFromGridCoordinates(IntVec2(x, y + 1));
+				if(IsPointBad(currentPointIndex, pointSouthOfCurrentPointIndex))
 				{
-					m_badPoints.push_back(&pointSouthOfCurrentPoint);
+					m_badPoints.push_back(pointSouthOfCurrentPointIndex);
 				}
 			}
 		}
@@ -263,8 +1914,8 @@ void Cloth::AddImpulseToBadPoints(float deltaSeconds)
 		Vec2 impulse(-10.f, 50.f);
 		for (int i = 0; i < m_badPoints.size(); i++)
 		{
-			Particle* badPoint = m_badPoints[i];
-			badPoint->m_currentPos += impulse * deltaSeconds;
+			int badPointIndex = m_badPoints[i];
+			m_particles.SetPosition(badPointIndex, m_particles.GetPosition(badPointIndex) + impulse * deltaSeconds);
 			//badPoint->m_previousPos += impulse * deltaSeconds;
 		}
 		m_impulseIntervalTimer = 0.f;
@@ -279,14 +1930,16 @@ void Cloth::DebugRender() const
 
 		for (int i = 0; i < m_badPoints.size(); i++)
 		{
-			AddVertsForDisc2D(verts, m_badPoints[i]->m_currentPos, pointRadius * 2.f, Rgba8::RED);
+			AddVertsForDisc2D(verts, m_particles.GetPosition(m_badPoints[i]), pointRadius * 2.f, Rgba8::RED);
 		}
 
 		for (int i = 0; i < m_badConstraints.size(); i++)
 		{
-			AddVertsForDisc2D(verts, m_badConstraints[i].particleA->m_currentPos, pointRadius * 1.5f, Rgba8(255, 148, 112, 255));
-			AddVertsForDisc2D(verts, m_badConstraints[i].particleB->m_currentPos, pointRadius * 1.5f, Rgba8::RED);
-			AddVertsForLineSegment2D(verts, m_badConstraints[i].particleA->m_currentPos, m_badConstraints[i].particleB->m_currentPos, lineThickness * 1.5f, Rgba8::RED);
+			Vec2 positionA = m_particles.GetPosition(m_badConstraints[i].particleIndexA);
+			Vec2 positionB = m_particles.GetPosition(m_badConstraints[i].particleIndexB);
+			AddVertsForDisc2D(verts, positionA, pointRadius * 1.5f, Rgba8(255, 148, 112, 255));
+			AddVertsForDisc2D(verts, positionB, pointRadius * 1.5f, Rgba8::RED);
+			AddVertsForLineSegment2D(verts, positionA, positionB, lineThickness * 1.5f, Rgba8::RED);
 		}
 
 		g_theRenderer->BindTexture(nullptr);
@@ -299,20 +1952,22 @@ void Cloth::DebugRender() const
 void Cloth::RenderClothStructureGrid() const
 {
 	std::vector<Vertex_PCU> verts;
-	for (int i = 0; i < m_clothParticles.size(); i++)
+	for (int i = 0; i < m_particles.GetNumParticles(); i++)
 	{
-		AddVertsForDisc2D(verts, m_clothParticles[i].m_currentPos, pointRadius, Rgba8::WHITE);
+		AddVertsForDisc2D(verts, m_particles.GetPosition(i), pointRadius, Rgba8::WHITE);
 	}
 
-	for (int i = 0; i < m_horizontalConstraints.size(); i++)
+	const std::vector<DistanceConstraint>& horizontalConstraints = GetHorizontalConstraints();
+	const std::vector<DistanceConstraint>& verticalConstraints = GetVerticalConstraints();
+	for (int i = 0; i < horizontalConstraints.size(); i++)
 	{
-		DistanceConstraint constraint = m_horizontalConstraints[i];
-		AddVertsForLineSegment2D(verts, constraint.particleA->m_currentPos, constraint.particleB->m_currentPos, lineThickness, Rgba8::WHITE);
+		const DistanceConstraint& constraint = horizontalConstraints[i];
+		AddVertsForLineSegment2D(verts, m_particles.GetPosition(constraint.particleIndexA), m_particles.GetPosition(constraint.particleIndexB), lineThickness, Rgba8::WHITE);
 	}
-	for (int i = 0; i < m_verticalConstraints.size(); i++)
+	for (int i = 0; i < verticalConstraints.size(); i++)
 	{
-		DistanceConstraint constraint = m_verticalConstraints[i];
-		AddVertsForLineSegment2D(verts, constraint.particleA->m_currentPos, constraint.particleB->m_currentPos, lineThickness, Rgba8::WHITE);
+		const DistanceConstraint& constraint = verticalConstraints[i];
+		AddVertsForLineSegment2D(verts, m_particles.GetPosition(constraint.particleIndexA), m_particles.GetPosition(constraint.particleIndexB), lineThickness, Rgba8::WHITE);
 	}
 	g_theRenderer->BindTexture(nullptr);
 	g_theRenderer->DrawVertexArray((int)verts.size(), verts.data());
@@ -320,30 +1975,40 @@ void Cloth::RenderClothStructureGrid() const
 
 void Cloth::RenderCloth() const
 {
+	//a coarser level is drawn as the full resolution mesh upsampled from it, so the texture and the silhouette stay smooth
+	bool isUpsampled = (m_levelOfDetail > 0);
+	std::vector<Vec2> upsampledPositions;
+	if (isUpsampled)
+	{
+		UpsampleToFullResolution(m_particles.m_x.data(), m_particles.m_y.data(), upsampledPositions);
+	}
+	auto getPosition = [this, isUpsampled, &upsampledPositions](int particleIndex) { return isUpsampled ? upsampledPositions[particleIndex] : m_particles.GetPosition(particleIndex); };
+
 	//uv of each quad on the cloth grid will be total X/Y length divide by number of quads in each axis
-	float uvLengthX = 1.f / (m_gridCoords.x - 1);
-	float uvLengthY = 1.f / (m_gridCoords.y - 1);
+	const IntVec2& gridCoords = m_fullResolutionTopology->m_gridCoords;
+	float uvLengthX = 1.f / (gridCoords.x - 1);
+	float uvLengthY = 1.f / (gridCoords.y - 1);
 	std::vector<Vertex_PCU> verts;
-	for (int y = 0; y < m_gridCoords.y - 1; y++)
+	for (int y = 0; y < gridCoords.y - 1; y++)
 	{
-		for (int x = 0; x < m_gridCoords.x - 1; x++)
+		for (int x = 0; x < gridCoords.x - 1; x++)
 		{
-			int topLeftParticleIndex = GetIndexForPointFromGridCoordinates(IntVec2(x, y));
-			int topRightParticleIndex = GetIndexForPointFromGridCoordinates(IntVec2(x + 1, y));
-			int bottomLeftParticleIndex = GetIndexForPointFromGridCoordinates(IntVec2(x, y + 1));
-			int bottomRightParticleIndex = GetIndexForPointFromGridCoordinates(IntVec2(x + 1, y + 1));
+			int topLeftParticleIndex = m_fullResolutionTopology->GetIndexForPointFromGridCoordinates(IntVec2(x, y));
+			int topRightParticleIndex = m_fullResolutionTopology->GetIndexForPointFromGridCoordinates(IntVec2(x + 1, y));
+			int bottomLeftParticleIndex = m_fullResolutionTopology->GetIndexForPointFromGridCoordinates(IntVec2(x, y + 1));
+			int bottomRightParticleIndex = m_fullResolutionTopology->GetIndexForPointFromGridCoordinates(IntVec2(x + 1, y + 1));
 			
 			//uv's are mapped from bottom left to top right, but the cloth grid starts (0, 0) at top left and ends (1, 1) at bottom right
 			//hence for uv's for the cloth, uv.x are mapped as usual, but y is flipped to get correct uv.y mapping
 			Vec2 uvTopLeft(uvLengthX * x, 1.f - uvLengthY * y);
 			Vec2 uvBottomRight(uvLengthX * (x + 1), 1.f - (uvLengthY * (y + 1)));
 
-			if(DoesParticleHaveBrokenVerticalConstraints(topLeftParticleIndex)/* && DoesParticleHaveBrokenVerticalConstraints(topRightParticleIndex)*/)
+			if(!isUpsampled && IsQuadTorn(topLeftParticleIndex, topRightParticleIndex, bottomLeftParticleIndex))
 				continue;
 			else
 			{
-				AddVertsForQuad3D(verts, Vec3(m_clothParticles[topLeftParticleIndex].m_currentPos), Vec3(m_clothParticles[bottomLeftParticleIndex].m_currentPos),
-					Vec3(m_clothParticles[bottomRightParticleIndex].m_currentPos), Vec3(m_clothParticles[topRightParticleIndex].m_currentPos),
+				AddVertsForQuad3D(verts, Vec3(getPosition(topLeftParticleIndex)), Vec3(getPosition(bottomLeftParticleIndex)),
+					Vec3(getPosition(bottomRightParticleIndex)), Vec3(getPosition(topRightParticleIndex)),
 					Rgba8::WHITE, AABB2(Vec2(uvTopLeft.x, uvBottomRight.y), Vec2(uvBottomRight.x, uvTopLeft.y)));
 			}
 		}
@@ -352,10 +2017,10 @@ void Cloth::RenderCloth() const
 	g_theRenderer->DrawVertexArray((int)verts.size(), verts.data());
 }
 
-bool Cloth::IsPointBad(Particle* particleA, Particle* particleB) const
+bool Cloth::IsPointBad(int particleIndexA, int particleIndexB) const
 {
 	float errorMargin = m_linkLength.y * 0.3f;
-	float deltaY = particleA->m_currentPos.y - particleB->m_currentPos.y;
+	float deltaY = m_particles.m_y[particleIndexA] - m_particles.m_y[particleIndexB];
 	if (deltaY < errorMargin)
 		return true;
 
@@ -371,34 +2036,57 @@ void Cloth::IdentifyBadConstraints(float deltaSeconds)
 	m_constraintCorrectionTimer += deltaSeconds;
 	if (m_constraintCorrectionTimer > correctionInterval)
 	{
+		MakeConstraintsUnique();
 		m_badConstraints.clear();
 		for (int i = 0; i < m_verticalConstraints.size(); i++)
 		{
 			DistanceConstraint& constraint = m_verticalConstraints[i];
-			if (IsPointBad(constraint.particleA, constraint.particleB))
+			if (IsPointBad(constraint.particleIndexA, constraint.particleIndexB))
 			{
 				m_badConstraints.push_back(constraint);
 				constraint.restLength -= deltaRestLengthIncrease;
+				OverrideLinkRestLength(m_verticalRestLengthOverrides, false, (int)constraint.particleIndexA, constraint.restLength);
 			}
 			else if (constraint.restLength > constraint.originalRestLength + deltaRestLengthIncrease ||
 				constraint.restLength < constraint.originalRestLength - deltaRestLengthIncrease)
 			{
 				constraint.restLength += deltaRestLengthIncrease;
+				OverrideLinkRestLength(m_verticalRestLengthOverrides, false, (int)constraint.particleIndexA, constraint.restLength);
 			}
 		}
 		m_constraintCorrectionTimer = 0.f;
 	}
 }
 
-bool Cloth::DoesParticleHaveBrokenVerticalConstraints(int index) const
+bool Cloth::IsLinkBroken(const std::vector<uint32_t>& brokenLinkMask, int particleIndex) const
+{
+	return ((brokenLinkMask[particleIndex >> 5] >> (particleIndex & 31)) & 1u) != 0;
+}
+
+void Cloth::OverrideLinkRestLength(std::vector<float>& restLengthOverrides, bool isHorizontal, int particleIndex, float restLength)
 {
-	for (int i = 0; i < m_particleIndiciesWithBrokenVerticalConstraint.size(); i++)
+	//the first override copies every rest length out of the topology, links without one then read the same value as before
+	if (restLengthOverrides.empty())
 	{
-		if (m_particleIndiciesWithBrokenVerticalConstraint[i] == index)
-			return true;
+		restLengthOverrides.assign(m_particles.GetNumParticles(), 0.f);
+		for (int i = 0; i < m_particles.GetNumParticles(); i++)
+		{
+			int x = i % m_gridCoords.x;
+			int y = i / m_gridCoords.x;
+			if (isHorizontal && x + 1 < m_gridCoords.x)
+				restLengthOverrides[i] = m_topology->m_horizontalRestLengths[x];
+			else if (!isHorizontal && y + 1 < m_gridCoords.y)
+				restLengthOverrides[i] = m_topology->m_verticalRestLengths[y];
+		}
 	}
+	restLengthOverrides[particleIndex] = restLength;
+}
 
-	return false;
+bool Cloth::IsQuadTorn(int topLeftParticleIndex, int topRightParticleIndex, int bottomLeftParticleIndex) const
+{
+	//the 4 edges of a quad are the links owned by its top left (east and south), top right (south) and bottom left (east) particles
+	return IsLinkBroken(m_brokenHorizontalLinkMask, topLeftParticleIndex) || IsLinkBroken(m_brokenVerticalLinkMask, topLeftParticleIndex) ||
+		IsLinkBroken(m_brokenVerticalLinkMask, topRightParticleIndex) || IsLinkBroken(m_brokenHorizontalLinkMask, bottomLeftParticleIndex);
 }
 
 //void Cloth::GrabPointOnCloth(const Vec2& screenMousePos)
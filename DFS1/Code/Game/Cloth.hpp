@@ -1,17 +1,56 @@
 #pragma once
 #include "Game/ParticleSystem.hpp"
+#include "Game/ClothTopology.hpp"
+#include "Game/SpatialHashGrid.hpp"
+#include "Game/ImplicitIntegrator.hpp"
+#include "Engine/Math/AABB2.hpp"
+#include <utility>
 
 constexpr float distanceBetweenPointsOnX = 3.f;
 constexpr float distanceBetweenPointsOnY = 3.f;
 
 class Game;
 class Texture;
+struct ColliderQuery;
+struct VerletIntegrationUniforms;
+struct AerodynamicUniforms;
 
-enum class ClothMassType
+//block of neighbouring grid points with the bounds of their current positions, colliders only look at the particles of
+//patches their bounds overlap. Patches are also the regions that fall asleep once they stop moving
+struct ClothPatch
 {
-	TOP_HEAVY,
-	BOTTOM_HEAVY,
-	UNIFORM
+	IntVec2 m_minGridCoords = IntVec2::ZERO;
+	IntVec2 m_maxGridCoords = IntVec2::ZERO; //exclusive
+	AABB2 m_bounds;
+	float m_maxKineticEnergy = 0.f;
+	int m_numRestingUpdates = 0;
+	bool m_isAsleep = false;
+	bool m_isDisturbed = false; //set by the collision jobs when they pushed a sleeping patch, it is woken once they are done
+	Vec2 m_sleepWindVelocity = Vec2::ZERO; //wind at the patch when it fell asleep
+};
+
+//wind blowing over the cloth. Every edge of the grid feels drag along the wind relative to it and lift across it, scaled by the
+//coefficients (which fold in the air density). Gust fronts travel with the wind and scale its speed by up to 1 +- m_gustAmplitude
+struct ClothWind
+{
+	Vec2 m_velocity = Vec2::ZERO;
+	float m_dragCoefficient = 0.f;
+	float m_liftCoefficient = 0.f;
+	float m_gustAmplitude = 0.f;
+	float m_gustWavelength = 200.f;
+};
+
+//one coarser grid of the multigrid solver: a level of detail of the simulated grid with particles of its own. Its nodes are
+//copied from the simulated particles, solved, and the change is interpolated back onto the simulated grid
+struct ClothMultigridLevel
+{
+	const ClothTopology* m_topology = nullptr;
+	ParticleStore m_particles;
+	//the simulated particle every node of this grid was copied from
+	std::vector<int> m_fineParticleIndices;
+	//node positions before the solve, the correction is measured against them
+	std::vector<float> m_restrictedX;
+	std::vector<float> m_restrictedY;
 };
 
 //struct Point
@@ -32,36 +71,205 @@ enum class ClothMassType
 class Cloth : public ParticleSystem
 {
 public:
-	Cloth(Game* game, IntVec2 pointGrid, Vec2 linkLength, ClothMassType weightType);
+	//the topology is shared with the other instances and has to outlive the cloth, topLeftPosition places its top left particle
+	Cloth(Game* game, const ClothTopology* topology, const Vec2& topLeftPosition);
 	void Update(float deltaSeconds) override;
 	void Render() const override;
-	void BreakConstraintsWithNeighbours(Particle* referencePoint);
-	void MovePoint(const Vec2& screenMousePos, Particle*& grabbedParticle);
-	void CollideWithCircle(const Vec2& circleCenter, float circleRadius);
-	void CollideWithBox(const AABB2& collisionBox);
+	void BreakConstraintsWithNeighbours(int particleIndex);
+	void TearConstraintsInDisc(const Vec2& discCenter, float discRadius);
+	void SetConstraintCompliance(float compliance);
+	void SetTearStretchRatio(float tearStretchRatio) { m_tearStretchRatio = tearStretchRatio; }
+	float GetTearStretchRatio() const { return m_tearStretchRatio; }
+	void SetYieldStretchRatio(float yieldStretchRatio) { m_yieldStretchRatio = yieldStretchRatio; }
+	void SetSelfCollisionEnabled(bool isSelfCollisionEnabled) { m_isSelfCollisionEnabled = isSelfCollisionEnabled; }
+	void SetTethersEnabled(bool areTethersEnabled) { m_areTethersEnabled = areTethersEnabled; }
+	//sweeps the grid's links stencil style instead of reading them from the constraint arrays (not for the jacobi solver)
+	void SetUseStencilLinks(bool useStencilLinks) { m_useStencilLinks = useStencilLinks; }
+	//steps the grid patch by patch instead of pass by pass (see StepPatchesTiled), for the gauss seidel and XPBD solvers
+	void SetUseTiledStep(bool useTiledStep) { m_useTiledStep = useTiledStep; }
+	void SetWind(const ClothWind& wind);
+	const ClothWind& GetWind() const { return m_wind; }
+	void TogglePinnedParticle(int particleIndex) override;
+	void WakeUp() override;
+	int GetNumSleepingParticles() const override;
+	//switches to simulating a coarser grid (see ClothTopology), carrying the positions and velocities over. Torn links only exist
+	//on the full grid, so a torn cloth stays at level 0
+	void SetLevelOfDetail(int levelOfDetail);
+	int GetLevelOfDetail() const { return m_levelOfDetail; }
+	AABB2 GetBounds() const;
+	//the full resolution topology the cloth was created with
+	const ClothTopology* GetTopology() const { return m_fullResolutionTopology; }
+	const std::vector<DistanceConstraint>& GetHorizontalConstraints() const { return m_ownsConstraints ? m_horizontalConstraints : m_topology->m_horizontalConstraints; }
+	const std::vector<DistanceConstraint>& GetVerticalConstraints() const { return m_ownsConstraints ? m_verticalConstraints : m_topology->m_verticalConstraints; }
 
 public:
-	std::vector<Particle> m_clothParticles;
-	std::vector<DistanceConstraint> m_horizontalConstraints;
-	std::vector<DistanceConstraint> m_verticalConstraints;
 	std::vector<DistanceConstraint> m_badConstraints;
 
 protected:
 	//const Vec2 m_gravity = Vec2(0.f, -150.f);
 	Game* m_game = nullptr;
+	const ClothTopology* m_fullResolutionTopology = nullptr;
+	//the level of detail being simulated, the particles, links and patches all belong to its grid
+	const ClothTopology* m_topology = nullptr;
+	int m_levelOfDetail = 0;
 	IntVec2 m_gridCoords = IntVec2::ZERO;
 	Vec2 m_linkLength = Vec2(distanceBetweenPointsOnX, distanceBetweenPointsOnY);
-	std::vector<Particle*> m_badPoints;
+	std::vector<int> m_badPoints;
 	float m_impulseIntervalTimer = 0.f;
 	float m_constraintCorrectionTimer = 0.f;
 	Texture* m_texture = nullptr;
-	std::vector<int> m_particleIndiciesWithBrokenVerticalConstraint;
+	//the links and their per particle slots are read from the topology until this instance changes them, it then works on its own copy
+	bool m_ownsConstraints = false;
+	std::vector<DistanceConstraint> m_horizontalConstraints;
+	std::vector<DistanceConstraint> m_verticalConstraints;
+	//per particle adjacency: the slot of the east (horizontal) and south (vertical) link each particle owns in the constraint arrays,
+	//-1 if the particle has no such link or it was torn
+	std::vector<int> m_horizontalConstraintSlots;
+	std::vector<int> m_verticalConstraintSlots;
+	//lagrange multipliers of the XPBD solver, one per link of this instance (per particle owning a link for the stencil links)
+	std::vector<float> m_horizontalLambdas;
+	std::vector<float> m_verticalLambdas;
+	//stencil links: every particle is linked to its east and south neighbour unless the broken link masks say otherwise, the rest
+	//lengths come per column and row from the topology and every link has the compliance last set. Nothing is stored per link
+	bool m_useStencilLinks = false;
+	float m_linkCompliance = 0.f;
+	//rest lengths of single links that differ from the topology's, indexed by the particle that owns the link. Empty until one differs
+	std::vector<float> m_horizontalRestLengthOverrides;
+	std::vector<float> m_verticalRestLengthOverrides;
+	//tiled step: integration, tethers and all iterations of the links run on one patch at a time, the refit and collisions then in
+	//one more pass over the patches. It solves with the stencil links and changes the order the links are projected in. Off by default:
+	//a single thread projects a link in about 27 ns, bound by the latency of each projection rather than by memory, so even on grids far
+	//larger than the caches the tiled step ran about 20% slower than the stencil links
+	bool m_useTiledStep = false;
+	//one bit per link, indexed by the particle that owns it, set once the link is torn
+	std::vector<uint32_t> m_brokenHorizontalLinkMask;
+	std::vector<uint32_t> m_brokenVerticalLinkMask;
+	bool m_hasTornLinks = false;
+	//a link tears once its length passes this multiple of its original rest length, 0 disables tearing
+	float m_tearStretchRatio = 0.f;
+	//links found overstretched during a step, torn together once the step is done
+	std::vector<int> m_pendingHorizontalBreaks;
+	std::vector<int> m_pendingVerticalBreaks;
+	//a link stretched past this multiple of its current rest length gives way: its rest length grows until the link sits at this ratio,
+	//so the cloth keeps the shape it was pulled into. 0 disables yielding
+	float m_yieldStretchRatio = 0.f;
+	std::vector<int> m_pendingHorizontalYields;
+	std::vector<int> m_pendingVerticalYields;
+	//particles that are not linked to each other are kept at least m_selfCollisionDistance apart
+	bool m_isSelfCollisionEnabled = false;
+	float m_selfCollisionDistance = 0.f;
+	SpatialHashGrid m_selfCollisionGrid;
+	AlignedFloatArray m_selfCollisionDeltasX;
+	AlignedFloatArray m_selfCollisionDeltasY;
+	//long range attachments: every particle that can reach a pinned particle through the links is kept within the length of the
+	//shortest such path (its geodesic rest distance) of the nearest one. They only ever pull, and only the free particle moves
+	bool m_areTethersEnabled = false;
+	bool m_areTethersDirty = true;
+	std::vector<int> m_tetherAnchors; //-1 for particles no pinned particle can reach
+	std::vector<float> m_tetherLengths;
+	ClothWind m_wind;
+	float m_windSeconds = 0.f;
+	//aerodynamic force on the east (horizontal) and south (vertical) edge of every particle, 0 where there is no edge. The arrays start
+	//with a row of zeros so the first row can read its north edges like any other
+	AlignedFloatArray m_horizontalWindForcesX;
+	AlignedFloatArray m_horizontalWindForcesY;
+	AlignedFloatArray m_verticalWindForcesX;
+	AlignedFloatArray m_verticalWindForcesY;
+	std::vector<Vec2> m_patchWindVelocities;
+	//fixed size patches of the grid, their bounds are refitted at the end of every update
+	std::vector<ClothPatch> m_patches;
+	int m_numPatchesX = 0;
+	int m_numSleepingPatches = 0;
+	//scratch for the flood fills that find which patches are linked to each other
+	std::vector<bool> m_isPatchInIsland;
+	std::vector<int> m_islandPatchIndices;
+	//coarser grids of the multigrid solver, coarsest last. Built the first time they are needed for the simulated level of detail
+	std::vector<ClothMultigridLevel> m_multigridLevels;
+	ImplicitIntegrator m_implicitIntegrator;
+	//constraint arrays are laid out as [even colour | odd colour], constraints within a colour never share a particle
+	int m_numEvenHorizontalConstraints = 0;
+	int m_numEvenVerticalConstraints = 0;
 
 protected:
-	void UpdateParticles(float deltaSeconds);
-	void InitializeParticles(ClothMassType weightType);
+	void InitializeParticles(const Vec2& topLeftPosition);
 	void InitializeConstraints();
-	void SatisfyConstraints() override;
+	void UpdateSelfCollisionDistance();
+	//catmull-rom through the simulated particles at every point of the full resolution grid
+	void UpsampleToFullResolution(const float* positionsX, const float* positionsY, std::vector<Vec2>& out_positions) const;
+	//whether tearing the disc at full resolution would remove a link, checked without switching levels
+	bool IsFullResolutionLinkInDisc(const Vec2& discCenter, float discRadius) const;
+	void MakeConstraintsUnique();
+	const std::vector<int>& GetHorizontalConstraintSlots() const { return m_ownsConstraints ? m_horizontalConstraintSlots : m_topology->m_horizontalConstraintSlots; }
+	const std::vector<int>& GetVerticalConstraintSlots() const { return m_ownsConstraints ? m_verticalConstraintSlots : m_topology->m_verticalConstraintSlots; }
+	bool IsWindBlowing() const;
+	Vec2 GetWindVelocityAtPoint(const Vec2& point) const;
+	void WakePatchesInChangedWind();
+	//patch by patch: the forces of the edges each patch owns first, then every particle gathers the forces of the edges it is on
+	void ApplyExternalForces(float deltaSeconds) override;
+	void ComputeRowWindForces(int y, AerodynamicUniforms uniforms);
+	void ApplyRowWindForces(int y, float deltaSeconds);
+	//windForcesX and windForcesY are indexed by particle, like the mask
+	void ClearTornLinkWindForces(const std::vector<uint32_t>& brokenLinkMask, int startIndex, int endIndex, float* windForcesX, float* windForcesY);
+	void IntegrateImplicit(float deltaSeconds) override;
+	void SatisfyConstraints(float deltaSeconds) override;
+	//runs the solver compiled for the grid size and iteration count (see ClothGridKernels) when there is one and it applies
+	bool SatisfyConstraintsFixedGrid();
+	void SatisfyConstraintsParallel(float inverseDeltaSecondsSquared);
+	void SatisfyConstraintsJacobi();
+	void SatisfyConstraintsStencil(float inverseDeltaSecondsSquared);
+	//one colour of the stencil links: the east links of every other column, or the south links of every other row, from firstLine on
+	void SatisfyStencilColor(bool isHorizontal, int firstLine, float inverseDeltaSecondsSquared, ConstraintResidual& residual);
+	bool IsTiledStepUsed() const;
+	void SimulateTiled(float deltaSeconds);
+	//one substep of every awake patch, in 4 colours of patches
+	void StepPatchesTiled(const VerletIntegrationUniforms& uniforms, float inverseDeltaSecondsSquared);
+	void IntegratePatch(const ClothPatch& patch, const VerletIntegrationUniforms& uniforms);
+	//tethers of the patch's particles, then every iteration of the links the patch owns. The residual of iteration j goes to iterationResiduals[j]
+	//adds to out_numConvergedPatches or out_numStalledPatches when the patch stops before its last iteration
+	void SatisfyPatchLinks(const ClothPatch& patch, float inverseDeltaSecondsSquared, std::vector<ConstraintResidual>& iterationResiduals,
+		int& out_numConvergedPatches, int& out_numStalledPatches);
+	void RefitAndResolvePatches();
+	void InitializeMultigridLevels();
+	//coarse to fine: every coarser grid is restricted from the simulated particles, solved, and its correction prolongated onto them
+	void SolveMultigridLevels();
+	void SolveMultigridLevel(ClothMultigridLevel& level);
+	void ProlongateMultigridCorrection(const ClothMultigridLevel& level);
+	void SatisfyConstraintRangeParallel(const std::vector<DistanceConstraint>& constraints, std::vector<float>& lambdas, int startIndex, int endIndex,
+		float inverseDeltaSecondsSquared, ConstraintResidual& residual);
+	void BreakConstraint(std::vector<DistanceConstraint>& constraints, int& numEvenConstraints, std::vector<int>& constraintSlots,
+		std::vector<uint32_t>& brokenLinkMask, int particleIndex);
+	void MoveConstraint(std::vector<DistanceConstraint>& constraints, std::vector<int>& constraintSlots, int fromSlot, int toSlot);
+	//stretchRatio is relative to the original rest length of a link, or to its current one when yielding
+	void FindOverstretchedConstraints(const std::vector<DistanceConstraint>& constraints, float stretchRatio, bool isRatioOfOriginalRestLength,
+		std::vector<int>& out_pendingLinks) const;
+	void ApplyPendingBreaks();
+	void ApplyPendingYields(std::vector<int>& pendingYields, bool isHorizontal);
+	void SolveSelfCollisions();
+	void InitializeTethers();
+	//dijkstra from the queued particles, only ever shortens tethers. Pinning a particle queues just that particle
+	void RelaxTethers(std::vector<std::pair<float, int>>& queue);
+	void AddTetherAnchor(int particleIndex);
+	//the particles tethered to the anchor are cut loose and re-reached from the tethered particles bordering them
+	void RemoveTetherAnchor(int particleIndex);
+	float GetLinkRestLength(int particleIndexA, int particleIndexB) const;
+	void SatisfyTetherConstraints();
+	void SatisfyTetherConstraint(int particleIndex);
+	void InitializePatches();
+	void RefitPatchBounds();
+	AABB2 ComputePatchBounds(const ClothPatch& patch) const;
+	void ResolveCollisions() override;
+	//pushes the patch's particles out of the colliders its bounds overlap and refits the bounds, query is scratch
+	void ResolvePatchCollisions(ClothPatch& patch, ColliderQuery& query);
+	void WakeParticle(int particleIndex) override;
+	int GetPatchIndexForParticle(int particleIndex) const;
+	float ComputePatchKineticEnergy(const ClothPatch& patch) const;
+	void UpdatePatchSleepStates();
+	void SetPatchAsleep(int patchIndex, bool isAsleep);
+	void WakePatchIsland(int patchIndex);
+	//collects the patches still connected to patchIndex through unbroken links, skipping the ones already in m_isPatchInIsland
+	void FindPatchIsland(int patchIndex, std::vector<int>& out_patchIndices);
+	bool AreNeighbourPatchesLinked(int westOrNorthPatchIndex, int eastOrSouthPatchIndex) const;
+	bool AreParticlesLinked(int particleIndexA, int particleIndexB) const;
 	//void SatisfyMinDistanceConstraint(MinDistanceConstraint& constraint);
 	int GetIndexForPointFromGridCoordinates(const IntVec2& gridCoords) const;
 	//void MovePoints(float deltaSeconds);
@@ -70,7 +278,9 @@ protected:
 	void DebugRender() const;
 	void RenderClothStructureGrid() const;
 	void RenderCloth() const;
-	bool IsPointBad(Particle* particleA, Particle* particleB) const;
+	bool IsPointBad(int particleIndexA, int particleIndexB) const;
 	void IdentifyBadConstraints(float deltaSeconds);
-	bool DoesParticleHaveBrokenVerticalConstraints(int index) const;
+	bool IsLinkBroken(const std::vector<uint32_t>& brokenLinkMask, int particleIndex) const;
+	void OverrideLinkRestLength(std::vector<float>& restLengthOverrides, bool isHorizontal, int particleIndex, float restLength);
+	bool IsQuadTorn(int topLeftParticleIndex, int topRightParticleIndex, int bottomLeftParticleIndex) const;
 };
\ No newline at end of file
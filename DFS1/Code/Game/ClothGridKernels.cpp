@@ -0,0 +1,139 @@
+#include "Game/ClothGridKernels.hpp"
+#include "Game/ParticleSystem.hpp"
+#include <math.h>
+
+//one link written without branches so the loops over a row can be vectorised, isFree is 1 for particles that can move and 0 for
+//fixed ones. Returns the violation SatisfyDistanceConstraint would have returned
+static inline float SatisfyGridLink(float* positionsX, float* positionsY, const float* invMasses, const float* isFree, int indexA, int indexB, float restLength)
+{
+	float invMassA = invMasses[indexA];
+	float invMassB = invMasses[indexB];
+	float positionAX = positionsX[indexA];
+	float positionAY = positionsY[indexA];
+	float positionBX = positionsX[indexB];
+	float positionBY = positionsY[indexB];
+	float vectorABX = positionBX - positionAX;
+	float vectorABY = positionBY - positionAY;
+	float vectorLength = sqrtf(vectorABX * vectorABX + vectorABY * vectorABY);
+	float excessPercent = (vectorLength - restLength) / (vectorLength * (invMassA + invMassB));
+
+	//links between two fixed particles and links of zero length (no direction to separate them in) leave both particles alone
+	bool isSolvable = (isFree[indexA] + isFree[indexB] > 0.f);
+	bool isMoved = isSolvable && vectorLength > 0.f;
+	bool isMovedA = isMoved && isFree[indexA] > 0.f;
+	bool isMovedB = isMoved && isFree[indexB] > 0.f;
+	positionsX[indexA] = isMovedA ? positionAX + vectorABX * invMassA * excessPercent : positionAX;
+	positionsY[indexA] = isMovedA ? positionAY + vectorABY * invMassA * excessPercent : positionAY;
+	positionsX[indexB] = isMovedB ? positionBX - vectorABX * invMassB * excessPercent : positionBX;
+	positionsY[indexB] = isMovedB ? positionBY - vectorABY * invMassB * excessPercent : positionBY;
+
+	float violation = (vectorLength > 0.f) ? fabsf(vectorLength - restLength) : restLength;
+	return isSolvable ? violation : 0.f;
+}
+
+//the violations of a row are written out and summed afterwards, a float sum inside the loop would keep it from being vectorised
+static void AddViolations(const float* violations, int numViolations, ConstraintResidual& residual)
+{
+	for (int i = 0; i < numViolations; i++)
+	{
+		residual.Add(violations[i]);
+	}
+}
+
+template <int GRID_WIDTH, int GRID_HEIGHT, int NUM_ITERATIONS>
+static void SatisfyFixedGridLinks(const FixedGridLinkArrays& arrays, ConstraintResidual* out_iterationResiduals)
+{
+	static_assert(GRID_WIDTH > 1 && GRID_HEIGHT > 1, "A fixed grid needs links in both directions");
+	static_assert(NUM_ITERATIONS <= MAX_FIXED_GRID_SOLVER_ITERATIONS, "Too many iterations for a fixed grid solver");
+	constexpr int NUM_PARTICLES = GRID_WIDTH * GRID_HEIGHT;
+	float* positionsX = arrays.m_positionsX;
+	float* positionsY = arrays.m_positionsY;
+	const float* invMasses = arrays.m_invMasses;
+	const float* horizontalRestLengths = arrays.m_horizontalRestLengths;
+	const float* verticalRestLengths = arrays.m_verticalRestLengths;
+
+	float isFree[NUM_PARTICLES];
+	for (int i = 0; i < NUM_PARTICLES; i++)
+	{
+		isFree[i] = (((arrays.m_fixedMask[i >> 5] >> (i & 31)) & 1u) != 0) ? 0.f : 1.f;
+	}
+
+	float violations[GRID_WIDTH];
+	for (int j = 0; j < NUM_ITERATIONS; j++)
+	{
+		ConstraintResidual residual;
+		//east links of the even columns, then of the odd ones
+		for (int firstColumn = 0; firstColumn < 2; firstColumn++)
+		{
+			for (int y = 0; y < GRID_HEIGHT; y++)
+			{
+				int rowStartIndex = y * GRID_WIDTH;
+				int numViolations = 0;
+				for (int x = firstColumn; x < GRID_WIDTH - 1; x += 2)
+				{
+					violations[numViolations++] = SatisfyGridLink(positionsX, positionsY, invMasses, isFree, rowStartIndex + x, rowStartIndex + x + 1,
+						horizontalRestLengths[x]);
+				}
+				AddViolations(violations, numViolations, residual);
+			}
+		}
+
+		//south links of the even rows, then of the odd ones. The links of a row are contiguous on both ends
+		for (int firstRow = 0; firstRow < 2; firstRow++)
+		{
+			for (int y = firstRow; y < GRID_HEIGHT - 1; y += 2)
+			{
+				int rowStartIndex = y * GRID_WIDTH;
+				for (int x = 0; x < GRID_WIDTH; x++)
+				{
+					violations[x] = SatisfyGridLink(positionsX, positionsY, invMasses, isFree, rowStartIndex + x, rowStartIndex + GRID_WIDTH + x,
+						verticalRestLengths[y]);
+				}
+				AddViolations(violations, GRID_WIDTH, residual);
+			}
+		}
+
+		out_iterationResiduals[j] = residual;
+	}
+}
+
+struct FixedGridLinkSolverEntry
+{
+	int m_gridWidth;
+	int m_gridHeight;
+	int m_numIterations;
+	FixedGridLinkSolver m_solver;
+};
+
+//the sizes the small UI cloths are made in, at the default and a doubled iteration count. The default 30x15 cloth comes first, with
+//its coarser levels of detail
+#define FIXED_GRID_LINK_SOLVER(gridWidth, gridHeight, numIterations) \
+	{ gridWidth, gridHeight, numIterations, &SatisfyFixedGridLinks<gridWidth, gridHeight, numIterations> }
+
+static const FixedGridLinkSolverEntry s_fixedGridLinkSolvers[] =
+{
+	FIXED_GRID_LINK_SOLVER(30, 15, 2),
+	FIXED_GRID_LINK_SOLVER(30, 15, 4),
+	FIXED_GRID_LINK_SOLVER(16, 8, 2),
+	FIXED_GRID_LINK_SOLVER(16, 8, 4),
+	FIXED_GRID_LINK_SOLVER(10, 5, 2),
+	FIXED_GRID_LINK_SOLVER(10, 5, 4),
+	FIXED_GRID_LINK_SOLVER(32, 16, 2),
+	FIXED_GRID_LINK_SOLVER(32, 16, 4),
+	FIXED_GRID_LINK_SOLVER(32, 32, 2),
+	FIXED_GRID_LINK_SOLVER(32, 32, 4),
+	FIXED_GRID_LINK_SOLVER(64, 64, 2),
+	FIXED_GRID_LINK_SOLVER(64, 64, 4),
+};
+
+#undef FIXED_GRID_LINK_SOLVER
+
+FixedGridLinkSolver GetFixedGridLinkSolver(int gridWidth, int gridHeight, int numIterations)
+{
+	for (const FixedGridLinkSolverEntry& entry : s_fixedGridLinkSolvers)
+	{
+		if (entry.m_gridWidth == gridWidth && entry.m_gridHeight == gridHeight && entry.m_numIterations == numIterations)
+			return entry.m_solver;
+	}
+	return nullptr;
+}
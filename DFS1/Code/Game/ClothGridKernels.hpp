@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+struct ConstraintResidual;
+
+//the largest iteration count a fixed grid solver is compiled for
+constexpr int MAX_FIXED_GRID_SOLVER_ITERATIONS = 4;
+
+//the arrays of an untorn grid of particles numbered row by row, every particle linked to its east and south neighbour
+struct FixedGridLinkArrays
+{
+	float* m_positionsX = nullptr;
+	float* m_positionsY = nullptr;
+	const float* m_invMasses = nullptr;
+	const uint32_t* m_fixedMask = nullptr;
+	const float* m_horizontalRestLengths = nullptr; //per column
+	const float* m_verticalRestLengths = nullptr; //per row
+};
+
+//gauss seidel over every link of the grid in the colour order of the cloth's constraint arrays, with the same arithmetic as
+//ParticleSystem::SatisfyDistanceConstraint, so it moves the particles exactly like the generic solvers do. The grid size and
+//iteration count are template arguments, so every loop has a known trip count the compiler can unroll and vectorise.
+//out_iterationResiduals gets one residual per iteration
+typedef void (*FixedGridLinkSolver)(const FixedGridLinkArrays& arrays, ConstraintResidual* out_iterationResiduals);
+
+//the solver compiled for this grid size and iteration count, nullptr when there is none and the generic solvers have to run
+FixedGridLinkSolver GetFixedGridLinkSolver(int gridWidth, int gridHeight, int numIterations);
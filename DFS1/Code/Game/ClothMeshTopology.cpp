@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include "Game/ClothMeshTopology.hpp"
+#include "Game/ParticleOrdering.hpp"
+#include "Engine/Core/ErrorWarningAssert.hpp"
+#include "Engine/Math/MathUtils.hpp"
+
+constexpr float clothTotalMass = 2000.f;
+//vertices closer than this fraction of the mesh size are welded into one particle
+constexpr float weldDistanceFraction = 1e-5f;
+
+//breadth first walk over the particles that are not visited yet, the new neighbours of every particle are queued from the lowest
+//to the highest number of links (Cuthill-McKee). The walk is appended to out_order and its particles are marked visited
+static void WalkCuthillMcKee(int startParticle, const std::vector<int>& neighbourStarts, const std::vector<int>& neighbours,
+	std::vector<bool>& isVisited, std::vector<int>& out_order)
+{
+	auto isFewerLinks = [&neighbourStarts](int particleA, int particleB)
+	{
+		int numLinksA = neighbourStarts[particleA + 1] - neighbourStarts[particleA];
+		int numLinksB = neighbourStarts[particleB + 1] - neighbourStarts[particleB];
+		return (numLinksA != numLinksB) ? numLinksA < numLinksB : particleA < particleB;
+	};
+
+	size_t walkIndex = out_order.size();
+	out_order.push_back(startParticle);
+	isVisited[startParticle] = true;
+	while (walkIndex < out_order.size())
+	{
+		int particle = out_order[walkIndex++];
+		size_t firstNewNeighbour = out_order.size();
+		for (int i = neighbourStarts[particle]; i < neighbourStarts[particle + 1]; i++)
+		{
+			if (!isVisited[neighbours[i]])
+			{
+				isVisited[neighbours[i]] = true;
+				out_order.push_back(neighbours[i]);
+			}
+		}
+		std::sort(out_order.begin() + firstNewNeighbour, out_order.end(), isFewerLinks);
+	}
+}
+
+ClothMeshTopology::ClothMeshTopology(const std::vector<Vertex_PNCU>& vertices, const std::vector<unsigned int>& triangleIndices, float pinHeight,
+	ClothMeshParticleOrder particleOrder)
+{
+	WeldVertices(vertices, triangleIndices);
+	InitializeConstraints();
+	m_importedBandwidth = GetBandwidth();
+	if (particleOrder == ClothMeshParticleOrder::REVERSE_CUTHILL_MCKEE)
+	{
+		std::vector<int> order;
+		GetReverseCuthillMcKeeOrder(order);
+		ReorderParticles(order);
+	}
+	else if (particleOrder == ClothMeshParticleOrder::MORTON)
+	{
+		std::vector<float> restPositionsX(GetNumParticles());
+		std::vector<float> restPositionsY(GetNumParticles());
+		for (int i = 0; i < GetNumParticles(); i++)
+		{
+			restPositionsX[i] = m_restPositions[i].x;
+			restPositionsY[i] = m_restPositions[i].y;
+		}
+		std::vector<int> order;
+		GetMortonOrder(restPositionsX.data(), restPositionsY.data(), GetNumParticles(), order);
+		ReorderParticles(order);
+	}
+	m_bandwidth = GetBandwidth();
+	InitializeMasses();
+	InitializePins(pinHeight);
+	ColorConstraints();
+}
+
+AABB2 ClothMeshTopology::GetRestBounds() const
+{
+	if (m_restPositions.empty())
+		return AABB2(Vec2::ZERO, Vec2::ZERO);
+
+	AABB2 bounds(m_restPositions[0], m_restPositions[0]);
+	for (int i = 1; i < GetNumParticles(); i++)
+	{
+		bounds.StretchToIncludePoint(m_restPositions[i]);
+	}
+	return bounds;
+}
+
+void ClothMeshTopology::WeldVertices(const std::vector<Vertex_PNCU>& vertices, const std::vector<unsigned int>& triangleIndices)
+{
+	//the importer gives every triangle corner its own vertex. Corners are sorted by their position snapped to the weld distance,
+	//so corners that share a position end up next to each other and become one particle
+	int numVertices = (int)vertices.size();
+	if (numVertices == 0)
+		return;
+
+	Vec2 mins(vertices[0].m_position.x, vertices[0].m_position.y);
+	Vec2 maxs = mins;
+	for (int i = 1; i < numVertices; i++)
+	{
+		mins.x = (vertices[i].m_position.x < mins.x) ? vertices[i].m_position.x : mins.x;
+		mins.y = (vertices[i].m_position.y < mins.y) ? vertices[i].m_position.y : mins.y;
+		maxs.x = (vertices[i].m_position.x > maxs.x) ? vertices[i].m_position.x : maxs.x;
+		maxs.y = (vertices[i].m_position.y > maxs.y) ? vertices[i].m_position.y : maxs.y;
+	}
+	float meshSize = ((maxs.x - mins.x) > (maxs.y - mins.y)) ? (maxs.x - mins.x) : (maxs.y - mins.y);
+	float inverseWeldDistance = (meshSize > 0.f) ? 1.f / (meshSize * weldDistanceFraction) : 1.f;
+
+	std::vector<std::pair<uint64_t, int>> snappedVertices(numVertices);
+	for (int i = 0; i < numVertices; i++)
+	{
+		uint32_t snappedX = (uint32_t)(int)floorf((vertices[i].m_position.x - mins.x) * inverseWeldDistance + 0.5f);
+		uint32_t snappedY = (uint32_t)(int)floorf((vertices[i].m_position.y - mins.y) * inverseWeldDistance + 0.5f);
+		snappedVertices[i] = std::make_pair(((uint64_t)snappedX << 32) | (uint64_t)snappedY, i);
+	}
+	std::sort(snappedVertices.begin(), snappedVertices.end());
+
+	int numWelds = 0;
+	std::vector<int> weldIndices(numVertices);
+	for (int i = 0; i < numVertices; i++)
+	{
+		if (i > 0 && snappedVertices[i].first != snappedVertices[i - 1].first)
+		{
+			numWelds++;
+		}
+		weldIndices[snappedVertices[i].second] = numWelds;
+	}
+
+	//particles are numbered in the order the triangles first use them
+	std::vector<int> particleIndices(numWelds + 1, -1);
+	for (int i = 0; i < numVertices; i++)
+	{
+		int& particleIndex = particleIndices[weldIndices[i]];
+		if (particleIndex < 0)
+		{
+			particleIndex = GetNumParticles();
+			m_restPositions.push_back(Vec2(vertices[i].m_position.x, vertices[i].m_position.y));
+			m_uvs.push_back(vertices[i].m_uvTexCoords);
+		}
+	}
+
+	for (int i = 0; i + 2 < triangleIndices.size(); i += 3)
+	{
+		int particleA = particleIndices[weldIndices[triangleIndices[i]]];
+		int particleB = particleIndices[weldIndices[triangleIndices[i + 1]]];
+		int particleC = particleIndices[weldIndices[triangleIndices[i + 2]]];
+		if (particleA == particleB || particleB == particleC || particleC == particleA)
+			continue;
+
+		m_triangleIndices.push_back(particleA);
+		m_triangleIndices.push_back(particleB);
+		m_triangleIndices.push_back(particleC);
+	}
+}
+
+void ClothMeshTopology::InitializeConstraints()
+{
+	//every edge is shared by up to two triangles, the sorted list of (lower, higher) index pairs holds each of them once
+	std::vector<uint64_t> edges;
+	edges.reserve(m_triangleIndices.size());
+	for (int i = 0; i < m_triangleIndices.size(); i += 3)
+	{
+		for (int corner = 0; corner < 3; corner++)
+		{
+			uint32_t particleA = (uint32_t)m_triangleIndices[i + corner];
+			uint32_t particleB = (uint32_t)m_triangleIndices[i + (corner + 1) % 3];
+			uint32_t lowerIndex = (particleA < particleB) ? particleA : particleB;
+			uint32_t higherIndex = (particleA < particleB) ? particleB : particleA;
+			edges.push_back(((uint64_t)lowerIndex << 32) | (uint64_t)higherIndex);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+	m_constraints.resize(edges.size());
+	for (int i = 0; i < edges.size(); i++)
+	{
+		DistanceConstraint& constraint = m_constraints[i];
+		constraint.particleIndexA = (uint32_t)(edges[i] >> 32);
+		constraint.particleIndexB = (uint32_t)(edges[i] & 0xffffffffu);
+		constraint.restLength = GetDistance2D(m_restPositions[constraint.particleIndexA], m_restPositions[constraint.particleIndexB]);
+		constraint.originalRestLength = constraint.restLength;
+	}
+}
+
+void ClothMeshTopology::InitializeMasses()
+{
+	//every particle carries a third of the area of its triangles, so a denser part of the mesh is not heavier than the rest
+	int numParticles = GetNumParticles();
+	m_masses.assign(numParticles, 0.f);
+	float totalArea = 0.f;
+	for (int i = 0; i < m_triangleIndices.size(); i += 3)
+	{
+		Vec2 edgeAB = m_restPositions[m_triangleIndices[i + 1]] - m_restPositions[m_triangleIndices[i]];
+		Vec2 edgeAC = m_restPositions[m_triangleIndices[i + 2]] - m_restPositions[m_triangleIndices[i]];
+		float area = fabsf(edgeAB.x * edgeAC.y - edgeAB.y * edgeAC.x) * 0.5f;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			m_masses[m_triangleIndices[i + corner]] += area / 3.f;
+		}
+		totalArea += area;
+	}
+
+	//particles no triangle area reached still need a mass, they get the average one
+	float averageMass = clothTotalMass / (float)(numParticles > 0 ? numParticles : 1);
+	float massPerArea = (totalArea > 0.f) ? clothTotalMass / totalArea : 0.f;
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_masses[i] = (m_masses[i] > 0.f && massPerArea > 0.f) ? m_masses[i] * massPerArea : averageMass;
+	}
+}
+
+void ClothMeshTopology::InitializePins(float pinHeight)
+{
+	AABB2 restBounds = GetRestBounds();
+	for (int i = 0; i < GetNumParticles(); i++)
+	{
+		if (m_restPositions[i].y >= restBounds.m_maxs.y - pinHeight)
+		{
+			m_pinnedParticles.push_back(i);
+		}
+	}
+}
+
+void ClothMeshTopology::GetReverseCuthillMcKeeOrder(std::vector<int>& out_order) const
+{
+	//the links as compressed neighbour lists
+	int numParticles = GetNumParticles();
+	std::vector<int> neighbourStarts(numParticles + 1, 0);
+	for (int i = 0; i < m_constraints.size(); i++)
+	{
+		neighbourStarts[m_constraints[i].particleIndexA + 1]++;
+		neighbourStarts[m_constraints[i].particleIndexB + 1]++;
+	}
+	for (int i = 0; i < numParticles; i++)
+	{
+		neighbourStarts[i + 1] += neighbourStarts[i];
+	}
+	std::vector<int> neighbours(neighbourStarts[numParticles]);
+	std::vector<int> neighbourCursors(neighbourStarts.begin(), neighbourStarts.end() - 1);
+	for (int i = 0; i < m_constraints.size(); i++)
+	{
+		neighbours[neighbourCursors[m_constraints[i].particleIndexA]++] = m_constraints[i].particleIndexB;
+		neighbours[neighbourCursors[m_constraints[i].particleIndexB]++] = m_constraints[i].particleIndexA;
+	}
+
+	//every connected piece is walked from a particle on its rim: a walk from its least linked particle ends on a particle about as
+	//far from it as the piece allows, which starts the real walk. Reversing the whole order gives reverse Cuthill-McKee
+	std::vector<int> particlesByLinks(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		particlesByLinks[i] = i;
+	}
+	std::stable_sort(particlesByLinks.begin(), particlesByLinks.end(), [&neighbourStarts](int a, int b)
+	{
+		return neighbourStarts[a + 1] - neighbourStarts[a] < neighbourStarts[b + 1] - neighbourStarts[b];
+	});
+	std::vector<bool> isVisited(numParticles, false);
+	std::vector<int> trialOrder;
+	out_order.clear();
+	out_order.reserve(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		int startParticle = particlesByLinks[i];
+		if (isVisited[startParticle])
+			continue;
+
+		trialOrder.clear();
+		WalkCuthillMcKee(startParticle, neighbourStarts, neighbours, isVisited, trialOrder);
+		for (int j = 0; j < trialOrder.size(); j++)
+		{
+			isVisited[trialOrder[j]] = false;
+		}
+		WalkCuthillMcKee(trialOrder.back(), neighbourStarts, neighbours, isVisited, out_order);
+	}
+	std::reverse(out_order.begin(), out_order.end());
+}
+
+void ClothMeshTopology::ReorderParticles(const std::vector<int>& order)
+{
+	int numParticles = GetNumParticles();
+	std::vector<int> newIndices;
+	GetNewParticleIndices(order, newIndices);
+	std::vector<Vec2> restPositions(numParticles);
+	std::vector<Vec2> uvs(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		restPositions[newIndices[i]] = m_restPositions[i];
+		uvs[newIndices[i]] = m_uvs[i];
+	}
+	m_restPositions.swap(restPositions);
+	m_uvs.swap(uvs);
+	for (int i = 0; i < m_triangleIndices.size(); i++)
+	{
+		m_triangleIndices[i] = newIndices[m_triangleIndices[i]];
+	}
+	RemapConstraintParticles(m_constraints, newIndices);
+	for (int i = 0; i < m_constraints.size(); i++)
+	{
+		DistanceConstraint& constraint = m_constraints[i];
+		if (constraint.particleIndexB < constraint.particleIndexA)
+		{
+			std::swap(constraint.particleIndexA, constraint.particleIndexB);
+		}
+	}
+	std::sort(m_constraints.begin(), m_constraints.end(), [](const DistanceConstraint& a, const DistanceConstraint& b)
+	{
+		return (a.particleIndexA != b.particleIndexA) ? a.particleIndexA < b.particleIndexA : a.particleIndexB < b.particleIndexB;
+	});
+}
+
+void ClothMeshTopology::ColorConstraints()
+{
+	//greedy edge colouring in particle order: a link takes the lowest colour neither of its particles has a link in yet. That needs
+	//at most twice the largest number of links on one particle minus one colours, a bit per colour limits it to 32 links per particle
+	int numConstraints = (int)m_constraints.size();
+	std::vector<uint64_t> usedColors(GetNumParticles(), 0);
+	std::vector<int> constraintColors(numConstraints);
+	int numColors = 0;
+	for (int i = 0; i < numConstraints; i++)
+	{
+		uint32_t particleA = m_constraints[i].particleIndexA;
+		uint32_t particleB = m_constraints[i].particleIndexB;
+		uint64_t takenColors = usedColors[particleA] | usedColors[particleB];
+		GUARANTEE_OR_DIE(takenColors != ~0ull, "Cloth mesh has a particle with more than 32 links");
+		int color = 0;
+		while ((takenColors >> color) & 1ull)
+		{
+			color++;
+		}
+		usedColors[particleA] |= 1ull << color;
+		usedColors[particleB] |= 1ull << color;
+		constraintColors[i] = color;
+		numColors = (color + 1 > numColors) ? color + 1 : numColors;
+	}
+
+	//counting sort by colour keeps the particle order inside every colour
+	m_colorStarts.assign(numColors + 1, 0);
+	for (int i = 0; i < numConstraints; i++)
+	{
+		m_colorStarts[constraintColors[i] + 1]++;
+	}
+	for (int color = 0; color < numColors; color++)
+	{
+		m_colorStarts[color + 1] += m_colorStarts[color];
+	}
+	std::vector<int> colorCursors(m_colorStarts.begin(), m_colorStarts.end() - 1);
+	std::vector<DistanceConstraint> coloredConstraints(numConstraints);
+	for (int i = 0; i < numConstraints; i++)
+	{
+		coloredConstraints[colorCursors[constraintColors[i]]++] = m_constraints[i];
+	}
+	m_constraints.swap(coloredConstraints);
+}
+
+int ClothMeshTopology::GetBandwidth() const
+{
+	int bandwidth = 0;
+	for (int i = 0; i < m_constraints.size(); i++)
+	{
+		int indexDistance = abs((int)m_constraints[i].particleIndexA - (int)m_constraints[i].particleIndexB);
+		bandwidth = (indexDistance > bandwidth) ? indexDistance : bandwidth;
+	}
+	return bandwidth;
+}
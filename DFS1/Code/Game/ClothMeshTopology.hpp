@@ -0,0 +1,54 @@
+#pragma once
+#include "Game/ParticleSystem.hpp"
+#include "Engine/Math/AABB2.hpp"
+#include "Engine/Core/Vertex_PNCU.hpp"
+#include <vector>
+
+enum class ClothMeshParticleOrder
+{
+	AS_IMPORTED, //the order the triangles first use the particles in
+	REVERSE_CUTHILL_MCKEE, //the two ends of a link close in memory, gives the smallest bandwidth
+	MORTON, //particles close in space close in memory, along a Z-order curve through the rest pose
+	NUM_PARTICLE_ORDERS
+};
+
+//the ClothTopology of a cloth of any shape: built once from a triangle mesh and only read afterwards, so any number of MeshCloth
+//instances can share it. Mesh vertices on the same position are welded into one particle and every triangle edge becomes a link.
+//The particles are renumbered (reverse Cuthill-McKee by default) so the two ends of a link sit close in memory, and the links are
+//split into colours whose links never share a particle for the parallel solvers
+class ClothMeshTopology
+{
+public:
+	//x and y of the vertices are the rest positions, z is dropped. Particles within pinHeight of the top of the mesh are pinned
+	ClothMeshTopology(const std::vector<Vertex_PNCU>& vertices, const std::vector<unsigned int>& triangleIndices, float pinHeight,
+		ClothMeshParticleOrder particleOrder = ClothMeshParticleOrder::REVERSE_CUTHILL_MCKEE);
+	ClothMeshTopology(const ClothMeshTopology& copyFrom) = delete;
+	int GetNumParticles() const { return (int)m_restPositions.size(); }
+	int GetNumColors() const { return (int)m_colorStarts.size() - 1; }
+	AABB2 GetRestBounds() const;
+
+public:
+	std::vector<Vec2> m_restPositions;
+	std::vector<Vec2> m_uvs;
+	std::vector<float> m_masses;
+	std::vector<int> m_pinnedParticles;
+	//three particle indices per triangle, welded triangles that collapsed to a line or a point are dropped
+	std::vector<int> m_triangleIndices;
+	//laid out colour by colour, colour c is [m_colorStarts[c], m_colorStarts[c + 1]) and ordered by particle index inside
+	std::vector<DistanceConstraint> m_constraints;
+	std::vector<int> m_colorStarts;
+	//largest index distance between the two particles of a link in the order the mesh came in, and after the renumbering
+	int m_importedBandwidth = 0;
+	int m_bandwidth = 0;
+
+private:
+	void WeldVertices(const std::vector<Vertex_PNCU>& vertices, const std::vector<unsigned int>& triangleIndices);
+	void InitializeConstraints();
+	void InitializeMasses();
+	void InitializePins(float pinHeight);
+	void GetReverseCuthillMcKeeOrder(std::vector<int>& out_order) const;
+	//particle order[i] becomes particle i, the links are sorted by their lower particle index again
+	void ReorderParticles(const std::vector<int>& order);
+	void ColorConstraints();
+	int GetBandwidth() const;
+};
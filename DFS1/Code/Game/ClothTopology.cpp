@@ -0,0 +1,297 @@
+#include <algorithm>
+#include "Game/ClothTopology.hpp"
+
+constexpr float errorRoom = 0.3f;
+constexpr float clothTotalMass = 2000.f;
+
+static void BuildGridLineSamples(const std::vector<int>& lines, int numFullResolutionLines, std::vector<ClothGridLineSample>& out_samples)
+{
+	//walks the full resolution lines and the kept lines side by side, the last cell also takes the last line
+	int numLines = (int)lines.size();
+	out_samples.resize(numFullResolutionLines);
+	int cellIndex = 0;
+	for (int fullResolutionLine = 0; fullResolutionLine < numFullResolutionLines; fullResolutionLine++)
+	{
+		while (cellIndex + 2 < numLines && lines[cellIndex + 1] <= fullResolutionLine)
+		{
+			cellIndex++;
+		}
+		int startLine = lines[cellIndex];
+		int endLine = (cellIndex + 1 < numLines) ? lines[cellIndex + 1] : startLine;
+		ClothGridLineSample& sample = out_samples[fullResolutionLine];
+		sample.m_cellIndex = cellIndex;
+		sample.m_fraction = (endLine > startLine) ? (float)(fullResolutionLine - startLine) / (float)(endLine - startLine) : 0.f;
+		sample.m_lineIndex = (fullResolutionLine == startLine) ? cellIndex : ((fullResolutionLine == endLine) ? cellIndex + 1 : -1);
+	}
+}
+
+ClothTopology::ClothTopology(IntVec2 gridCoords, Vec2 linkLength, ClothMassType weightType)
+	:m_gridCoords(gridCoords), m_linkLength(linkLength), m_fullResolutionGridCoords(gridCoords)
+{
+	for (int x = 0; x < m_gridCoords.x; x++)
+	{
+		m_fullResolutionColumns.push_back(x);
+	}
+	for (int y = 0; y < m_gridCoords.y; y++)
+	{
+		m_fullResolutionRows.push_back(y);
+	}
+	InitializeParticles(weightType);
+	InitializeConstraints();
+	InitializeGridLineSamples();
+
+	for (int i = 0; i < m_gridCoords.x; i++)
+	{
+		if (i % 10 == 0 || i == m_gridCoords.x - 1)
+			m_pinnedParticles.push_back(i);
+	}
+
+	for (int levelOfDetail = 1; levelOfDetail < NUM_CLOTH_LEVELS_OF_DETAIL; levelOfDetail++)
+	{
+		m_coarserLevelsOfDetail.push_back(new ClothTopology(*this, levelOfDetail));
+	}
+}
+
+ClothTopology::ClothTopology(const ClothTopology& fullResolution, int levelOfDetail)
+	:m_linkLength(fullResolution.m_linkLength), m_levelOfDetail(levelOfDetail), m_fullResolutionGridCoords(fullResolution.m_gridCoords)
+{
+	//keep every stride-th row and column, plus the last ones so the cloth keeps its size and the ones through pinned particles so
+	//every pin still has a particle to hold
+	int stride = 1 << levelOfDetail;
+	std::vector<bool> isColumnKept(m_fullResolutionGridCoords.x, false);
+	std::vector<bool> isRowKept(m_fullResolutionGridCoords.y, false);
+	for (int x = 0; x < m_fullResolutionGridCoords.x; x++)
+	{
+		isColumnKept[x] = (x % stride == 0) || (x == m_fullResolutionGridCoords.x - 1);
+	}
+	for (int y = 0; y < m_fullResolutionGridCoords.y; y++)
+	{
+		isRowKept[y] = (y % stride == 0) || (y == m_fullResolutionGridCoords.y - 1);
+	}
+	for (int i = 0; i < fullResolution.m_pinnedParticles.size(); i++)
+	{
+		isColumnKept[fullResolution.m_pinnedParticles[i] % m_fullResolutionGridCoords.x] = true;
+		isRowKept[fullResolution.m_pinnedParticles[i] / m_fullResolutionGridCoords.x] = true;
+	}
+	for (int x = 0; x < m_fullResolutionGridCoords.x; x++)
+	{
+		if (isColumnKept[x])
+			m_fullResolutionColumns.push_back(x);
+	}
+	for (int y = 0; y < m_fullResolutionGridCoords.y; y++)
+	{
+		if (isRowKept[y])
+			m_fullResolutionRows.push_back(y);
+	}
+	m_gridCoords = IntVec2((int)m_fullResolutionColumns.size(), (int)m_fullResolutionRows.size());
+
+	InitializeLevelOfDetailParticles(fullResolution);
+	InitializeConstraints();
+	InitializeGridLineSamples();
+	for (int i = 0; i < fullResolution.m_pinnedParticles.size(); i++)
+	{
+		int pinnedParticleIndex = fullResolution.m_pinnedParticles[i];
+		IntVec2 fullResolutionGridCoords(pinnedParticleIndex % m_fullResolutionGridCoords.x, pinnedParticleIndex / m_fullResolutionGridCoords.x);
+		m_pinnedParticles.push_back(GetIndexForFullResolutionPoint(fullResolutionGridCoords));
+	}
+}
+
+ClothTopology::~ClothTopology()
+{
+	for (int i = 0; i < m_coarserLevelsOfDetail.size(); i++)
+	{
+		delete m_coarserLevelsOfDetail[i];
+	}
+	m_coarserLevelsOfDetail.clear();
+}
+
+int ClothTopology::GetIndexForPointFromGridCoordinates(const IntVec2& gridCoords) const
+{
+	return gridCoords.x + (gridCoords.y * m_gridCoords.x);
+}
+
+const ClothTopology* ClothTopology::GetLevelOfDetail(int levelOfDetail) const
+{
+	if (levelOfDetail <= 0 || m_coarserLevelsOfDetail.empty())
+		return this;
+
+	int coarserLevelIndex = (levelOfDetail - 1 < (int)m_coarserLevelsOfDetail.size()) ? levelOfDetail - 1 : (int)m_coarserLevelsOfDetail.size() - 1;
+	return m_coarserLevelsOfDetail[coarserLevelIndex];
+}
+
+int ClothTopology::GetIndexForFullResolutionPoint(const IntVec2& fullResolutionGridCoords) const
+{
+	int column = m_columnSamples[fullResolutionGridCoords.x].m_lineIndex;
+	int row = m_rowSamples[fullResolutionGridCoords.y].m_lineIndex;
+	if (column < 0 || row < 0)
+		return -1;
+
+	return GetIndexForPointFromGridCoordinates(IntVec2(column, row));
+}
+
+Vec2 ClothTopology::GetRestDimensions() const
+{
+	return Vec2((m_fullResolutionGridCoords.x - 1) * m_linkLength.x, (m_fullResolutionGridCoords.y - 1) * m_linkLength.y);
+}
+
+void ClothTopology::InitializeParticles(ClothMassType weightType)
+{
+	float topToBottomMassSplitFactor = 0.5f;
+	if (weightType == ClothMassType::TOP_HEAVY)
+		topToBottomMassSplitFactor = 0.75f;
+	else if (weightType == ClothMassType::BOTTOM_HEAVY)
+		topToBottomMassSplitFactor = 0.25f;
+
+	float totalMassOfTopPoints = clothTotalMass * topToBottomMassSplitFactor;
+	float totalMassOfBottomPoints = clothTotalMass - totalMassOfTopPoints;
+	int numberOfTopPoints = (m_gridCoords.y / 2) * m_gridCoords.x;
+	float massOfEachTopPoint = totalMassOfTopPoints / float(numberOfTopPoints);
+	int numberOfBottomPoints = (m_gridCoords.x * m_gridCoords.y) - numberOfTopPoints;
+	float massOfEachBottomPoint = totalMassOfBottomPoints / numberOfBottomPoints;
+
+	m_restOffsets.reserve(m_gridCoords.x * m_gridCoords.y);
+	m_masses.reserve(m_gridCoords.x * m_gridCoords.y);
+	for (int y = 0; y < m_gridCoords.y; y++)
+	{
+		for (int x = 0; x < m_gridCoords.x; x++)
+		{
+			m_restOffsets.push_back(Vec2(x * m_linkLength.x, -y * m_linkLength.y));
+			m_masses.push_back((y < int(m_gridCoords.y / 2)) ? massOfEachTopPoint : massOfEachBottomPoint);
+		}
+	}
+}
+
+void ClothTopology::InitializeLevelOfDetailParticles(const ClothTopology& fullResolution)
+{
+	//every particle stands in for the full resolution particles closest to it and takes their mass: half of the lines to each
+	//neighbouring kept line, plus half of its own line at the edges where there is no neighbour on one side
+	m_restOffsets.reserve(m_gridCoords.x * m_gridCoords.y);
+	m_masses.reserve(m_gridCoords.x * m_gridCoords.y);
+	for (int y = 0; y < m_gridCoords.y; y++)
+	{
+		int fullResolutionRow = m_fullResolutionRows[y];
+		int rowsAbove = (y > 0) ? fullResolutionRow - m_fullResolutionRows[y - 1] : 1;
+		int rowsBelow = (y < m_gridCoords.y - 1) ? m_fullResolutionRows[y + 1] - fullResolutionRow : 1;
+		for (int x = 0; x < m_gridCoords.x; x++)
+		{
+			int fullResolutionColumn = m_fullResolutionColumns[x];
+			int columnsLeft = (x > 0) ? fullResolutionColumn - m_fullResolutionColumns[x - 1] : 1;
+			int columnsRight = (x < m_gridCoords.x - 1) ? m_fullResolutionColumns[x + 1] - fullResolutionColumn : 1;
+			float numRepresentedParticles = 0.25f * (float)((columnsLeft + columnsRight) * (rowsAbove + rowsBelow));
+			int fullResolutionIndex = fullResolution.GetIndexForPointFromGridCoordinates(IntVec2(fullResolutionColumn, fullResolutionRow));
+			m_restOffsets.push_back(fullResolution.m_restOffsets[fullResolutionIndex]);
+			m_masses.push_back(fullResolution.m_masses[fullResolutionIndex] * numRepresentedParticles);
+		}
+	}
+}
+
+void ClothTopology::InitializeConstraints()
+{
+	//a link of a coarser level spans several full resolution links
+	m_horizontalRestLengths.resize((m_gridCoords.x > 1) ? m_gridCoords.x - 1 : 0);
+	m_verticalRestLengths.resize((m_gridCoords.y > 1) ? m_gridCoords.y - 1 : 0);
+	for (int x = 0; x < m_gridCoords.x - 1; x++)
+	{
+		int numSpannedLinks = m_fullResolutionColumns[x + 1] - m_fullResolutionColumns[x];
+		m_horizontalRestLengths[x] = (m_linkLength.x - errorRoom) * (float)numSpannedLinks;
+	}
+	for (int y = 0; y < m_gridCoords.y - 1; y++)
+	{
+		int numSpannedLinks = m_fullResolutionRows[y + 1] - m_fullResolutionRows[y];
+		m_verticalRestLengths[y] = (m_linkLength.y - errorRoom) * (float)numSpannedLinks;
+	}
+
+	//initialize stick constraints
+	for (int y = 0; y < m_gridCoords.y; y++)
+	{
+		for (int x = 0; x < m_gridCoords.x; x++)
+		{
+			int indexOfAdjacentEastPoint = 0;
+			int indexOfAdjacentSouthPoint = 0;
+			//no east link for the last point
+			if (x < m_gridCoords.x - 1)
+			{
+				//constraint from current point to the point on east of it.
+				DistanceConstraint constraintA;
+				constraintA.particleIndexA = (uint32_t)GetIndexForPointFromGridCoordinates(IntVec2(x, y));
+				indexOfAdjacentEastPoint = GetIndexForPointFromGridCoordinates(IntVec2(x, y) + IntVec2(1, 0));
+				if (indexOfAdjacentEastPoint < GetNumParticles())
+				{
+					constraintA.particleIndexB = (uint32_t)indexOfAdjacentEastPoint;
+					constraintA.restLength = m_horizontalRestLengths[x];
+					constraintA.originalRestLength = constraintA.restLength;
+					m_horizontalConstraints.push_back(constraintA);
+				}
+			}
+
+			//constraint from current point to the point on south of it.
+			DistanceConstraint constraintB;
+			constraintB.particleIndexA = (uint32_t)GetIndexForPointFromGridCoordinates(IntVec2(x, y));
+			indexOfAdjacentSouthPoint = GetIndexForPointFromGridCoordinates(IntVec2(x, y) + IntVec2(0, 1));
+			if (indexOfAdjacentSouthPoint < GetNumParticles())
+			{
+				constraintB.particleIndexB = (uint32_t)indexOfAdjacentSouthPoint;
+				constraintB.restLength = m_verticalRestLengths[y];
+				constraintB.originalRestLength = constraintB.restLength;
+				m_verticalConstraints.push_back(constraintB);
+			}
+		}
+	}
+
+	//group the constraints into the 4 independent sets of the grid (even/odd columns for horizontal links, even/odd rows for
+	//vertical links). Serial gauss seidel then walks the same red-black order that the parallel solver uses.
+	std::stable_partition(m_horizontalConstraints.begin(), m_horizontalConstraints.end(),
+		[this](const DistanceConstraint& constraint) { return IsHorizontalConstraintEvenColor(constraint); });
+	std::stable_partition(m_verticalConstraints.begin(), m_verticalConstraints.end(),
+		[this](const DistanceConstraint& constraint) { return IsVerticalConstraintEvenColor(constraint); });
+	UpdateConstraintColorRanges();
+	InitializeConstraintSlots();
+}
+
+void ClothTopology::InitializeConstraintSlots()
+{
+	int numParticles = GetNumParticles();
+	m_horizontalConstraintSlots.assign(numParticles, -1);
+	m_verticalConstraintSlots.assign(numParticles, -1);
+	for (int i = 0; i < m_horizontalConstraints.size(); i++)
+	{
+		m_horizontalConstraintSlots[m_horizontalConstraints[i].particleIndexA] = i;
+	}
+	for (int i = 0; i < m_verticalConstraints.size(); i++)
+	{
+		m_verticalConstraintSlots[m_verticalConstraints[i].particleIndexA] = i;
+	}
+}
+
+void ClothTopology::InitializeGridLineSamples()
+{
+	BuildGridLineSamples(m_fullResolutionColumns, m_fullResolutionGridCoords.x, m_columnSamples);
+	BuildGridLineSamples(m_fullResolutionRows, m_fullResolutionGridCoords.y, m_rowSamples);
+}
+
+void ClothTopology::UpdateConstraintColorRanges()
+{
+	m_numEvenHorizontalConstraints = 0;
+	while (m_numEvenHorizontalConstraints < m_horizontalConstraints.size() && IsHorizontalConstraintEvenColor(m_horizontalConstraints[m_numEvenHorizontalConstraints]))
+	{
+		m_numEvenHorizontalConstraints++;
+	}
+
+	m_numEvenVerticalConstraints = 0;
+	while (m_numEvenVerticalConstraints < m_verticalConstraints.size() && IsVerticalConstraintEvenColor(m_verticalConstraints[m_numEvenVerticalConstraints]))
+	{
+		m_numEvenVerticalConstraints++;
+	}
+}
+
+bool ClothTopology::IsHorizontalConstraintEvenColor(const DistanceConstraint& constraint) const
+{
+	int column = (int)constraint.particleIndexA % m_gridCoords.x;
+	return (column % 2) == 0;
+}
+
+bool ClothTopology::IsVerticalConstraintEvenColor(const DistanceConstraint& constraint) const
+{
+	int row = (int)constraint.particleIndexA / m_gridCoords.x;
+	return (row % 2) == 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "Game/ParticleSystem.hpp"
+#include "Engine/Math/IntVec2.hpp"
+#include <vector>
+
+enum class ClothMassType
+{
+	TOP_HEAVY,
+	BOTTOM_HEAVY,
+	UNIFORM
+};
+
+//level 0 is the full resolution grid, every further level keeps only every 2nd row and column of the one before
+constexpr int NUM_CLOTH_LEVELS_OF_DETAIL = 3;
+
+//where a row or column of the full resolution grid falls on the grid of a level of detail: m_fraction of the way from the level's
+//line m_cellIndex to line m_cellIndex + 1. m_lineIndex is the level's own line when the two coincide, -1 otherwise
+struct ClothGridLineSample
+{
+	int m_cellIndex = 0;
+	float m_fraction = 0.f;
+	int m_lineIndex = -1;
+};
+
+//everything identical cloths have in common: the grid, the rest pose, masses and pins, and the coloured link arrays with the
+//per particle link slots. It is built once and only read afterwards, so any number of cloth instances can share one and be
+//stepped on different threads. An instance copies the links the first time it changes them (tearing, compliance). The coarser
+//levels of detail are topologies of their own, so an instance switches level by switching the topology it simulates
+class ClothTopology
+{
+public:
+	ClothTopology(IntVec2 gridCoords, Vec2 linkLength, ClothMassType weightType);
+	ClothTopology(const ClothTopology& copyFrom) = delete;
+	~ClothTopology();
+	int GetNumParticles() const { return (int)m_restOffsets.size(); }
+	int GetIndexForPointFromGridCoordinates(const IntVec2& gridCoords) const;
+	//the coarser versions of this grid are built with it and share its lifetime, level 0 is this topology
+	const ClothTopology* GetLevelOfDetail(int levelOfDetail) const;
+	//index of the particle of this level that sits on a full resolution grid point, -1 if the level skipped that point
+	int GetIndexForFullResolutionPoint(const IntVec2& fullResolutionGridCoords) const;
+	//distance from the top left to the bottom right particle in the rest pose
+	Vec2 GetRestDimensions() const;
+
+public:
+	IntVec2 m_gridCoords = IntVec2::ZERO;
+	//distance between neighbouring points of the full resolution grid, on every level
+	Vec2 m_linkLength = Vec2::ZERO;
+	int m_levelOfDetail = 0;
+	IntVec2 m_fullResolutionGridCoords = IntVec2::ZERO;
+	//full resolution column (row) each column (row) of this grid was taken from
+	std::vector<int> m_fullResolutionColumns;
+	std::vector<int> m_fullResolutionRows;
+	//one per full resolution column (row), used to upsample this grid back to full resolution
+	std::vector<ClothGridLineSample> m_columnSamples;
+	std::vector<ClothGridLineSample> m_rowSamples;
+	//rest position of every particle relative to the top left particle, rows go down from it
+	std::vector<Vec2> m_restOffsets;
+	std::vector<float> m_masses;
+	std::vector<int> m_pinnedParticles;
+	//every link of a column (row) has the same rest length, the east links of column x and the south links of row y
+	std::vector<float> m_horizontalRestLengths;
+	std::vector<float> m_verticalRestLengths;
+	//laid out as [even colour | odd colour], constraints within a colour never share a particle
+	std::vector<DistanceConstraint> m_horizontalConstraints;
+	std::vector<DistanceConstraint> m_verticalConstraints;
+	int m_numEvenHorizontalConstraints = 0;
+	int m_numEvenVerticalConstraints = 0;
+	//slot of the east (horizontal) and south (vertical) link each particle owns in the constraint arrays, -1 if it has none
+	std::vector<int> m_horizontalConstraintSlots;
+	std::vector<int> m_verticalConstraintSlots;
+
+private:
+	ClothTopology(const ClothTopology& fullResolution, int levelOfDetail);
+	void InitializeParticles(ClothMassType weightType);
+	void InitializeLevelOfDetailParticles(const ClothTopology& fullResolution);
+	void InitializeGridLineSamples();
+	void InitializeConstraints();
+	void InitializeConstraintSlots();
+	void UpdateConstraintColorRanges();
+	bool IsHorizontalConstraintEvenColor(const DistanceConstraint& constraint) const;
+	bool IsVerticalConstraintEvenColor(const DistanceConstraint& constraint) const;
+
+private:
+	std::vector<ClothTopology*> m_coarserLevelsOfDetail;
+};
@@ -0,0 +1,294 @@
+#include "Game/ColliderSet.hpp"
+#include "Game/ParticleKernels.hpp"
+#include "Game/SignedDistanceField.hpp"
+#include <math.h>
+
+//bounds test shared by every shape, touching bounds do not overlap since the kernels only push particles that are strictly closer than their radius
+static bool DoBoundsOverlap(float minX, float minY, float maxX, float maxY, const AABB2& queryBounds)
+{
+	return minX < queryBounds.m_maxs.x && queryBounds.m_mins.x < maxX && minY < queryBounds.m_maxs.y && queryBounds.m_mins.y < maxY;
+}
+
+void ColliderQuery::Clear()
+{
+	m_discIndices.clear();
+	m_boxIndices.clear();
+	m_orientedBoxIndices.clear();
+	m_capsuleIndices.clear();
+	m_signedDistanceFieldIndices.clear();
+}
+
+bool ColliderQuery::IsEmpty() const
+{
+	return m_discIndices.empty() && m_boxIndices.empty() && m_orientedBoxIndices.empty() && m_capsuleIndices.empty() && m_signedDistanceFieldIndices.empty();
+}
+
+int ColliderSet::AddDisc(const Vec2& center, float radius)
+{
+	m_discCentersX.push_back(0.f);
+	m_discCentersY.push_back(0.f);
+	m_discRadii.push_back(0.f);
+	m_discPreviousCentersX.push_back(center.x);
+	m_discPreviousCentersY.push_back(center.y);
+	int discIndex = GetNumDiscs() - 1;
+	SetDisc(discIndex, center, radius);
+	return discIndex;
+}
+
+int ColliderSet::AddAABB2(const AABB2& box)
+{
+	m_boxMinsX.push_back(0.f);
+	m_boxMinsY.push_back(0.f);
+	m_boxMaxsX.push_back(0.f);
+	m_boxMaxsY.push_back(0.f);
+	m_boxPreviousCentersX.push_back(box.GetCenter().x);
+	m_boxPreviousCentersY.push_back(box.GetCenter().y);
+	int boxIndex = GetNumAABB2s() - 1;
+	SetAABB2(boxIndex, box);
+	return boxIndex;
+}
+
+int ColliderSet::AddOBB2(const OBB2& orientedBox)
+{
+	m_orientedBoxCentersX.push_back(0.f);
+	m_orientedBoxCentersY.push_back(0.f);
+	m_orientedBoxIBasisX.push_back(0.f);
+	m_orientedBoxIBasisY.push_back(0.f);
+	m_orientedBoxHalfWidths.push_back(0.f);
+	m_orientedBoxHalfHeights.push_back(0.f);
+	int orientedBoxIndex = GetNumOBB2s() - 1;
+	SetOBB2(orientedBoxIndex, orientedBox);
+	return orientedBoxIndex;
+}
+
+int ColliderSet::AddCapsule2(const Capsule2& capsule)
+{
+	m_capsuleStartsX.push_back(0.f);
+	m_capsuleStartsY.push_back(0.f);
+	m_capsuleEndsX.push_back(0.f);
+	m_capsuleEndsY.push_back(0.f);
+	m_capsuleRadii.push_back(0.f);
+	int capsuleIndex = GetNumCapsule2s() - 1;
+	SetCapsule2(capsuleIndex, capsule);
+	return capsuleIndex;
+}
+
+int ColliderSet::AddSignedDistanceField(const SignedDistanceField* field)
+{
+	m_signedDistanceFields.push_back(field);
+	return GetNumSignedDistanceFields() - 1;
+}
+
+void ColliderSet::SetDisc(int discIndex, const Vec2& center, float radius)
+{
+	m_discCentersX[discIndex] = center.x;
+	m_discCentersY[discIndex] = center.y;
+	m_discRadii[discIndex] = radius;
+}
+
+void ColliderSet::SetAABB2(int boxIndex, const AABB2& box)
+{
+	m_boxMinsX[boxIndex] = box.m_mins.x;
+	m_boxMinsY[boxIndex] = box.m_mins.y;
+	m_boxMaxsX[boxIndex] = box.m_maxs.x;
+	m_boxMaxsY[boxIndex] = box.m_maxs.y;
+}
+
+void ColliderSet::SetOBB2(int orientedBoxIndex, const OBB2& orientedBox)
+{
+	m_orientedBoxCentersX[orientedBoxIndex] = orientedBox.m_center.x;
+	m_orientedBoxCentersY[orientedBoxIndex] = orientedBox.m_center.y;
+	m_orientedBoxIBasisX[orientedBoxIndex] = orientedBox.m_iBasisNormal.x;
+	m_orientedBoxIBasisY[orientedBoxIndex] = orientedBox.m_iBasisNormal.y;
+	m_orientedBoxHalfWidths[orientedBoxIndex] = orientedBox.m_halfDimensions.x;
+	m_orientedBoxHalfHeights[orientedBoxIndex] = orientedBox.m_halfDimensions.y;
+}
+
+void ColliderSet::SetCapsule2(int capsuleIndex, const Capsule2& capsule)
+{
+	m_capsuleStartsX[capsuleIndex] = capsule.m_bone.m_start.x;
+	m_capsuleStartsY[capsuleIndex] = capsule.m_bone.m_start.y;
+	m_capsuleEndsX[capsuleIndex] = capsule.m_bone.m_end.x;
+	m_capsuleEndsY[capsuleIndex] = capsule.m_bone.m_end.y;
+	m_capsuleRadii[capsuleIndex] = capsule.m_radius;
+}
+
+void ColliderSet::Clear()
+{
+	m_discCentersX.clear();
+	m_discCentersY.clear();
+	m_discRadii.clear();
+	m_discPreviousCentersX.clear();
+	m_discPreviousCentersY.clear();
+	m_boxMinsX.clear();
+	m_boxMinsY.clear();
+	m_boxMaxsX.clear();
+	m_boxMaxsY.clear();
+	m_boxPreviousCentersX.clear();
+	m_boxPreviousCentersY.clear();
+	m_orientedBoxCentersX.clear();
+	m_orientedBoxCentersY.clear();
+	m_orientedBoxIBasisX.clear();
+	m_orientedBoxIBasisY.clear();
+	m_orientedBoxHalfWidths.clear();
+	m_orientedBoxHalfHeights.clear();
+	m_capsuleStartsX.clear();
+	m_capsuleStartsY.clear();
+	m_capsuleEndsX.clear();
+	m_capsuleEndsY.clear();
+	m_capsuleRadii.clear();
+	m_signedDistanceFields.clear();
+}
+
+void ColliderSet::StorePreviousPoses()
+{
+	m_discPreviousCentersX = m_discCentersX;
+	m_discPreviousCentersY = m_discCentersY;
+	for (int i = 0; i < GetNumAABB2s(); i++)
+	{
+		m_boxPreviousCentersX[i] = (m_boxMinsX[i] + m_boxMaxsX[i]) * 0.5f;
+		m_boxPreviousCentersY[i] = (m_boxMinsY[i] + m_boxMaxsY[i]) * 0.5f;
+	}
+}
+
+int ColliderSet::GetNumColliders() const
+{
+	return GetNumDiscs() + GetNumAABB2s() + GetNumOBB2s() + GetNumCapsule2s() + GetNumSignedDistanceFields();
+}
+
+AABB2 ColliderSet::GetAABB2(int boxIndex) const
+{
+	return AABB2(m_boxMinsX[boxIndex], m_boxMinsY[boxIndex], m_boxMaxsX[boxIndex], m_boxMaxsY[boxIndex]);
+}
+
+OBB2 ColliderSet::GetOBB2(int orientedBoxIndex) const
+{
+	OBB2 orientedBox;
+	orientedBox.m_center = Vec2(m_orientedBoxCentersX[orientedBoxIndex], m_orientedBoxCentersY[orientedBoxIndex]);
+	orientedBox.m_iBasisNormal = Vec2(m_orientedBoxIBasisX[orientedBoxIndex], m_orientedBoxIBasisY[orientedBoxIndex]);
+	orientedBox.m_halfDimensions = Vec2(m_orientedBoxHalfWidths[orientedBoxIndex], m_orientedBoxHalfHeights[orientedBoxIndex]);
+	return orientedBox;
+}
+
+Capsule2 ColliderSet::GetCapsule2(int capsuleIndex) const
+{
+	Capsule2 capsule;
+	capsule.m_bone = LineSegment2(Vec2(m_capsuleStartsX[capsuleIndex], m_capsuleStartsY[capsuleIndex]), Vec2(m_capsuleEndsX[capsuleIndex], m_capsuleEndsY[capsuleIndex]));
+	capsule.m_radius = m_capsuleRadii[capsuleIndex];
+	return capsule;
+}
+
+void ColliderSet::FindCollidersOverlapping(const AABB2& bounds, float particleRadius, ColliderQuery& out_query) const
+{
+	out_query.Clear();
+	AABB2 queryBounds = bounds.GetPaddedBox(-particleRadius, -particleRadius, -particleRadius, -particleRadius);
+
+	//discs and boxes are tested with the bounds of their whole sweep
+	for (int i = 0; i < GetNumDiscs(); i++)
+	{
+		float radius = m_discRadii[i];
+		float motionX = m_discCentersX[i] - m_discPreviousCentersX[i];
+		float motionY = m_discCentersY[i] - m_discPreviousCentersY[i];
+		float minX = m_discCentersX[i] - radius - (motionX > 0.f ? motionX : 0.f);
+		float minY = m_discCentersY[i] - radius - (motionY > 0.f ? motionY : 0.f);
+		float maxX = m_discCentersX[i] + radius - (motionX < 0.f ? motionX : 0.f);
+		float maxY = m_discCentersY[i] + radius - (motionY < 0.f ? motionY : 0.f);
+		if (DoBoundsOverlap(minX, minY, maxX, maxY, queryBounds))
+		{
+			out_query.m_discIndices.push_back(i);
+		}
+	}
+
+	for (int i = 0; i < GetNumAABB2s(); i++)
+	{
+		float motionX = (m_boxMinsX[i] + m_boxMaxsX[i]) * 0.5f - m_boxPreviousCentersX[i];
+		float motionY = (m_boxMinsY[i] + m_boxMaxsY[i]) * 0.5f - m_boxPreviousCentersY[i];
+		float minX = m_boxMinsX[i] - (motionX > 0.f ? motionX : 0.f);
+		float minY = m_boxMinsY[i] - (motionY > 0.f ? motionY : 0.f);
+		float maxX = m_boxMaxsX[i] - (motionX < 0.f ? motionX : 0.f);
+		float maxY = m_boxMaxsY[i] - (motionY < 0.f ? motionY : 0.f);
+		if (DoBoundsOverlap(minX, minY, maxX, maxY, queryBounds))
+		{
+			out_query.m_boxIndices.push_back(i);
+		}
+	}
+
+	for (int i = 0; i < GetNumOBB2s(); i++)
+	{
+		//extents of the rotated box along the world axes
+		float iBasisX = fabsf(m_orientedBoxIBasisX[i]);
+		float iBasisY = fabsf(m_orientedBoxIBasisY[i]);
+		float halfExtentX = iBasisX * m_orientedBoxHalfWidths[i] + iBasisY * m_orientedBoxHalfHeights[i];
+		float halfExtentY = iBasisY * m_orientedBoxHalfWidths[i] + iBasisX * m_orientedBoxHalfHeights[i];
+		if (DoBoundsOverlap(m_orientedBoxCentersX[i] - halfExtentX, m_orientedBoxCentersY[i] - halfExtentY, m_orientedBoxCentersX[i] + halfExtentX,
+			m_orientedBoxCentersY[i] + halfExtentY, queryBounds))
+		{
+			out_query.m_orientedBoxIndices.push_back(i);
+		}
+	}
+
+	for (int i = 0; i < GetNumCapsule2s(); i++)
+	{
+		float radius = m_capsuleRadii[i];
+		float minX = (m_capsuleStartsX[i] < m_capsuleEndsX[i]) ? m_capsuleStartsX[i] : m_capsuleEndsX[i];
+		float minY = (m_capsuleStartsY[i] < m_capsuleEndsY[i]) ? m_capsuleStartsY[i] : m_capsuleEndsY[i];
+		float maxX = (m_capsuleStartsX[i] < m_capsuleEndsX[i]) ? m_capsuleEndsX[i] : m_capsuleStartsX[i];
+		float maxY = (m_capsuleStartsY[i] < m_capsuleEndsY[i]) ? m_capsuleEndsY[i] : m_capsuleStartsY[i];
+		if (DoBoundsOverlap(minX - radius, minY - radius, maxX + radius, maxY + radius, queryBounds))
+		{
+			out_query.m_capsuleIndices.push_back(i);
+		}
+	}
+
+	for (int i = 0; i < GetNumSignedDistanceFields(); i++)
+	{
+		//the field only acts on particles inside its samples, whatever it holds
+		AABB2 fieldBounds = m_signedDistanceFields[i]->GetBounds();
+		if (!m_signedDistanceFields[i]->IsEmpty() && DoBoundsOverlap(fieldBounds.m_mins.x, fieldBounds.m_mins.y, fieldBounds.m_maxs.x,
+			fieldBounds.m_maxs.y, queryBounds))
+		{
+			out_query.m_signedDistanceFieldIndices.push_back(i);
+		}
+	}
+}
+
+void ColliderSet::PushParticlesOut(const ColliderQuery& query, float* positionsX, float* positionsY, int numParticles, float particleRadius, bool useSimd) const
+{
+	for (int queryIndex = 0; queryIndex < query.m_discIndices.size(); queryIndex++)
+	{
+		int i = query.m_discIndices[queryIndex];
+		SweepParticlesAgainstDisc(positionsX, positionsY, numParticles, m_discCentersX[i], m_discCentersY[i], m_discRadii[i] + particleRadius,
+			m_discCentersX[i] - m_discPreviousCentersX[i], m_discCentersY[i] - m_discPreviousCentersY[i]);
+		PushParticlesOutOfDisc(positionsX, positionsY, numParticles, m_discCentersX[i], m_discCentersY[i], m_discRadii[i] + particleRadius, useSimd);
+	}
+
+	for (int queryIndex = 0; queryIndex < query.m_boxIndices.size(); queryIndex++)
+	{
+		int i = query.m_boxIndices[queryIndex];
+		float motionX = (m_boxMinsX[i] + m_boxMaxsX[i]) * 0.5f - m_boxPreviousCentersX[i];
+		float motionY = (m_boxMinsY[i] + m_boxMaxsY[i]) * 0.5f - m_boxPreviousCentersY[i];
+		SweepParticlesAgainstAABB2(positionsX, positionsY, numParticles, m_boxMinsX[i], m_boxMinsY[i], m_boxMaxsX[i], m_boxMaxsY[i], particleRadius, motionX, motionY);
+		PushParticlesOutOfAABB2(positionsX, positionsY, numParticles, m_boxMinsX[i], m_boxMinsY[i], m_boxMaxsX[i], m_boxMaxsY[i], particleRadius, useSimd);
+	}
+
+	for (int queryIndex = 0; queryIndex < query.m_orientedBoxIndices.size(); queryIndex++)
+	{
+		int i = query.m_orientedBoxIndices[queryIndex];
+		PushParticlesOutOfOBB2(positionsX, positionsY, numParticles, m_orientedBoxCentersX[i], m_orientedBoxCentersY[i], m_orientedBoxIBasisX[i], m_orientedBoxIBasisY[i],
+			m_orientedBoxHalfWidths[i], m_orientedBoxHalfHeights[i], particleRadius, useSimd);
+	}
+
+	for (int queryIndex = 0; queryIndex < query.m_capsuleIndices.size(); queryIndex++)
+	{
+		int i = query.m_capsuleIndices[queryIndex];
+		PushParticlesOutOfCapsule2(positionsX, positionsY, numParticles, m_capsuleStartsX[i], m_capsuleStartsY[i], m_capsuleEndsX[i], m_capsuleEndsY[i],
+			m_capsuleRadii[i] + particleRadius, useSimd);
+	}
+
+	//one bilinear lookup per particle, the kernel is scalar since every particle gathers from different samples
+	for (int queryIndex = 0; queryIndex < query.m_signedDistanceFieldIndices.size(); queryIndex++)
+	{
+		int i = query.m_signedDistanceFieldIndices[queryIndex];
+		m_signedDistanceFields[i]->PushParticlesOut(positionsX, positionsY, numParticles, particleRadius);
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "Engine/Math/AABB2.hpp"
+#include "Engine/Math/OBB2.hpp"
+#include "Engine/Math/Capsule2.hpp"
+#include <vector>
+
+class SignedDistanceField;
+
+//indices of the colliders of each shape that can reach a group of particles
+struct ColliderQuery
+{
+	std::vector<int> m_discIndices;
+	std::vector<int> m_boxIndices;
+	std::vector<int> m_orientedBoxIndices;
+	std::vector<int> m_capsuleIndices;
+	std::vector<int> m_signedDistanceFieldIndices;
+
+	void Clear();
+	bool IsEmpty() const;
+};
+
+//static colliders that particle systems resolve their particles against. Every shape type keeps its own structure of arrays so a
+//query only walks the fields it tests, and each collider is applied to a whole batch of particles with the SIMD kernels.
+class ColliderSet
+{
+public:
+	int AddDisc(const Vec2& center, float radius);
+	int AddAABB2(const AABB2& box);
+	int AddOBB2(const OBB2& orientedBox);
+	int AddCapsule2(const Capsule2& capsule);
+	//the field is not copied, it has to outlive the set or be removed with Clear
+	int AddSignedDistanceField(const SignedDistanceField* field);
+	void SetDisc(int discIndex, const Vec2& center, float radius);
+	void SetAABB2(int boxIndex, const AABB2& box);
+	void SetOBB2(int orientedBoxIndex, const OBB2& orientedBox);
+	void SetCapsule2(int capsuleIndex, const Capsule2& capsule);
+	void Clear();
+	//remembers the current disc and box poses as the start of the next step's sweep, call once every particle system has been updated
+	void StorePreviousPoses();
+
+	int GetNumColliders() const;
+	int GetNumDiscs() const { return (int)m_discCentersX.size(); }
+	int GetNumAABB2s() const { return (int)m_boxMinsX.size(); }
+	int GetNumOBB2s() const { return (int)m_orientedBoxCentersX.size(); }
+	int GetNumCapsule2s() const { return (int)m_capsuleStartsX.size(); }
+	int GetNumSignedDistanceFields() const { return (int)m_signedDistanceFields.size(); }
+	Vec2 GetDiscCenter(int discIndex) const { return Vec2(m_discCentersX[discIndex], m_discCentersY[discIndex]); }
+	float GetDiscRadius(int discIndex) const { return m_discRadii[discIndex]; }
+	AABB2 GetAABB2(int boxIndex) const;
+	OBB2 GetOBB2(int orientedBoxIndex) const;
+	Capsule2 GetCapsule2(int capsuleIndex) const;
+	const SignedDistanceField* GetSignedDistanceField(int fieldIndex) const { return m_signedDistanceFields[fieldIndex]; }
+
+	//collects the colliders that come within particleRadius of the bounds anywhere along their motion since the previous poses
+	void FindCollidersOverlapping(const AABB2& bounds, float particleRadius, ColliderQuery& out_query) const;
+	//pushes a contiguous range of particles out of the queried colliders, shapes are resolved in the order discs, boxes, oriented boxes, capsules,
+	//signed distance fields.
+	//Moving discs and boxes first sweep the particles from their previous pose so they can not tunnel through them
+	void PushParticlesOut(const ColliderQuery& query, float* positionsX, float* positionsY, int numParticles, float particleRadius, bool useSimd) const;
+
+private:
+	std::vector<float> m_discCentersX;
+	std::vector<float> m_discCentersY;
+	std::vector<float> m_discRadii;
+	std::vector<float> m_discPreviousCentersX;
+	std::vector<float> m_discPreviousCentersY;
+
+	std::vector<float> m_boxMinsX;
+	std::vector<float> m_boxMinsY;
+	std::vector<float> m_boxMaxsX;
+	std::vector<float> m_boxMaxsY;
+	std::vector<float> m_boxPreviousCentersX;
+	std::vector<float> m_boxPreviousCentersY;
+
+	std::vector<float> m_orientedBoxCentersX;
+	std::vector<float> m_orientedBoxCentersY;
+	std::vector<float> m_orientedBoxIBasisX;
+	std::vector<float> m_orientedBoxIBasisY;
+	std::vector<float> m_orientedBoxHalfWidths;
+	std::vector<float> m_orientedBoxHalfHeights;
+
+	std::vector<float> m_capsuleStartsX;
+	std::vector<float> m_capsuleStartsY;
+	std::vector<float> m_capsuleEndsX;
+	std::vector<float> m_capsuleEndsY;
+	std::vector<float> m_capsuleRadii;
+
+	std::vector<const SignedDistanceField*> m_signedDistanceFields;
+};
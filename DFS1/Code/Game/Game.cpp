@@ -11,23 +11,61 @@
 #include "Engine/Core/EventSystem.hpp"
 #include "Engine/Renderer/BitmapFont.hpp"
 #include "Engine/Renderer/Window.hpp"
+#include "Engine/Core/JobSystem.hpp"
+#include "Engine/Core/Image.hpp"
+#include "Engine/Renderer/MeshBuilder.hpp"
 #include "ThirdParty/ImGUI/imgui.h"
 #include "Game/Game.hpp"
 #include "Game/App.hpp"
 #include "Game/Cloth.hpp"
+#include "Game/ClothMeshTopology.hpp"
+#include "Game/MeshCloth.hpp"
 #include "Game/Plant.hpp"
+#include "Game/ParticleKernels.hpp"
+#include "Game/ParticleOrdering.hpp"
+#include <math.h>
 
 extern App* g_theApp;
 extern Renderer* g_theRenderer;
 extern InputSystem* g_theInput;
 extern AudioSystem* g_theAudio;
 extern Window* g_theWindow;
+extern JobSystem* g_theJobSystem;
 
 static float animationTimer = 0.f;
 constexpr float COLLISION_CIRCLE_RADIUS = 7.f;
 constexpr float COLLISION_BOX_WIDTH = 15.f;
 constexpr float COLLISION_BOX_HEIGHT = 10.f;
 constexpr float COLLISION_OBJECT_MOVE_SPEED = 1.f;
+constexpr float CLOTH_TEAR_BRUSH_RADIUS = 2.f;
+constexpr float RANDOM_COLLIDER_MIN_SIZE = 1.f;
+constexpr float RANDOM_COLLIDER_MAX_SIZE = 4.f;
+constexpr float COLLIDER_FIELD_CELL_SIZE = 0.5f;
+constexpr float COLLIDER_FIELD_MAX_DISTANCE = 4.f;
+//plant mode ground: a mask stretched over the bottom GROUND_BOUNDS_HEIGHT of the world, rolling hills and a rock spire right of the
+//second plant that it is pushed into by a strong enough force
+constexpr int GROUND_MASK_WIDTH = 100;
+constexpr int GROUND_MASK_HEIGHT = 35;
+constexpr float GROUND_BOUNDS_HEIGHT = 70.f;
+constexpr float GROUND_BASE_HEIGHT = 12.f;
+constexpr float GROUND_HILL_HEIGHT = 4.f;
+constexpr float GROUND_HILL_FREQUENCY = 0.06f;
+constexpr float GROUND_SPIRE_X = 67.f;
+constexpr float GROUND_SPIRE_TOP = 66.f;
+constexpr float GROUND_SPIRE_RADIUS = 4.f;
+constexpr int MIN_CLOTHS_PER_JOB = 1;
+//the top row of an imported mesh is pinned, and it hangs this far from the top right corner of the world
+constexpr float MESH_CLOTH_PIN_HEIGHT = 0.5f;
+constexpr float MESH_CLOTH_MARGIN = 5.f;
+//the cloth scene shows off tearing, cloths elsewhere only tear when the game config asks for it
+constexpr float DEMO_CLOTH_TEAR_STRETCH_RATIO = 3.f;
+//automatic cloth level of detail, by the fraction of the view the cloth covers and how far off center it is (1 = at the edge)
+constexpr float CLOTH_LOD_1_MAX_VIEW_FRACTION = 0.3f;
+constexpr float CLOTH_LOD_2_MAX_VIEW_FRACTION = 0.15f;
+constexpr float CLOTH_LOD_1_MIN_CENTER_OFFSET = 0.5f;
+constexpr float CLOTH_LOD_2_MIN_CENTER_OFFSET = 0.8f;
+//a cloth has to get this much further past a threshold to switch to a coarser level than it needs to come back to switch to a finer one
+constexpr float CLOTH_LOD_HYSTERESIS = 0.05f;
 
 
 void Game::Startup()
@@ -40,6 +78,10 @@ void Game::Startup()
 	m_screenCamera.SetOrthoView(Vec2(0.f, 0.f), m_uiScreenSize);
 	m_stopwatch.Start(&m_gameClock, 1.f);
 	InitializeMode();
+#if defined(PARTICLE_KERNEL_VERIFICATION)
+	SubscribeEventCallbackFunction("verifyparticlekernels", Command_VerifyParticleKernels);
+#endif
+	SubscribeEventCallbackFunction("benchmarkparticleorders", Command_BenchmarkParticleOrders);
 }
 
 void Game::ShutDown()
@@ -111,16 +153,23 @@ void Game::InitializeMode()
 	{
 	case GAME_MODE_CLOTH:
 	{
-		m_cloth = new Cloth(this, IntVec2(30, 15), Vec2(3.f, 3.f), ClothMassType::UNIFORM);
+		CreateCloths(IntVec2(30, 15), Vec2(3.f, 3.f), 1);
+		m_cloth->SetTearStretchRatio(DEMO_CLOTH_TEAR_STRETCH_RATIO);
 		m_collisionCirclePosition = Vec2(90.f, 10.f);
 		Vec2 boxMins = Vec2(10.f, 90.f);
 		m_collisionBox = AABB2(boxMins, boxMins + Vec2(COLLISION_BOX_WIDTH, COLLISION_BOX_HEIGHT));
+		ResetColliders(0, false);
 		break;
 	}
 	case GAME_MODE_PLANT:
 	{
 		m_plant = new Plant(this, Vec2(100.f, 20.f));
 		m_plant2 = new Plant(this, Vec2(50.f, 30.f));
+		m_plant->SetSleepingEnabled(true);
+		m_plant2->SetSleepingEnabled(true);
+		ResetPlantColliders();
+		m_plant->SetColliderSet(&m_colliders);
+		m_plant2->SetColliderSet(&m_colliders);
 		break;
 	}
 	case NUM_MODES:
@@ -142,8 +191,8 @@ void Game::CleanupCurrentMode()
 	{
 	case GAME_MODE_CLOTH:
 	{
-		delete m_cloth;
-		m_cloth = nullptr;
+		DestroyMeshCloth();
+		DestroyCloths();
 		break;
 	}
 	case GAME_MODE_PLANT:
@@ -152,6 +201,8 @@ void Game::CleanupCurrentMode()
 		m_plant = nullptr;
 		delete m_plant2;
 		m_plant2 = nullptr;
+		m_groundField.Clear();
+		m_groundTexelBoxes.clear();
 		break;
 	}
 	case NUM_MODES:
@@ -201,18 +252,26 @@ void Game::UpdateModePhysics(float deltaSeconds)
 	case GAME_MODE_CLOTH:
 	{
 		if (m_moveParticle)
-			m_cloth->MovePoint(m_screenMousePos, m_grabbedClothPoint);
-		m_cloth->Update(deltaSeconds);
-		m_cloth->CollideWithCircle(m_collisionCirclePosition, COLLISION_CIRCLE_RADIUS);
-		m_cloth->CollideWithBox(m_collisionBox);
+			m_cloth->MovePoint(m_screenMousePos, m_grabbedClothPointIndex);
+		m_colliders.SetDisc(m_collisionCircleIndex, m_collisionCirclePosition, COLLISION_CIRCLE_RADIUS);
+		m_colliders.SetAABB2(m_collisionBoxIndex, m_collisionBox);
+		UpdateCloths(deltaSeconds);
+		if (m_meshCloth)
+		{
+			m_meshCloth->Update(deltaSeconds);
+		}
+		m_colliders.StorePreviousPoses();
 		break;
 	}
 	case GAME_MODE_PLANT:
 	{
 		if (m_moveParticle)
-			m_plant->MovePoint(m_screenMousePos, m_grabbedPlantPoint);
+			m_plant->MovePoint(m_screenMousePos, m_grabbedPlantPointIndex);
+		m_colliders.SetDisc(m_collisionCircleIndex, m_collisionCirclePosition, COLLISION_CIRCLE_RADIUS);
+		m_colliders.SetAABB2(m_collisionBoxIndex, m_collisionBox);
 		m_plant->Update(deltaSeconds);
 		m_plant2->Update(deltaSeconds);
+		m_colliders.StorePreviousPoses();
 		break;
 	}
 	case NUM_MODES:
@@ -244,13 +303,20 @@ void Game::RenderMode() const
 	{
 	case GAME_MODE_CLOTH:
 	{
-		RenderCollisionBox();
-		RenderCollisionCircle();
-		m_cloth->Render();
+		RenderColliders();
+		for (int i = 0; i < m_cloths.size(); i++)
+		{
+			m_cloths[i]->Render();
+		}
+		if (m_meshCloth)
+		{
+			m_meshCloth->Render();
+		}
 		break;
 	}
 	case GAME_MODE_PLANT:
 	{
+		RenderColliders();
 		m_plant->Render();
 		m_plant2->Render();
 		break;
@@ -309,20 +375,20 @@ void Game::HandleGameInput()
 	if (g_theInput->WasKeyJustReleased(KEYCODE_LEFT_MOUSE))
 	{
 		m_moveParticle = false;
-		m_grabbedClothPoint = nullptr;
-		m_grabbedPlantPoint = nullptr;
+		m_grabbedClothPointIndex = -1;
+		m_grabbedPlantPointIndex = -1;
 	}
 	if (g_theInput->WasKeyJustPressed(KEYCODE_F1))
 	{
 		m_debugRender = !m_debugRender;
 	}
-	if (g_theInput->WasKeyJustPressed('B') && m_grabbedClothPoint)
+	if (g_theInput->WasKeyJustPressed('B') && m_cloth && m_grabbedClothPointIndex >= 0)
 	{
-		m_grabbedClothPoint->m_isPinned = !m_grabbedClothPoint->m_isPinned;
+		m_cloth->TogglePinnedParticle(m_grabbedClothPointIndex);
 	}
-	if (g_theInput->IsKeyDown('C') && m_grabbedClothPoint)
+	if (g_theInput->IsKeyDown('C') && m_cloth && m_grabbedClothPointIndex >= 0)
 	{
-		m_cloth->BreakConstraintsWithNeighbours(m_grabbedClothPoint);
+		m_cloth->TearConstraintsInDisc(m_screenMousePos, CLOTH_TEAR_BRUSH_RADIUS);
 	}
 	if (g_theInput->WasKeyJustPressed(KEYCODE_F2))
 	{
@@ -334,8 +400,8 @@ void Game::HandleGameInput()
 	}
 	if (g_theInput->IsKeyDown(KEYCODE_F4))
 	{
-		if (m_cloth)
-			m_cloth->ChangeHorizontalForceBy(10.f);
+		for (int i = 0; i < m_cloths.size(); i++)
+			m_cloths[i]->ChangeHorizontalForceBy(10.f);
 		if(m_plant)
 			m_plant->ChangeHorizontalForceBy(10.f);
 		if (m_plant2)
@@ -343,8 +409,8 @@ void Game::HandleGameInput()
 	}
 	if (g_theInput->IsKeyDown(KEYCODE_F5))
 	{
-		if (m_cloth)
-			m_cloth->ChangeHorizontalForceBy(-10.f);
+		for (int i = 0; i < m_cloths.size(); i++)
+			m_cloths[i]->ChangeHorizontalForceBy(-10.f);
 		if (m_plant)
 			m_plant->ChangeHorizontalForceBy(-10.f);
 		if (m_plant2)
@@ -355,6 +421,13 @@ void Game::HandleGameInput()
 		m_plant->m_renderStructureOnly = !m_plant->m_renderStructureOnly;
 		m_plant2->m_renderStructureOnly = !m_plant2->m_renderStructureOnly;
 	}
+	if (g_theInput->WasKeyJustPressed('M') && m_plant && m_plant2)
+	{
+		//only the first plant can be grabbed
+		int noGrabbedParticleIndex = -1;
+		m_plant->RenumberParticlesAlongMortonCurve(m_grabbedPlantPointIndex);
+		m_plant2->RenumberParticlesAlongMortonCurve(noGrabbedParticleIndex);
+	}
 	if (g_theInput->IsKeyDown(KEYCODE_LEFTARROW))
 	{
 		m_collisionCirclePosition += Vec2(-1.f, 0.f);
@@ -462,28 +535,286 @@ void Game::RenderDebugInfoText() const
 		horizontalForce = m_plant->GetCurrentHorizontalForce();
 	std::string text = Stringf("Horizontal Force = %.1f, FramesMS = %.1f (%.1f fps)", horizontalForce, m_gameClock.GetDeltaTime() * 1000.f, 1.f / m_gameClock.GetDeltaTime());
 
+	font->AddVertsForTextInBox2D(verts, textBox, cellHeight, text, Rgba8::WHITE, 1.f, Vec2::ZERO);
+
+	const SolverStats& solverStats = m_cloth ? m_cloth->GetSolverStats() : m_plant->GetSolverStats();
+	textBox.Translate(Vec2(0.f, -cellHeight));
+	text = Stringf("Solver: %d/%d iterations over %d substeps (%d converged, %d stalled), residual max = %.4f rms = %.4f", solverStats.m_numIterations,
+		solverStats.m_maxIterations, solverStats.m_numSubsteps, solverStats.m_numConvergedSolves, solverStats.m_numStalledSolves, solverStats.m_maxResidual,
+		solverStats.m_rmsResidual);
+	font->AddVertsForTextInBox2D(verts, textBox, cellHeight, text, Rgba8::WHITE, 1.f, Vec2::ZERO);
+
+	int numParticles = 0;
+	int numSleepingParticles = 0;
+	for (int i = 0; i < m_cloths.size(); i++)
+	{
+		numParticles += m_cloths[i]->GetNumParticles();
+		numSleepingParticles += m_cloths[i]->GetNumSleepingParticles();
+	}
+	if (m_meshCloth)
+	{
+		numParticles += m_meshCloth->GetNumParticles();
+		numSleepingParticles += m_meshCloth->GetNumSleepingParticles();
+	}
+	for (const Plant* plant : { m_plant, m_plant2 })
+	{
+		if (plant)
+		{
+			numParticles += plant->GetNumParticles();
+			numSleepingParticles += plant->GetNumSleepingParticles();
+		}
+	}
+	textBox.Translate(Vec2(0.f, -cellHeight));
+	text = Stringf("Sleeping particles: %d/%d", numSleepingParticles, numParticles);
 	font->AddVertsForTextInBox2D(verts, textBox, cellHeight, text, Rgba8::WHITE, 1.f, Vec2::ZERO);
 	g_theRenderer->BindTexture(&font->GetTexture());
 	g_theRenderer->DrawVertexArray((int)verts.size(), verts.data());
 }
 
-void Game::RenderCollisionCircle() const
+static void AddVertsForColliders(std::vector<Vertex_PCU>& verts, const ColliderSet& colliders)
 {
 	constexpr float ringThickness = 0.3f;
-	std::vector<Vertex_PCU> verts;
-	AddVertsForRing2D(verts, m_collisionCirclePosition, COLLISION_CIRCLE_RADIUS, Rgba8::YELLOW, ringThickness);
-	g_theRenderer->BindTexture(nullptr);
-	g_theRenderer->DrawVertexArray((int)verts.size(), verts.data());
+	for (int i = 0; i < colliders.GetNumDiscs(); i++)
+	{
+		AddVertsForRing2D(verts, colliders.GetDiscCenter(i), colliders.GetDiscRadius(i), Rgba8::YELLOW, ringThickness);
+	}
+	for (int i = 0; i < colliders.GetNumAABB2s(); i++)
+	{
+		AddVertsForAABB2D(verts, colliders.GetAABB2(i), Rgba8::YELLOW);
+	}
+	for (int i = 0; i < colliders.GetNumOBB2s(); i++)
+	{
+		AddVertsForOBB2D(verts, colliders.GetOBB2(i), Rgba8::YELLOW);
+	}
+	for (int i = 0; i < colliders.GetNumCapsule2s(); i++)
+	{
+		AddVertsForCapsule2D(verts, colliders.GetCapsule2(i), Rgba8::YELLOW);
+	}
 }
 
-void Game::RenderCollisionBox() const
+void Game::RenderColliders() const
 {
 	std::vector<Vertex_PCU> verts;
-	AddVertsForAABB2D(verts, m_collisionBox, Rgba8::YELLOW);
+	AddVertsForColliders(verts, m_colliders);
+	AddVertsForColliders(verts, m_bakedColliders);
+	for (const AABB2& texelBox : m_groundTexelBoxes)
+	{
+		AddVertsForAABB2D(verts, texelBox, Rgba8::GREY);
+	}
 	g_theRenderer->BindTexture(nullptr);
 	g_theRenderer->DrawVertexArray((int)verts.size(), verts.data());
 }
 
+void Game::ResetColliders(int numRandomColliders, bool bakeRandomColliders)
+{
+	//the movable circle and box always come first, random small shapes of every type are scattered over the world after them.
+	//Baked shapes go into a field over the world instead, the movable ones stay analytic since the field is only baked once
+	m_colliders.Clear();
+	m_bakedColliders.Clear();
+	m_colliderField.Clear();
+	m_collisionCircleIndex = m_colliders.AddDisc(m_collisionCirclePosition, COLLISION_CIRCLE_RADIUS);
+	m_collisionBoxIndex = m_colliders.AddAABB2(m_collisionBox);
+	ColliderSet& randomColliders = bakeRandomColliders ? m_bakedColliders : m_colliders;
+
+	RandomNumberGenerator rng;
+	for (int i = 0; i < numRandomColliders; i++)
+	{
+		Vec2 center(rng.GetRandomFloatInRange(0.f, m_worldSize.x), rng.GetRandomFloatInRange(0.f, m_worldSize.y));
+		float size = rng.GetRandomFloatInRange(RANDOM_COLLIDER_MIN_SIZE, RANDOM_COLLIDER_MAX_SIZE);
+		Vec2 direction = Vec2::MakeFromPolarDegrees(rng.GetRandomFloatInRange(0.f, 360.f));
+		switch (i % 4)
+		{
+		case 0:
+		{
+			randomColliders.AddDisc(center, size);
+			break;
+		}
+		case 1:
+		{
+			randomColliders.AddAABB2(AABB2(center - Vec2(size, size * 0.5f), center + Vec2(size, size * 0.5f)));
+			break;
+		}
+		case 2:
+		{
+			OBB2 orientedBox;
+			orientedBox.m_center = center;
+			orientedBox.m_iBasisNormal = direction;
+			orientedBox.m_halfDimensions = Vec2(size, size * 0.5f);
+			randomColliders.AddOBB2(orientedBox);
+			break;
+		}
+		default:
+		{
+			Capsule2 capsule;
+			capsule.m_bone = LineSegment2(center - direction * size, center + direction * size);
+			capsule.m_radius = size * 0.5f;
+			randomColliders.AddCapsule2(capsule);
+			break;
+		}
+		}
+	}
+
+	if (bakeRandomColliders && numRandomColliders > 0)
+	{
+		m_colliderField.BakeFromColliders(m_bakedColliders, AABB2(Vec2::ZERO, m_worldSize), COLLIDER_FIELD_CELL_SIZE, COLLIDER_FIELD_MAX_DISTANCE);
+		m_colliders.AddSignedDistanceField(&m_colliderField);
+	}
+}
+
+void Game::ResetPlantColliders()
+{
+	//the movable circle and box above the plants, and the ground they grow out of. The ground is painted into a mask the way a level
+	//image would be and baked into a field, so its collision cost does not depend on how detailed it is
+	m_collisionCirclePosition = Vec2(m_worldSize.x * 0.75f, m_worldSize.y * 0.7f);
+	Vec2 boxMins = Vec2(m_worldSize.x * 0.1f, m_worldSize.y * 0.7f);
+	m_collisionBox = AABB2(boxMins, boxMins + Vec2(COLLISION_BOX_WIDTH, COLLISION_BOX_HEIGHT));
+	ResetColliders(0, false);
+
+	AABB2 groundBounds(Vec2::ZERO, Vec2(m_worldSize.x, GROUND_BOUNDS_HEIGHT));
+	Vec2 texelSize(m_worldSize.x / (float)GROUND_MASK_WIDTH, GROUND_BOUNDS_HEIGHT / (float)GROUND_MASK_HEIGHT);
+	Vec2 spireTop = Vec2(GROUND_SPIRE_X, GROUND_SPIRE_TOP);
+	Image groundMask(IntVec2(GROUND_MASK_WIDTH, GROUND_MASK_HEIGHT), Rgba8::BLACK);
+	m_groundTexelBoxes.clear();
+	for (int texelY = 0; texelY < GROUND_MASK_HEIGHT; texelY++)
+	{
+		for (int texelX = 0; texelX < GROUND_MASK_WIDTH; texelX++)
+		{
+			Vec2 texelMins(texelSize.x * (float)texelX, texelSize.y * (float)texelY);
+			Vec2 texelCenter = texelMins + texelSize * 0.5f;
+			float groundHeight = GROUND_BASE_HEIGHT + GROUND_HILL_HEIGHT * sinf(texelCenter.x * GROUND_HILL_FREQUENCY);
+			float spireDistance = (texelCenter.y < GROUND_SPIRE_TOP) ? fabsf(texelCenter.x - GROUND_SPIRE_X) : GetDistance2D(texelCenter, spireTop);
+			bool isSolid = texelCenter.y < groundHeight || spireDistance < GROUND_SPIRE_RADIUS;
+			if (isSolid)
+			{
+				groundMask.SetTexelColor(IntVec2(texelX, texelY), Rgba8::WHITE);
+				m_groundTexelBoxes.push_back(AABB2(texelMins, texelMins + texelSize));
+			}
+		}
+	}
+	m_groundField.BakeFromImage(groundMask, groundBounds, 128);
+	m_colliders.AddSignedDistanceField(&m_groundField);
+}
+
+void Game::CreateCloths(IntVec2 gridCoords, Vec2 linkLength, int numInstances)
+{
+	m_clothTopology = new ClothTopology(gridCoords, linkLength, ClothMassType::UNIFORM);
+	for (int i = 0; i < numInstances; i++)
+	{
+		Cloth* cloth = new Cloth(this, m_clothTopology, GetClothTopLeftPosition(i, numInstances));
+		cloth->SetColliderSet(&m_colliders);
+		m_cloths.push_back(cloth);
+	}
+	m_cloth = m_cloths[0];
+}
+
+void Game::DestroyCloths()
+{
+	//the instances read the topology, so it goes last
+	for (int i = 0; i < m_cloths.size(); i++)
+	{
+		delete m_cloths[i];
+	}
+	m_cloths.clear();
+	m_cloth = nullptr;
+	delete m_clothTopology;
+	m_clothTopology = nullptr;
+}
+
+void Game::CreateMeshCloth(const char* objFilePath, ClothMeshParticleOrder particleOrder)
+{
+	//the importer splits quads into triangles and gives every corner a vertex of its own, the topology welds them back together
+	if (!DoesFileExist(objFilePath))
+	{
+		g_theConsole->AddLine(g_theConsole->ERRORTEXT, Stringf("Cloth mesh %s does not exist", objFilePath));
+		return;
+	}
+	MeshBuilder meshBuilder;
+	mesh_import_options importOptions;
+	meshBuilder.ImportFromOBJFile(objFilePath, importOptions);
+	if (meshBuilder.GetNumIndices() == 0)
+	{
+		g_theConsole->AddLine(g_theConsole->ERRORTEXT, Stringf("Cloth mesh %s has no triangles", objFilePath));
+		return;
+	}
+
+	m_meshClothTopology = new ClothMeshTopology(meshBuilder.GetVerticesData(), meshBuilder.GetIndicesData(), MESH_CLOTH_PIN_HEIGHT, particleOrder);
+	float meshWidth = m_meshClothTopology->GetRestBounds().GetDimensions().x;
+	m_meshCloth = new MeshCloth(this, m_meshClothTopology, Vec2(m_worldSize.x - meshWidth - MESH_CLOTH_MARGIN, m_worldSize.y - MESH_CLOTH_MARGIN));
+	m_meshCloth->SetColliderSet(&m_colliders);
+	g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Cloth mesh %s: %d particles, %d links in %d colours, bandwidth %d (%d as imported)", objFilePath,
+		m_meshClothTopology->GetNumParticles(), (int)m_meshClothTopology->m_constraints.size(), m_meshClothTopology->GetNumColors(),
+		m_meshClothTopology->m_bandwidth, m_meshClothTopology->m_importedBandwidth));
+}
+
+void Game::DestroyMeshCloth()
+{
+	delete m_meshCloth;
+	m_meshCloth = nullptr;
+	delete m_meshClothTopology;
+	m_meshClothTopology = nullptr;
+}
+
+void Game::UpdateCloths(float deltaSeconds)
+{
+	//instances only share data nobody writes during the step (topology, colliders), so each one is updated by its own job. Their own
+	//parallel loops still split up on the job system, small cloths stay below the job thresholds and just run inline
+	ParallelForFunction updateCloths = [this, deltaSeconds](int startIndex, int endIndex)
+	{
+		for (int i = startIndex; i < endIndex; i++)
+		{
+			m_cloths[i]->Update(deltaSeconds);
+		}
+	};
+
+	int numCloths = (int)m_cloths.size();
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numCloths, MIN_CLOTHS_PER_JOB, updateCloths);
+	else
+		updateCloths(0, numCloths);
+}
+
+int Game::ChooseClothLevelOfDetail(const Cloth* cloth) const
+{
+	//input acts on particle indices of m_cloth, so it always stays at full resolution
+	if (cloth == m_cloth)
+		return 0;
+
+	//the world camera always shows the whole world
+	AABB2 bounds = cloth->GetBounds();
+	Vec2 dimensions = bounds.GetDimensions();
+	float viewFractionX = dimensions.x / m_worldSize.x;
+	float viewFractionY = dimensions.y / m_worldSize.y;
+	float viewFraction = (viewFractionX > viewFractionY) ? viewFractionX : viewFractionY;
+	Vec2 centerOffset = bounds.GetCenter() - m_worldSize * 0.5f;
+	float centerOffsetX = fabsf(centerOffset.x) / (m_worldSize.x * 0.5f);
+	float centerOffsetY = fabsf(centerOffset.y) / (m_worldSize.y * 0.5f);
+	float centerOffsetFraction = (centerOffsetX > centerOffsetY) ? centerOffsetX : centerOffsetY;
+
+	//separate thresholds for switching down and up, so a cloth sitting on a threshold does not swap levels every frame
+	int currentLevelOfDetail = cloth->GetLevelOfDetail();
+	float level2Margin = (currentLevelOfDetail >= 2) ? CLOTH_LOD_HYSTERESIS : -CLOTH_LOD_HYSTERESIS;
+	if (viewFraction < CLOTH_LOD_2_MAX_VIEW_FRACTION + level2Margin || centerOffsetFraction > CLOTH_LOD_2_MIN_CENTER_OFFSET - level2Margin)
+		return 2;
+	float level1Margin = (currentLevelOfDetail >= 1) ? CLOTH_LOD_HYSTERESIS : -CLOTH_LOD_HYSTERESIS;
+	if (viewFraction < CLOTH_LOD_1_MAX_VIEW_FRACTION + level1Margin || centerOffsetFraction > CLOTH_LOD_1_MIN_CENTER_OFFSET - level1Margin)
+		return 1;
+	return 0;
+}
+
+Vec2 Game::GetClothTopLeftPosition(int instanceIndex, int numInstances) const
+{
+	//instances are centered in the cells of a grid spread over the world, a single cloth is centered in the world
+	int numColumns = (int)ceilf(sqrtf((float)numInstances));
+	int numRows = (numInstances + numColumns - 1) / numColumns;
+	Vec2 cellDimensions(m_worldSize.x / (float)numColumns, m_worldSize.y / (float)numRows);
+	Vec2 restDimensions = m_clothTopology->GetRestDimensions();
+	int column = instanceIndex % numColumns;
+	int row = instanceIndex / numColumns;
+	float xStart = cellDimensions.x * (float)column + (cellDimensions.x - restDimensions.x) / 2.f;
+	float yStart = m_worldSize.y - cellDimensions.y * (float)row - (cellDimensions.y - restDimensions.y) / 2.f;
+	return Vec2(xStart, yStart);
+}
+
 void Game::DemoImGUIWindow()
 {
 	bool show_demo_window = false;
@@ -532,19 +863,168 @@ void Game::ClothControlPanel()
 {
 	static int gridCoordsArray[2] = {};
 	static float linkLength[2] = {};
+	static int solverTypeIndex = 0;
+	static int numSubsteps = 1;
+	static int numIterations = 2;
+	static float linkCompliance = 0.f;
+	static float residualTolerance = 0.f;
+	static float stallTolerance = 0.f;
+	static float tearStretchRatio = m_cloth ? m_cloth->GetTearStretchRatio() : g_gameConfigBlackboard.GetValue("clothTearStretchRatio", 0.f);
+	static float yieldStretchRatio = g_gameConfigBlackboard.GetValue("clothYieldStretchRatio", 0.f);
+	static bool isSelfCollisionEnabled = false;
+	static bool isSleepingEnabled = true;
+	static bool areTethersEnabled = true;
+	static bool useStencilLinks = false;
+	static bool useTiledStep = false;
+	static float windVelocity[2] = {};
+	static float windDragCoefficient = 0.002f;
+	static float windLiftCoefficient = 0.001f;
+	static float windGustAmplitude = 0.f;
+	static int numRandomColliders = 0;
+	static bool bakeRandomColliders = false;
+	static char meshClothFile[256] = "Data/Models/Banner.obj";
+	static int meshParticleOrderIndex = (int)ClothMeshParticleOrder::REVERSE_CUTHILL_MCKEE;
+	const char* meshParticleOrderNames[] = { "As Imported", "Reverse Cuthill-McKee", "Morton (Z-Order)" };
+	static_assert(sizeof(meshParticleOrderNames) / sizeof(meshParticleOrderNames[0]) == (size_t)ClothMeshParticleOrder::NUM_PARTICLE_ORDERS, "Missing particle order name");
+	static int numClothInstances = 1;
+	static int levelOfDetailIndex = 0;
+	const char* levelOfDetailNames[] = { "Full Resolution", "Every 2nd Particle", "Every 4th Particle", "Auto (view size and position)" };
+	static_assert(sizeof(levelOfDetailNames) / sizeof(levelOfDetailNames[0]) == NUM_CLOTH_LEVELS_OF_DETAIL + 1, "Missing level of detail name");
+	const char* solverTypeNames[] = { "Serial Gauss-Seidel", "Parallel Gauss-Seidel", "Jacobi (SIMD)", "XPBD", "Multigrid", "Implicit Euler (CG)" };
+	static_assert(sizeof(solverTypeNames) / sizeof(solverTypeNames[0]) == (size_t)ConstraintSolverType::NUM_SOLVER_TYPES, "Missing solver type name");
 	ImGui::Begin("Control Panel");
 	ImGui::InputInt2("Dimensions", gridCoordsArray);
 	ImGui::InputFloat2("X/Y Link Length", linkLength);
+	ImGui::SliderInt("Cloth Instances", &numClothInstances, 1, 64);
+	ImGui::Combo("Level of Detail", &levelOfDetailIndex, levelOfDetailNames, NUM_CLOTH_LEVELS_OF_DETAIL + 1);
+	ImGui::Combo("Constraint Solver", &solverTypeIndex, solverTypeNames, (int)ConstraintSolverType::NUM_SOLVER_TYPES);
+	ImGui::SliderInt("Substeps", &numSubsteps, 1, 32);
+	ImGui::SliderFloat("Physics Timestep (s)", &m_physicsFixedTimeStep, 1.f / 120.f, 1.f / 20.f, "%.4f");
+	ImGui::SliderInt("Max Iterations", &numIterations, 1, 16);
+	ImGui::SliderFloat("Residual Tolerance", &residualTolerance, 0.f, 0.1f, "%.4f", ImGuiSliderFlags_Logarithmic);
+	ImGui::SliderFloat("Stall Tolerance (0 = off)", &stallTolerance, 0.f, 0.1f, "%.4f", ImGuiSliderFlags_Logarithmic);
+	ImGui::SliderFloat("Tear Stretch Ratio (0 = off)", &tearStretchRatio, 0.f, 10.f, "%.2f");
+	ImGui::SliderFloat("Yield Stretch Ratio (0 = off)", &yieldStretchRatio, 0.f, 3.f, "%.2f");
+	ImGui::Checkbox("Self Collision", &isSelfCollisionEnabled);
+	ImGui::Checkbox("Sleep Resting Patches", &isSleepingEnabled);
+	ImGui::Checkbox("Long Range Tethers", &areTethersEnabled);
+	ImGui::Checkbox("Implicit Stencil Links", &useStencilLinks);
+	ImGui::Checkbox("Tiled Step (Patch by Patch)", &useTiledStep);
+	ImGui::SliderFloat2("Wind Velocity", windVelocity, -500.f, 500.f, "%.0f");
+	ImGui::SliderFloat("Wind Drag", &windDragCoefficient, 0.f, 0.02f, "%.4f");
+	ImGui::SliderFloat("Wind Lift", &windLiftCoefficient, 0.f, 0.02f, "%.4f");
+	ImGui::SliderFloat("Wind Gusts", &windGustAmplitude, 0.f, 1.f, "%.2f");
+	ClothWind wind;
+	wind.m_velocity = Vec2(windVelocity[0], windVelocity[1]);
+	wind.m_dragCoefficient = windDragCoefficient;
+	wind.m_liftCoefficient = windLiftCoefficient;
+	wind.m_gustAmplitude = windGustAmplitude;
+	bool collidersChanged = ImGui::SliderInt("Random Colliders", &numRandomColliders, 0, 1000);
+	collidersChanged = ImGui::Checkbox("Bake Random Colliders Into SDF", &bakeRandomColliders) || collidersChanged;
+	if (collidersChanged)
+	{
+		ResetColliders(numRandomColliders, bakeRandomColliders);
+	}
+	bool complianceChanged = ImGui::SliderFloat("Link Compliance (XPBD, Implicit)", &linkCompliance, 0.f, 0.001f, "%.7f", ImGuiSliderFlags_Logarithmic);
 	if (ImGui::Button("Regenerate Cloth"))
 	{
-		if (m_cloth)
+		DestroyCloths();
+		CreateCloths(IntVec2(gridCoordsArray[0], gridCoordsArray[1]), Vec2(linkLength[0], linkLength[1]), numClothInstances);
+		complianceChanged = true;
+	}
+	ImGui::InputText("OBJ File", meshClothFile, sizeof(meshClothFile));
+	ImGui::Combo("Mesh Particle Order", &meshParticleOrderIndex, meshParticleOrderNames, (int)ClothMeshParticleOrder::NUM_PARTICLE_ORDERS);
+	if (ImGui::Button("Load Mesh Cloth"))
+	{
+		DestroyMeshCloth();
+		CreateMeshCloth(meshClothFile, static_cast<ClothMeshParticleOrder>(meshParticleOrderIndex));
+		complianceChanged = true;
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Remove Mesh Cloth"))
+	{
+		DestroyMeshCloth();
+	}
+	if (m_meshCloth)
+	{
+		m_meshCloth->SetSolverType(static_cast<ConstraintSolverType>(solverTypeIndex));
+		m_meshCloth->SetNumSubsteps(numSubsteps);
+		m_meshCloth->SetNumIterations(numIterations);
+		m_meshCloth->SetResidualTolerance(residualTolerance);
+		m_meshCloth->SetStallTolerance(stallTolerance);
+		m_meshCloth->SetSleepingEnabled(isSleepingEnabled);
+		if (complianceChanged)
 		{
-			delete m_cloth;
-			m_cloth = nullptr;
+			m_meshCloth->SetConstraintCompliance(linkCompliance);
+		}
+	}
+	for (int i = 0; i < m_cloths.size(); i++)
+	{
+		Cloth* cloth = m_cloths[i];
+		int levelOfDetail = (levelOfDetailIndex < NUM_CLOTH_LEVELS_OF_DETAIL) ? levelOfDetailIndex : ChooseClothLevelOfDetail(cloth);
+		if (cloth == m_cloth && levelOfDetail != cloth->GetLevelOfDetail())
+		{
+			//the grabbed index belongs to the particles of the old level
+			m_grabbedClothPointIndex = -1;
+		}
+		cloth->SetLevelOfDetail(levelOfDetail);
+		cloth->SetSolverType(static_cast<ConstraintSolverType>(solverTypeIndex));
+		cloth->SetNumSubsteps(numSubsteps);
+		cloth->SetNumIterations(numIterations);
+		cloth->SetResidualTolerance(residualTolerance);
+		cloth->SetStallTolerance(stallTolerance);
+		cloth->SetTearStretchRatio(tearStretchRatio);
+		cloth->SetYieldStretchRatio(yieldStretchRatio);
+		cloth->SetSelfCollisionEnabled(isSelfCollisionEnabled);
+		cloth->SetSleepingEnabled(isSleepingEnabled);
+		cloth->SetTethersEnabled(areTethersEnabled);
+		cloth->SetUseStencilLinks(useStencilLinks);
+		cloth->SetUseTiledStep(useTiledStep);
+		cloth->SetWind(wind);
+		if (complianceChanged)
+		{
+			cloth->SetConstraintCompliance(linkCompliance);
 		}
-
-		m_cloth = new Cloth(this, IntVec2(gridCoordsArray[0], gridCoordsArray[1]), Vec2(linkLength[0], linkLength[1]), ClothMassType::UNIFORM);
 	}
 	ImGui::End();
 }
 
+#if defined(PARTICLE_KERNEL_VERIFICATION)
+bool Game::Command_VerifyParticleKernels(EventArgs& args)
+{
+	//runs the SIMD and scalar particle kernels on the same data, they should always match bit for bit
+	int numParticles = args.GetValue("NumParticles", 1027);
+	bool verletMatches = DoesVerletKernelMatchScalar(numParticles);
+	bool jacobiMatches = DoJacobiKernelsMatchScalar(numParticles);
+	bool collidersMatch = DoColliderKernelsMatchScalar(numParticles);
+	bool aerodynamicsMatch = DoAerodynamicKernelsMatchScalar(numParticles);
+	g_theConsole->AddLine(verletMatches ? g_theConsole->INFO_MAJOR : g_theConsole->ERRORTEXT,
+		Stringf("Verlet kernel, SIMD width %d: %s", PARTICLE_KERNEL_SIMD_WIDTH, verletMatches ? "matches scalar" : "DOES NOT match scalar"));
+	g_theConsole->AddLine(jacobiMatches ? g_theConsole->INFO_MAJOR : g_theConsole->ERRORTEXT,
+		Stringf("Jacobi kernels, SIMD width %d: %s", PARTICLE_KERNEL_SIMD_WIDTH, jacobiMatches ? "match scalar" : "DO NOT match scalar"));
+	g_theConsole->AddLine(collidersMatch ? g_theConsole->INFO_MAJOR : g_theConsole->ERRORTEXT,
+		Stringf("Collider kernels, SIMD width %d: %s", PARTICLE_KERNEL_SIMD_WIDTH, collidersMatch ? "match scalar" : "DO NOT match scalar"));
+	g_theConsole->AddLine(aerodynamicsMatch ? g_theConsole->INFO_MAJOR : g_theConsole->ERRORTEXT,
+		Stringf("Aerodynamic kernels, SIMD width %d: %s", PARTICLE_KERNEL_SIMD_WIDTH, aerodynamicsMatch ? "match scalar" : "DO NOT match scalar"));
+	return false;
+}
+#endif
+
+bool Game::Command_BenchmarkParticleOrders(EventArgs& args)
+{
+	//the same jacobi iterations on a grid numbered row by row and along a Morton curve. The miss counts come from a cache model, so
+	//they do not depend on what else the machine is doing
+	int gridWidth = args.GetValue("Width", 512);
+	int gridHeight = args.GetValue("Height", 512);
+	int numIterations = args.GetValue("Iterations", 20);
+	int cacheKiB = args.GetValue("CacheKiB", 32);
+	ParticleOrderBenchmarkResult rowMajor;
+	ParticleOrderBenchmarkResult morton;
+	BenchmarkParticleOrders(gridWidth, gridHeight, numIterations, cacheKiB, rowMajor, morton);
+	g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("%dx%d grid, %d KiB cache model:", gridWidth, gridHeight, cacheKiB));
+	g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Row major: %.3f ms per iteration, %lld cache misses per iteration",
+		rowMajor.m_secondsPerIteration * 1000.0, (long long)rowMajor.m_cacheMissesPerIteration));
+	g_theConsole->AddLine(g_theConsole->INFO_MAJOR, Stringf("Morton: %.3f ms per iteration, %lld cache misses per iteration",
+		morton.m_secondsPerIteration * 1000.0, (long long)morton.m_cacheMissesPerIteration));
+	return false;
+}
@@ -3,11 +3,18 @@
 #include "Engine/Core/Vertex_PCU.hpp"
 #include "Engine/Core/Stopwatch.hpp"
 #include "Engine/Core/Clock.hpp"
+#include "Engine/Core/EventSystem.hpp"
+#include "Game/ColliderSet.hpp"
+#include "Game/SignedDistanceField.hpp"
+#include "Game/ClothMeshTopology.hpp"
+#include "Game/ParticleKernels.hpp"
+#include <vector>
 
 constexpr float PHYSICS_FIXED_TIMESTEP = 0.01f;
 
 class Cloth;
-struct Particle;
+class ClothTopology;
+class MeshCloth;
 class Plant;
 
 enum GameMode
@@ -27,8 +34,8 @@ public:
 	void ShutDown();
 
 public:
-	Particle* m_grabbedClothPoint = nullptr;
-	Particle* m_grabbedPlantPoint = nullptr;
+	int m_grabbedClothPointIndex = -1;
+	int m_grabbedPlantPointIndex = -1;
 	bool m_debugRender = false;
 	bool m_renderClothGrid = true;
 	bool m_renderClothTexture = true;
@@ -46,11 +53,26 @@ private:
 	float m_attractTriangleMinAlpha = 50.f;
 	float m_attractTriangleMaxAlpha = 255.f;
 	Vec2 m_uiScreenSize = Vec2::ZERO;
+	//every cloth instance shares one topology and is stepped as its own job, m_cloth is the first one and the one input acts on
+	ClothTopology* m_clothTopology = nullptr;
+	std::vector<Cloth*> m_cloths;
 	Cloth* m_cloth = nullptr;
+	//cloth imported from an OBJ mesh, simulated next to the grid cloths
+	ClothMeshTopology* m_meshClothTopology = nullptr;
+	MeshCloth* m_meshCloth = nullptr;
 	Plant* m_plant = nullptr;
 	Plant* m_plant2 = nullptr;
 	Vec2 m_collisionCirclePosition = Vec2::ZERO;
 	AABB2 m_collisionBox = AABB2::ZERO_TO_ONE;
+	ColliderSet m_colliders;
+	//random colliders baked into m_colliderField instead of being tested one by one, kept to draw them
+	ColliderSet m_bakedColliders;
+	SignedDistanceField m_colliderField;
+	//ground of the plant mode, baked from a mask image. The solid texels are kept to draw it
+	SignedDistanceField m_groundField;
+	std::vector<AABB2> m_groundTexelBoxes;
+	int m_collisionCircleIndex = -1;
+	int m_collisionBoxIndex = -1;
 	float m_physicsTimeOwed = 0.f;
 	float m_physicsFixedTimeStep = PHYSICS_FIXED_TIMESTEP;
 	Vec2 m_screenMousePos = Vec2::ZERO;
@@ -71,8 +93,21 @@ private:
 	void UpdateAttractMode(float deltaSeconds);
 	void RenderQuad() const;
 	void RenderDebugInfoText() const;
-	void RenderCollisionCircle() const;
-	void RenderCollisionBox() const;
+	void RenderColliders() const;
+	void ResetColliders(int numRandomColliders, bool bakeRandomColliders);
+	void ResetPlantColliders();
+	void CreateCloths(IntVec2 gridCoords, Vec2 linkLength, int numInstances);
+	void DestroyCloths();
+	void CreateMeshCloth(const char* objFilePath, ClothMeshParticleOrder particleOrder);
+	void DestroyMeshCloth();
+	void UpdateCloths(float deltaSeconds);
+	int ChooseClothLevelOfDetail(const Cloth* cloth) const;
+	Vec2 GetClothTopLeftPosition(int instanceIndex, int numInstances) const;
 	void DemoImGUIWindow();
 	void ClothControlPanel();
+
+#if defined(PARTICLE_KERNEL_VERIFICATION)
+	static bool Command_VerifyParticleKernels(EventArgs& args);
+#endif
+	static bool Command_BenchmarkParticleOrders(EventArgs& args);
 };
\ No newline at end of file
@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <mutex>
+#include <math.h>
+#include "Game/ImplicitIntegrator.hpp"
+#include "Game/ParticleKernels.hpp"
+#include "Engine/Core/JobSystem.hpp"
+#include "Engine/Core/EngineCommon.hpp"
+
+constexpr int MIN_LINKS_PER_JOB = 2048;
+constexpr int MIN_PARTICLES_PER_JOB = 1024;
+constexpr int ROWS_PER_CHUNK = 1024;
+constexpr int MAX_CHUNK_SUMS = 3;
+//the solve stops once the residual is this fraction of the right hand side
+constexpr double CONJUGATE_GRADIENT_TOLERANCE = 1e-3;
+
+extern JobSystem* g_theJobSystem;
+
+//the 2x2 block (row major) times the vector
+static inline void MultiplyBlock(const float* block, float vectorX, float vectorY, float& out_x, float& out_y)
+{
+	out_x = block[0] * vectorX + block[1] * vectorY;
+	out_y = block[2] * vectorX + block[3] * vectorY;
+}
+
+void ImplicitIntegrator::Step(ParticleStore& particles, const std::vector<DistanceConstraint>* const* linkSets, int numLinkSets,
+	const VerletIntegrationUniforms& uniforms, ImplicitStepResult& out_result)
+{
+	out_result = ImplicitStepResult();
+	m_linkSets.assign(linkSets, linkSets + numLinkSets);
+	m_linkSetStarts.resize(numLinkSets + 1);
+	m_linkSetStarts[0] = 0;
+	for (int i = 0; i < numLinkSets; i++)
+	{
+		m_linkSetStarts[i + 1] = m_linkSetStarts[i] + (int)linkSets[i]->size();
+	}
+
+	//links only ever go away by tearing and particles by changing the level of detail, both change the counts
+	int numLinks = m_linkSetStarts[numLinkSets];
+	if (particles.GetNumParticles() != m_numParticles || numLinks != m_numLinks)
+	{
+		m_numParticles = particles.GetNumParticles();
+		m_numLinks = numLinks;
+		BuildPattern(particles);
+	}
+	if (m_numParticles == 0)
+		return;
+
+	ComputeLinkSprings(particles, uniforms.m_deltaSeconds, out_result.m_linkResidual);
+	AssembleSystem(particles, uniforms);
+	SolveConjugateGradient(out_result);
+	ApplyVelocityChanges(particles, uniforms);
+}
+
+const DistanceConstraint& ImplicitIntegrator::GetLink(int linkIndex) const
+{
+	int setIndex = 0;
+	while (linkIndex >= m_linkSetStarts[setIndex + 1])
+	{
+		setIndex++;
+	}
+	return (*m_linkSets[setIndex])[linkIndex - m_linkSetStarts[setIndex]];
+}
+
+void ImplicitIntegrator::BuildPattern(const ParticleStore& particles)
+{
+	int numParticles = particles.GetNumParticles();
+	m_incidenceStarts.assign(numParticles + 1, 0);
+	for (int linkIndex = 0; linkIndex < m_numLinks; linkIndex++)
+	{
+		const DistanceConstraint& link = GetLink(linkIndex);
+		m_incidenceStarts[link.particleIndexA + 1]++;
+		m_incidenceStarts[link.particleIndexB + 1]++;
+	}
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_incidenceStarts[i + 1] += m_incidenceStarts[i];
+	}
+
+	m_incidences.resize(m_incidenceStarts[numParticles]);
+	std::vector<int> nextIncidences(m_incidenceStarts.begin(), m_incidenceStarts.end() - 1);
+	for (int linkIndex = 0; linkIndex < m_numLinks; linkIndex++)
+	{
+		const DistanceConstraint& link = GetLink(linkIndex);
+		LinkIncidence& incidenceA = m_incidences[nextIncidences[link.particleIndexA]++];
+		incidenceA.m_linkIndex = linkIndex;
+		incidenceA.m_otherParticleIndex = (int)link.particleIndexB;
+		incidenceA.m_forceSign = 1.f;
+		LinkIncidence& incidenceB = m_incidences[nextIncidences[link.particleIndexB]++];
+		incidenceB.m_linkIndex = linkIndex;
+		incidenceB.m_otherParticleIndex = (int)link.particleIndexA;
+		incidenceB.m_forceSign = -1.f;
+	}
+
+	//every row has its diagonal block and one block per particle it is linked to, links between the same particles share it
+	std::vector<int> rowStarts(numParticles + 1, 0);
+	std::vector<int> columns;
+	columns.reserve(numParticles + m_incidences.size());
+	std::vector<int> rowColumns;
+	for (int i = 0; i < numParticles; i++)
+	{
+		rowColumns.clear();
+		rowColumns.push_back(i);
+		for (int incidenceIndex = m_incidenceStarts[i]; incidenceIndex < m_incidenceStarts[i + 1]; incidenceIndex++)
+		{
+			rowColumns.push_back(m_incidences[incidenceIndex].m_otherParticleIndex);
+		}
+		std::sort(rowColumns.begin(), rowColumns.end());
+		rowColumns.erase(std::unique(rowColumns.begin(), rowColumns.end()), rowColumns.end());
+		columns.insert(columns.end(), rowColumns.begin(), rowColumns.end());
+		rowStarts[i + 1] = (int)columns.size();
+	}
+	m_systemMatrix.SetPattern(numParticles, rowStarts, columns);
+	m_diagonalBlockIndices.resize(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_diagonalBlockIndices[i] = m_systemMatrix.FindBlock(i, i);
+		for (int incidenceIndex = m_incidenceStarts[i]; incidenceIndex < m_incidenceStarts[i + 1]; incidenceIndex++)
+		{
+			LinkIncidence& incidence = m_incidences[incidenceIndex];
+			incidence.m_blockIndex = m_systemMatrix.FindBlock(i, incidence.m_otherParticleIndex);
+		}
+	}
+
+	m_linkJacobians.resize(m_numLinks * 3);
+	m_linkForces.resize(m_numLinks * 2);
+	m_inverseDiagonals.resize(numParticles * 4);
+	m_velocities.resize(numParticles * 2);
+	m_rightHandSide.resize(numParticles * 2);
+	//the last solution is the first guess of the next solve, it means nothing for a different set of particles
+	m_velocityChanges.assign(numParticles * 2, 0.f);
+	m_residuals.resize(numParticles * 2);
+	m_preconditionedResiduals.resize(numParticles * 2);
+	m_searchDirections.resize(numParticles * 2);
+	m_searchDirectionProducts.resize(numParticles * 2);
+}
+
+void ImplicitIntegrator::ComputeLinkSprings(const ParticleStore& particles, float deltaSeconds, ConstraintResidual& out_linkResidual)
+{
+	//every link writes only its own jacobian and force, the rows gather them afterwards
+	float deltaSecondsSquared = deltaSeconds * deltaSeconds;
+	std::mutex residualMutex;
+	ParallelForFunction computeSprings = [this, &particles, &out_linkResidual, &residualMutex, deltaSecondsSquared](int startIndex, int endIndex)
+	{
+		ConstraintResidual jobResidual;
+		for (int linkIndex = startIndex; linkIndex < endIndex; linkIndex++)
+		{
+			const DistanceConstraint& link = GetLink(linkIndex);
+			float* jacobian = &m_linkJacobians[linkIndex * 3];
+			float* force = &m_linkForces[linkIndex * 2];
+			jacobian[0] = 0.f;
+			jacobian[1] = 0.f;
+			jacobian[2] = 0.f;
+			force[0] = 0.f;
+			force[1] = 0.f;
+			int indexA = (int)link.particleIndexA;
+			int indexB = (int)link.particleIndexB;
+			if (particles.IsFixed(indexA) && particles.IsFixed(indexB))
+			{
+				jobResidual.Add(0.f);
+				continue;
+			}
+
+			float vectorABX = particles.m_x[indexB] - particles.m_x[indexA];
+			float vectorABY = particles.m_y[indexB] - particles.m_y[indexA];
+			float length = sqrtf(vectorABX * vectorABX + vectorABY * vectorABY);
+			jobResidual.Add(fabsf(length - link.restLength));
+			if (length <= 0.f)
+				continue;
+
+			//d(force on A)/d(position of A) of the spring is -stiffness * (t I + (1 - t) n n^T) with t = 1 - L/l: the full stiffness along
+			//the link and t across it. Across the link a compressed spring has negative stiffness, which would make the system indefinite,
+			//so t only counts while it is stretched
+			float stiffness = (link.compliance > 0.f) ? 1.f / link.compliance : m_rigidLinkStiffness;
+			float directionX = vectorABX / length;
+			float directionY = vectorABY / length;
+			float transverseStiffness = (length > link.restLength) ? 1.f - link.restLength / length : 0.f;
+			float alongStiffness = 1.f - transverseStiffness;
+			float scale = deltaSecondsSquared * stiffness;
+			jacobian[0] = scale * (transverseStiffness + alongStiffness * directionX * directionX);
+			jacobian[1] = scale * (alongStiffness * directionX * directionY);
+			jacobian[2] = scale * (transverseStiffness + alongStiffness * directionY * directionY);
+			force[0] = stiffness * (length - link.restLength) * directionX;
+			force[1] = stiffness * (length - link.restLength) * directionY;
+		}
+
+		std::lock_guard<std::mutex> lock(residualMutex);
+		out_linkResidual.Merge(jobResidual);
+	};
+
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(m_numLinks, MIN_LINKS_PER_JOB, computeSprings);
+	else
+		computeSprings(0, m_numLinks);
+}
+
+void ImplicitIntegrator::AssembleSystem(const ParticleStore& particles, const VerletIntegrationUniforms& uniforms)
+{
+	//row by row: M plus the jacobians of the row's links on the diagonal, minus them on the blocks of the linked particles. The right
+	//hand side is h (f + h K v), where h K v of a link only depends on the velocity of its particles relative to each other
+	float deltaSeconds = uniforms.m_deltaSeconds;
+	float inverseDeltaSeconds = 1.f / deltaSeconds;
+	ParallelForFunction assembleRows = [this, &particles, &uniforms, deltaSeconds, inverseDeltaSeconds](int startIndex, int endIndex)
+	{
+		for (int i = startIndex; i < endIndex; i++)
+		{
+			for (int blockIndex = m_systemMatrix.m_rowStarts[i]; blockIndex < m_systemMatrix.m_rowStarts[i + 1]; blockIndex++)
+			{
+				float* block = m_systemMatrix.GetBlock(blockIndex);
+				block[0] = 0.f;
+				block[1] = 0.f;
+				block[2] = 0.f;
+				block[3] = 0.f;
+			}
+
+			float velocityX = (particles.m_x[i] - particles.m_prevX[i]) * inverseDeltaSeconds;
+			float velocityY = (particles.m_y[i] - particles.m_prevY[i]) * inverseDeltaSeconds;
+			m_velocities[i * 2] = velocityX;
+			m_velocities[i * 2 + 1] = velocityY;
+			float* diagonal = m_systemMatrix.GetBlock(m_diagonalBlockIndices[i]);
+			float* rightHandSide = &m_rightHandSide[i * 2];
+			float* inverseDiagonal = &m_inverseDiagonals[i * 4];
+			if (particles.IsFixed(i))
+			{
+				diagonal[0] = 1.f;
+				diagonal[3] = 1.f;
+				rightHandSide[0] = 0.f;
+				rightHandSide[1] = 0.f;
+				inverseDiagonal[0] = 1.f;
+				inverseDiagonal[1] = 0.f;
+				inverseDiagonal[2] = 0.f;
+				inverseDiagonal[3] = 1.f;
+				continue;
+			}
+
+			float mass = 1.f / particles.m_invMass[i];
+			diagonal[0] = mass;
+			diagonal[3] = mass;
+			rightHandSide[0] = deltaSeconds * mass * uniforms.m_accelerationX;
+			rightHandSide[1] = deltaSeconds * mass * uniforms.m_accelerationY;
+			for (int incidenceIndex = m_incidenceStarts[i]; incidenceIndex < m_incidenceStarts[i + 1]; incidenceIndex++)
+			{
+				const LinkIncidence& incidence = m_incidences[incidenceIndex];
+				const float* jacobian = &m_linkJacobians[incidence.m_linkIndex * 3];
+				const float* force = &m_linkForces[incidence.m_linkIndex * 2];
+				int otherIndex = incidence.m_otherParticleIndex;
+				float relativeVelocityX = velocityX - (particles.m_x[otherIndex] - particles.m_prevX[otherIndex]) * inverseDeltaSeconds;
+				float relativeVelocityY = velocityY - (particles.m_y[otherIndex] - particles.m_prevY[otherIndex]) * inverseDeltaSeconds;
+				diagonal[0] += jacobian[0];
+				diagonal[1] += jacobian[1];
+				diagonal[2] += jacobian[1];
+				diagonal[3] += jacobian[2];
+				rightHandSide[0] += deltaSeconds * incidence.m_forceSign * force[0] - (jacobian[0] * relativeVelocityX + jacobian[1] * relativeVelocityY);
+				rightHandSide[1] += deltaSeconds * incidence.m_forceSign * force[1] - (jacobian[1] * relativeVelocityX + jacobian[2] * relativeVelocityY);
+				//a fixed particle's velocity does not change, its column is left out so the system stays symmetric
+				if (!particles.IsFixed(otherIndex))
+				{
+					float* block = m_systemMatrix.GetBlock(incidence.m_blockIndex);
+					block[0] -= jacobian[0];
+					block[1] -= jacobian[1];
+					block[2] -= jacobian[1];
+					block[3] -= jacobian[2];
+				}
+			}
+
+			float inverseDeterminant = 1.f / (diagonal[0] * diagonal[3] - diagonal[1] * diagonal[2]);
+			inverseDiagonal[0] = diagonal[3] * inverseDeterminant;
+			inverseDiagonal[1] = -diagonal[1] * inverseDeterminant;
+			inverseDiagonal[2] = -diagonal[2] * inverseDeterminant;
+			inverseDiagonal[3] = diagonal[0] * inverseDeterminant;
+		}
+	};
+
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(m_numParticles, MIN_PARTICLES_PER_JOB, assembleRows);
+	else
+		assembleRows(0, m_numParticles);
+}
+
+void ImplicitIntegrator::SolveConjugateGradient(ImplicitStepResult& out_result)
+{
+	//r = b - A x, z = P r and p = z, from the last step's solution
+	double sums[MAX_CHUNK_SUMS];
+	SumOverRowChunks(3, [this](int startRow, int endRow, double* out_sums)
+		{
+			m_systemMatrix.MultiplyRows(m_velocityChanges.data(), m_searchDirectionProducts.data(), startRow, endRow);
+			for (int row = startRow; row < endRow; row++)
+			{
+				float residualX = m_rightHandSide[row * 2] - m_searchDirectionProducts[row * 2];
+				float residualY = m_rightHandSide[row * 2 + 1] - m_searchDirectionProducts[row * 2 + 1];
+				float preconditionedX;
+				float preconditionedY;
+				MultiplyBlock(&m_inverseDiagonals[row * 4], residualX, residualY, preconditionedX, preconditionedY);
+				m_residuals[row * 2] = residualX;
+				m_residuals[row * 2 + 1] = residualY;
+				m_preconditionedResiduals[row * 2] = preconditionedX;
+				m_preconditionedResiduals[row * 2 + 1] = preconditionedY;
+				m_searchDirections[row * 2] = preconditionedX;
+				m_searchDirections[row * 2 + 1] = preconditionedY;
+				out_sums[0] += (double)residualX * preconditionedX + (double)residualY * preconditionedY;
+				out_sums[1] += (double)residualX * residualX + (double)residualY * residualY;
+				out_sums[2] += (double)m_rightHandSide[row * 2] * m_rightHandSide[row * 2] + (double)m_rightHandSide[row * 2 + 1] * m_rightHandSide[row * 2 + 1];
+			}
+		}, sums);
+	double residualDotPreconditioned = sums[0];
+	double residualLengthSquared = sums[1];
+	double rightHandSideLengthSquared = sums[2];
+	double toleranceSquared = CONJUGATE_GRADIENT_TOLERANCE * CONJUGATE_GRADIENT_TOLERANCE * rightHandSideLengthSquared;
+
+	int iteration = 0;
+	while (iteration < MAX_CONJUGATE_GRADIENT_ITERATIONS && residualLengthSquared > toleranceSquared)
+	{
+		SumOverRowChunks(1, [this](int startRow, int endRow, double* out_sums)
+			{
+				m_systemMatrix.MultiplyRows(m_searchDirections.data(), m_searchDirectionProducts.data(), startRow, endRow);
+				for (int i = startRow * 2; i < endRow * 2; i++)
+				{
+					out_sums[0] += (double)m_searchDirections[i] * m_searchDirectionProducts[i];
+				}
+			}, sums);
+		if (sums[0] <= 0.0)
+			break;
+
+		float stepLength = (float)(residualDotPreconditioned / sums[0]);
+		SumOverRowChunks(2, [this, stepLength](int startRow, int endRow, double* out_sums)
+			{
+				for (int row = startRow; row < endRow; row++)
+				{
+					m_velocityChanges[row * 2] += stepLength * m_searchDirections[row * 2];
+					m_velocityChanges[row * 2 + 1] += stepLength * m_searchDirections[row * 2 + 1];
+					float residualX = m_residuals[row * 2] - stepLength * m_searchDirectionProducts[row * 2];
+					float residualY = m_residuals[row * 2 + 1] - stepLength * m_searchDirectionProducts[row * 2 + 1];
+					float preconditionedX;
+					float preconditionedY;
+					MultiplyBlock(&m_inverseDiagonals[row * 4], residualX, residualY, preconditionedX, preconditionedY);
+					m_residuals[row * 2] = residualX;
+					m_residuals[row * 2 + 1] = residualY;
+					m_preconditionedResiduals[row * 2] = preconditionedX;
+					m_preconditionedResiduals[row * 2 + 1] = preconditionedY;
+					out_sums[0] += (double)residualX * preconditionedX + (double)residualY * preconditionedY;
+					out_sums[1] += (double)residualX * residualX + (double)residualY * residualY;
+				}
+			}, sums);
+		iteration++;
+		residualLengthSquared = sums[1];
+		if (residualLengthSquared <= toleranceSquared || residualDotPreconditioned <= 0.0)
+			break;
+
+		float directionScale = (float)(sums[0] / residualDotPreconditioned);
+		residualDotPreconditioned = sums[0];
+		SumOverRowChunks(0, [this, directionScale](int startRow, int endRow, double* out_sums)
+			{
+				UNUSED(out_sums);
+				for (int i = startRow * 2; i < endRow * 2; i++)
+				{
+					m_searchDirections[i] = m_preconditionedResiduals[i] + directionScale * m_searchDirections[i];
+				}
+			}, sums);
+	}
+
+	out_result.m_numIterations = iteration;
+	out_result.m_relativeResidual = (rightHandSideLengthSquared > 0.0) ? (float)sqrt(residualLengthSquared / rightHandSideLengthSquared) : 0.f;
+}
+
+void ImplicitIntegrator::ApplyVelocityChanges(ParticleStore& particles, const VerletIntegrationUniforms& uniforms)
+{
+	//the drag takes the same share of the old velocity as the verlet integrator does. The previous positions keep the velocity, so
+	//the other integrators and the collisions carry on from here
+	float deltaSeconds = uniforms.m_deltaSeconds;
+	float damping = 1.f - uniforms.m_drag;
+	ParallelForFunction applyVelocities = [this, &particles, deltaSeconds, damping](int startIndex, int endIndex)
+	{
+		for (int i = startIndex; i < endIndex; i++)
+		{
+			if (particles.IsFixed(i))
+				continue;
+
+			float velocityX = m_velocities[i * 2] * damping + m_velocityChanges[i * 2];
+			float velocityY = m_velocities[i * 2 + 1] * damping + m_velocityChanges[i * 2 + 1];
+			particles.m_prevX[i] = particles.m_x[i];
+			particles.m_prevY[i] = particles.m_y[i];
+			particles.m_x[i] += velocityX * deltaSeconds;
+			particles.m_y[i] += velocityY * deltaSeconds;
+		}
+	};
+
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(m_numParticles, MIN_PARTICLES_PER_JOB, applyVelocities);
+	else
+		applyVelocities(0, m_numParticles);
+}
+
+void ImplicitIntegrator::SumOverRowChunks(int numSums, const RowSumFunction& sumRows, double* out_sums)
+{
+	int numRows = m_numParticles;
+	int numChunks = (numRows + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK;
+	m_chunkSums.assign(numChunks * MAX_CHUNK_SUMS, 0.0);
+	ParallelForFunction sumChunks = [this, &sumRows, numRows](int startChunk, int endChunk)
+	{
+		for (int chunk = startChunk; chunk < endChunk; chunk++)
+		{
+			int startRow = chunk * ROWS_PER_CHUNK;
+			int endRow = (startRow + ROWS_PER_CHUNK < numRows) ? startRow + ROWS_PER_CHUNK : numRows;
+			sumRows(startRow, endRow, &m_chunkSums[chunk * MAX_CHUNK_SUMS]);
+		}
+	};
+
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numChunks, 1, sumChunks);
+	else
+		sumChunks(0, numChunks);
+
+	for (int i = 0; i < numSums; i++)
+	{
+		out_sums[i] = 0.0;
+		for (int chunk = 0; chunk < numChunks; chunk++)
+		{
+			out_sums[i] += m_chunkSums[chunk * MAX_CHUNK_SUMS + i];
+		}
+	}
+}
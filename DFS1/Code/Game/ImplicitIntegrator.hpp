@@ -0,0 +1,82 @@
+#pragma once
+#include "Game/ParticleSystem.hpp"
+#include "Game/SparseMatrix.hpp"
+#include <vector>
+#include <functional>
+
+struct VerletIntegrationUniforms;
+
+constexpr int MAX_CONJUGATE_GRADIENT_ITERATIONS = 64;
+
+struct ImplicitStepResult
+{
+	int m_numIterations = 0; //conjugate gradient iterations
+	float m_relativeResidual = 0.f; //|b - A dv| / |b| once the solve stopped
+	ConstraintResidual m_linkResidual; //|length - restLength| of the links at the start of the step
+};
+
+//backward euler for particles linked by springs (Baraff & Witkin): every link is a spring along its rest length, with a stiffness of
+//1 / compliance (m_rigidLinkStiffness for links of 0 compliance). The velocity change dv of a step solves
+//	(M - h^2 K) dv = h (f + h K v)
+//with K the jacobian of the spring forces, linearised around the positions at the start of the step. The system is symmetric positive
+//definite (the compressed part of the springs' transverse stiffness is dropped) and solved by conjugate gradient with a 2x2 block
+//jacobi preconditioner, starting from the last step's dv. Fixed particles keep their velocity, their rows and columns are left out
+class ImplicitIntegrator
+{
+public:
+	//advances the particles by uniforms.m_deltaSeconds under the uniforms' acceleration and drag. linkSets are the arrays the links
+	//are kept in, the pattern of the system is rebuilt whenever the number of particles or links changed since the last step
+	void Step(ParticleStore& particles, const std::vector<DistanceConstraint>* const* linkSets, int numLinkSets, const VerletIntegrationUniforms& uniforms,
+		ImplicitStepResult& out_result);
+	void SetRigidLinkStiffness(float rigidLinkStiffness) { m_rigidLinkStiffness = rigidLinkStiffness; }
+
+private:
+	//one end of a link seen from one of its particles: the link, the particle at the other end, and the block of the row for it
+	struct LinkIncidence
+	{
+		int m_linkIndex = 0;
+		int m_otherParticleIndex = 0;
+		int m_blockIndex = 0;
+		float m_forceSign = 1.f; //the link's force is the one on its particle A
+	};
+
+	typedef std::function<void(int startRow, int endRow, double* out_sums)> RowSumFunction;
+
+private:
+	const DistanceConstraint& GetLink(int linkIndex) const;
+	void BuildPattern(const ParticleStore& particles);
+	void ComputeLinkSprings(const ParticleStore& particles, float deltaSeconds, ConstraintResidual& out_linkResidual);
+	void AssembleSystem(const ParticleStore& particles, const VerletIntegrationUniforms& uniforms);
+	void SolveConjugateGradient(ImplicitStepResult& out_result);
+	void ApplyVelocityChanges(ParticleStore& particles, const VerletIntegrationUniforms& uniforms);
+	//runs sumRows over fixed chunks of rows on the job system, each adds numSums values. They are added up chunk by chunk in order,
+	//so the sums do not depend on how the work was split between threads
+	void SumOverRowChunks(int numSums, const RowSumFunction& sumRows, double* out_sums);
+
+private:
+	float m_rigidLinkStiffness = 1000000.f;
+	//the links of every set, numbered one set after the other
+	std::vector<const std::vector<DistanceConstraint>*> m_linkSets;
+	std::vector<int> m_linkSetStarts;
+	int m_numLinks = 0;
+	int m_numParticles = 0;
+	//per particle list of the links it is on
+	std::vector<int> m_incidenceStarts;
+	std::vector<LinkIncidence> m_incidences;
+	//per link: h^2 times the spring's stiffness matrix (xx, xy, yy) and the spring force on particle A
+	std::vector<float> m_linkJacobians;
+	std::vector<float> m_linkForces;
+	BlockCsrMatrix m_systemMatrix;
+	std::vector<int> m_diagonalBlockIndices;
+	//per particle inverse of the diagonal block of the system, the preconditioner
+	std::vector<float> m_inverseDiagonals;
+	//interleaved per particle vectors of the solve. m_velocityChanges is kept between steps as the first guess of the next one
+	std::vector<float> m_velocities;
+	std::vector<float> m_rightHandSide;
+	std::vector<float> m_velocityChanges;
+	std::vector<float> m_residuals;
+	std::vector<float> m_preconditionedResiduals;
+	std::vector<float> m_searchDirections;
+	std::vector<float> m_searchDirectionProducts;
+	std::vector<double> m_chunkSums;
+};
@@ -0,0 +1,200 @@
+#include <mutex>
+#include "Engine/Core/Vertex_PCU.hpp"
+#include "Engine/Core/VertexUtils.hpp"
+#include "Engine/Core/EngineCommon.hpp"
+#include "Engine/Core/JobSystem.hpp"
+#include "Engine/Renderer/Renderer.hpp"
+#include "Engine/Renderer/Texture.hpp"
+#include "Game/MeshCloth.hpp"
+#include "Game/ClothMeshTopology.hpp"
+#include "Game/Game.hpp"
+#include "Game/ParticleKernels.hpp"
+
+constexpr float pointRadius = 0.5f;
+constexpr float lineThickness = 0.25f;
+constexpr int DEFAULT_NUM_ITERATIONS = 2;
+constexpr int MIN_CONSTRAINTS_PER_JOB = 2048;
+constexpr float particleCollisionRadius = 0.6f;
+
+extern Renderer* g_theRenderer;
+extern JobSystem* g_theJobSystem;
+
+MeshCloth::MeshCloth(Game* game, const ClothMeshTopology* topology, const Vec2& topLeftPosition)
+	:m_game(game), m_topology(topology), m_constraints(topology->m_constraints)
+{
+	AABB2 restBounds = topology->GetRestBounds();
+	Vec2 offset = topLeftPosition - Vec2(restBounds.m_mins.x, restBounds.m_maxs.y);
+	int numParticles = topology->GetNumParticles();
+	m_particles.Reserve(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_particles.AddParticle(topology->m_restPositions[i] + offset, topology->m_masses[i]);
+	}
+	for (int i = 0; i < topology->m_pinnedParticles.size(); i++)
+	{
+		m_particles.SetPinned(topology->m_pinnedParticles[i], true);
+	}
+
+	std::string textureFile = g_gameConfigBlackboard.GetValue("clothTexture", "");
+	m_texture = g_theRenderer->CreateOrGetTextureFromFile(textureFile.c_str());
+	m_gravity = -400.f;
+	m_numIterations = DEFAULT_NUM_ITERATIONS;
+	m_collisionRadius = particleCollisionRadius;
+}
+
+void MeshCloth::Update(float deltaSeconds)
+{
+	if (WakeUpIfDisturbed())
+	{
+		m_solverStats = SolverStats();
+		return;
+	}
+
+	Simulate(deltaSeconds);
+	ResolveCollisions();
+	UpdateSleepState();
+}
+
+void MeshCloth::Render() const
+{
+	if (m_game->m_renderClothTexture)
+	{
+		RenderMesh();
+	}
+
+	if (m_game->m_renderClothGrid)
+	{
+		RenderStructure();
+	}
+}
+
+void MeshCloth::SetConstraintCompliance(float compliance)
+{
+	for (int i = 0; i < m_constraints.size(); i++)
+	{
+		m_constraints[i].compliance = compliance;
+	}
+}
+
+void MeshCloth::IntegrateImplicit(float deltaSeconds)
+{
+	VerletIntegrationUniforms uniforms;
+	GetIntegrationUniforms(deltaSeconds, uniforms);
+	const std::vector<DistanceConstraint>* linkSets[] = { &m_constraints };
+	ImplicitStepResult result;
+	m_implicitIntegrator.Step(m_particles, linkSets, 1, uniforms, result);
+	RecordImplicitStep(result);
+}
+
+void MeshCloth::SatisfyConstraints(float deltaSeconds)
+{
+	if (m_solverType == ConstraintSolverType::IMPLICIT_EULER)
+		return;
+
+	//there are no coarser meshes to run the multigrid solver on, it falls back to the coloured gauss seidel it finishes with
+	bool useXpbd = (m_solverType == ConstraintSolverType::XPBD);
+	float inverseDeltaSecondsSquared = 1.f / (deltaSeconds * deltaSeconds);
+	if (useXpbd)
+	{
+		ResetLagrangeMultipliers(m_constraintLambdas, (int)m_constraints.size());
+	}
+
+	bool useColors = (m_solverType == ConstraintSolverType::PARALLEL_GAUSS_SEIDEL || useXpbd || m_solverType == ConstraintSolverType::MULTIGRID);
+	if (useColors && g_theJobSystem)
+	{
+		for (int j = 0; j < m_numIterations; j++)
+		{
+			//every ParallelFor returns only when its whole colour is solved, which is the barrier between dependent colours
+			ConstraintResidual residual;
+			for (int colorIndex = 0; colorIndex < m_topology->GetNumColors(); colorIndex++)
+			{
+				SatisfyColorParallel(colorIndex, inverseDeltaSecondsSquared, residual);
+			}
+			if (RecordSolverIteration(j, residual))
+				break;
+		}
+		return;
+	}
+	if (m_solverType == ConstraintSolverType::JACOBI)
+	{
+		PrepareJacobiSolve();
+		for (int j = 0; j < m_numIterations; j++)
+		{
+			ConstraintResidual residual;
+			AccumulateJacobiCorrections(m_constraints, residual);
+			ApplyJacobiCorrections();
+			if (RecordSolverIteration(j, residual))
+				break;
+		}
+		return;
+	}
+
+	for (int j = 0; j < m_numIterations; j++)
+	{
+		ConstraintResidual residual;
+		for (int i = 0; i < m_constraints.size(); i++)
+		{
+			if (useXpbd)
+				residual.Add(SatisfyDistanceConstraintXPBD(m_constraints[i], m_constraintLambdas[i], inverseDeltaSecondsSquared));
+			else
+				residual.Add(SatisfyDistanceConstraint(m_constraints[i]));
+		}
+
+		if (RecordSolverIteration(j, residual))
+			break;
+	}
+}
+
+void MeshCloth::SatisfyColorParallel(int colorIndex, float inverseDeltaSecondsSquared, ConstraintResidual& residual)
+{
+	bool useXpbd = (m_solverType == ConstraintSolverType::XPBD);
+	int startIndex = m_topology->m_colorStarts[colorIndex];
+	int endIndex = m_topology->m_colorStarts[colorIndex + 1];
+	std::mutex residualMutex;
+	g_theJobSystem->ParallelFor(endIndex - startIndex, MIN_CONSTRAINTS_PER_JOB,
+		[this, startIndex, useXpbd, inverseDeltaSecondsSquared, &residual, &residualMutex](int jobStartIndex, int jobEndIndex)
+		{
+			ConstraintResidual jobResidual;
+			for (int i = startIndex + jobStartIndex; i < startIndex + jobEndIndex; i++)
+			{
+				if (useXpbd)
+					jobResidual.Add(SatisfyDistanceConstraintXPBD(m_constraints[i], m_constraintLambdas[i], inverseDeltaSecondsSquared));
+				else
+					jobResidual.Add(SatisfyDistanceConstraint(m_constraints[i]));
+			}
+
+			std::lock_guard<std::mutex> lock(residualMutex);
+			residual.Merge(jobResidual);
+		});
+}
+
+void MeshCloth::RenderMesh() const
+{
+	//the uvs are the ones the mesh was authored with, taken from the first corner welded into each particle
+	const std::vector<int>& triangleIndices = m_topology->m_triangleIndices;
+	std::vector<Vertex_PCU> verts;
+	verts.reserve(triangleIndices.size());
+	for (int i = 0; i < triangleIndices.size(); i++)
+	{
+		int particleIndex = triangleIndices[i];
+		verts.push_back(Vertex_PCU(Vec3(m_particles.GetPosition(particleIndex)), Rgba8::WHITE, m_topology->m_uvs[particleIndex]));
+	}
+	g_theRenderer->BindTexture(m_texture);
+	g_theRenderer->DrawVertexArray((int)verts.size(), verts.data());
+}
+
+void MeshCloth::RenderStructure() const
+{
+	std::vector<Vertex_PCU> verts;
+	for (int i = 0; i < m_particles.GetNumParticles(); i++)
+	{
+		AddVertsForDisc2D(verts, m_particles.GetPosition(i), pointRadius, Rgba8::WHITE);
+	}
+	for (int i = 0; i < m_constraints.size(); i++)
+	{
+		const DistanceConstraint& constraint = m_constraints[i];
+		AddVertsForLineSegment2D(verts, m_particles.GetPosition(constraint.particleIndexA), m_particles.GetPosition(constraint.particleIndexB), lineThickness, Rgba8::WHITE);
+	}
+	g_theRenderer->BindTexture(nullptr);
+	g_theRenderer->DrawVertexArray((int)verts.size(), verts.data());
+}
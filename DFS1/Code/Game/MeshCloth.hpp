@@ -0,0 +1,36 @@
+#pragma once
+#include "Game/ParticleSystem.hpp"
+#include "Game/ImplicitIntegrator.hpp"
+
+class Game;
+class Texture;
+class ClothMeshTopology;
+
+//cloth simulated on the particles and links of an imported triangle mesh. The grid cloth's patches, levels of detail, tethers and
+//tearing depend on its rows and columns, a mesh cloth is solved with the plain solvers over the mesh's link colours and sleeps
+//as a whole
+class MeshCloth : public ParticleSystem
+{
+public:
+	//the mesh keeps its rest shape and is moved so the top left of its bounds sits on topLeftPosition
+	MeshCloth(Game* game, const ClothMeshTopology* topology, const Vec2& topLeftPosition);
+	void Update(float deltaSeconds) override;
+	void Render() const override;
+	void SetConstraintCompliance(float compliance);
+
+protected:
+	void IntegrateImplicit(float deltaSeconds) override;
+	void SatisfyConstraints(float deltaSeconds) override;
+	void SatisfyColorParallel(int colorIndex, float inverseDeltaSecondsSquared, ConstraintResidual& residual);
+	void RenderMesh() const;
+	void RenderStructure() const;
+
+protected:
+	Game* m_game = nullptr;
+	const ClothMeshTopology* m_topology = nullptr;
+	//a copy of the topology's links, laid out by colour the same way, so the compliance can change per instance
+	std::vector<DistanceConstraint> m_constraints;
+	std::vector<float> m_constraintLambdas; //one per link, used by the XPBD solver
+	ImplicitIntegrator m_implicitIntegrator;
+	Texture* m_texture = nullptr;
+};
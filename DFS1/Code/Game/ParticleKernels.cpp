@@ -0,0 +1,1468 @@
+#include "Game/ParticleKernels.hpp"
+#include "Game/ParticleSystem.hpp"
+#include "Engine/Math/RandomNumberGenerator.hpp"
+#include <math.h>
+#include <string.h>
+#if PARTICLE_KERNEL_SIMD_WIDTH > 1
+#include <immintrin.h>
+#endif
+
+//constraint kernels gather DistanceConstraint fields as 32 bit elements
+constexpr int DISTANCE_CONSTRAINT_STRIDE = (int)(sizeof(DistanceConstraint) / sizeof(uint32_t));
+static_assert(sizeof(DistanceConstraint) == DISTANCE_CONSTRAINT_STRIDE * sizeof(uint32_t), "DistanceConstraint must be made of 32 bit fields");
+
+static void IntegrateVerletScalar(float* positionsX, float* positionsY, float* prevPositionsX, float* prevPositionsY, const uint32_t* pinnedMask, int startIndex, int endIndex,
+	const VerletIntegrationUniforms& uniforms)
+{
+	float damping = 1.f - uniforms.m_drag;
+	float stepX = uniforms.m_accelerationX * uniforms.m_deltaSeconds * uniforms.m_deltaSeconds;
+	float stepY = uniforms.m_accelerationY * uniforms.m_deltaSeconds * uniforms.m_deltaSeconds;
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		bool isPinned = ((pinnedMask[i >> 5] >> (i & 31)) & 1u) != 0;
+		float currentX = positionsX[i];
+		float currentY = positionsY[i];
+		float nextX = currentX + ((currentX - prevPositionsX[i]) * damping + stepX);
+		float nextY = currentY + ((currentY - prevPositionsY[i]) * damping + stepY);
+		positionsX[i] = isPinned ? currentX : nextX;
+		positionsY[i] = isPinned ? currentY : nextY;
+		prevPositionsX[i] = isPinned ? prevPositionsX[i] : currentX;
+		prevPositionsY[i] = isPinned ? prevPositionsY[i] : currentY;
+	}
+}
+
+void IntegrateVerlet(float* positionsX, float* positionsY, float* prevPositionsX, float* prevPositionsY, const uint32_t* pinnedMask, int numParticles,
+	const VerletIntegrationUniforms& uniforms, bool useSimd)
+{
+	int i = 0;
+	float damping = 1.f - uniforms.m_drag;
+	float stepX = uniforms.m_accelerationX * uniforms.m_deltaSeconds * uniforms.m_deltaSeconds;
+	float stepY = uniforms.m_accelerationY * uniforms.m_deltaSeconds * uniforms.m_deltaSeconds;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		const __m256 dampingFactor = _mm256_set1_ps(damping);
+		const __m256 stepXFactor = _mm256_set1_ps(stepX);
+		const __m256 stepYFactor = _mm256_set1_ps(stepY);
+		for (; i + 8 <= numParticles; i += 8)
+		{
+			//i is a multiple of 8 so the 8 pinned bits for these lanes never straddle two mask words
+			int pinnedBits = (int)((pinnedMask[i >> 5] >> (i & 31)) & 0xFFu);
+			if (pinnedBits == 0xFF)
+				continue;
+
+			__m256 isPinned = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(pinnedBits), laneBits), laneBits));
+
+			__m256 currentX = _mm256_load_ps(positionsX + i);
+			__m256 currentY = _mm256_load_ps(positionsY + i);
+			__m256 prevX = _mm256_load_ps(prevPositionsX + i);
+			__m256 prevY = _mm256_load_ps(prevPositionsY + i);
+			__m256 nextX = _mm256_add_ps(currentX, _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(currentX, prevX), dampingFactor), stepXFactor));
+			__m256 nextY = _mm256_add_ps(currentY, _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(currentY, prevY), dampingFactor), stepYFactor));
+
+			_mm256_store_ps(positionsX + i, _mm256_blendv_ps(nextX, currentX, isPinned));
+			_mm256_store_ps(positionsY + i, _mm256_blendv_ps(nextY, currentY, isPinned));
+			_mm256_store_ps(prevPositionsX + i, _mm256_blendv_ps(currentX, prevX, isPinned));
+			_mm256_store_ps(prevPositionsY + i, _mm256_blendv_ps(currentY, prevY, isPinned));
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+		const __m128 dampingFactor = _mm_set1_ps(damping);
+		const __m128 stepXFactor = _mm_set1_ps(stepX);
+		const __m128 stepYFactor = _mm_set1_ps(stepY);
+		for (; i + 4 <= numParticles; i += 4)
+		{
+			int pinnedBits = (int)((pinnedMask[i >> 5] >> (i & 31)) & 0xFu);
+			if (pinnedBits == 0xF)
+				continue;
+
+			__m128 isPinned = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(pinnedBits), laneBits), laneBits));
+
+			__m128 currentX = _mm_load_ps(positionsX + i);
+			__m128 currentY = _mm_load_ps(positionsY + i);
+			__m128 prevX = _mm_load_ps(prevPositionsX + i);
+			__m128 prevY = _mm_load_ps(prevPositionsY + i);
+			__m128 nextX = _mm_add_ps(currentX, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(currentX, prevX), dampingFactor), stepXFactor));
+			__m128 nextY = _mm_add_ps(currentY, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(currentY, prevY), dampingFactor), stepYFactor));
+
+			_mm_store_ps(positionsX + i, _mm_or_ps(_mm_and_ps(isPinned, currentX), _mm_andnot_ps(isPinned, nextX)));
+			_mm_store_ps(positionsY + i, _mm_or_ps(_mm_and_ps(isPinned, currentY), _mm_andnot_ps(isPinned, nextY)));
+			_mm_store_ps(prevPositionsX + i, _mm_or_ps(_mm_and_ps(isPinned, prevX), _mm_andnot_ps(isPinned, currentX)));
+			_mm_store_ps(prevPositionsY + i, _mm_or_ps(_mm_and_ps(isPinned, prevY), _mm_andnot_ps(isPinned, currentY)));
+		}
+	}
+#else
+	(void)useSimd;
+	(void)damping;
+	(void)stepX;
+	(void)stepY;
+#endif
+
+	IntegrateVerletScalar(positionsX, positionsY, prevPositionsX, prevPositionsY, pinnedMask, i, numParticles, uniforms);
+}
+
+void ComputeEffectiveInverseMasses(const float* invMasses, const uint32_t* pinnedMask, int numParticles, float* out_effectiveInvMasses)
+{
+	for (int i = 0; i < numParticles; i++)
+	{
+		bool isPinned = ((pinnedMask[i >> 5] >> (i & 31)) & 1u) != 0;
+		out_effectiveInvMasses[i] = isPinned ? 0.f : invMasses[i];
+	}
+}
+
+static void ComputeDistanceConstraintCorrectionsScalar(const float* positionsX, const float* positionsY, const float* effectiveInvMasses, const DistanceConstraint* constraints,
+	int startIndex, int endIndex, float* out_correctionsX, float* out_correctionsY, float& out_maxViolation, float& out_sumSquaredViolation)
+{
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		uint32_t indexA = constraints[i].particleIndexA;
+		uint32_t indexB = constraints[i].particleIndexB;
+		float deltaX = positionsX[indexB] - positionsX[indexA];
+		float deltaY = positionsY[indexB] - positionsY[indexA];
+		float length = sqrtf(deltaX * deltaX + deltaY * deltaY);
+		float invMassSum = effectiveInvMasses[indexA] + effectiveInvMasses[indexB];
+		float violation = 0.f;
+		float scale = 0.f;
+		if (length > 0.f && invMassSum > 0.f)
+		{
+			violation = length - constraints[i].restLength;
+			scale = violation / (length * invMassSum);
+		}
+		out_correctionsX[i] = deltaX * scale;
+		out_correctionsY[i] = deltaY * scale;
+
+		float absViolation = fabsf(violation);
+		out_maxViolation = absViolation > out_maxViolation ? absViolation : out_maxViolation;
+		out_sumSquaredViolation += absViolation * absViolation;
+	}
+}
+
+void ComputeDistanceConstraintCorrections(const float* positionsX, const float* positionsY, const float* effectiveInvMasses, const DistanceConstraint* constraints,
+	int numConstraints, float* out_correctionsX, float* out_correctionsY, float& out_maxViolation, float& out_sumSquaredViolation, bool useSimd)
+{
+	int i = 0;
+	float maxViolation = 0.f;
+	float sumSquaredViolation = 0.f;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256i constraintStride = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(DISTANCE_CONSTRAINT_STRIDE));
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 signMask = _mm256_set1_ps(-0.f);
+		__m256 maxViolations = zero;
+		__m256 sumSquaredViolations = zero;
+		for (; i + 8 <= numConstraints; i += 8)
+		{
+			const int* constraintFields = reinterpret_cast<const int*>(constraints + i);
+			__m256i indicesA = _mm256_i32gather_epi32(constraintFields, constraintStride, 4);
+			__m256i indicesB = _mm256_i32gather_epi32(constraintFields + 1, constraintStride, 4);
+			__m256 restLengths = _mm256_i32gather_ps(reinterpret_cast<const float*>(constraintFields + 2), constraintStride, 4);
+
+			__m256 deltaX = _mm256_sub_ps(_mm256_i32gather_ps(positionsX, indicesB, 4), _mm256_i32gather_ps(positionsX, indicesA, 4));
+			__m256 deltaY = _mm256_sub_ps(_mm256_i32gather_ps(positionsY, indicesB, 4), _mm256_i32gather_ps(positionsY, indicesA, 4));
+			__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(deltaX, deltaX), _mm256_mul_ps(deltaY, deltaY)));
+			__m256 invMassSum = _mm256_add_ps(_mm256_i32gather_ps(effectiveInvMasses, indicesA, 4), _mm256_i32gather_ps(effectiveInvMasses, indicesB, 4));
+			__m256 violation = _mm256_sub_ps(length, restLengths);
+			__m256 scale = _mm256_div_ps(violation, _mm256_mul_ps(length, invMassSum));
+			__m256 isSolvable = _mm256_and_ps(_mm256_cmp_ps(length, zero, _CMP_GT_OQ), _mm256_cmp_ps(invMassSum, zero, _CMP_GT_OQ));
+			scale = _mm256_and_ps(scale, isSolvable);
+
+			_mm256_storeu_ps(out_correctionsX + i, _mm256_mul_ps(deltaX, scale));
+			_mm256_storeu_ps(out_correctionsY + i, _mm256_mul_ps(deltaY, scale));
+
+			__m256 absViolation = _mm256_and_ps(_mm256_andnot_ps(signMask, violation), isSolvable);
+			maxViolations = _mm256_max_ps(maxViolations, absViolation);
+			sumSquaredViolations = _mm256_add_ps(sumSquaredViolations, _mm256_mul_ps(absViolation, absViolation));
+		}
+
+		alignas(32) float laneMaxViolations[8];
+		alignas(32) float laneSumSquaredViolations[8];
+		_mm256_store_ps(laneMaxViolations, maxViolations);
+		_mm256_store_ps(laneSumSquaredViolations, sumSquaredViolations);
+		for (int lane = 0; lane < 8; lane++)
+		{
+			maxViolation = laneMaxViolations[lane] > maxViolation ? laneMaxViolations[lane] : maxViolation;
+			sumSquaredViolation += laneSumSquaredViolations[lane];
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 signMask = _mm_set1_ps(-0.f);
+		__m128 maxViolations = zero;
+		__m128 sumSquaredViolations = zero;
+		for (; i + 4 <= numConstraints; i += 4)
+		{
+			const DistanceConstraint* c = constraints + i;
+			uint32_t a0 = c[0].particleIndexA, a1 = c[1].particleIndexA, a2 = c[2].particleIndexA, a3 = c[3].particleIndexA;
+			uint32_t b0 = c[0].particleIndexB, b1 = c[1].particleIndexB, b2 = c[2].particleIndexB, b3 = c[3].particleIndexB;
+			__m128 restLengths = _mm_setr_ps(c[0].restLength, c[1].restLength, c[2].restLength, c[3].restLength);
+
+			__m128 deltaX = _mm_sub_ps(_mm_setr_ps(positionsX[b0], positionsX[b1], positionsX[b2], positionsX[b3]),
+				_mm_setr_ps(positionsX[a0], positionsX[a1], positionsX[a2], positionsX[a3]));
+			__m128 deltaY = _mm_sub_ps(_mm_setr_ps(positionsY[b0], positionsY[b1], positionsY[b2], positionsY[b3]),
+				_mm_setr_ps(positionsY[a0], positionsY[a1], positionsY[a2], positionsY[a3]));
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(deltaX, deltaX), _mm_mul_ps(deltaY, deltaY)));
+			__m128 invMassSum = _mm_add_ps(_mm_setr_ps(effectiveInvMasses[a0], effectiveInvMasses[a1], effectiveInvMasses[a2], effectiveInvMasses[a3]),
+				_mm_setr_ps(effectiveInvMasses[b0], effectiveInvMasses[b1], effectiveInvMasses[b2], effectiveInvMasses[b3]));
+			__m128 violation = _mm_sub_ps(length, restLengths);
+			__m128 scale = _mm_div_ps(violation, _mm_mul_ps(length, invMassSum));
+			__m128 isSolvable = _mm_and_ps(_mm_cmpgt_ps(length, zero), _mm_cmpgt_ps(invMassSum, zero));
+			scale = _mm_and_ps(scale, isSolvable);
+
+			_mm_storeu_ps(out_correctionsX + i, _mm_mul_ps(deltaX, scale));
+			_mm_storeu_ps(out_correctionsY + i, _mm_mul_ps(deltaY, scale));
+
+			__m128 absViolation = _mm_and_ps(_mm_andnot_ps(signMask, violation), isSolvable);
+			maxViolations = _mm_max_ps(maxViolations, absViolation);
+			sumSquaredViolations = _mm_add_ps(sumSquaredViolations, _mm_mul_ps(absViolation, absViolation));
+		}
+
+		alignas(16) float laneMaxViolations[4];
+		alignas(16) float laneSumSquaredViolations[4];
+		_mm_store_ps(laneMaxViolations, maxViolations);
+		_mm_store_ps(laneSumSquaredViolations, sumSquaredViolations);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			maxViolation = laneMaxViolations[lane] > maxViolation ? laneMaxViolations[lane] : maxViolation;
+			sumSquaredViolation += laneSumSquaredViolations[lane];
+		}
+	}
+#else
+	(void)useSimd;
+#endif
+
+	ComputeDistanceConstraintCorrectionsScalar(positionsX, positionsY, effectiveInvMasses, constraints, i, numConstraints, out_correctionsX, out_correctionsY,
+		maxViolation, sumSquaredViolation);
+	out_maxViolation = maxViolation > out_maxViolation ? maxViolation : out_maxViolation;
+	out_sumSquaredViolation += sumSquaredViolation;
+}
+
+void AccumulateDistanceConstraintCorrections(const float* effectiveInvMasses, const DistanceConstraint* constraints, int numConstraints,
+	const float* correctionsX, const float* correctionsY, float* deltasX, float* deltasY, float* constraintCounts)
+{
+	//constraints sharing a particle would conflict in a vector scatter, so this pass stays scalar
+	for (int i = 0; i < numConstraints; i++)
+	{
+		uint32_t indexA = constraints[i].particleIndexA;
+		uint32_t indexB = constraints[i].particleIndexB;
+		float invMassA = effectiveInvMasses[indexA];
+		float invMassB = effectiveInvMasses[indexB];
+		deltasX[indexA] += correctionsX[i] * invMassA;
+		deltasY[indexA] += correctionsY[i] * invMassA;
+		deltasX[indexB] -= correctionsX[i] * invMassB;
+		deltasY[indexB] -= correctionsY[i] * invMassB;
+		constraintCounts[indexA] += 1.f;
+		constraintCounts[indexB] += 1.f;
+	}
+}
+
+static void ApplyJacobiDeltasScalar(float* positionsX, float* positionsY, float* deltasX, float* deltasY, float* constraintCounts, int startIndex, int endIndex, float relaxation)
+{
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		float count = constraintCounts[i] > 1.f ? constraintCounts[i] : 1.f;
+		float scale = relaxation / count;
+		positionsX[i] = positionsX[i] + deltasX[i] * scale;
+		positionsY[i] = positionsY[i] + deltasY[i] * scale;
+		deltasX[i] = 0.f;
+		deltasY[i] = 0.f;
+		constraintCounts[i] = 0.f;
+	}
+}
+
+void ApplyJacobiDeltas(float* positionsX, float* positionsY, float* deltasX, float* deltasY, float* constraintCounts, int numParticles,
+	float relaxation, bool useSimd)
+{
+	int i = 0;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 relaxationFactor = _mm256_set1_ps(relaxation);
+		for (; i + 8 <= numParticles; i += 8)
+		{
+			__m256 scale = _mm256_div_ps(relaxationFactor, _mm256_max_ps(_mm256_load_ps(constraintCounts + i), one));
+			_mm256_store_ps(positionsX + i, _mm256_add_ps(_mm256_load_ps(positionsX + i), _mm256_mul_ps(_mm256_load_ps(deltasX + i), scale)));
+			_mm256_store_ps(positionsY + i, _mm256_add_ps(_mm256_load_ps(positionsY + i), _mm256_mul_ps(_mm256_load_ps(deltasY + i), scale)));
+			_mm256_store_ps(deltasX + i, zero);
+			_mm256_store_ps(deltasY + i, zero);
+			_mm256_store_ps(constraintCounts + i, zero);
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 relaxationFactor = _mm_set1_ps(relaxation);
+		for (; i + 4 <= numParticles; i += 4)
+		{
+			__m128 scale = _mm_div_ps(relaxationFactor, _mm_max_ps(_mm_load_ps(constraintCounts + i), one));
+			_mm_store_ps(positionsX + i, _mm_add_ps(_mm_load_ps(positionsX + i), _mm_mul_ps(_mm_load_ps(deltasX + i), scale)));
+			_mm_store_ps(positionsY + i, _mm_add_ps(_mm_load_ps(positionsY + i), _mm_mul_ps(_mm_load_ps(deltasY + i), scale)));
+			_mm_store_ps(deltasX + i, zero);
+			_mm_store_ps(deltasY + i, zero);
+			_mm_store_ps(constraintCounts + i, zero);
+		}
+	}
+#else
+	(void)useSimd;
+#endif
+
+	ApplyJacobiDeltasScalar(positionsX, positionsY, deltasX, deltasY, constraintCounts, i, numParticles, relaxation);
+}
+
+//moves a point closer than radius to the nearest point on a collider out to that radius, a point sitting exactly on the nearest
+//point has no direction to be pushed in and stays
+static bool PushPointAwayFromNearestPointScalar(float& positionX, float& positionY, float nearestX, float nearestY, float radius)
+{
+	float offsetX = positionX - nearestX;
+	float offsetY = positionY - nearestY;
+	float distanceSquared = offsetX * offsetX + offsetY * offsetY;
+	if (!(distanceSquared < radius * radius && distanceSquared > 0.f))
+		return false;
+
+	float scale = radius / sqrtf(distanceSquared);
+	positionX = nearestX + offsetX * scale;
+	positionY = nearestY + offsetY * scale;
+	return true;
+}
+
+//points inside the box leave through the closest edge, points outside it are pushed away from the nearest point on it
+static bool PushPointOutOfBoxScalar(float& positionX, float& positionY, float minX, float minY, float maxX, float maxY, float particleRadius)
+{
+	float x = positionX;
+	float y = positionY;
+	if (x > minX && x < maxX && y > minY && y < maxY)
+	{
+		float distanceToMinX = x - minX;
+		float distanceToMaxX = maxX - x;
+		float distanceToMinY = y - minY;
+		float distanceToMaxY = maxY - y;
+		float edgeX = distanceToMinX < distanceToMaxX ? minX - particleRadius : maxX + particleRadius;
+		float edgeY = distanceToMinY < distanceToMaxY ? minY - particleRadius : maxY + particleRadius;
+		float distanceToEdgeX = distanceToMinX < distanceToMaxX ? distanceToMinX : distanceToMaxX;
+		float distanceToEdgeY = distanceToMinY < distanceToMaxY ? distanceToMinY : distanceToMaxY;
+		if (distanceToEdgeX < distanceToEdgeY)
+			positionX = edgeX;
+		else
+			positionY = edgeY;
+		return true;
+	}
+
+	float nearestX = x < maxX ? x : maxX;
+	float nearestY = y < maxY ? y : maxY;
+	nearestX = minX > nearestX ? minX : nearestX;
+	nearestY = minY > nearestY ? minY : nearestY;
+	return PushPointAwayFromNearestPointScalar(positionX, positionY, nearestX, nearestY, particleRadius);
+}
+
+static void PushParticlesOutOfDiscScalar(float* positionsX, float* positionsY, int startIndex, int endIndex, float centerX, float centerY, float radius)
+{
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		PushPointAwayFromNearestPointScalar(positionsX[i], positionsY[i], centerX, centerY, radius);
+	}
+}
+
+static void PushParticlesOutOfAABB2Scalar(float* positionsX, float* positionsY, int startIndex, int endIndex, float minX, float minY, float maxX, float maxY,
+	float particleRadius)
+{
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		PushPointOutOfBoxScalar(positionsX[i], positionsY[i], minX, minY, maxX, maxY, particleRadius);
+	}
+}
+
+static void PushParticlesOutOfOBB2Scalar(float* positionsX, float* positionsY, int startIndex, int endIndex, float centerX, float centerY, float iBasisX, float iBasisY,
+	float halfWidth, float halfHeight, float particleRadius)
+{
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		//the box is axis aligned in its own space, j basis is i rotated by 90 degrees
+		float relativeX = positionsX[i] - centerX;
+		float relativeY = positionsY[i] - centerY;
+		float localX = relativeX * iBasisX + relativeY * iBasisY;
+		float localY = relativeY * iBasisX - relativeX * iBasisY;
+		if (PushPointOutOfBoxScalar(localX, localY, -halfWidth, -halfHeight, halfWidth, halfHeight, particleRadius))
+		{
+			positionsX[i] = centerX + (localX * iBasisX - localY * iBasisY);
+			positionsY[i] = centerY + (localX * iBasisY + localY * iBasisX);
+		}
+	}
+}
+
+static void PushParticlesOutOfCapsule2Scalar(float* positionsX, float* positionsY, int startIndex, int endIndex, float startX, float startY, float boneX, float boneY,
+	float inverseBoneLengthSquared, float radius)
+{
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		float fraction = ((positionsX[i] - startX) * boneX + (positionsY[i] - startY) * boneY) * inverseBoneLengthSquared;
+		fraction = fraction < 1.f ? fraction : 1.f;
+		fraction = 0.f > fraction ? 0.f : fraction;
+		PushPointAwayFromNearestPointScalar(positionsX[i], positionsY[i], startX + boneX * fraction, startY + boneY * fraction, radius);
+	}
+}
+
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+static __m256 PushPointsAwayFromNearestPoints8(__m256& positionX, __m256& positionY, __m256 nearestX, __m256 nearestY, __m256 radius)
+{
+	__m256 offsetX = _mm256_sub_ps(positionX, nearestX);
+	__m256 offsetY = _mm256_sub_ps(positionY, nearestY);
+	__m256 distanceSquared = _mm256_add_ps(_mm256_mul_ps(offsetX, offsetX), _mm256_mul_ps(offsetY, offsetY));
+	__m256 isTouching = _mm256_and_ps(_mm256_cmp_ps(distanceSquared, _mm256_mul_ps(radius, radius), _CMP_LT_OQ),
+		_mm256_cmp_ps(distanceSquared, _mm256_setzero_ps(), _CMP_GT_OQ));
+
+	//lanes that are not touching may divide by zero here, their result is thrown away by the blend
+	__m256 scale = _mm256_div_ps(radius, _mm256_sqrt_ps(distanceSquared));
+	positionX = _mm256_blendv_ps(positionX, _mm256_add_ps(nearestX, _mm256_mul_ps(offsetX, scale)), isTouching);
+	positionY = _mm256_blendv_ps(positionY, _mm256_add_ps(nearestY, _mm256_mul_ps(offsetY, scale)), isTouching);
+	return isTouching;
+}
+
+static __m256 PushPointsOutOfBox8(__m256& positionX, __m256& positionY, __m256 minX, __m256 minY, __m256 maxX, __m256 maxY, __m256 particleRadius)
+{
+	__m256 x = positionX;
+	__m256 y = positionY;
+	__m256 isInside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, minX, _CMP_GT_OQ), _mm256_cmp_ps(x, maxX, _CMP_LT_OQ)),
+		_mm256_and_ps(_mm256_cmp_ps(y, minY, _CMP_GT_OQ), _mm256_cmp_ps(y, maxY, _CMP_LT_OQ)));
+	__m256 distanceToMinX = _mm256_sub_ps(x, minX);
+	__m256 distanceToMaxX = _mm256_sub_ps(maxX, x);
+	__m256 distanceToMinY = _mm256_sub_ps(y, minY);
+	__m256 distanceToMaxY = _mm256_sub_ps(maxY, y);
+	__m256 isMinXCloser = _mm256_cmp_ps(distanceToMinX, distanceToMaxX, _CMP_LT_OQ);
+	__m256 isMinYCloser = _mm256_cmp_ps(distanceToMinY, distanceToMaxY, _CMP_LT_OQ);
+	__m256 edgeX = _mm256_blendv_ps(_mm256_add_ps(maxX, particleRadius), _mm256_sub_ps(minX, particleRadius), isMinXCloser);
+	__m256 edgeY = _mm256_blendv_ps(_mm256_add_ps(maxY, particleRadius), _mm256_sub_ps(minY, particleRadius), isMinYCloser);
+	__m256 isXEdgeCloser = _mm256_cmp_ps(_mm256_min_ps(distanceToMinX, distanceToMaxX), _mm256_min_ps(distanceToMinY, distanceToMaxY), _CMP_LT_OQ);
+	__m256 insideX = _mm256_blendv_ps(x, edgeX, isXEdgeCloser);
+	__m256 insideY = _mm256_blendv_ps(edgeY, y, isXEdgeCloser);
+
+	__m256 nearestX = _mm256_max_ps(minX, _mm256_min_ps(x, maxX));
+	__m256 nearestY = _mm256_max_ps(minY, _mm256_min_ps(y, maxY));
+	__m256 isTouching = PushPointsAwayFromNearestPoints8(x, y, nearestX, nearestY, particleRadius);
+	positionX = _mm256_blendv_ps(x, insideX, isInside);
+	positionY = _mm256_blendv_ps(y, insideY, isInside);
+	return _mm256_or_ps(isInside, isTouching);
+}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+//SSE2 has no blend instruction
+static __m128 Select4(__m128 condition, __m128 ifTrue, __m128 ifFalse)
+{
+	return _mm_or_ps(_mm_and_ps(condition, ifTrue), _mm_andnot_ps(condition, ifFalse));
+}
+
+static __m128 PushPointsAwayFromNearestPoints4(__m128& positionX, __m128& positionY, __m128 nearestX, __m128 nearestY, __m128 radius)
+{
+	__m128 offsetX = _mm_sub_ps(positionX, nearestX);
+	__m128 offsetY = _mm_sub_ps(positionY, nearestY);
+	__m128 distanceSquared = _mm_add_ps(_mm_mul_ps(offsetX, offsetX), _mm_mul_ps(offsetY, offsetY));
+	__m128 isTouching = _mm_and_ps(_mm_cmplt_ps(distanceSquared, _mm_mul_ps(radius, radius)), _mm_cmpgt_ps(distanceSquared, _mm_setzero_ps()));
+
+	__m128 scale = _mm_div_ps(radius, _mm_sqrt_ps(distanceSquared));
+	positionX = Select4(isTouching, _mm_add_ps(nearestX, _mm_mul_ps(offsetX, scale)), positionX);
+	positionY = Select4(isTouching, _mm_add_ps(nearestY, _mm_mul_ps(offsetY, scale)), positionY);
+	return isTouching;
+}
+
+static __m128 PushPointsOutOfBox4(__m128& positionX, __m128& positionY, __m128 minX, __m128 minY, __m128 maxX, __m128 maxY, __m128 particleRadius)
+{
+	__m128 x = positionX;
+	__m128 y = positionY;
+	__m128 isInside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(x, minX), _mm_cmplt_ps(x, maxX)), _mm_and_ps(_mm_cmpgt_ps(y, minY), _mm_cmplt_ps(y, maxY)));
+	__m128 distanceToMinX = _mm_sub_ps(x, minX);
+	__m128 distanceToMaxX = _mm_sub_ps(maxX, x);
+	__m128 distanceToMinY = _mm_sub_ps(y, minY);
+	__m128 distanceToMaxY = _mm_sub_ps(maxY, y);
+	__m128 edgeX = Select4(_mm_cmplt_ps(distanceToMinX, distanceToMaxX), _mm_sub_ps(minX, particleRadius), _mm_add_ps(maxX, particleRadius));
+	__m128 edgeY = Select4(_mm_cmplt_ps(distanceToMinY, distanceToMaxY), _mm_sub_ps(minY, particleRadius), _mm_add_ps(maxY, particleRadius));
+	__m128 isXEdgeCloser = _mm_cmplt_ps(_mm_min_ps(distanceToMinX, distanceToMaxX), _mm_min_ps(distanceToMinY, distanceToMaxY));
+	__m128 insideX = Select4(isXEdgeCloser, edgeX, x);
+	__m128 insideY = Select4(isXEdgeCloser, y, edgeY);
+
+	__m128 nearestX = _mm_max_ps(minX, _mm_min_ps(x, maxX));
+	__m128 nearestY = _mm_max_ps(minY, _mm_min_ps(y, maxY));
+	__m128 isTouching = PushPointsAwayFromNearestPoints4(x, y, nearestX, nearestY, particleRadius);
+	positionX = Select4(isInside, insideX, x);
+	positionY = Select4(isInside, insideY, y);
+	return _mm_or_ps(isInside, isTouching);
+}
+#endif
+
+void PushParticlesOutOfDisc(float* positionsX, float* positionsY, int numParticles, float centerX, float centerY, float radius, bool useSimd)
+{
+	int i = 0;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256 center[2] = { _mm256_set1_ps(centerX), _mm256_set1_ps(centerY) };
+		const __m256 radiusFactor = _mm256_set1_ps(radius);
+		for (; i + 8 <= numParticles; i += 8)
+		{
+			__m256 positionX = _mm256_loadu_ps(positionsX + i);
+			__m256 positionY = _mm256_loadu_ps(positionsY + i);
+			PushPointsAwayFromNearestPoints8(positionX, positionY, center[0], center[1], radiusFactor);
+			_mm256_storeu_ps(positionsX + i, positionX);
+			_mm256_storeu_ps(positionsY + i, positionY);
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128 center[2] = { _mm_set1_ps(centerX), _mm_set1_ps(centerY) };
+		const __m128 radiusFactor = _mm_set1_ps(radius);
+		for (; i + 4 <= numParticles; i += 4)
+		{
+			__m128 positionX = _mm_loadu_ps(positionsX + i);
+			__m128 positionY = _mm_loadu_ps(positionsY + i);
+			PushPointsAwayFromNearestPoints4(positionX, positionY, center[0], center[1], radiusFactor);
+			_mm_storeu_ps(positionsX + i, positionX);
+			_mm_storeu_ps(positionsY + i, positionY);
+		}
+	}
+#else
+	(void)useSimd;
+#endif
+
+	PushParticlesOutOfDiscScalar(positionsX, positionsY, i, numParticles, centerX, centerY, radius);
+}
+
+void PushParticlesOutOfAABB2(float* positionsX, float* positionsY, int numParticles, float minX, float minY, float maxX, float maxY, float particleRadius, bool useSimd)
+{
+	int i = 0;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256 mins[2] = { _mm256_set1_ps(minX), _mm256_set1_ps(minY) };
+		const __m256 maxs[2] = { _mm256_set1_ps(maxX), _mm256_set1_ps(maxY) };
+		const __m256 radiusFactor = _mm256_set1_ps(particleRadius);
+		for (; i + 8 <= numParticles; i += 8)
+		{
+			__m256 positionX = _mm256_loadu_ps(positionsX + i);
+			__m256 positionY = _mm256_loadu_ps(positionsY + i);
+			PushPointsOutOfBox8(positionX, positionY, mins[0], mins[1], maxs[0], maxs[1], radiusFactor);
+			_mm256_storeu_ps(positionsX + i, positionX);
+			_mm256_storeu_ps(positionsY + i, positionY);
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128 mins[2] = { _mm_set1_ps(minX), _mm_set1_ps(minY) };
+		const __m128 maxs[2] = { _mm_set1_ps(maxX), _mm_set1_ps(maxY) };
+		const __m128 radiusFactor = _mm_set1_ps(particleRadius);
+		for (; i + 4 <= numParticles; i += 4)
+		{
+			__m128 positionX = _mm_loadu_ps(positionsX + i);
+			__m128 positionY = _mm_loadu_ps(positionsY + i);
+			PushPointsOutOfBox4(positionX, positionY, mins[0], mins[1], maxs[0], maxs[1], radiusFactor);
+			_mm_storeu_ps(positionsX + i, positionX);
+			_mm_storeu_ps(positionsY + i, positionY);
+		}
+	}
+#else
+	(void)useSimd;
+#endif
+
+	PushParticlesOutOfAABB2Scalar(positionsX, positionsY, i, numParticles, minX, minY, maxX, maxY, particleRadius);
+}
+
+void PushParticlesOutOfOBB2(float* positionsX, float* positionsY, int numParticles, float centerX, float centerY, float iBasisX, float iBasisY,
+	float halfWidth, float halfHeight, float particleRadius, bool useSimd)
+{
+	int i = 0;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256 center[2] = { _mm256_set1_ps(centerX), _mm256_set1_ps(centerY) };
+		const __m256 iBasis[2] = { _mm256_set1_ps(iBasisX), _mm256_set1_ps(iBasisY) };
+		const __m256 mins[2] = { _mm256_set1_ps(-halfWidth), _mm256_set1_ps(-halfHeight) };
+		const __m256 maxs[2] = { _mm256_set1_ps(halfWidth), _mm256_set1_ps(halfHeight) };
+		const __m256 radiusFactor = _mm256_set1_ps(particleRadius);
+		for (; i + 8 <= numParticles; i += 8)
+		{
+			__m256 positionX = _mm256_loadu_ps(positionsX + i);
+			__m256 positionY = _mm256_loadu_ps(positionsY + i);
+			__m256 relativeX = _mm256_sub_ps(positionX, center[0]);
+			__m256 relativeY = _mm256_sub_ps(positionY, center[1]);
+			__m256 localX = _mm256_add_ps(_mm256_mul_ps(relativeX, iBasis[0]), _mm256_mul_ps(relativeY, iBasis[1]));
+			__m256 localY = _mm256_sub_ps(_mm256_mul_ps(relativeY, iBasis[0]), _mm256_mul_ps(relativeX, iBasis[1]));
+			__m256 isPushed = PushPointsOutOfBox8(localX, localY, mins[0], mins[1], maxs[0], maxs[1], radiusFactor);
+
+			//only pushed lanes go back through the basis, the rest keep their exact positions
+			__m256 worldX = _mm256_add_ps(center[0], _mm256_sub_ps(_mm256_mul_ps(localX, iBasis[0]), _mm256_mul_ps(localY, iBasis[1])));
+			__m256 worldY = _mm256_add_ps(center[1], _mm256_add_ps(_mm256_mul_ps(localX, iBasis[1]), _mm256_mul_ps(localY, iBasis[0])));
+			_mm256_storeu_ps(positionsX + i, _mm256_blendv_ps(positionX, worldX, isPushed));
+			_mm256_storeu_ps(positionsY + i, _mm256_blendv_ps(positionY, worldY, isPushed));
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128 center[2] = { _mm_set1_ps(centerX), _mm_set1_ps(centerY) };
+		const __m128 iBasis[2] = { _mm_set1_ps(iBasisX), _mm_set1_ps(iBasisY) };
+		const __m128 mins[2] = { _mm_set1_ps(-halfWidth), _mm_set1_ps(-halfHeight) };
+		const __m128 maxs[2] = { _mm_set1_ps(halfWidth), _mm_set1_ps(halfHeight) };
+		const __m128 radiusFactor = _mm_set1_ps(particleRadius);
+		for (; i + 4 <= numParticles; i += 4)
+		{
+			__m128 positionX = _mm_loadu_ps(positionsX + i);
+			__m128 positionY = _mm_loadu_ps(positionsY + i);
+			__m128 relativeX = _mm_sub_ps(positionX, center[0]);
+			__m128 relativeY = _mm_sub_ps(positionY, center[1]);
+			__m128 localX = _mm_add_ps(_mm_mul_ps(relativeX, iBasis[0]), _mm_mul_ps(relativeY, iBasis[1]));
+			__m128 localY = _mm_sub_ps(_mm_mul_ps(relativeY, iBasis[0]), _mm_mul_ps(relativeX, iBasis[1]));
+			__m128 isPushed = PushPointsOutOfBox4(localX, localY, mins[0], mins[1], maxs[0], maxs[1], radiusFactor);
+
+			__m128 worldX = _mm_add_ps(center[0], _mm_sub_ps(_mm_mul_ps(localX, iBasis[0]), _mm_mul_ps(localY, iBasis[1])));
+			__m128 worldY = _mm_add_ps(center[1], _mm_add_ps(_mm_mul_ps(localX, iBasis[1]), _mm_mul_ps(localY, iBasis[0])));
+			_mm_storeu_ps(positionsX + i, Select4(isPushed, worldX, positionX));
+			_mm_storeu_ps(positionsY + i, Select4(isPushed, worldY, positionY));
+		}
+	}
+#else
+	(void)useSimd;
+#endif
+
+	PushParticlesOutOfOBB2Scalar(positionsX, positionsY, i, numParticles, centerX, centerY, iBasisX, iBasisY, halfWidth, halfHeight, particleRadius);
+}
+
+void PushParticlesOutOfCapsule2(float* positionsX, float* positionsY, int numParticles, float startX, float startY, float endX, float endY, float radius, bool useSimd)
+{
+	int i = 0;
+	float boneX = endX - startX;
+	float boneY = endY - startY;
+	float boneLengthSquared = boneX * boneX + boneY * boneY;
+	//a capsule with a zero length bone is a disc around its start
+	float inverseBoneLengthSquared = boneLengthSquared > 0.f ? 1.f / boneLengthSquared : 0.f;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256 start[2] = { _mm256_set1_ps(startX), _mm256_set1_ps(startY) };
+		const __m256 bone[2] = { _mm256_set1_ps(boneX), _mm256_set1_ps(boneY) };
+		const __m256 inverseLengthSquared = _mm256_set1_ps(inverseBoneLengthSquared);
+		const __m256 radiusFactor = _mm256_set1_ps(radius);
+		for (; i + 8 <= numParticles; i += 8)
+		{
+			__m256 positionX = _mm256_loadu_ps(positionsX + i);
+			__m256 positionY = _mm256_loadu_ps(positionsY + i);
+			__m256 fraction = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(positionX, start[0]), bone[0]), _mm256_mul_ps(_mm256_sub_ps(positionY, start[1]), bone[1])),
+				inverseLengthSquared);
+			fraction = _mm256_max_ps(zero, _mm256_min_ps(fraction, one));
+			__m256 nearestX = _mm256_add_ps(start[0], _mm256_mul_ps(bone[0], fraction));
+			__m256 nearestY = _mm256_add_ps(start[1], _mm256_mul_ps(bone[1], fraction));
+			PushPointsAwayFromNearestPoints8(positionX, positionY, nearestX, nearestY, radiusFactor);
+			_mm256_storeu_ps(positionsX + i, positionX);
+			_mm256_storeu_ps(positionsY + i, positionY);
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 start[2] = { _mm_set1_ps(startX), _mm_set1_ps(startY) };
+		const __m128 bone[2] = { _mm_set1_ps(boneX), _mm_set1_ps(boneY) };
+		const __m128 inverseLengthSquared = _mm_set1_ps(inverseBoneLengthSquared);
+		const __m128 radiusFactor = _mm_set1_ps(radius);
+		for (; i + 4 <= numParticles; i += 4)
+		{
+			__m128 positionX = _mm_loadu_ps(positionsX + i);
+			__m128 positionY = _mm_loadu_ps(positionsY + i);
+			__m128 fraction = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(positionX, start[0]), bone[0]), _mm_mul_ps(_mm_sub_ps(positionY, start[1]), bone[1])),
+				inverseLengthSquared);
+			fraction = _mm_max_ps(zero, _mm_min_ps(fraction, one));
+			__m128 nearestX = _mm_add_ps(start[0], _mm_mul_ps(bone[0], fraction));
+			__m128 nearestY = _mm_add_ps(start[1], _mm_mul_ps(bone[1], fraction));
+			PushPointsAwayFromNearestPoints4(positionX, positionY, nearestX, nearestY, radiusFactor);
+			_mm_storeu_ps(positionsX + i, positionX);
+			_mm_storeu_ps(positionsY + i, positionY);
+		}
+	}
+#else
+	(void)useSimd;
+#endif
+
+	PushParticlesOutOfCapsule2Scalar(positionsX, positionsY, i, numParticles, startX, startY, boneX, boneY, inverseBoneLengthSquared, radius);
+}
+
+void SweepParticlesAgainstDisc(float* positionsX, float* positionsY, int numParticles, float centerX, float centerY, float radius, float motionX, float motionY)
+{
+	//seen from the collider at its current pose, a resting particle at p moves from p + motion to p during the step
+	float motionLengthSquared = motionX * motionX + motionY * motionY;
+	if (motionLengthSquared <= 0.f)
+		return;
+
+	float cullMinX = centerX - radius - (motionX > 0.f ? motionX : 0.f);
+	float cullMaxX = centerX + radius - (motionX < 0.f ? motionX : 0.f);
+	float cullMinY = centerY - radius - (motionY > 0.f ? motionY : 0.f);
+	float cullMaxY = centerY + radius - (motionY < 0.f ? motionY : 0.f);
+	float radiusSquared = radius * radius;
+	for (int i = 0; i < numParticles; i++)
+	{
+		float positionX = positionsX[i];
+		float positionY = positionsY[i];
+		if (positionX <= cullMinX || positionX >= cullMaxX || positionY <= cullMinY || positionY >= cullMaxY)
+			continue;
+
+		float startOffsetX = positionX + motionX - centerX;
+		float startOffsetY = positionY + motionY - centerY;
+		float startDistanceSquared = startOffsetX * startOffsetX + startOffsetY * startOffsetY;
+		float halfB = -(startOffsetX * motionX + startOffsetY * motionY);
+		float timeOfImpact = 0.f;
+		if (startDistanceSquared < radiusSquared)
+		{
+			//a particle the disc already touched (usually one it pushed last step) is carried along if it is on the leading side,
+			//the regular push takes care of the others
+			if (halfB >= 0.f)
+				continue;
+		}
+		else
+		{
+			//first root of |startOffset - motion * t| = radius
+			float discriminant = halfB * halfB - motionLengthSquared * (startDistanceSquared - radiusSquared);
+			if (discriminant < 0.f)
+				continue;
+
+			timeOfImpact = (-halfB - sqrtf(discriminant)) / motionLengthSquared;
+			if (timeOfImpact < 0.f || timeOfImpact > 1.f)
+				continue;
+		}
+
+		positionsX[i] = positionX + motionX * (1.f - timeOfImpact);
+		positionsY[i] = positionY + motionY * (1.f - timeOfImpact);
+	}
+}
+
+//slab test of the segment start + motion * t against a box, returns the entry time or -1 if the segment misses the box
+static float GetSegmentEntryTimeIntoBox(float start, float motion, float boxMin, float boxMax, float& out_exitTime)
+{
+	if (motion == 0.f)
+	{
+		out_exitTime = (start > boxMin && start < boxMax) ? 1.f : -1.f;
+		return (start > boxMin && start < boxMax) ? 0.f : 2.f;
+	}
+
+	float timeAtMin = (boxMin - start) / motion;
+	float timeAtMax = (boxMax - start) / motion;
+	out_exitTime = timeAtMin > timeAtMax ? timeAtMin : timeAtMax;
+	return timeAtMin < timeAtMax ? timeAtMin : timeAtMax;
+}
+
+void SweepParticlesAgainstAABB2(float* positionsX, float* positionsY, int numParticles, float minX, float minY, float maxX, float maxY, float particleRadius,
+	float motionX, float motionY)
+{
+	if (motionX == 0.f && motionY == 0.f)
+		return;
+
+	float grownMinX = minX - particleRadius;
+	float grownMinY = minY - particleRadius;
+	float grownMaxX = maxX + particleRadius;
+	float grownMaxY = maxY + particleRadius;
+	float cullMinX = grownMinX - (motionX > 0.f ? motionX : 0.f);
+	float cullMaxX = grownMaxX - (motionX < 0.f ? motionX : 0.f);
+	float cullMinY = grownMinY - (motionY > 0.f ? motionY : 0.f);
+	float cullMaxY = grownMaxY - (motionY < 0.f ? motionY : 0.f);
+	for (int i = 0; i < numParticles; i++)
+	{
+		float positionX = positionsX[i];
+		float positionY = positionsY[i];
+		if (positionX <= cullMinX || positionX >= cullMaxX || positionY <= cullMinY || positionY >= cullMaxY)
+			continue;
+
+		//relative to the box the particle travels from p + motion back to p
+		float startX = positionX + motionX;
+		float startY = positionY + motionY;
+		float timeOfImpact = 0.f;
+		if (startX > grownMinX && startX < grownMaxX && startY > grownMinY && startY < grownMaxY)
+		{
+			//a particle the box already touched is carried along if its closest face is one the box is moving towards, so particles
+			//resting on a side face do not stick to it
+			float distanceToMinX = startX - grownMinX;
+			float distanceToMaxX = grownMaxX - startX;
+			float distanceToMinY = startY - grownMinY;
+			float distanceToMaxY = grownMaxY - startY;
+			float distanceToEdgeX = distanceToMinX < distanceToMaxX ? distanceToMinX : distanceToMaxX;
+			float distanceToEdgeY = distanceToMinY < distanceToMaxY ? distanceToMinY : distanceToMaxY;
+			float faceMotion = 0.f;
+			if (distanceToEdgeX < distanceToEdgeY)
+				faceMotion = distanceToMinX < distanceToMaxX ? -motionX : motionX;
+			else
+				faceMotion = distanceToMinY < distanceToMaxY ? -motionY : motionY;
+			if (faceMotion <= 0.f)
+				continue;
+		}
+		else
+		{
+			float exitTimeX = 0.f;
+			float exitTimeY = 0.f;
+			float entryTimeX = GetSegmentEntryTimeIntoBox(startX, -motionX, grownMinX, grownMaxX, exitTimeX);
+			float entryTimeY = GetSegmentEntryTimeIntoBox(startY, -motionY, grownMinY, grownMaxY, exitTimeY);
+			timeOfImpact = entryTimeX > entryTimeY ? entryTimeX : entryTimeY;
+			float exitTime = exitTimeX < exitTimeY ? exitTimeX : exitTimeY;
+			if (timeOfImpact > exitTime || timeOfImpact < 0.f || timeOfImpact > 1.f)
+				continue;
+		}
+
+		positionsX[i] = positionX + motionX * (1.f - timeOfImpact);
+		positionsY[i] = positionY + motionY * (1.f - timeOfImpact);
+	}
+}
+
+#if PARTICLE_KERNEL_SIMD_WIDTH > 1
+//bits startIndex to startIndex + numBits (at most 32) of a particle mask, the range does not have to be aligned to the mask words
+static uint32_t GetParticleMaskBits(const uint32_t* particleMask, int startIndex, int numBits)
+{
+	int bitIndex = startIndex & 31;
+	uint64_t bits = particleMask[startIndex >> 5];
+	if (bitIndex + numBits > 32)
+	{
+		bits |= (uint64_t)particleMask[(startIndex >> 5) + 1] << 32;
+	}
+	return (uint32_t)((bits >> bitIndex) & ((1ull << numBits) - 1ull));
+}
+#endif
+
+//estimates of 1 / sqrt(x) and 1 / x, each refined by one newton step to about 22 bits. On x86 the scalar path uses the same estimate
+//instructions as the SIMD paths, so both give identical results
+static inline float GetReciprocalSquareRootEstimate(float value)
+{
+#if PARTICLE_KERNEL_SIMD_WIDTH > 1
+	return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(value)));
+#else
+	return 1.f / sqrtf(value);
+#endif
+}
+
+static inline float GetReciprocalEstimate(float value)
+{
+#if PARTICLE_KERNEL_SIMD_WIDTH > 1
+	return _mm_cvtss_f32(_mm_rcp_ss(_mm_set_ss(value)));
+#else
+	return 1.f / value;
+#endif
+}
+
+//flat plate model of the air pushing on the edge from particle A to particle B: with u the wind relative to the edge and p the
+//edge normal scaled by the edge length, drag acts along u and lift along the part of the normal perpendicular to u. Both grow with
+//the square of the relative wind speed and the edge length and vanish when the wind runs along the edge. Written so that an edge
+//costs one reciprocal square root and one reciprocal estimate instead of a square root and two divisions. The displacements are the
+//particles' verlet steps, position - previous position
+static inline void ComputeAerodynamicEdgeForceScalar(const AerodynamicUniforms& uniforms, float positionAX, float positionAY, float displacementAX, float displacementAY,
+	float invMassA, float positionBX, float positionBY, float displacementBX, float displacementBY, float invMassB, float& out_forceX, float& out_forceY)
+{
+	float halfInverseDeltaSeconds = 0.5f * uniforms.m_inverseDeltaSeconds;
+	float edgeX = positionBX - positionAX;
+	float edgeY = positionBY - positionAY;
+	float relativeWindX = uniforms.m_windVelocityX - (displacementAX + displacementBX) * halfInverseDeltaSeconds;
+	float relativeWindY = uniforms.m_windVelocityY - (displacementAY + displacementBY) * halfInverseDeltaSeconds;
+	float normalX = -edgeY;
+	float normalY = edgeX;
+	float windDotNormal = relativeWindX * normalX + relativeWindY * normalY;
+	float absWindDotNormal = fabsf(windDotNormal);
+	float speedSquared = relativeWindX * relativeWindX + relativeWindY * relativeWindY;
+	float lengthTimesSpeedSquared = (edgeX * edgeX + edgeY * edgeY) * speedSquared;
+	float estimate = GetReciprocalSquareRootEstimate(lengthTimesSpeedSquared);
+	float inverseLengthTimesSpeed = estimate * (1.5f - ((0.5f * lengthTimesSpeedSquared) * estimate) * estimate);
+	float liftScale = lengthTimesSpeedSquared > 0.f ? uniforms.m_liftCoefficient * inverseLengthTimesSpeed : 0.f;
+	float windFactor = uniforms.m_dragCoefficient * absWindDotNormal - liftScale * (windDotNormal * windDotNormal);
+	float normalFactor = liftScale * speedSquared * windDotNormal;
+
+	//a particle is on up to 4 edges and takes half of each, so this keeps the wind from pushing the lighter particle of the edge past
+	//the wind speed within one step, which would make very light cloth blow up
+	float maxInvMass = invMassA > invMassB ? invMassA : invMassB;
+	float velocityChangeRate = (uniforms.m_dragCoefficient + uniforms.m_liftCoefficient) * absWindDotNormal * maxInvMass;
+	float rateEstimate = GetReciprocalEstimate(velocityChangeRate);
+	float inverseRate = rateEstimate * (2.f - velocityChangeRate * rateEstimate);
+	float limit = velocityChangeRate > halfInverseDeltaSeconds ? halfInverseDeltaSeconds * inverseRate : 1.f;
+	windFactor = windFactor * limit;
+	normalFactor = normalFactor * limit;
+	out_forceX = relativeWindX * windFactor + normalX * normalFactor;
+	out_forceY = relativeWindY * windFactor + normalY * normalFactor;
+}
+
+static void ComputeAerodynamicEdgeForcesScalar(const float* positionsX, const float* positionsY, const float* prevPositionsX, const float* prevPositionsY,
+	const float* invMasses, int startIndex, int endIndex, int endEastIndex, int rowStride, bool hasSouthEdges, const AerodynamicUniforms& uniforms,
+	float* out_horizontalX, float* out_horizontalY, float* out_verticalX, float* out_verticalY)
+{
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		float positionAX = positionsX[i];
+		float positionAY = positionsY[i];
+		float displacementAX = positionAX - prevPositionsX[i];
+		float displacementAY = positionAY - prevPositionsY[i];
+		out_horizontalX[i] = 0.f;
+		out_horizontalY[i] = 0.f;
+		out_verticalX[i] = 0.f;
+		out_verticalY[i] = 0.f;
+		if (i < endEastIndex)
+		{
+			int indexB = i + 1;
+			ComputeAerodynamicEdgeForceScalar(uniforms, positionAX, positionAY, displacementAX, displacementAY, invMasses[i], positionsX[indexB], positionsY[indexB],
+				positionsX[indexB] - prevPositionsX[indexB], positionsY[indexB] - prevPositionsY[indexB], invMasses[indexB], out_horizontalX[i], out_horizontalY[i]);
+		}
+		if (hasSouthEdges)
+		{
+			int indexB = i + rowStride;
+			ComputeAerodynamicEdgeForceScalar(uniforms, positionAX, positionAY, displacementAX, displacementAY, invMasses[i], positionsX[indexB], positionsY[indexB],
+				positionsX[indexB] - prevPositionsX[indexB], positionsY[indexB] - prevPositionsY[indexB], invMasses[indexB], out_verticalX[i], out_verticalY[i]);
+		}
+	}
+}
+
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+struct AerodynamicFactors8
+{
+	__m256 m_windVelocityX;
+	__m256 m_windVelocityY;
+	__m256 m_halfInverseDeltaSeconds;
+	__m256 m_dragCoefficient;
+	__m256 m_liftCoefficient;
+	__m256 m_forceCoefficientSum;
+};
+
+static void ComputeAerodynamicEdgeForces8(const AerodynamicFactors8& factors, __m256 positionAX, __m256 positionAY, __m256 displacementAX, __m256 displacementAY,
+	__m256 invMassA, __m256 positionBX, __m256 positionBY, __m256 displacementBX, __m256 displacementBY, __m256 invMassB, __m256& out_forceX, __m256& out_forceY)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 two = _mm256_set1_ps(2.f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 threeHalves = _mm256_set1_ps(1.5f);
+	const __m256 signBit = _mm256_set1_ps(-0.f);
+	__m256 edgeX = _mm256_sub_ps(positionBX, positionAX);
+	__m256 edgeY = _mm256_sub_ps(positionBY, positionAY);
+	__m256 relativeWindX = _mm256_sub_ps(factors.m_windVelocityX, _mm256_mul_ps(_mm256_add_ps(displacementAX, displacementBX), factors.m_halfInverseDeltaSeconds));
+	__m256 relativeWindY = _mm256_sub_ps(factors.m_windVelocityY, _mm256_mul_ps(_mm256_add_ps(displacementAY, displacementBY), factors.m_halfInverseDeltaSeconds));
+	__m256 normalX = _mm256_xor_ps(edgeY, signBit);
+	__m256 normalY = edgeX;
+	__m256 windDotNormal = _mm256_add_ps(_mm256_mul_ps(relativeWindX, normalX), _mm256_mul_ps(relativeWindY, normalY));
+	__m256 absWindDotNormal = _mm256_andnot_ps(signBit, windDotNormal);
+	__m256 speedSquared = _mm256_add_ps(_mm256_mul_ps(relativeWindX, relativeWindX), _mm256_mul_ps(relativeWindY, relativeWindY));
+	__m256 lengthTimesSpeedSquared = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(edgeX, edgeX), _mm256_mul_ps(edgeY, edgeY)), speedSquared);
+	__m256 estimate = _mm256_rsqrt_ps(lengthTimesSpeedSquared);
+	__m256 inverseLengthTimesSpeed = _mm256_mul_ps(estimate, _mm256_sub_ps(threeHalves, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(half, lengthTimesSpeedSquared), estimate), estimate)));
+	__m256 liftScale = _mm256_and_ps(_mm256_cmp_ps(lengthTimesSpeedSquared, zero, _CMP_GT_OQ), _mm256_mul_ps(factors.m_liftCoefficient, inverseLengthTimesSpeed));
+	__m256 windFactor = _mm256_sub_ps(_mm256_mul_ps(factors.m_dragCoefficient, absWindDotNormal), _mm256_mul_ps(liftScale, _mm256_mul_ps(windDotNormal, windDotNormal)));
+	__m256 normalFactor = _mm256_mul_ps(_mm256_mul_ps(liftScale, speedSquared), windDotNormal);
+
+	__m256 maxInvMass = _mm256_max_ps(invMassA, invMassB);
+	__m256 velocityChangeRate = _mm256_mul_ps(_mm256_mul_ps(factors.m_forceCoefficientSum, absWindDotNormal), maxInvMass);
+	__m256 rateEstimate = _mm256_rcp_ps(velocityChangeRate);
+	__m256 inverseRate = _mm256_mul_ps(rateEstimate, _mm256_sub_ps(two, _mm256_mul_ps(velocityChangeRate, rateEstimate)));
+	__m256 isLimited = _mm256_cmp_ps(velocityChangeRate, factors.m_halfInverseDeltaSeconds, _CMP_GT_OQ);
+	__m256 limit = _mm256_blendv_ps(one, _mm256_mul_ps(factors.m_halfInverseDeltaSeconds, inverseRate), isLimited);
+	windFactor = _mm256_mul_ps(windFactor, limit);
+	normalFactor = _mm256_mul_ps(normalFactor, limit);
+	out_forceX = _mm256_add_ps(_mm256_mul_ps(relativeWindX, windFactor), _mm256_mul_ps(normalX, normalFactor));
+	out_forceY = _mm256_add_ps(_mm256_mul_ps(relativeWindY, windFactor), _mm256_mul_ps(normalY, normalFactor));
+}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+struct AerodynamicFactors4
+{
+	__m128 m_windVelocityX;
+	__m128 m_windVelocityY;
+	__m128 m_halfInverseDeltaSeconds;
+	__m128 m_dragCoefficient;
+	__m128 m_liftCoefficient;
+	__m128 m_forceCoefficientSum;
+};
+
+static void ComputeAerodynamicEdgeForces4(const AerodynamicFactors4& factors, __m128 positionAX, __m128 positionAY, __m128 displacementAX, __m128 displacementAY,
+	__m128 invMassA, __m128 positionBX, __m128 positionBY, __m128 displacementBX, __m128 displacementBY, __m128 invMassB, __m128& out_forceX, __m128& out_forceY)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 two = _mm_set1_ps(2.f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 threeHalves = _mm_set1_ps(1.5f);
+	const __m128 signBit = _mm_set1_ps(-0.f);
+	__m128 edgeX = _mm_sub_ps(positionBX, positionAX);
+	__m128 edgeY = _mm_sub_ps(positionBY, positionAY);
+	__m128 relativeWindX = _mm_sub_ps(factors.m_windVelocityX, _mm_mul_ps(_mm_add_ps(displacementAX, displacementBX), factors.m_halfInverseDeltaSeconds));
+	__m128 relativeWindY = _mm_sub_ps(factors.m_windVelocityY, _mm_mul_ps(_mm_add_ps(displacementAY, displacementBY), factors.m_halfInverseDeltaSeconds));
+	__m128 normalX = _mm_xor_ps(edgeY, signBit);
+	__m128 normalY = edgeX;
+	__m128 windDotNormal = _mm_add_ps(_mm_mul_ps(relativeWindX, normalX), _mm_mul_ps(relativeWindY, normalY));
+	__m128 absWindDotNormal = _mm_andnot_ps(signBit, windDotNormal);
+	__m128 speedSquared = _mm_add_ps(_mm_mul_ps(relativeWindX, relativeWindX), _mm_mul_ps(relativeWindY, relativeWindY));
+	__m128 lengthTimesSpeedSquared = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(edgeX, edgeX), _mm_mul_ps(edgeY, edgeY)), speedSquared);
+	__m128 estimate = _mm_rsqrt_ps(lengthTimesSpeedSquared);
+	__m128 inverseLengthTimesSpeed = _mm_mul_ps(estimate, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(half, lengthTimesSpeedSquared), estimate), estimate)));
+	__m128 liftScale = _mm_and_ps(_mm_cmpgt_ps(lengthTimesSpeedSquared, zero), _mm_mul_ps(factors.m_liftCoefficient, inverseLengthTimesSpeed));
+	__m128 windFactor = _mm_sub_ps(_mm_mul_ps(factors.m_dragCoefficient, absWindDotNormal), _mm_mul_ps(liftScale, _mm_mul_ps(windDotNormal, windDotNormal)));
+	__m128 normalFactor = _mm_mul_ps(_mm_mul_ps(liftScale, speedSquared), windDotNormal);
+
+	__m128 maxInvMass = _mm_max_ps(invMassA, invMassB);
+	__m128 velocityChangeRate = _mm_mul_ps(_mm_mul_ps(factors.m_forceCoefficientSum, absWindDotNormal), maxInvMass);
+	__m128 rateEstimate = _mm_rcp_ps(velocityChangeRate);
+	__m128 inverseRate = _mm_mul_ps(rateEstimate, _mm_sub_ps(two, _mm_mul_ps(velocityChangeRate, rateEstimate)));
+	__m128 isLimited = _mm_cmpgt_ps(velocityChangeRate, factors.m_halfInverseDeltaSeconds);
+	__m128 limit = Select4(isLimited, _mm_mul_ps(factors.m_halfInverseDeltaSeconds, inverseRate), one);
+	windFactor = _mm_mul_ps(windFactor, limit);
+	normalFactor = _mm_mul_ps(normalFactor, limit);
+	out_forceX = _mm_add_ps(_mm_mul_ps(relativeWindX, windFactor), _mm_mul_ps(normalX, normalFactor));
+	out_forceY = _mm_add_ps(_mm_mul_ps(relativeWindY, windFactor), _mm_mul_ps(normalY, normalFactor));
+}
+#endif
+
+void ComputeAerodynamicEdgeForces(const float* positionsX, const float* positionsY, const float* prevPositionsX, const float* prevPositionsY, const float* invMasses,
+	int startIndex, int numParticles, int rowStride, bool hasLastEastEdge, bool hasSouthEdges, const AerodynamicUniforms& uniforms, float* out_horizontalX,
+	float* out_horizontalY, float* out_verticalX, float* out_verticalY, bool useSimd)
+{
+	//the SIMD loops only take batches where every particle has its east edge, the rest is left to the scalar loop
+	int i = startIndex;
+	int endIndex = startIndex + numParticles;
+	int endEastIndex = hasLastEastEdge ? endIndex : endIndex - 1;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		AerodynamicFactors8 factors;
+		factors.m_windVelocityX = _mm256_set1_ps(uniforms.m_windVelocityX);
+		factors.m_windVelocityY = _mm256_set1_ps(uniforms.m_windVelocityY);
+		factors.m_halfInverseDeltaSeconds = _mm256_set1_ps(0.5f * uniforms.m_inverseDeltaSeconds);
+		factors.m_dragCoefficient = _mm256_set1_ps(uniforms.m_dragCoefficient);
+		factors.m_liftCoefficient = _mm256_set1_ps(uniforms.m_liftCoefficient);
+		factors.m_forceCoefficientSum = _mm256_set1_ps(uniforms.m_dragCoefficient + uniforms.m_liftCoefficient);
+		for (; i + 8 <= endEastIndex; i += 8)
+		{
+			__m256 positionAX = _mm256_loadu_ps(positionsX + i);
+			__m256 positionAY = _mm256_loadu_ps(positionsY + i);
+			__m256 displacementAX = _mm256_sub_ps(positionAX, _mm256_loadu_ps(prevPositionsX + i));
+			__m256 displacementAY = _mm256_sub_ps(positionAY, _mm256_loadu_ps(prevPositionsY + i));
+			__m256 invMassA = _mm256_loadu_ps(invMasses + i);
+			__m256 forceX;
+			__m256 forceY;
+
+			int eastIndex = i + 1;
+			__m256 eastPositionX = _mm256_loadu_ps(positionsX + eastIndex);
+			__m256 eastPositionY = _mm256_loadu_ps(positionsY + eastIndex);
+			ComputeAerodynamicEdgeForces8(factors, positionAX, positionAY, displacementAX, displacementAY, invMassA, eastPositionX, eastPositionY,
+				_mm256_sub_ps(eastPositionX, _mm256_loadu_ps(prevPositionsX + eastIndex)), _mm256_sub_ps(eastPositionY, _mm256_loadu_ps(prevPositionsY + eastIndex)),
+				_mm256_loadu_ps(invMasses + eastIndex), forceX, forceY);
+			_mm256_storeu_ps(out_horizontalX + i, forceX);
+			_mm256_storeu_ps(out_horizontalY + i, forceY);
+
+			if (hasSouthEdges)
+			{
+				int southIndex = i + rowStride;
+				__m256 southPositionX = _mm256_loadu_ps(positionsX + southIndex);
+				__m256 southPositionY = _mm256_loadu_ps(positionsY + southIndex);
+				ComputeAerodynamicEdgeForces8(factors, positionAX, positionAY, displacementAX, displacementAY, invMassA, southPositionX, southPositionY,
+					_mm256_sub_ps(southPositionX, _mm256_loadu_ps(prevPositionsX + southIndex)), _mm256_sub_ps(southPositionY, _mm256_loadu_ps(prevPositionsY + southIndex)),
+					_mm256_loadu_ps(invMasses + southIndex), forceX, forceY);
+			}
+			else
+			{
+				forceX = _mm256_setzero_ps();
+				forceY = _mm256_setzero_ps();
+			}
+			_mm256_storeu_ps(out_verticalX + i, forceX);
+			_mm256_storeu_ps(out_verticalY + i, forceY);
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		AerodynamicFactors4 factors;
+		factors.m_windVelocityX = _mm_set1_ps(uniforms.m_windVelocityX);
+		factors.m_windVelocityY = _mm_set1_ps(uniforms.m_windVelocityY);
+		factors.m_halfInverseDeltaSeconds = _mm_set1_ps(0.5f * uniforms.m_inverseDeltaSeconds);
+		factors.m_dragCoefficient = _mm_set1_ps(uniforms.m_dragCoefficient);
+		factors.m_liftCoefficient = _mm_set1_ps(uniforms.m_liftCoefficient);
+		factors.m_forceCoefficientSum = _mm_set1_ps(uniforms.m_dragCoefficient + uniforms.m_liftCoefficient);
+		for (; i + 4 <= endEastIndex; i += 4)
+		{
+			__m128 positionAX = _mm_loadu_ps(positionsX + i);
+			__m128 positionAY = _mm_loadu_ps(positionsY + i);
+			__m128 displacementAX = _mm_sub_ps(positionAX, _mm_loadu_ps(prevPositionsX + i));
+			__m128 displacementAY = _mm_sub_ps(positionAY, _mm_loadu_ps(prevPositionsY + i));
+			__m128 invMassA = _mm_loadu_ps(invMasses + i);
+			__m128 forceX;
+			__m128 forceY;
+
+			int eastIndex = i + 1;
+			__m128 eastPositionX = _mm_loadu_ps(positionsX + eastIndex);
+			__m128 eastPositionY = _mm_loadu_ps(positionsY + eastIndex);
+			ComputeAerodynamicEdgeForces4(factors, positionAX, positionAY, displacementAX, displacementAY, invMassA, eastPositionX, eastPositionY,
+				_mm_sub_ps(eastPositionX, _mm_loadu_ps(prevPositionsX + eastIndex)), _mm_sub_ps(eastPositionY, _mm_loadu_ps(prevPositionsY + eastIndex)),
+				_mm_loadu_ps(invMasses + eastIndex), forceX, forceY);
+			_mm_storeu_ps(out_horizontalX + i, forceX);
+			_mm_storeu_ps(out_horizontalY + i, forceY);
+
+			if (hasSouthEdges)
+			{
+				int southIndex = i + rowStride;
+				__m128 southPositionX = _mm_loadu_ps(positionsX + southIndex);
+				__m128 southPositionY = _mm_loadu_ps(positionsY + southIndex);
+				ComputeAerodynamicEdgeForces4(factors, positionAX, positionAY, displacementAX, displacementAY, invMassA, southPositionX, southPositionY,
+					_mm_sub_ps(southPositionX, _mm_loadu_ps(prevPositionsX + southIndex)), _mm_sub_ps(southPositionY, _mm_loadu_ps(prevPositionsY + southIndex)),
+					_mm_loadu_ps(invMasses + southIndex), forceX, forceY);
+			}
+			else
+			{
+				forceX = _mm_setzero_ps();
+				forceY = _mm_setzero_ps();
+			}
+			_mm_storeu_ps(out_verticalX + i, forceX);
+			_mm_storeu_ps(out_verticalY + i, forceY);
+		}
+	}
+#else
+	(void)useSimd;
+#endif
+
+	ComputeAerodynamicEdgeForcesScalar(positionsX, positionsY, prevPositionsX, prevPositionsY, invMasses, i, endIndex, endEastIndex, rowStride, hasSouthEdges, uniforms,
+		out_horizontalX, out_horizontalY, out_verticalX, out_verticalY);
+}
+
+static void ApplyAerodynamicEdgeForcesScalar(float* prevPositionsX, float* prevPositionsY, const float* invMasses, const uint32_t* fixedMask, int startIndex, int endIndex,
+	int rowStride, const AerodynamicEdgeForces& edgeForces, float deltaSeconds)
+{
+	//every particle takes half of each of its (up to 4) edges' forces
+	float halfDeltaSecondsSquared = 0.5f * deltaSeconds * deltaSeconds;
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		bool isFixed = ((fixedMask[i >> 5] >> (i & 31)) & 1u) != 0;
+		float forceX = (edgeForces.m_horizontalX[i] + edgeForces.m_horizontalX[i - 1]) + (edgeForces.m_verticalX[i] + edgeForces.m_verticalX[i - rowStride]);
+		float forceY = (edgeForces.m_horizontalY[i] + edgeForces.m_horizontalY[i - 1]) + (edgeForces.m_verticalY[i] + edgeForces.m_verticalY[i - rowStride]);
+		float scale = invMasses[i] * halfDeltaSecondsSquared;
+		prevPositionsX[i] = isFixed ? prevPositionsX[i] : prevPositionsX[i] - forceX * scale;
+		prevPositionsY[i] = isFixed ? prevPositionsY[i] : prevPositionsY[i] - forceY * scale;
+	}
+}
+
+void ApplyAerodynamicEdgeForces(float* prevPositionsX, float* prevPositionsY, const float* invMasses, const uint32_t* fixedMask, int startIndex, int numParticles,
+	int rowStride, const AerodynamicEdgeForces& edgeForces, float deltaSeconds, bool useSimd)
+{
+	int i = startIndex;
+	int endIndex = startIndex + numParticles;
+	float halfDeltaSecondsSquared = 0.5f * deltaSeconds * deltaSeconds;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		const __m256 halfDeltaSecondsSquaredFactor = _mm256_set1_ps(halfDeltaSecondsSquared);
+		for (; i + 8 <= endIndex; i += 8)
+		{
+			int fixedBits = (int)GetParticleMaskBits(fixedMask, i, 8);
+			if (fixedBits == 0xFF)
+				continue;
+
+			__m256 isFixed = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(fixedBits), laneBits), laneBits));
+			__m256 forceX = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(edgeForces.m_horizontalX + i), _mm256_loadu_ps(edgeForces.m_horizontalX + i - 1)),
+				_mm256_add_ps(_mm256_loadu_ps(edgeForces.m_verticalX + i), _mm256_loadu_ps(edgeForces.m_verticalX + i - rowStride)));
+			__m256 forceY = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(edgeForces.m_horizontalY + i), _mm256_loadu_ps(edgeForces.m_horizontalY + i - 1)),
+				_mm256_add_ps(_mm256_loadu_ps(edgeForces.m_verticalY + i), _mm256_loadu_ps(edgeForces.m_verticalY + i - rowStride)));
+			__m256 scale = _mm256_mul_ps(_mm256_loadu_ps(invMasses + i), halfDeltaSecondsSquaredFactor);
+			__m256 prevX = _mm256_loadu_ps(prevPositionsX + i);
+			__m256 prevY = _mm256_loadu_ps(prevPositionsY + i);
+			_mm256_storeu_ps(prevPositionsX + i, _mm256_blendv_ps(_mm256_sub_ps(prevX, _mm256_mul_ps(forceX, scale)), prevX, isFixed));
+			_mm256_storeu_ps(prevPositionsY + i, _mm256_blendv_ps(_mm256_sub_ps(prevY, _mm256_mul_ps(forceY, scale)), prevY, isFixed));
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+		const __m128 halfDeltaSecondsSquaredFactor = _mm_set1_ps(halfDeltaSecondsSquared);
+		for (; i + 4 <= endIndex; i += 4)
+		{
+			int fixedBits = (int)GetParticleMaskBits(fixedMask, i, 4);
+			if (fixedBits == 0xF)
+				continue;
+
+			__m128 isFixed = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(fixedBits), laneBits), laneBits));
+			__m128 forceX = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(edgeForces.m_horizontalX + i), _mm_loadu_ps(edgeForces.m_horizontalX + i - 1)),
+				_mm_add_ps(_mm_loadu_ps(edgeForces.m_verticalX + i), _mm_loadu_ps(edgeForces.m_verticalX + i - rowStride)));
+			__m128 forceY = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(edgeForces.m_horizontalY + i), _mm_loadu_ps(edgeForces.m_horizontalY + i - 1)),
+				_mm_add_ps(_mm_loadu_ps(edgeForces.m_verticalY + i), _mm_loadu_ps(edgeForces.m_verticalY + i - rowStride)));
+			__m128 scale = _mm_mul_ps(_mm_loadu_ps(invMasses + i), halfDeltaSecondsSquaredFactor);
+			__m128 prevX = _mm_loadu_ps(prevPositionsX + i);
+			__m128 prevY = _mm_loadu_ps(prevPositionsY + i);
+			_mm_storeu_ps(prevPositionsX + i, Select4(isFixed, prevX, _mm_sub_ps(prevX, _mm_mul_ps(forceX, scale))));
+			_mm_storeu_ps(prevPositionsY + i, Select4(isFixed, prevY, _mm_sub_ps(prevY, _mm_mul_ps(forceY, scale))));
+		}
+	}
+#else
+	(void)useSimd;
+	(void)halfDeltaSecondsSquared;
+#endif
+
+	ApplyAerodynamicEdgeForcesScalar(prevPositionsX, prevPositionsY, invMasses, fixedMask, i, endIndex, rowStride, edgeForces, deltaSeconds);
+}
+
+void IntegrateVerletRange(float* positionsX, float* positionsY, float* prevPositionsX, float* prevPositionsY, const uint32_t* pinnedMask, int startIndex,
+	int numParticles, const VerletIntegrationUniforms& uniforms, bool useSimd)
+{
+	int i = startIndex;
+	int endIndex = startIndex + numParticles;
+	float damping = 1.f - uniforms.m_drag;
+	float stepX = uniforms.m_accelerationX * uniforms.m_deltaSeconds * uniforms.m_deltaSeconds;
+	float stepY = uniforms.m_accelerationY * uniforms.m_deltaSeconds * uniforms.m_deltaSeconds;
+#if PARTICLE_KERNEL_SIMD_WIDTH == 8
+	if (useSimd)
+	{
+		const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		const __m256 dampingFactor = _mm256_set1_ps(damping);
+		const __m256 stepXFactor = _mm256_set1_ps(stepX);
+		const __m256 stepYFactor = _mm256_set1_ps(stepY);
+		for (; i + 8 <= endIndex; i += 8)
+		{
+			int pinnedBits = (int)GetParticleMaskBits(pinnedMask, i, 8);
+			if (pinnedBits == 0xFF)
+				continue;
+
+			__m256 isPinned = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(pinnedBits), laneBits), laneBits));
+
+			__m256 currentX = _mm256_loadu_ps(positionsX + i);
+			__m256 currentY = _mm256_loadu_ps(positionsY + i);
+			__m256 prevX = _mm256_loadu_ps(prevPositionsX + i);
+			__m256 prevY = _mm256_loadu_ps(prevPositionsY + i);
+			__m256 nextX = _mm256_add_ps(currentX, _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(currentX, prevX), dampingFactor), stepXFactor));
+			__m256 nextY = _mm256_add_ps(currentY, _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(currentY, prevY), dampingFactor), stepYFactor));
+
+			_mm256_storeu_ps(positionsX + i, _mm256_blendv_ps(nextX, currentX, isPinned));
+			_mm256_storeu_ps(positionsY + i, _mm256_blendv_ps(nextY, currentY, isPinned));
+			_mm256_storeu_ps(prevPositionsX + i, _mm256_blendv_ps(currentX, prevX, isPinned));
+			_mm256_storeu_ps(prevPositionsY + i, _mm256_blendv_ps(currentY, prevY, isPinned));
+		}
+	}
+#elif PARTICLE_KERNEL_SIMD_WIDTH == 4
+	if (useSimd)
+	{
+		const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+		const __m128 dampingFactor = _mm_set1_ps(damping);
+		const __m128 stepXFactor = _mm_set1_ps(stepX);
+		const __m128 stepYFactor = _mm_set1_ps(stepY);
+		for (; i + 4 <= endIndex; i += 4)
+		{
+			int pinnedBits = (int)GetParticleMaskBits(pinnedMask, i, 4);
+			if (pinnedBits == 0xF)
+				continue;
+
+			__m128 isPinned = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(pinnedBits), laneBits), laneBits));
+
+			__m128 currentX = _mm_loadu_ps(positionsX + i);
+			__m128 currentY = _mm_loadu_ps(positionsY + i);
+			__m128 prevX = _mm_loadu_ps(prevPositionsX + i);
+			__m128 prevY = _mm_loadu_ps(prevPositionsY + i);
+			__m128 nextX = _mm_add_ps(currentX, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(currentX, prevX), dampingFactor), stepXFactor));
+			__m128 nextY = _mm_add_ps(currentY, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(currentY, prevY), dampingFactor), stepYFactor));
+
+			_mm_storeu_ps(positionsX + i, Select4(isPinned, currentX, nextX));
+			_mm_storeu_ps(positionsY + i, Select4(isPinned, currentY, nextY));
+			_mm_storeu_ps(prevPositionsX + i, Select4(isPinned, prevX, currentX));
+			_mm_storeu_ps(prevPositionsY + i, Select4(isPinned, prevY, currentY));
+		}
+	}
+#else
+	(void)useSimd;
+	(void)damping;
+	(void)stepX;
+	(void)stepY;
+#endif
+
+	IntegrateVerletScalar(positionsX, positionsY, prevPositionsX, prevPositionsY, pinnedMask, i, endIndex, uniforms);
+}
+
+#if defined(PARTICLE_KERNEL_VERIFICATION)
+static void FillRandomParticles(ParticleStore& particles, int numParticles, const RandomNumberGenerator& rng)
+{
+	for (int i = 0; i < numParticles; i++)
+	{
+		Vec2 position(rng.GetRandomFloatInRange(-100.f, 100.f), rng.GetRandomFloatInRange(-100.f, 100.f));
+		int particleIndex = particles.AddParticle(position, rng.GetRandomFloatInRange(0.5f, 10.f), rng.GetRandomIntLessThan(8) == 0);
+		particles.m_prevX[particleIndex] += rng.GetRandomFloatInRange(-1.f, 1.f);
+		particles.m_prevY[particleIndex] += rng.GetRandomFloatInRange(-1.f, 1.f);
+	}
+}
+
+static bool AreArraysBitIdentical(const AlignedFloatArray& arrayA, const AlignedFloatArray& arrayB)
+{
+	return arrayA.size() == arrayB.size() && memcmp(arrayA.data(), arrayB.data(), arrayA.size() * sizeof(float)) == 0;
+}
+
+bool DoesVerletKernelMatchScalar(int numParticles)
+{
+	RandomNumberGenerator rng;
+	ParticleStore simdParticles;
+	FillRandomParticles(simdParticles, numParticles, rng);
+	ParticleStore scalarParticles = simdParticles;
+
+	VerletIntegrationUniforms uniforms;
+	uniforms.m_accelerationX = rng.GetRandomFloatInRange(-100.f, 100.f);
+	uniforms.m_accelerationY = -400.f;
+	uniforms.m_drag = 0.01f;
+	uniforms.m_deltaSeconds = 0.01f;
+	IntegrateVerlet(simdParticles.m_x.data(), simdParticles.m_y.data(), simdParticles.m_prevX.data(), simdParticles.m_prevY.data(), simdParticles.m_pinnedMask.data(),
+		numParticles, uniforms, true);
+	IntegrateVerlet(scalarParticles.m_x.data(), scalarParticles.m_y.data(), scalarParticles.m_prevX.data(), scalarParticles.m_prevY.data(), scalarParticles.m_pinnedMask.data(),
+		numParticles, uniforms, false);
+
+	return AreArraysBitIdentical(simdParticles.m_x, scalarParticles.m_x) && AreArraysBitIdentical(simdParticles.m_y, scalarParticles.m_y) &&
+		AreArraysBitIdentical(simdParticles.m_prevX, scalarParticles.m_prevX) && AreArraysBitIdentical(simdParticles.m_prevY, scalarParticles.m_prevY);
+}
+
+bool DoJacobiKernelsMatchScalar(int numParticles)
+{
+	//the random constraint generation needs at least two particles
+	if (numParticles < 2)
+		numParticles = 2;
+	RandomNumberGenerator rng;
+	ParticleStore simdParticles;
+	FillRandomParticles(simdParticles, numParticles, rng);
+	ParticleStore scalarParticles = simdParticles;
+
+	std::vector<DistanceConstraint> constraints;
+	for (int i = 0; i < numParticles * 2; i++)
+	{
+		DistanceConstraint constraint;
+		constraint.particleIndexA = (uint32_t)rng.GetRandomIntLessThan(numParticles);
+		constraint.particleIndexB = (uint32_t)rng.GetRandomIntLessThan(numParticles);
+		constraint.restLength = rng.GetRandomFloatInRange(0.f, 10.f);
+		constraints.push_back(constraint);
+	}
+
+	ParticleStore* particleStores[2] = { &simdParticles, &scalarParticles };
+	float maxViolations[2] = {};
+	for (int storeIndex = 0; storeIndex < 2; storeIndex++)
+	{
+		ParticleStore& particles = *particleStores[storeIndex];
+		bool useSimd = (storeIndex == 0);
+		AlignedFloatArray effectiveInvMasses(numParticles);
+		AlignedFloatArray deltasX(numParticles, 0.f);
+		AlignedFloatArray deltasY(numParticles, 0.f);
+		AlignedFloatArray constraintCounts(numParticles, 0.f);
+		AlignedFloatArray correctionsX(constraints.size());
+		AlignedFloatArray correctionsY(constraints.size());
+		ComputeEffectiveInverseMasses(particles.m_invMass.data(), particles.m_pinnedMask.data(), numParticles, effectiveInvMasses.data());
+		float maxViolation = 0.f;
+		float sumSquaredViolation = 0.f;
+		ComputeDistanceConstraintCorrections(particles.m_x.data(), particles.m_y.data(), effectiveInvMasses.data(), constraints.data(), (int)constraints.size(),
+			correctionsX.data(), correctionsY.data(), maxViolation, sumSquaredViolation, useSimd);
+		maxViolations[storeIndex] = maxViolation;
+		AccumulateDistanceConstraintCorrections(effectiveInvMasses.data(), constraints.data(), (int)constraints.size(), correctionsX.data(), correctionsY.data(),
+			deltasX.data(), deltasY.data(), constraintCounts.data());
+		ApplyJacobiDeltas(particles.m_x.data(), particles.m_y.data(), deltasX.data(), deltasY.data(), constraintCounts.data(), numParticles, 1.5f, useSimd);
+	}
+
+	//the summed squared violation depends on the reduction order, the max does not
+	return AreArraysBitIdentical(simdParticles.m_x, scalarParticles.m_x) && AreArraysBitIdentical(simdParticles.m_y, scalarParticles.m_y) &&
+		maxViolations[0] == maxViolations[1];
+}
+
+bool DoColliderKernelsMatchScalar(int numParticles)
+{
+	//the first particle is skipped to test unaligned ranges
+	if (numParticles < 2)
+		numParticles = 2;
+	RandomNumberGenerator rng;
+	ParticleStore simdParticles;
+	FillRandomParticles(simdParticles, numParticles, rng);
+	ParticleStore scalarParticles = simdParticles;
+
+	//colliders sized so a good share of the particles end up inside or just next to them
+	float discCenterX = rng.GetRandomFloatInRange(-50.f, 50.f);
+	float discCenterY = rng.GetRandomFloatInRange(-50.f, 50.f);
+	float discRadius = rng.GetRandomFloatInRange(20.f, 50.f);
+	float boxMinX = rng.GetRandomFloatInRange(-100.f, 0.f);
+	float boxMinY = rng.GetRandomFloatInRange(-100.f, 0.f);
+	float boxMaxX = boxMinX + rng.GetRandomFloatInRange(10.f, 100.f);
+	float boxMaxY = boxMinY + rng.GetRandomFloatInRange(10.f, 100.f);
+	float orientation = rng.GetRandomFloatInRange(0.f, 6.2831853f);
+	float iBasisX = cosf(orientation);
+	float iBasisY = sinf(orientation);
+	float capsuleStartX = rng.GetRandomFloatInRange(-100.f, 100.f);
+	float capsuleStartY = rng.GetRandomFloatInRange(-100.f, 100.f);
+	float capsuleEndX = rng.GetRandomFloatInRange(-100.f, 100.f);
+	float capsuleEndY = rng.GetRandomFloatInRange(-100.f, 100.f);
+	constexpr float particleRadius = 0.6f;
+
+	ParticleStore* particleStores[2] = { &simdParticles, &scalarParticles };
+	for (int storeIndex = 0; storeIndex < 2; storeIndex++)
+	{
+		//start one particle in so the SIMD loads are not aligned
+		float* positionsX = particleStores[storeIndex]->m_x.data() + 1;
+		float* positionsY = particleStores[storeIndex]->m_y.data() + 1;
+		int numPushedParticles = numParticles - 1;
+		bool useSimd = (storeIndex == 0);
+		PushParticlesOutOfDisc(positionsX, positionsY, numPushedParticles, discCenterX, discCenterY, discRadius + particleRadius, useSimd);
+		PushParticlesOutOfAABB2(positionsX, positionsY, numPushedParticles, boxMinX, boxMinY, boxMaxX, boxMaxY, particleRadius, useSimd);
+		PushParticlesOutOfOBB2(positionsX, positionsY, numPushedParticles, discCenterY, discCenterX, iBasisX, iBasisY, 40.f, 15.f, particleRadius, useSimd);
+		PushParticlesOutOfCapsule2(positionsX, positionsY, numPushedParticles, capsuleStartX, capsuleStartY, capsuleEndX, capsuleEndY, 10.f + particleRadius, useSimd);
+	}
+
+	return AreArraysBitIdentical(simdParticles.m_x, scalarParticles.m_x) && AreArraysBitIdentical(simdParticles.m_y, scalarParticles.m_y);
+}
+
+bool DoAerodynamicKernelsMatchScalar(int numParticles)
+{
+	//a random grid, rowStride wide, with a row of zero forces in front so the first row can read its missing north edges
+	constexpr int rowStride = 37;
+	if (numParticles < 4)
+		numParticles = 4;
+	RandomNumberGenerator rng;
+	ParticleStore simdParticles;
+	FillRandomParticles(simdParticles, numParticles, rng);
+	ParticleStore scalarParticles = simdParticles;
+
+	AerodynamicUniforms uniforms;
+	uniforms.m_windVelocityX = rng.GetRandomFloatInRange(-200.f, 200.f);
+	uniforms.m_windVelocityY = rng.GetRandomFloatInRange(-50.f, 50.f);
+	uniforms.m_dragCoefficient = 0.01f;
+	uniforms.m_liftCoefficient = 0.005f;
+	uniforms.m_inverseDeltaSeconds = 100.f;
+	int numRows = (numParticles + rowStride - 1) / rowStride;
+	AlignedFloatArray forceArrays[2][4];
+	for (int pathIndex = 0; pathIndex < 2; pathIndex++)
+	{
+		bool useSimd = (pathIndex == 0);
+		ParticleStore& particles = useSimd ? simdParticles : scalarParticles;
+		AlignedFloatArray* forces = forceArrays[pathIndex];
+		for (int i = 0; i < 4; i++)
+		{
+			forces[i].assign(rowStride + numParticles, 0.f);
+		}
+		//row by row in two unaligned halves, the way the cloth patches split their rows
+		for (int y = 0; y < numRows; y++)
+		{
+			int rowStartIndex = y * rowStride;
+			int rowLength = (rowStartIndex + rowStride < numParticles) ? rowStride : numParticles - rowStartIndex;
+			bool hasSouthEdges = (rowStartIndex + rowStride + rowLength <= numParticles);
+			int firstHalfLength = rowLength / 2;
+			ComputeAerodynamicEdgeForces(particles.m_x.data(), particles.m_y.data(), particles.m_prevX.data(), particles.m_prevY.data(), particles.m_invMass.data(),
+				rowStartIndex, firstHalfLength, rowStride, true, hasSouthEdges, uniforms, forces[0].data() + rowStride, forces[1].data() + rowStride,
+				forces[2].data() + rowStride, forces[3].data() + rowStride, useSimd);
+			ComputeAerodynamicEdgeForces(particles.m_x.data(), particles.m_y.data(), particles.m_prevX.data(), particles.m_prevY.data(), particles.m_invMass.data(),
+				rowStartIndex + firstHalfLength, rowLength - firstHalfLength, rowStride, false, hasSouthEdges, uniforms, forces[0].data() + rowStride,
+				forces[1].data() + rowStride, forces[2].data() + rowStride, forces[3].data() + rowStride, useSimd);
+		}
+
+		AerodynamicEdgeForces edgeForces;
+		edgeForces.m_horizontalX = forces[0].data() + rowStride;
+		edgeForces.m_horizontalY = forces[1].data() + rowStride;
+		edgeForces.m_verticalX = forces[2].data() + rowStride;
+		edgeForces.m_verticalY = forces[3].data() + rowStride;
+		//an unaligned start exercises the mask reads that straddle two words
+		ApplyAerodynamicEdgeForces(particles.m_prevX.data(), particles.m_prevY.data(), particles.m_invMass.data(), particles.m_pinnedMask.data(), 3, numParticles - 3,
+			rowStride, edgeForces, 0.01f, useSimd);
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (!AreArraysBitIdentical(forceArrays[0][i], forceArrays[1][i]))
+			return false;
+	}
+	return AreArraysBitIdentical(simdParticles.m_prevX, scalarParticles.m_prevX) && AreArraysBitIdentical(simdParticles.m_prevY, scalarParticles.m_prevY);
+}
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+
+struct DistanceConstraint;
+
+struct VerletIntegrationUniforms
+{
+	float m_accelerationX = 0.f;
+	float m_accelerationY = 0.f;
+	float m_drag = 0.f;
+	float m_deltaSeconds = 0.f;
+};
+
+struct AerodynamicUniforms
+{
+	float m_windVelocityX = 0.f;
+	float m_windVelocityY = 0.f;
+	float m_dragCoefficient = 0.f;
+	float m_liftCoefficient = 0.f;
+	float m_inverseDeltaSeconds = 0.f;
+};
+
+//per edge forces indexed by the particle that owns the edge: the east (horizontal) and south (vertical) edge of every grid particle
+struct AerodynamicEdgeForces
+{
+	const float* m_horizontalX = nullptr;
+	const float* m_horizontalY = nullptr;
+	const float* m_verticalX = nullptr;
+	const float* m_verticalY = nullptr;
+};
+
+//batched particle kernels that work on the ParticleStore arrays directly. Each kernel has a SIMD path (AVX2 when the
+//compiler targets it, SSE otherwise) and a scalar path that does the same floating point operations in the same order,
+//so both paths produce identical results.
+#if defined(__AVX2__)
+#define PARTICLE_KERNEL_SIMD_WIDTH 8
+#elif defined(_M_X64) || defined(__SSE2__)
+#define PARTICLE_KERNEL_SIMD_WIDTH 4
+#else
+#define PARTICLE_KERNEL_SIMD_WIDTH 1
+#endif
+
+//the checks of the SIMD paths against the scalar ones are built into debug builds, define this to check an optimised build too
+#if defined(_DEBUG) && !defined(PARTICLE_KERNEL_VERIFICATION)
+#define PARTICLE_KERNEL_VERIFICATION
+#endif
+
+//verlet integrates every unpinned particle, pinned particles are masked out instead of branched around. Groups of particles that
+//are all pinned (e.g. asleep) are skipped
+void IntegrateVerlet(float* positionsX, float* positionsY, float* prevPositionsX, float* prevPositionsY, const uint32_t* pinnedMask, int numParticles,
+	const VerletIntegrationUniforms& uniforms, bool useSimd);
+
+//the same integration for numParticles particles from startIndex, the range does not have to be aligned to the SIMD width or the mask
+//words, so a patch of a grid can integrate its rows on their own
+void IntegrateVerletRange(float* positionsX, float* positionsY, float* prevPositionsX, float* prevPositionsY, const uint32_t* pinnedMask, int startIndex,
+	int numParticles, const VerletIntegrationUniforms& uniforms, bool useSimd);
+
+//writes the inverse mass of each particle, or 0 for pinned particles
+void ComputeEffectiveInverseMasses(const float* invMasses, const uint32_t* pinnedMask, int numParticles, float* out_effectiveInvMasses);
+
+//projects every constraint against the same positions and writes its correction vector (before mass weighting) into the output arrays,
+//the largest and summed squared |length - restLength| of the solvable constraints are folded into the violation outputs
+void ComputeDistanceConstraintCorrections(const float* positionsX, const float* positionsY, const float* effectiveInvMasses, const DistanceConstraint* constraints,
+	int numConstraints, float* out_correctionsX, float* out_correctionsY, float& out_maxViolation, float& out_sumSquaredViolation, bool useSimd);
+
+//scatters the mass weighted corrections into per particle delta and constraint count buffers
+void AccumulateDistanceConstraintCorrections(const float* effectiveInvMasses, const DistanceConstraint* constraints, int numConstraints,
+	const float* correctionsX, const float* correctionsY, float* deltasX, float* deltasY, float* constraintCounts);
+
+//moves every particle by its averaged delta scaled by the relaxation factor and clears the delta buffers for the next iteration
+void ApplyJacobiDeltas(float* positionsX, float* positionsY, float* deltasX, float* deltasY, float* constraintCounts, int numParticles,
+	float relaxation, bool useSimd);
+
+//air drag and lift on the east (i to i + 1) and south (i to i + rowStride) edges of numParticles grid particles of a row from startIndex,
+//written to the output arrays at i. Both edges of a particle come from one walk over the row, so it is only loaded once. Without
+//hasLastEastEdge the last particle has no east edge and without hasSouthEdges the row has no south edges, missing edges are written
+//as 0. The velocity of an edge is the average verlet velocity of its particles, and the force is limited to what brings the lighter
+//particle up to the wind speed within one step
+void ComputeAerodynamicEdgeForces(const float* positionsX, const float* positionsY, const float* prevPositionsX, const float* prevPositionsY, const float* invMasses,
+	int startIndex, int numParticles, int rowStride, bool hasLastEastEdge, bool hasSouthEdges, const AerodynamicUniforms& uniforms, float* out_horizontalX,
+	float* out_horizontalY, float* out_verticalX, float* out_verticalY, bool useSimd);
+
+//gathers half of the force of each grid edge a particle is on (its own east and south edge, its west neighbour's east edge and its north
+//neighbour's south edge) and turns it into a velocity change by moving the previous position. Fixed particles are masked out. The edge
+//force arrays have to be readable at i - 1 and i - rowStride, and hold 0 for edges that do not exist, so no particle writes to another
+//one's data and any range of particles can be run on its own thread
+void ApplyAerodynamicEdgeForces(float* prevPositionsX, float* prevPositionsY, const float* invMasses, const uint32_t* fixedMask, int startIndex, int numParticles,
+	int rowStride, const AerodynamicEdgeForces& edgeForces, float deltaSeconds, bool useSimd);
+
+//collider kernels push every particle of a range that is closer than its radius to one collider onto the collider surface (grown by
+//that radius), other particles are left untouched. The range does not have to be aligned. Disc and capsule radii already include
+//the particle radius, boxes take it separately
+void PushParticlesOutOfDisc(float* positionsX, float* positionsY, int numParticles, float centerX, float centerY, float radius, bool useSimd);
+void PushParticlesOutOfAABB2(float* positionsX, float* positionsY, int numParticles, float minX, float minY, float maxX, float maxY, float particleRadius, bool useSimd);
+void PushParticlesOutOfOBB2(float* positionsX, float* positionsY, int numParticles, float centerX, float centerY, float iBasisX, float iBasisY,
+	float halfWidth, float halfHeight, float particleRadius, bool useSimd);
+void PushParticlesOutOfCapsule2(float* positionsX, float* positionsY, int numParticles, float startX, float startY, float endX, float endY, float radius, bool useSimd);
+
+//swept collider tests for colliders that moved by (motionX, motionY) since the previous step. A particle the collider swept over is
+//placed where the collider's leading surface first touched it, relative to the collider's current pose, so fast colliders carry
+//particles along instead of jumping past them. Each particle is first culled against the bounds of the swept shape, the few that
+//remain are tested exactly, so these only have a scalar path. Particles already touching the leading side are moved with the collider.
+//Boxes are swept as boxes grown by the particle radius
+void SweepParticlesAgainstDisc(float* positionsX, float* positionsY, int numParticles, float centerX, float centerY, float radius, float motionX, float motionY);
+void SweepParticlesAgainstAABB2(float* positionsX, float* positionsY, int numParticles, float minX, float minY, float maxX, float maxY, float particleRadius,
+	float motionX, float motionY);
+
+#if defined(PARTICLE_KERNEL_VERIFICATION)
+//run the SIMD and scalar paths of the kernels on the same random data and return whether the results are bit identical
+bool DoesVerletKernelMatchScalar(int numParticles);
+bool DoJacobiKernelsMatchScalar(int numParticles);
+bool DoColliderKernelsMatchScalar(int numParticles);
+bool DoAerodynamicKernelsMatchScalar(int numParticles);
+#endif
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include "Game/ParticleOrdering.hpp"
+#include "Game/ParticleSystem.hpp"
+#include "Game/ParticleKernels.hpp"
+#include "Engine/Core/JobSystem.hpp"
+#include "Engine/Core/Time.hpp"
+
+constexpr int RADIX_BITS = 8;
+constexpr int RADIX_SIZE = 1 << RADIX_BITS;
+constexpr int MIN_KEYS_PER_JOB = 16384;
+constexpr float MORTON_CELLS_PER_AXIS = 65535.f;
+constexpr int CACHE_LINE_SIZE = 64;
+constexpr int CACHE_WAYS = 8;
+//the benchmark links are a bit shorter than the grid spacing, so every iteration has work to do
+constexpr float benchmarkRestLengthFraction = 0.9f;
+
+extern JobSystem* g_theJobSystem;
+
+//set associative cache with least recently used replacement, counting misses of the accesses fed to it. Every modelled array starts on
+//a line of its own right after the one before, like arrays allocated back to back
+class CacheModel
+{
+public:
+	CacheModel(int cacheKiB, int numElementsPerArray)
+	{
+		int numLines = cacheKiB * 1024 / CACHE_LINE_SIZE;
+		m_numSets = (numLines / CACHE_WAYS > 0) ? numLines / CACHE_WAYS : 1;
+		m_linesPerArray = (numElementsPerArray * (int)sizeof(float) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+		m_ways.assign(m_numSets * CACHE_WAYS, -1);
+	}
+
+	void Access(int arrayIndex, int elementIndex)
+	{
+		int64_t line = (int64_t)arrayIndex * m_linesPerArray + (elementIndex * (int)sizeof(float)) / CACHE_LINE_SIZE;
+		int64_t* ways = &m_ways[(line % m_numSets) * CACHE_WAYS];
+		//ways are kept most recently used first
+		int hitWay = CACHE_WAYS - 1;
+		for (int i = 0; i < CACHE_WAYS; i++)
+		{
+			if (ways[i] == line)
+			{
+				hitWay = i;
+				break;
+			}
+		}
+		if (ways[hitWay] != line)
+		{
+			m_numMisses++;
+		}
+		for (int i = hitWay; i > 0; i--)
+		{
+			ways[i] = ways[i - 1];
+		}
+		ways[0] = line;
+	}
+
+	int64_t m_numMisses = 0;
+
+private:
+	int m_numSets = 1;
+	int m_linesPerArray = 0;
+	std::vector<int64_t> m_ways;
+};
+
+uint32_t GetMortonCode(uint32_t x, uint32_t y)
+{
+	//spreads the 16 bits of a coordinate out to every other bit
+	auto spreadBits = [](uint32_t value)
+	{
+		value &= 0x0000ffffu;
+		value = (value | (value << 8)) & 0x00ff00ffu;
+		value = (value | (value << 4)) & 0x0f0f0f0fu;
+		value = (value | (value << 2)) & 0x33333333u;
+		value = (value | (value << 1)) & 0x55555555u;
+		return value;
+	};
+
+	return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+void RadixSortKeysAndValues(std::vector<uint32_t>& keys, std::vector<int>& values)
+{
+	//the keys are split into one block per job. Every pass each block counts its digits, the offsets are summed digit by digit and
+	//block by block inside a digit, so every block scatters into output ranges of its own and blocks keep their order within a digit
+	int numKeys = (int)keys.size();
+	if (numKeys == 0)
+		return;
+
+	int maxNumBlocks = g_theJobSystem ? g_theJobSystem->GetNumWorkerThreads() + 1 : 1;
+	int numBlocks = (numKeys + MIN_KEYS_PER_JOB - 1) / MIN_KEYS_PER_JOB;
+	numBlocks = (numBlocks < maxNumBlocks) ? numBlocks : maxNumBlocks;
+	int keysPerBlock = (numKeys + numBlocks - 1) / numBlocks;
+
+	std::vector<uint32_t> sortedKeys(numKeys);
+	std::vector<int> sortedValues(numKeys);
+	std::vector<int> blockDigitOffsets(numBlocks * RADIX_SIZE);
+	for (int shift = 0; shift < 32; shift += RADIX_BITS)
+	{
+		ParallelForFunction countDigits = [&keys, &blockDigitOffsets, shift, keysPerBlock, numKeys](int startBlock, int endBlock)
+		{
+			for (int block = startBlock; block < endBlock; block++)
+			{
+				int* digitCounts = &blockDigitOffsets[block * RADIX_SIZE];
+				std::fill(digitCounts, digitCounts + RADIX_SIZE, 0);
+				int endKey = ((block + 1) * keysPerBlock < numKeys) ? (block + 1) * keysPerBlock : numKeys;
+				for (int i = block * keysPerBlock; i < endKey; i++)
+				{
+					digitCounts[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+				}
+			}
+		};
+		if (g_theJobSystem)
+			g_theJobSystem->ParallelFor(numBlocks, 1, countDigits);
+		else
+			countDigits(0, numBlocks);
+
+		//a pass where every key has the same digit would not move anything
+		bool isPassNeeded = true;
+		int offset = 0;
+		for (int digit = 0; digit < RADIX_SIZE; digit++)
+		{
+			int digitStart = offset;
+			for (int block = 0; block < numBlocks; block++)
+			{
+				int count = blockDigitOffsets[block * RADIX_SIZE + digit];
+				blockDigitOffsets[block * RADIX_SIZE + digit] = offset;
+				offset += count;
+			}
+			if (offset - digitStart == numKeys)
+			{
+				isPassNeeded = false;
+			}
+		}
+		if (!isPassNeeded)
+			continue;
+
+		ParallelForFunction scatterKeys = [&keys, &values, &sortedKeys, &sortedValues, &blockDigitOffsets, shift, keysPerBlock, numKeys](int startBlock, int endBlock)
+		{
+			for (int block = startBlock; block < endBlock; block++)
+			{
+				int* digitCursors = &blockDigitOffsets[block * RADIX_SIZE];
+				int endKey = ((block + 1) * keysPerBlock < numKeys) ? (block + 1) * keysPerBlock : numKeys;
+				for (int i = block * keysPerBlock; i < endKey; i++)
+				{
+					int destination = digitCursors[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+					sortedKeys[destination] = keys[i];
+					sortedValues[destination] = values[i];
+				}
+			}
+		};
+		if (g_theJobSystem)
+			g_theJobSystem->ParallelFor(numBlocks, 1, scatterKeys);
+		else
+			scatterKeys(0, numBlocks);
+
+		keys.swap(sortedKeys);
+		values.swap(sortedValues);
+	}
+}
+
+void GetMortonOrder(const float* positionsX, const float* positionsY, int numParticles, std::vector<int>& out_order)
+{
+	out_order.resize(numParticles);
+	if (numParticles == 0)
+		return;
+
+	//both axes use the scale of the longer side of the bounds, so the curve's cells stay square
+	float minX = positionsX[0];
+	float minY = positionsY[0];
+	float maxX = minX;
+	float maxY = minY;
+	for (int i = 1; i < numParticles; i++)
+	{
+		minX = (positionsX[i] < minX) ? positionsX[i] : minX;
+		minY = (positionsY[i] < minY) ? positionsY[i] : minY;
+		maxX = (positionsX[i] > maxX) ? positionsX[i] : maxX;
+		maxY = (positionsY[i] > maxY) ? positionsY[i] : maxY;
+	}
+	float extent = ((maxX - minX) > (maxY - minY)) ? (maxX - minX) : (maxY - minY);
+	float cellsPerUnit = (extent > 0.f) ? MORTON_CELLS_PER_AXIS / extent : 0.f;
+
+	std::vector<uint32_t> mortonCodes(numParticles);
+	ParallelForFunction computeMortonCodes = [&](int startIndex, int endIndex)
+	{
+		for (int i = startIndex; i < endIndex; i++)
+		{
+			uint32_t cellX = (uint32_t)((positionsX[i] - minX) * cellsPerUnit);
+			uint32_t cellY = (uint32_t)((positionsY[i] - minY) * cellsPerUnit);
+			mortonCodes[i] = GetMortonCode(cellX, cellY);
+			out_order[i] = i;
+		}
+	};
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numParticles, MIN_KEYS_PER_JOB, computeMortonCodes);
+	else
+		computeMortonCodes(0, numParticles);
+
+	RadixSortKeysAndValues(mortonCodes, out_order);
+}
+
+void GetNewParticleIndices(const std::vector<int>& order, std::vector<int>& out_newIndices)
+{
+	out_newIndices.resize(order.size());
+	for (int i = 0; i < order.size(); i++)
+	{
+		out_newIndices[order[i]] = i;
+	}
+}
+
+void RemapConstraintParticles(std::vector<DistanceConstraint>& constraints, const std::vector<int>& newIndices)
+{
+	for (int i = 0; i < constraints.size(); i++)
+	{
+		constraints[i].particleIndexA = (uint32_t)newIndices[constraints[i].particleIndexA];
+		constraints[i].particleIndexB = (uint32_t)newIndices[constraints[i].particleIndexB];
+	}
+}
+
+static void SortConstraintsByFirstParticle(std::vector<DistanceConstraint>& constraints)
+{
+	for (int i = 0; i < constraints.size(); i++)
+	{
+		DistanceConstraint& constraint = constraints[i];
+		if (constraint.particleIndexB < constraint.particleIndexA)
+		{
+			std::swap(constraint.particleIndexA, constraint.particleIndexB);
+		}
+	}
+	std::sort(constraints.begin(), constraints.end(), [](const DistanceConstraint& a, const DistanceConstraint& b)
+	{
+		return (a.particleIndexA != b.particleIndexA) ? a.particleIndexA < b.particleIndexA : a.particleIndexB < b.particleIndexB;
+	});
+}
+
+static void BenchmarkParticleOrder(ParticleStore& particles, const std::vector<DistanceConstraint>& constraints, int numIterations, int cacheKiB,
+	ParticleOrderBenchmarkResult& out_result)
+{
+	int numParticles = particles.GetNumParticles();
+	int numConstraints = (int)constraints.size();
+	AlignedFloatArray effectiveInvMasses(numParticles);
+	AlignedFloatArray correctionsX(numConstraints);
+	AlignedFloatArray correctionsY(numConstraints);
+	AlignedFloatArray deltasX(numParticles, 0.f);
+	AlignedFloatArray deltasY(numParticles, 0.f);
+	AlignedFloatArray constraintCounts(numParticles, 0.f);
+	ComputeEffectiveInverseMasses(particles.m_invMass.data(), particles.m_pinnedMask.data(), numParticles, effectiveInvMasses.data());
+
+	double startSeconds = GetCurrentTimeSeconds();
+	for (int i = 0; i < numIterations; i++)
+	{
+		float maxViolation = 0.f;
+		float sumSquaredViolation = 0.f;
+		ComputeDistanceConstraintCorrections(particles.m_x.data(), particles.m_y.data(), effectiveInvMasses.data(), constraints.data(), numConstraints,
+			correctionsX.data(), correctionsY.data(), maxViolation, sumSquaredViolation, true);
+		AccumulateDistanceConstraintCorrections(effectiveInvMasses.data(), constraints.data(), numConstraints, correctionsX.data(), correctionsY.data(),
+			deltasX.data(), deltasY.data(), constraintCounts.data());
+		ApplyJacobiDeltas(particles.m_x.data(), particles.m_y.data(), deltasX.data(), deltasY.data(), constraintCounts.data(), numParticles, 1.f, true);
+	}
+	out_result.m_secondsPerIteration = (numIterations > 0) ? (GetCurrentTimeSeconds() - startSeconds) / (double)numIterations : 0.0;
+
+	//one iteration as the kernels touch the per particle arrays: positions, inverse masses, deltas and counts, in that order
+	enum { POSITIONS_X, POSITIONS_Y, INVERSE_MASSES, DELTAS_X, DELTAS_Y, CONSTRAINT_COUNTS };
+	CacheModel cache(cacheKiB, numParticles);
+	for (int i = 0; i < numConstraints; i++)
+	{
+		int particleA = (int)constraints[i].particleIndexA;
+		int particleB = (int)constraints[i].particleIndexB;
+		for (int arrayIndex = POSITIONS_X; arrayIndex <= INVERSE_MASSES; arrayIndex++)
+		{
+			cache.Access(arrayIndex, particleA);
+			cache.Access(arrayIndex, particleB);
+		}
+	}
+	for (int i = 0; i < numConstraints; i++)
+	{
+		int particleA = (int)constraints[i].particleIndexA;
+		int particleB = (int)constraints[i].particleIndexB;
+		for (int arrayIndex = INVERSE_MASSES; arrayIndex <= CONSTRAINT_COUNTS; arrayIndex++)
+		{
+			cache.Access(arrayIndex, particleA);
+			cache.Access(arrayIndex, particleB);
+		}
+	}
+	for (int i = 0; i < numParticles; i++)
+	{
+		cache.Access(POSITIONS_X, i);
+		cache.Access(POSITIONS_Y, i);
+		cache.Access(DELTAS_X, i);
+		cache.Access(DELTAS_Y, i);
+		cache.Access(CONSTRAINT_COUNTS, i);
+	}
+	out_result.m_cacheMissesPerIteration = cache.m_numMisses;
+}
+
+void BenchmarkParticleOrders(int gridWidth, int gridHeight, int numIterations, int cacheKiB, ParticleOrderBenchmarkResult& out_rowMajor,
+	ParticleOrderBenchmarkResult& out_morton)
+{
+	gridWidth = (gridWidth > 1) ? gridWidth : 1;
+	gridHeight = (gridHeight > 1) ? gridHeight : 1;
+	ParticleStore rowMajorParticles;
+	rowMajorParticles.Reserve(gridWidth * gridHeight);
+	for (int y = 0; y < gridHeight; y++)
+	{
+		for (int x = 0; x < gridWidth; x++)
+		{
+			rowMajorParticles.AddParticle(Vec2((float)x, (float)-y), 1.f);
+		}
+	}
+	std::vector<DistanceConstraint> rowMajorConstraints;
+	for (int y = 0; y < gridHeight; y++)
+	{
+		for (int x = 0; x < gridWidth; x++)
+		{
+			DistanceConstraint constraint;
+			constraint.particleIndexA = (uint32_t)(y * gridWidth + x);
+			constraint.restLength = benchmarkRestLengthFraction;
+			constraint.originalRestLength = benchmarkRestLengthFraction;
+			if (x + 1 < gridWidth)
+			{
+				constraint.particleIndexB = constraint.particleIndexA + 1;
+				rowMajorConstraints.push_back(constraint);
+			}
+			if (y + 1 < gridHeight)
+			{
+				constraint.particleIndexB = constraint.particleIndexA + (uint32_t)gridWidth;
+				rowMajorConstraints.push_back(constraint);
+			}
+		}
+	}
+
+	std::vector<int> order;
+	std::vector<int> newIndices;
+	GetMortonOrder(rowMajorParticles.m_x.data(), rowMajorParticles.m_y.data(), rowMajorParticles.GetNumParticles(), order);
+	GetNewParticleIndices(order, newIndices);
+	ParticleStore mortonParticles = rowMajorParticles;
+	mortonParticles.Reorder(order);
+	std::vector<DistanceConstraint> mortonConstraints = rowMajorConstraints;
+	RemapConstraintParticles(mortonConstraints, newIndices);
+	SortConstraintsByFirstParticle(mortonConstraints);
+
+	BenchmarkParticleOrder(rowMajorParticles, rowMajorConstraints, numIterations, cacheKiB, out_rowMajor);
+	BenchmarkParticleOrder(mortonParticles, mortonConstraints, numIterations, cacheKiB, out_morton);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+struct DistanceConstraint;
+
+//interleaves the bits of two 16 bit coordinates, x in the even bits and y in the odd ones
+uint32_t GetMortonCode(uint32_t x, uint32_t y);
+
+//stable least significant digit radix sort of the keys, the values are moved with their keys. Runs on the job system when there is one
+void RadixSortKeysAndValues(std::vector<uint32_t>& keys, std::vector<int>& values);
+
+//particles sorted along a Z-order (Morton) curve through the bounds of their positions, so particles close to each other in space are
+//close in memory. out_order[i] is the particle that becomes particle i, particles on the same curve cell keep their order
+void GetMortonOrder(const float* positionsX, const float* positionsY, int numParticles, std::vector<int>& out_order);
+
+//out_newIndices[particle] is where the particle goes in the order
+void GetNewParticleIndices(const std::vector<int>& order, std::vector<int>& out_newIndices);
+void RemapConstraintParticles(std::vector<DistanceConstraint>& constraints, const std::vector<int>& newIndices);
+
+struct ParticleOrderBenchmarkResult
+{
+	double m_secondsPerIteration = 0.0;
+	//misses of the modelled cache over the per particle arrays the iterations gather from and scatter to
+	int64_t m_cacheMissesPerIteration = 0;
+};
+
+//runs jacobi iterations over a gridWidth x gridHeight grid of linked particles numbered row by row and numbered along a Morton curve,
+//the links of both are sorted by their first particle. Cache misses are counted on an LRU cache of cacheKiB with 64 byte lines
+void BenchmarkParticleOrders(int gridWidth, int gridHeight, int numIterations, int cacheKiB, ParticleOrderBenchmarkResult& out_rowMajor,
+	ParticleOrderBenchmarkResult& out_morton);
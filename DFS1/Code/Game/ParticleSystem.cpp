@@ -1,61 +1,454 @@
 #include "Game/ParticleSystem.hpp"
+#include "Game/ParticleKernels.hpp"
+#include "Game/ColliderSet.hpp"
+#include "Game/ImplicitIntegrator.hpp"
 #include "Engine/Math/MathUtils.hpp"
+#include "Engine/Core/EngineCommon.hpp"
+#include <math.h>
+
+void ParticleStore::Reserve(int numParticles)
+{
+	m_x.reserve(numParticles);
+	m_y.reserve(numParticles);
+	m_prevX.reserve(numParticles);
+	m_prevY.reserve(numParticles);
+	m_invMass.reserve(numParticles);
+	m_pinnedMask.reserve((numParticles + 31) / 32);
+	m_sleepingMask.reserve((numParticles + 31) / 32);
+	m_fixedMask.reserve((numParticles + 31) / 32);
+}
+
+int ParticleStore::AddParticle(const Vec2& position, float mass, bool isPinned)
+{
+	int particleIndex = GetNumParticles();
+	m_x.push_back(position.x);
+	m_y.push_back(position.y);
+	m_prevX.push_back(position.x);
+	m_prevY.push_back(position.y);
+	m_invMass.push_back(1.f / mass);
+	if ((particleIndex >> 5) >= (int)m_pinnedMask.size())
+	{
+		m_pinnedMask.push_back(0u);
+		m_sleepingMask.push_back(0u);
+		m_fixedMask.push_back(0u);
+	}
+	SetPinned(particleIndex, isPinned);
+	return particleIndex;
+}
+
+void ParticleStore::SetPosition(int particleIndex, const Vec2& position)
+{
+	m_x[particleIndex] = position.x;
+	m_y[particleIndex] = position.y;
+}
+
+void ParticleStore::SetPinned(int particleIndex, bool isPinned)
+{
+	uint32_t bit = 1u << (particleIndex & 31);
+	if (isPinned)
+		m_pinnedMask[particleIndex >> 5] |= bit;
+	else
+		m_pinnedMask[particleIndex >> 5] &= ~bit;
+	m_fixedMask[particleIndex >> 5] = m_pinnedMask[particleIndex >> 5] | m_sleepingMask[particleIndex >> 5];
+}
+
+void ParticleStore::SetSleeping(int particleIndex, bool isSleeping)
+{
+	uint32_t bit = 1u << (particleIndex & 31);
+	if (isSleeping)
+		m_sleepingMask[particleIndex >> 5] |= bit;
+	else
+		m_sleepingMask[particleIndex >> 5] &= ~bit;
+	m_fixedMask[particleIndex >> 5] = m_pinnedMask[particleIndex >> 5] | m_sleepingMask[particleIndex >> 5];
+}
+
+void ParticleStore::Reorder(const std::vector<int>& order)
+{
+	auto reorderArray = [&order](AlignedFloatArray& values)
+	{
+		AlignedFloatArray reorderedValues(values.size());
+		for (int i = 0; i < order.size(); i++)
+		{
+			reorderedValues[i] = values[order[i]];
+		}
+		values.swap(reorderedValues);
+	};
+	auto reorderMask = [&order](std::vector<uint32_t>& mask)
+	{
+		std::vector<uint32_t> reorderedMask(mask.size(), 0u);
+		for (int i = 0; i < order.size(); i++)
+		{
+			reorderedMask[i >> 5] |= ((mask[order[i] >> 5] >> (order[i] & 31)) & 1u) << (i & 31);
+		}
+		mask.swap(reorderedMask);
+	};
+
+	reorderArray(m_x);
+	reorderArray(m_y);
+	reorderArray(m_prevX);
+	reorderArray(m_prevY);
+	reorderArray(m_invMass);
+	reorderMask(m_pinnedMask);
+	reorderMask(m_sleepingMask);
+	reorderMask(m_fixedMask);
+}
+
+void ConstraintResidual::Add(float violation)
+{
+	m_maxViolation = violation > m_maxViolation ? violation : m_maxViolation;
+	m_sumSquaredViolation += violation * violation;
+	m_numConstraints++;
+}
+
+void ConstraintResidual::Merge(const ConstraintResidual& other)
+{
+	m_maxViolation = other.m_maxViolation > m_maxViolation ? other.m_maxViolation : m_maxViolation;
+	m_sumSquaredViolation += other.m_sumSquaredViolation;
+	m_numConstraints += other.m_numConstraints;
+}
+
+float ConstraintResidual::GetRms() const
+{
+	if (m_numConstraints == 0)
+		return 0.f;
+
+	return sqrtf(m_sumSquaredViolation / (float)m_numConstraints);
+}
 
 void ParticleSystem::ChangeHorizontalForceBy(float changeAmount)
 {
 	m_horizontalForce += changeAmount;
 }
 
-void ParticleSystem::GrabAndMovePoint(const Vec2& screenMousePos, std::vector<Particle>& particles, Particle*& grabbedParticle)
+void ParticleSystem::MovePoint(const Vec2& screenMousePos, int& grabbedParticleIndex)
+{
+	GrabAndMovePoint(screenMousePos, grabbedParticleIndex);
+}
+
+void ParticleSystem::TogglePinnedParticle(int particleIndex)
+{
+	if (particleIndex < 0 || particleIndex >= m_particles.GetNumParticles())
+		return;
+
+	m_particles.SetPinned(particleIndex, !m_particles.IsPinned(particleIndex));
+	WakeParticle(particleIndex);
+}
+
+void ParticleSystem::SetSleepingEnabled(bool isSleepingEnabled)
+{
+	if (!isSleepingEnabled && m_isSleepingEnabled)
+	{
+		WakeUp();
+	}
+	m_isSleepingEnabled = isSleepingEnabled;
+}
+
+void ParticleSystem::WakeUp()
+{
+	m_isAsleep = false;
+	m_numRestingUpdates = 0;
+	for (int i = 0; i < m_particles.m_sleepingMask.size(); i++)
+	{
+		m_particles.m_sleepingMask[i] = 0u;
+		m_particles.m_fixedMask[i] = m_particles.m_pinnedMask[i];
+	}
+}
+
+int ParticleSystem::GetNumSleepingParticles() const
+{
+	return m_isAsleep ? m_particles.GetNumParticles() : 0;
+}
+
+void ParticleSystem::WakeParticle(int particleIndex)
+{
+	//the whole system is a single island by default
+	UNUSED(particleIndex);
+	if (m_isAsleep)
+	{
+		WakeUp();
+	}
+}
+
+float ParticleSystem::GetMaxKineticEnergy(int startIndex, int endIndex) const
+{
+	if (m_substepSeconds <= 0.f)
+		return 0.f;
+
+	//verlet has no explicit velocity, the displacement over the last substep stands in for it
+	float maxDisplacementSquared = 0.f;
+	for (int i = startIndex; i < endIndex; i++)
+	{
+		float displacementX = m_particles.m_x[i] - m_particles.m_prevX[i];
+		float displacementY = m_particles.m_y[i] - m_particles.m_prevY[i];
+		float displacementSquared = displacementX * displacementX + displacementY * displacementY;
+		maxDisplacementSquared = (displacementSquared > maxDisplacementSquared) ? displacementSquared : maxDisplacementSquared;
+	}
+	return 0.5f * maxDisplacementSquared / (m_substepSeconds * m_substepSeconds);
+}
+
+bool ParticleSystem::WakeUpIfDisturbed()
+{
+	//returns true if the system is still asleep and its update can be skipped. Besides input, only a change of force or a collider
+	//that pushes one of the particles can disturb it
+	if (!m_isAsleep)
+		return false;
+
+	bool isDisturbed = (m_horizontalForce != m_sleepHorizontalForce);
+	if (!isDisturbed && m_colliderSet)
+	{
+		AlignedFloatArray positionsBeforePushX = m_particles.m_x;
+		AlignedFloatArray positionsBeforePushY = m_particles.m_y;
+		ResolveCollisions();
+		isDisturbed = (positionsBeforePushX != m_particles.m_x || positionsBeforePushY != m_particles.m_y);
+	}
+	if (!isDisturbed)
+		return true;
+
+	WakeUp();
+	return false;
+}
+
+void ParticleSystem::UpdateSleepState()
+{
+	m_sleepHorizontalForce = m_horizontalForce;
+	if (!m_isSleepingEnabled)
+		return;
+
+	if (GetMaxKineticEnergy(0, m_particles.GetNumParticles()) < m_sleepKineticEnergy)
+		m_numRestingUpdates++;
+	else
+		m_numRestingUpdates = 0;
+
+	if (m_numRestingUpdates < m_numRestingUpdatesToSleep)
+		return;
+
+	//nothing moves while asleep, so the particles have to wake up without the velocity they had
+	m_isAsleep = true;
+	m_particles.m_prevX = m_particles.m_x;
+	m_particles.m_prevY = m_particles.m_y;
+}
+
+void ParticleSystem::GrabAndMovePoint(const Vec2& screenMousePos, int& grabbedParticleIndex)
 {
 	constexpr float discCheckRadius = 2.f;
-	if (grabbedParticle == nullptr)
+	if (grabbedParticleIndex < 0)
 	{
 		//check if any point lies in a small circle around the current mouse pos
-		for (int i = 0; i < particles.size(); i++)
+		for (int i = 0; i < m_particles.GetNumParticles(); i++)
 		{
-			Particle& particle = particles[i];
-			if (IsPointInsideDisc2D(particle.m_currentPos, screenMousePos, discCheckRadius))
+			if (IsPointInsideDisc2D(m_particles.GetPosition(i), screenMousePos, discCheckRadius))
 			{
-				particle.m_currentPos = screenMousePos;
-				grabbedParticle = &particle;
+				m_particles.SetPosition(i, screenMousePos);
+				grabbedParticleIndex = i;
+				WakeParticle(i);
 				return;
 			}
 		}
 	}
-	else
+	else if (grabbedParticleIndex < m_particles.GetNumParticles())
 	{
-		grabbedParticle->m_currentPos = screenMousePos;
+		m_particles.SetPosition(grabbedParticleIndex, screenMousePos);
+		WakeParticle(grabbedParticleIndex);
 	}
 }
 
-void ParticleSystem::UpdateParticle(Particle& particleToUpdate, float deltaSeconds)
+void ParticleSystem::Simulate(float deltaSeconds)
 {
-	float drag = 0.01f;
-	Vec2 acceleration = Vec2(m_horizontalForce, m_gravity);
-	if (particleToUpdate.m_isPinned)
-		return;
+	m_solverStats = SolverStats();
+	m_solverStats.m_numSubsteps = m_numSubsteps;
+	bool useImplicitEuler = (m_solverType == ConstraintSolverType::IMPLICIT_EULER);
+	m_solverStats.m_maxIterations = m_numSubsteps * (useImplicitEuler ? MAX_CONJUGATE_GRADIENT_ITERATIONS : m_numIterations);
+
+	float substepSeconds = deltaSeconds / (float)m_numSubsteps;
+	m_substepSeconds = substepSeconds;
+	for (int substep = 0; substep < m_numSubsteps; substep++)
+	{
+		ApplyExternalForces(substepSeconds);
+		if (useImplicitEuler)
+			IntegrateImplicit(substepSeconds);
+		else
+			IntegrateParticles(substepSeconds);
+		SatisfyConstraints(substepSeconds);
+	}
+}
+
+void ParticleSystem::ApplyExternalForces(float deltaSeconds)
+{
+	UNUSED(deltaSeconds);
+}
+
+void ParticleSystem::IntegrateParticles(float deltaSeconds)
+{
+	VerletIntegrationUniforms uniforms;
+	GetIntegrationUniforms(deltaSeconds, uniforms);
+	IntegrateVerlet(m_particles.m_x.data(), m_particles.m_y.data(), m_particles.m_prevX.data(), m_particles.m_prevY.data(), m_particles.m_fixedMask.data(),
+		m_particles.GetNumParticles(), uniforms, m_useSimdKernels);
+}
+
+void ParticleSystem::IntegrateImplicit(float deltaSeconds)
+{
+	IntegrateParticles(deltaSeconds);
+}
+
+void ParticleSystem::RecordImplicitStep(const ImplicitStepResult& result)
+{
+	//the iterations are the conjugate gradient's, the residual is how far the links were off their rest length before the step
+	m_solverStats.m_numIterations += result.m_numIterations;
+	m_solverStats.m_maxResidual = result.m_linkResidual.m_maxViolation;
+	m_solverStats.m_rmsResidual = result.m_linkResidual.GetRms();
+}
 
-	Vec2 temp = particleToUpdate.m_currentPos;
-	particleToUpdate.m_currentPos += (particleToUpdate.m_currentPos - particleToUpdate.m_prevPos) * (1.f - drag) + (acceleration * deltaSeconds * deltaSeconds);
-	particleToUpdate.m_prevPos = temp;
+void ParticleSystem::GetIntegrationUniforms(float deltaSeconds, VerletIntegrationUniforms& out_uniforms) const
+{
+	out_uniforms.m_accelerationX = m_horizontalForce;
+	out_uniforms.m_accelerationY = m_gravity;
+	//m_drag is the velocity lost per full update, spread it over the substeps so the damping does not depend on the substep count
+	out_uniforms.m_drag = (m_numSubsteps > 1) ? 1.f - powf(1.f - m_drag, 1.f / (float)m_numSubsteps) : m_drag;
+	out_uniforms.m_deltaSeconds = deltaSeconds;
+}
+
+float ParticleSystem::SatisfyDistanceConstraint(const DistanceConstraint& constraint)
+{
+	return SatisfyDistanceConstraint(m_particles, constraint);
 }
 
-void ParticleSystem::SatisfyDistanceConstraint(DistanceConstraint& constraint)
+float ParticleSystem::SatisfyDistanceConstraint(ParticleStore& particles, const DistanceConstraint& constraint)
 {
-	float invMassPointA = 1.f / constraint.particleA->m_mass;
-	float invMassPointB = 1.f / constraint.particleB->m_mass;
-	Vec2 vectorAB = constraint.particleB->m_currentPos - constraint.particleA->m_currentPos;
-	float vectorLength = GetDistance2D(constraint.particleA->m_currentPos, constraint.particleB->m_currentPos);
+	uint32_t indexA = constraint.particleIndexA;
+	uint32_t indexB = constraint.particleIndexB;
+	bool isFixedA = particles.IsFixed(indexA);
+	bool isFixedB = particles.IsFixed(indexB);
+	//a link between two pinned (or sleeping) particles can never be fixed, so it should not hold back convergence
+	if (isFixedA && isFixedB)
+		return 0.f;
+
+	float invMassPointA = particles.m_invMass[indexA];
+	float invMassPointB = particles.m_invMass[indexB];
+	Vec2 positionA = particles.GetPosition(indexA);
+	Vec2 positionB = particles.GetPosition(indexB);
+	Vec2 vectorAB = positionB - positionA;
+	float vectorLength = GetDistance2D(positionA, positionB);
+	//colliders can push two linked particles onto the same spot, there is no direction to separate them in then
+	if (vectorLength <= 0.f)
+		return constraint.restLength;
+
 	float excessPercent = (vectorLength - constraint.restLength) / (vectorLength * (invMassPointA + invMassPointB));
-	if (!constraint.particleA->m_isPinned)
+	if (!isFixedA)
+	{
+		particles.SetPosition(indexA, positionA + vectorAB * invMassPointA * excessPercent);
+	}
+	if (!isFixedB)
+	{
+		particles.SetPosition(indexB, positionB - vectorAB * invMassPointB * excessPercent);
+	}
+
+	return fabsf(vectorLength - constraint.restLength);
+}
+
+float ParticleSystem::SatisfyDistanceConstraintXPBD(const DistanceConstraint& constraint, float& lambda, float inverseDeltaSecondsSquared)
+{
+	uint32_t indexA = constraint.particleIndexA;
+	uint32_t indexB = constraint.particleIndexB;
+	bool isFixedA = m_particles.IsFixed(indexA);
+	bool isFixedB = m_particles.IsFixed(indexB);
+	if (isFixedA && isFixedB)
+		return 0.f;
+
+	float invMassPointA = isFixedA ? 0.f : m_particles.m_invMass[indexA];
+	float invMassPointB = isFixedB ? 0.f : m_particles.m_invMass[indexB];
+	Vec2 positionA = m_particles.GetPosition(indexA);
+	Vec2 positionB = m_particles.GetPosition(indexB);
+	Vec2 vectorAB = positionB - positionA;
+	float vectorLength = vectorAB.GetLength();
+	float alphaTilde = constraint.compliance * inverseDeltaSecondsSquared;
+	float denominator = invMassPointA + invMassPointB + alphaTilde;
+	if (vectorLength <= 0.f || denominator <= 0.f)
+		return 0.f;
+
+	//C = |AB| - restLength, its gradient is -n for A and +n for B. A compliant constraint is satisfied once C + alphaTilde * lambda
+	//reaches 0, so that is the residual reported back to the solver
+	float constraintError = vectorLength - constraint.restLength;
+	float residual = constraintError + alphaTilde * lambda;
+	float deltaLambda = -residual / denominator;
+	lambda += deltaLambda;
+	Vec2 correction = vectorAB * (deltaLambda / vectorLength);
+	m_particles.SetPosition(indexA, positionA - correction * invMassPointA);
+	m_particles.SetPosition(indexB, positionB + correction * invMassPointB);
+	return fabsf(residual);
+}
+
+void ParticleSystem::ResetLagrangeMultipliers(std::vector<float>& lambdas, int numConstraints)
+{
+	lambdas.assign(numConstraints, 0.f);
+}
+
+bool ParticleSystem::RecordSolverIteration(int iteration, const ConstraintResidual& residual)
+{
+	float previousMaxResidual = m_solverStats.m_maxResidual;
+	m_solverStats.m_numIterations++;
+	m_solverStats.m_maxResidual = residual.m_maxViolation;
+	m_solverStats.m_rmsResidual = residual.GetRms();
+	if (m_residualTolerance > 0.f && residual.m_maxViolation < m_residualTolerance)
 	{
-		constraint.particleA->m_currentPos += vectorAB * invMassPointA * excessPercent;
+		m_solverStats.m_numConvergedSolves++;
+		return true;
 	}
-	if (!constraint.particleB->m_isPinned)
+
+	if (m_stallTolerance > 0.f && iteration > 0 && (previousMaxResidual - residual.m_maxViolation) < m_stallTolerance)
+	{
+		m_solverStats.m_numStalledSolves++;
+		return true;
+	}
+	return false;
+}
+
+void ParticleSystem::PrepareJacobiSolve()
+{
+	int numParticles = m_particles.GetNumParticles();
+	m_effectiveInvMasses.resize(numParticles);
+	m_jacobiDeltasX.assign(numParticles, 0.f);
+	m_jacobiDeltasY.assign(numParticles, 0.f);
+	m_jacobiConstraintCounts.assign(numParticles, 0.f);
+	ComputeEffectiveInverseMasses(m_particles.m_invMass.data(), m_particles.m_fixedMask.data(), numParticles, m_effectiveInvMasses.data());
+}
+
+void ParticleSystem::AccumulateJacobiCorrections(const std::vector<DistanceConstraint>& constraints, ConstraintResidual& residual)
+{
+	int numConstraints = (int)constraints.size();
+	if (m_constraintCorrectionsX.size() < constraints.size())
 	{
-		constraint.particleB->m_currentPos -= vectorAB * invMassPointB * excessPercent;
+		m_constraintCorrectionsX.resize(numConstraints);
+		m_constraintCorrectionsY.resize(numConstraints);
 	}
 
+	ConstraintResidual constraintsResidual;
+	ComputeDistanceConstraintCorrections(m_particles.m_x.data(), m_particles.m_y.data(), m_effectiveInvMasses.data(), constraints.data(), numConstraints,
+		m_constraintCorrectionsX.data(), m_constraintCorrectionsY.data(), constraintsResidual.m_maxViolation, constraintsResidual.m_sumSquaredViolation, m_useSimdKernels);
+	constraintsResidual.m_numConstraints = numConstraints;
+	residual.Merge(constraintsResidual);
+	AccumulateDistanceConstraintCorrections(m_effectiveInvMasses.data(), constraints.data(), numConstraints, m_constraintCorrectionsX.data(), m_constraintCorrectionsY.data(),
+		m_jacobiDeltasX.data(), m_jacobiDeltasY.data(), m_jacobiConstraintCounts.data());
 }
 
+void ParticleSystem::ApplyJacobiCorrections()
+{
+	ApplyJacobiDeltas(m_particles.m_x.data(), m_particles.m_y.data(), m_jacobiDeltasX.data(), m_jacobiDeltasY.data(), m_jacobiConstraintCounts.data(),
+		m_particles.GetNumParticles(), m_jacobiRelaxation, m_useSimdKernels);
+}
+
+void ParticleSystem::ResolveCollisions()
+{
+	int numParticles = m_particles.GetNumParticles();
+	if (!m_colliderSet || m_colliderSet->GetNumColliders() == 0 || numParticles == 0)
+		return;
+
+	//a single query with the bounds of all particles, systems with many particles split themselves up further
+	AABB2 particleBounds(m_particles.m_x[0], m_particles.m_y[0], m_particles.m_x[0], m_particles.m_y[0]);
+	for (int i = 1; i < numParticles; i++)
+	{
+		particleBounds.StretchToIncludePoint(m_particles.GetPosition(i));
+	}
+	ColliderQuery query;
+	m_colliderSet->FindCollidersOverlapping(particleBounds, m_collisionRadius, query);
+	m_colliderSet->PushParticlesOut(query, m_particles.m_x.data(), m_particles.m_y.data(), numParticles, m_collisionRadius, m_useSimdKernels);
+}
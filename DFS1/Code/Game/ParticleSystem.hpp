@@ -1,21 +1,88 @@
 #pragma once
 #include "Engine/Math/Vec2.hpp"
+#include "Engine/Core/AlignedAllocator.hpp"
 #include <vector>
+#include <stdint.h>
 
-struct Particle
+typedef std::vector<float, AlignedAllocator<float>> AlignedFloatArray;
+
+class ColliderSet;
+struct VerletIntegrationUniforms;
+struct ImplicitStepResult;
+
+//structure of arrays particle storage, every per particle attribute lives in its own contiguous (cache line aligned) array
+//and particles are referred to by their index instead of by pointer, so growing the arrays never invalidates constraints.
+struct ParticleStore
+{
+	AlignedFloatArray m_x;
+	AlignedFloatArray m_y;
+	AlignedFloatArray m_prevX;
+	AlignedFloatArray m_prevY;
+	AlignedFloatArray m_invMass;
+	std::vector<uint32_t> m_pinnedMask;
+	//particles of regions that fell asleep
+	std::vector<uint32_t> m_sleepingMask;
+	//pinned or sleeping, the integrator and the solvers leave these particles where they are
+	std::vector<uint32_t> m_fixedMask;
+
+	void Reserve(int numParticles);
+	int AddParticle(const Vec2& position, float mass, bool isPinned = false);
+	int GetNumParticles() const { return (int)m_x.size(); }
+	Vec2 GetPosition(int particleIndex) const { return Vec2(m_x[particleIndex], m_y[particleIndex]); }
+	Vec2 GetPrevPosition(int particleIndex) const { return Vec2(m_prevX[particleIndex], m_prevY[particleIndex]); }
+	void SetPosition(int particleIndex, const Vec2& position);
+	float GetMass(int particleIndex) const { return 1.f / m_invMass[particleIndex]; }
+	bool IsPinned(int particleIndex) const { return ((m_pinnedMask[particleIndex >> 5] >> (particleIndex & 31)) & 1u) != 0; }
+	void SetPinned(int particleIndex, bool isPinned);
+	bool IsSleeping(int particleIndex) const { return ((m_sleepingMask[particleIndex >> 5] >> (particleIndex & 31)) & 1u) != 0; }
+	void SetSleeping(int particleIndex, bool isSleeping);
+	bool IsFixed(int particleIndex) const { return ((m_fixedMask[particleIndex >> 5] >> (particleIndex & 31)) & 1u) != 0; }
+	//moves every attribute of particle order[i] to index i
+	void Reorder(const std::vector<int>& order);
+};
+
+enum class ConstraintSolverType
 {
-	Vec2 m_currentPos = Vec2::ZERO;
-	Vec2 m_prevPos = Vec2::ZERO;
-	float m_mass = 1.f;
-	bool m_isPinned = false;
+	SERIAL_GAUSS_SEIDEL,
+	PARALLEL_GAUSS_SEIDEL, //graph coloured gauss seidel, each independent constraint set is solved as a parallel for on the job system
+	JACOBI, //all constraints are projected in SIMD batches against the same positions, averaged corrections are applied afterwards
+	XPBD, //graph coloured gauss seidel with per constraint compliance and lagrange multipliers, stiffness does not depend on iterations or timestep
+	MULTIGRID, //cloth only: gauss seidel on coarser grids first, their corrections are interpolated onto the grid before the coloured iterations
+	IMPLICIT_EULER, //cloths only: backward euler with the links as stiff springs, a conjugate gradient solve per substep instead of projections
+	NUM_SOLVER_TYPES
 };
 
 struct DistanceConstraint
 {
-	Particle* particleA = nullptr;
-	Particle* particleB = nullptr;
+	uint32_t particleIndexA = 0;
+	uint32_t particleIndexB = 0;
 	float restLength = 0.f;
 	float originalRestLength = 0.f;
+	float compliance = 0.f; //inverse stiffness used by the XPBD solver, 0 is a rigid link
+};
+
+//constraint violation (|length - restLength| for distance constraints) gathered while the constraints are projected
+struct ConstraintResidual
+{
+	float m_maxViolation = 0.f;
+	float m_sumSquaredViolation = 0.f;
+	int m_numConstraints = 0;
+
+	void Add(float violation);
+	void Merge(const ConstraintResidual& other);
+	float GetRms() const;
+};
+
+//solver telemetry for the most recent update
+struct SolverStats
+{
+	int m_numSubsteps = 0;
+	int m_numIterations = 0; //iterations actually run, summed over all substeps
+	int m_maxIterations = 0; //iterations a fixed schedule would have run
+	float m_maxResidual = 0.f; //residual measured during the last iteration that ran
+	float m_rmsResidual = 0.f;
+	int m_numConvergedSolves = 0; //solves that stopped early because the residual dropped below the tolerance
+	int m_numStalledSolves = 0; //solves that stopped early because an iteration no longer improved the residual
 };
 
 class ParticleSystem
@@ -26,15 +93,95 @@ public:
 	virtual void Render() const = 0;
 	void ChangeHorizontalForceBy(float changeAmount);
 	float GetCurrentHorizontalForce() const { return m_horizontalForce; };
+	void MovePoint(const Vec2& screenMousePos, int& grabbedParticleIndex);
+	virtual void TogglePinnedParticle(int particleIndex);
+	void SetSolverType(ConstraintSolverType solverType) { m_solverType = solverType; }
+	ConstraintSolverType GetSolverType() const { return m_solverType; }
+	int GetNumParticles() const { return m_particles.GetNumParticles(); }
+	void SetUseSimdKernels(bool useSimdKernels) { m_useSimdKernels = useSimdKernels; }
+	void SetJacobiRelaxation(float relaxation) { m_jacobiRelaxation = relaxation; }
+	void SetNumSubsteps(int numSubsteps) { m_numSubsteps = numSubsteps > 1 ? numSubsteps : 1; }
+	int GetNumSubsteps() const { return m_numSubsteps; }
+	void SetNumIterations(int numIterations) { m_numIterations = numIterations > 1 ? numIterations : 1; }
+	int GetNumIterations() const { return m_numIterations; }
+	void SetResidualTolerance(float residualTolerance) { m_residualTolerance = residualTolerance; }
+	float GetResidualTolerance() const { return m_residualTolerance; }
+	void SetStallTolerance(float stallTolerance) { m_stallTolerance = stallTolerance; }
+	const SolverStats& GetSolverStats() const { return m_solverStats; }
+	void SetColliderSet(const ColliderSet* colliderSet) { m_colliderSet = colliderSet; }
+	void SetCollisionRadius(float collisionRadius) { m_collisionRadius = collisionRadius; }
+	void SetSleepingEnabled(bool isSleepingEnabled);
+	void SetSleepKineticEnergy(float sleepKineticEnergy) { m_sleepKineticEnergy = sleepKineticEnergy; }
+	//wakes every sleeping particle, regions then need m_numRestingUpdatesToSleep quiet updates again before they can fall asleep
+	virtual void WakeUp();
+	virtual int GetNumSleepingParticles() const;
 
 protected:
 	float m_horizontalForce = 0.f;
 	float m_gravity = 0.f;
+	float m_drag = 0.01f;
+	ParticleStore m_particles;
+	ConstraintSolverType m_solverType = ConstraintSolverType::SERIAL_GAUSS_SEIDEL;
+	bool m_useSimdKernels = true;
+	float m_jacobiRelaxation = 1.5f;
+	//every update is split into m_numSubsteps integrate + solve steps, each solve runs up to m_numIterations passes over the constraints
+	int m_numSubsteps = 1;
+	int m_numIterations = 1;
+	//a solve stops early once the largest constraint violation drops below this (in world units). 0 always runs every iteration
+	float m_residualTolerance = 0.f;
+	//a solve also gives up once an iteration reduces the largest violation by less than this, e.g. when links stretched between two
+	//pinned particles can never be satisfied. 0 never gives up
+	float m_stallTolerance = 0.f;
+	SolverStats m_solverStats;
+	//colliders are owned by the scene and can be shared between particle systems, particles are treated as discs of m_collisionRadius
+	const ColliderSet* m_colliderSet = nullptr;
+	float m_collisionRadius = 0.f;
+	//a system falls asleep once the largest kinetic energy per unit mass of its particles stayed below m_sleepKineticEnergy for
+	//m_numRestingUpdatesToSleep updates, and skips its updates until it is disturbed. Systems made of regions (cloth patches) track
+	//the energy per region, and regions linked to each other fall asleep together
+	bool m_isSleepingEnabled = false;
+	bool m_isAsleep = false;
+	float m_sleepKineticEnergy = 0.01f;
+	int m_numRestingUpdatesToSleep = 50;
+	int m_numRestingUpdates = 0;
+	float m_sleepHorizontalForce = 0.f; //force when the sleep state was last updated, changing the force wakes the system up
+	float m_substepSeconds = 0.f;
+
+	//scratch buffers for the jacobi solver
+	AlignedFloatArray m_effectiveInvMasses;
+	AlignedFloatArray m_jacobiDeltasX;
+	AlignedFloatArray m_jacobiDeltasY;
+	AlignedFloatArray m_jacobiConstraintCounts;
+	AlignedFloatArray m_constraintCorrectionsX;
+	AlignedFloatArray m_constraintCorrectionsY;
 
 protected:
-	void GrabAndMovePoint(const Vec2& screenMousePos, std::vector<Particle>& particles, Particle*& grabbedParticle);
-	void UpdateParticle(Particle& particleToUpdate, float deltaSeconds);
-	virtual void SatisfyConstraints() = 0;
-	void SatisfyDistanceConstraint(DistanceConstraint& constraint);
+	void GrabAndMovePoint(const Vec2& screenMousePos, int& grabbedParticleIndex);
+	void Simulate(float deltaSeconds);
+	//forces that differ per particle, applied as a change of velocity right before the integrator adds gravity and the horizontal force
+	virtual void ApplyExternalForces(float deltaSeconds);
+	void IntegrateParticles(float deltaSeconds);
+	//integrates and solves the links in one go for the IMPLICIT_EULER solver, SatisfyConstraints still runs afterwards. Systems without an
+	//implicit integrator fall back to IntegrateParticles and their own constraint solve
+	virtual void IntegrateImplicit(float deltaSeconds);
+	void RecordImplicitStep(const ImplicitStepResult& result);
+	void GetIntegrationUniforms(float deltaSeconds, VerletIntegrationUniforms& out_uniforms) const;
+	virtual void SatisfyConstraints(float deltaSeconds) = 0;
+	float SatisfyDistanceConstraint(const DistanceConstraint& constraint);
+	//the same projection on particles that are not the system's own, e.g. the coarser grids of the multigrid solver
+	static float SatisfyDistanceConstraint(ParticleStore& particles, const DistanceConstraint& constraint);
+	//lambda is the constraint's lagrange multiplier, kept outside the constraint so the constraints themselves can be shared read only
+	float SatisfyDistanceConstraintXPBD(const DistanceConstraint& constraint, float& lambda, float inverseDeltaSecondsSquared);
+	void ResetLagrangeMultipliers(std::vector<float>& lambdas, int numConstraints);
+	bool RecordSolverIteration(int iteration, const ConstraintResidual& residual);
+	void PrepareJacobiSolve();
+	void AccumulateJacobiCorrections(const std::vector<DistanceConstraint>& constraints, ConstraintResidual& residual);
+	void ApplyJacobiCorrections();
+	virtual void ResolveCollisions();
+	//called when something outside the simulation moved or changed the particle (grabbing, pinning, tearing)
+	virtual void WakeParticle(int particleIndex);
+	float GetMaxKineticEnergy(int startIndex, int endIndex) const;
+	bool WakeUpIfDisturbed();
+	void UpdateSleepState();
 
-};
\ No newline at end of file
+};
@@ -1,4 +1,5 @@
 #include "Game/Plant.hpp"
+#include "Game/ParticleOrdering.hpp"
 #include "Engine/Core/XmlUtils.hpp"
 #include "Engine/Core/ErrorWarningAssert.hpp"
 #include "Engine/Math/MathUtils.hpp"
@@ -9,7 +10,7 @@
 
 constexpr float pointRadius = 0.5f;
 constexpr float lineThickness = 0.25f;
-constexpr int TOTAL_NUM_ITERATION = 1;
+constexpr int DEFAULT_NUM_ITERATIONS = 1;
 
 extern InputSystem* g_theInput;
 extern Renderer* g_theRenderer;
@@ -19,17 +20,18 @@ Plant::Plant(Game* game, const Vec2& root)
 {
 	RandomNumberGenerator rng;
 	m_gravity = -50.f;
-	m_particles.reserve(100);
+	m_numIterations = DEFAULT_NUM_ITERATIONS;
+	m_particles.Reserve(100);
 
 	InitializeStem(90.f, root, true);
-	int particleListSize = int(m_particles.size() - 1);
+	int particleListSize = m_particles.GetNumParticles() - 1;
 	InitializeBespokeBranchOne(root, rng.GetRandomFloatInRange(0.7f, 1.2f));
 
 	AddDistanceConstraint(particleListSize + 1, 8, true);
 	AddAngularConstraint(9, particleListSize + 1, 8);
 	AddDistanceConstraint(particleListSize + 2, 8);
 
-	particleListSize = int(m_particles.size() - 1);
+	particleListSize = m_particles.GetNumParticles() - 1;
 	InitializeBespokeBranchTwo(root, rng.GetRandomFloatInRange(0.7f, 1.2f));
 
 	AddDistanceConstraint(particleListSize + 1, 5, true);
@@ -39,8 +41,13 @@ Plant::Plant(Game* game, const Vec2& root)
 
 void Plant::Update(float deltaSeconds)
 {
-	UpdateParticles(deltaSeconds);
-	SatisfyConstraints();
+	//a plant is small enough to sleep as a single island
+	if (WakeUpIfDisturbed())
+		return;
+
+	Simulate(deltaSeconds);
+	ResolveCollisions();
+	UpdateSleepState();
 }
 
 void Plant::Render() const
@@ -48,11 +55,26 @@ void Plant::Render() const
 	RenderStructure();
 }
 
-void Plant::UpdateParticles(float deltaSeconds)
+void Plant::RenumberParticlesAlongMortonCurve(int& grabbedParticleIndex)
 {
-	for (int i = 0; i < m_particles.size(); i++)
+	//the constraints keep their order, so the solvers still project them in the order the plant was built
+	std::vector<int> order;
+	std::vector<int> newIndices;
+	GetMortonOrder(m_particles.m_x.data(), m_particles.m_y.data(), m_particles.GetNumParticles(), order);
+	GetNewParticleIndices(order, newIndices);
+	m_particles.Reorder(order);
+	RemapConstraintParticles(m_constraints, newIndices);
+	RemapConstraintParticles(m_constraintsToRender, newIndices);
+	for (int i = 0; i < m_angularConstraints.size(); i++)
+	{
+		AngularConstraint& constraint = m_angularConstraints[i];
+		constraint.particleIndexA = (uint32_t)newIndices[constraint.particleIndexA];
+		constraint.particleIndexB = (uint32_t)newIndices[constraint.particleIndexB];
+		constraint.commonParticleIndex = (uint32_t)newIndices[constraint.commonParticleIndex];
+	}
+	if (grabbedParticleIndex >= 0 && grabbedParticleIndex < (int)newIndices.size())
 	{
-		UpdateParticle(m_particles[i], deltaSeconds);
+		grabbedParticleIndex = newIndices[grabbedParticleIndex];
 	}
 }
 
@@ -67,11 +89,9 @@ bool Plant::LoadXmlData(const char* path)
 	XmlElement* pointElement = pointsChildElement->FirstChildElement();
 	while (pointElement)
 	{
-		Particle point;
-		point.m_currentPos = ParseXmlAttribute(*pointElement, "pos", point.m_currentPos);
-		point.m_prevPos = point.m_currentPos;
-		point.m_isPinned = ParseXmlAttribute(*pointElement, "pinned", point.m_isPinned);
-		m_particles.push_back(point);
+		Vec2 pointPosition = ParseXmlAttribute(*pointElement, "pos", Vec2::ZERO);
+		bool isPointPinned = ParseXmlAttribute(*pointElement, "pinned", false);
+		m_particles.AddParticle(pointPosition, 1.f, isPointPinned);
 		pointElement = pointElement->NextSiblingElement();
 	}
 
@@ -107,28 +127,15 @@ void Plant::InitializeStem(float angle, const Vec2& originPoint, bool root /*, s
 		spinePoints.push_back(newPoint);
 	}
 
-	int initialParticleListSize = int(m_particles.size());
+	int initialParticleListSize = m_particles.GetNumParticles();
 	//left root and right root particles have to always be the first and seconds elements in the array.
-	Particle leftRootParticle;
-	leftRootParticle.m_currentPos = leftRoot;
-	leftRootParticle.m_prevPos = leftRoot;
-	leftRootParticle.m_isPinned = root;
-	m_particles.push_back(leftRootParticle);
-	Particle rightRootParticle;
-	rightRootParticle.m_currentPos = rightRoot;
-	rightRootParticle.m_prevPos = rightRoot;
-	rightRootParticle.m_isPinned = root;
-	m_particles.push_back(rightRootParticle);
+	m_particles.AddParticle(leftRoot, 1.f, root);
+	m_particles.AddParticle(rightRoot, 1.f, root);
 
 	for (int i = 0; i < spinePoints.size(); i++)
 	{
-		Particle particle;
-		particle.m_currentPos = spinePoints[i];
-		particle.m_prevPos = spinePoints[i];
-		if (i == 0)
-			particle.m_isPinned = root;
-
-		m_particles.push_back(particle);
+		bool isPinned = (i == 0) ? root : false;
+		m_particles.AddParticle(spinePoints[i], 1.f, isPinned);
 	}
 
 	//all constraints from left root to spine points
@@ -152,56 +159,89 @@ void Plant::InitializeStem(float angle, const Vec2& originPoint, bool root /*, s
 
 }
 
-void Plant::SatisfyConstraints()
+void Plant::SatisfyConstraints(float deltaSeconds)
 {
-	for (int j = 0; j < TOTAL_NUM_ITERATION; j++)
+	bool useJacobiSolver = (m_solverType == ConstraintSolverType::JACOBI);
+	bool useXpbd = (m_solverType == ConstraintSolverType::XPBD);
+	float inverseDeltaSecondsSquared = 1.f / (deltaSeconds * deltaSeconds);
+	if (useJacobiSolver)
 	{
-		for (int i = 0; i < m_constraints.size(); i++)
+		PrepareJacobiSolve();
+	}
+	if (useXpbd)
+	{
+		ResetLagrangeMultipliers(m_constraintLambdas, (int)m_constraints.size());
+	}
+
+	for (int j = 0; j < m_numIterations; j++)
+	{
+		//only the distance constraints feed the residual, the angular constraints snap straight to their target angle
+		ConstraintResidual residual;
+		if (useJacobiSolver)
+		{
+			AccumulateJacobiCorrections(m_constraints, residual);
+			ApplyJacobiCorrections();
+		}
+		else if (useXpbd)
+		{
+			for (int i = 0; i < m_constraints.size(); i++)
+			{
+				residual.Add(SatisfyDistanceConstraintXPBD(m_constraints[i], m_constraintLambdas[i], inverseDeltaSecondsSquared));
+			}
+		}
+		else
 		{
-			SatisfyDistanceConstraint(m_constraints[i]);
+			for (int i = 0; i < m_constraints.size(); i++)
+			{
+				residual.Add(SatisfyDistanceConstraint(m_constraints[i]));
+			}
 		}
 
 		for (int i = 0; i < m_angularConstraints.size(); i++)
 		{
 			SatisfyAngularConstraint(m_angularConstraints[i]);
 		}
+
+		if (RecordSolverIteration(j, residual))
+			break;
 	}
 }
 
 void Plant::SatisfyAngularConstraint(AngularConstraint& constraint)
 {
-	Vec2 v1 = constraint.particleA->m_currentPos - constraint.commonParticle->m_currentPos;
-	Vec2 v2 = constraint.particleB->m_currentPos - constraint.commonParticle->m_currentPos;
+	Vec2 commonParticlePos = m_particles.GetPosition(constraint.commonParticleIndex);
+	Vec2 v1 = m_particles.GetPosition(constraint.particleIndexA) - commonParticlePos;
+	Vec2 v2 = m_particles.GetPosition(constraint.particleIndexB) - commonParticlePos;
 	Vec2 averageVector = (v1.GetNormalized() + v2.GetNormalized()).GetNormalized();
 
 	float v1CorrectionDirection = (v1.GetOrientationDegrees() - averageVector.GetOrientationDegrees()) > 0 ? 1.f : -1.f;
 	Vec2 correctedV1 = averageVector.GetRotatedDegrees((constraint.desiredAngleDegrees / 2.f) * v1CorrectionDirection) * v1.GetLength();
 	Vec2 correctedV2 = averageVector.GetRotatedDegrees((constraint.desiredAngleDegrees / 2.f) * v1CorrectionDirection * -1.f) * v2.GetLength();
 
-	constraint.particleA->m_currentPos = constraint.commonParticle->m_currentPos + correctedV1;
-	constraint.particleB->m_currentPos = constraint.commonParticle->m_currentPos + correctedV2;
+	m_particles.SetPosition(constraint.particleIndexA, commonParticlePos + correctedV1);
+	m_particles.SetPosition(constraint.particleIndexB, commonParticlePos + correctedV2);
 }
 
 void Plant::RenderStructure() const
 {
 	std::vector<Vertex_PCU> verts;
-	for (int i = 0; i < m_particles.size(); i++)
+	for (int i = 0; i < m_particles.GetNumParticles(); i++)
 	{
-		AddVertsForDisc2D(verts, m_particles[i].m_currentPos, pointRadius, Rgba8::WHITE);
+		AddVertsForDisc2D(verts, m_particles.GetPosition(i), pointRadius, Rgba8::WHITE);
 	}
 
 	if (!m_renderStructureOnly)
 	{
 		for (int i = 0; i < m_constraints.size(); i++)
 		{
-			DistanceConstraint constraint = m_constraints[i];
-			AddVertsForLineSegment2D(verts, constraint.particleA->m_currentPos, constraint.particleB->m_currentPos, lineThickness, Rgba8::WHITE);
+			const DistanceConstraint& constraint = m_constraints[i];
+			AddVertsForLineSegment2D(verts, m_particles.GetPosition(constraint.particleIndexA), m_particles.GetPosition(constraint.particleIndexB), lineThickness, Rgba8::WHITE);
 		}
 	}
 	for (int i = 0; i < m_constraintsToRender.size(); i++)
 	{
-		DistanceConstraint constraint = m_constraintsToRender[i];
-		AddVertsForLineSegment2D(verts, constraint.particleA->m_currentPos, constraint.particleB->m_currentPos, lineThickness, Rgba8::GREEN);
+		const DistanceConstraint& constraint = m_constraintsToRender[i];
+		AddVertsForLineSegment2D(verts, m_particles.GetPosition(constraint.particleIndexA), m_particles.GetPosition(constraint.particleIndexB), lineThickness, Rgba8::GREEN);
 	}
 	g_theRenderer->BindTexture(nullptr);
 	g_theRenderer->DrawVertexArray((int)verts.size(), verts.data());
@@ -209,21 +249,10 @@ void Plant::RenderStructure() const
 
 void Plant::InitializeBespokeBranchOne(const Vec2& root, float scale)
 {
-	int startIndex = (int)m_particles.size() - 1;
-	Particle particle1;
-	particle1.m_currentPos = root + (Vec2(5.f, 30.f) * scale);
-	particle1.m_prevPos = particle1.m_currentPos;
-	m_particles.push_back(particle1);
-
-	Particle particle2;
-	particle2.m_currentPos = root + (Vec2(7.f, 35.f) * scale);
-	particle2.m_prevPos = particle2.m_currentPos;
-	m_particles.push_back(particle2);
-
-	Particle particle3;
-	particle3.m_currentPos = root + (Vec2(3.f, 35.f) * scale);
-	particle3.m_prevPos = particle3.m_currentPos;
-	m_particles.push_back(particle3);
+	int startIndex = m_particles.GetNumParticles() - 1;
+	m_particles.AddParticle(root + (Vec2(5.f, 30.f) * scale), 1.f);
+	m_particles.AddParticle(root + (Vec2(7.f, 35.f) * scale), 1.f);
+	m_particles.AddParticle(root + (Vec2(3.f, 35.f) * scale), 1.f);
 
 	AddDistanceConstraint(startIndex + 1, startIndex + 2, true);
 
@@ -234,21 +263,10 @@ void Plant::InitializeBespokeBranchOne(const Vec2& root, float scale)
 
 void Plant::InitializeBespokeBranchTwo(const Vec2& root, float scale)
 {
-	int startIndex = (int)m_particles.size() - 1;
-	Particle particle1;
-	particle1.m_currentPos = root + (Vec2(-10.f, 25.f) * scale);
-	particle1.m_prevPos = particle1.m_currentPos;
-	m_particles.push_back(particle1);
-
-	Particle particle2;
-	particle2.m_currentPos = root + (Vec2(-7.f, 30.f) * scale);
-	particle2.m_prevPos = particle2.m_currentPos;
-	m_particles.push_back(particle2);
-
-	Particle particle3;
-	particle3.m_currentPos = root + (Vec2(-12.f, 30.f) * scale);
-	particle3.m_prevPos = particle3.m_currentPos;
-	m_particles.push_back(particle3);
+	int startIndex = m_particles.GetNumParticles() - 1;
+	m_particles.AddParticle(root + (Vec2(-10.f, 25.f) * scale), 1.f);
+	m_particles.AddParticle(root + (Vec2(-7.f, 30.f) * scale), 1.f);
+	m_particles.AddParticle(root + (Vec2(-12.f, 30.f) * scale), 1.f);
 
 	AddDistanceConstraint(startIndex + 1, startIndex + 2, true);
 
@@ -260,9 +278,9 @@ void Plant::InitializeBespokeBranchTwo(const Vec2& root, float scale)
 void Plant::AddDistanceConstraint(int aIndex, int bIndex, bool addToRenderList)
 {
 	DistanceConstraint constraint;
-	constraint.particleA = &m_particles[aIndex];
-	constraint.particleB = &m_particles[bIndex];
-	constraint.restLength = GetDistance2D(constraint.particleA->m_currentPos, constraint.particleB->m_currentPos);
+	constraint.particleIndexA = (uint32_t)aIndex;
+	constraint.particleIndexB = (uint32_t)bIndex;
+	constraint.restLength = GetDistance2D(m_particles.GetPosition(aIndex), m_particles.GetPosition(bIndex));
 	constraint.originalRestLength = constraint.restLength;
 	m_constraints.push_back(constraint);
 	if (addToRenderList)
@@ -274,16 +292,11 @@ void Plant::AddDistanceConstraint(int aIndex, int bIndex, bool addToRenderList)
 void Plant::AddAngularConstraint(int aIndex, int bIndex, int commonIndex)
 {
 	AngularConstraint angularConstraint;
-	angularConstraint.particleA = &m_particles[aIndex];
-	angularConstraint.particleB = &m_particles[bIndex];
-	angularConstraint.commonParticle = &m_particles[commonIndex];
-	angularConstraint.desiredAngleDegrees = angularConstraint.desiredAngleDegrees = GetAngleDegreesBetweenVectors2D(angularConstraint.particleA->m_currentPos - angularConstraint.commonParticle->m_currentPos,
-		angularConstraint.particleB->m_currentPos - angularConstraint.commonParticle->m_currentPos);
+	angularConstraint.particleIndexA = (uint32_t)aIndex;
+	angularConstraint.particleIndexB = (uint32_t)bIndex;
+	angularConstraint.commonParticleIndex = (uint32_t)commonIndex;
+	Vec2 commonParticlePos = m_particles.GetPosition(commonIndex);
+	angularConstraint.desiredAngleDegrees = GetAngleDegreesBetweenVectors2D(m_particles.GetPosition(aIndex) - commonParticlePos, m_particles.GetPosition(bIndex) - commonParticlePos);
 	m_angularConstraints.push_back(angularConstraint);
 }
 
-void Plant::MovePoint(const Vec2& screenMousePos, Particle*& grabbedParticle)
-{
-	GrabAndMovePoint(screenMousePos, m_particles, grabbedParticle);
-}
-
@@ -5,9 +5,9 @@ class Game;
 
 struct AngularConstraint
 {
-	Particle* particleA;
-	Particle* particleB;
-	Particle* commonParticle;
+	uint32_t particleIndexA = 0;
+	uint32_t particleIndexB = 0;
+	uint32_t commonParticleIndex = 0;
 	float desiredAngleDegrees = 0.f;
 };
 
@@ -17,22 +17,23 @@ public:
 	Plant(Game* game, const Vec2& root);
 	void Update(float deltaSeconds) override;
 	void Render() const override;
-	void MovePoint(const Vec2& screenMousePos, Particle*& grabbedParticle);
+	//renumbers the particles along a Z-order curve through their current positions and remaps every constraint, grabbedParticleIndex
+	//is a particle index the caller holds on to
+	void RenumberParticlesAlongMortonCurve(int& grabbedParticleIndex);
 	bool m_renderStructureOnly = true;
 
 protected:
 	Game* m_game = nullptr;
-	std::vector<Particle> m_particles;
 	std::vector<DistanceConstraint> m_constraints;
-	//std::vector<Particle> m_angleConstraintParticles;
+	std::vector<float> m_constraintLambdas; //one per distance constraint, used by the XPBD solver
+	//std::vector<int> m_angleConstraintParticles;
 	std::vector<AngularConstraint> m_angularConstraints;
 	std::vector<DistanceConstraint> m_constraintsToRender; //this vector is only to render the structure that has only the main plant structure
 
 protected:
-	void UpdateParticles(float deltaSeconds);
 	bool LoadXmlData(const char* path);
 	void InitializeStem(float angle, const Vec2& originPoint, bool root = false);
-	void SatisfyConstraints() override;
+	void SatisfyConstraints(float deltaSeconds) override;
 	void SatisfyAngularConstraint(AngularConstraint& constraint);
 	void RenderStructure() const;
 	void InitializeBespokeBranchOne(const Vec2& root, float scale);
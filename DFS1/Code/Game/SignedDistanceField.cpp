@@ -0,0 +1,384 @@
+#include "Game/SignedDistanceField.hpp"
+#include "Game/ColliderSet.hpp"
+#include "Engine/Math/MathUtils.hpp"
+#include "Engine/Core/Image.hpp"
+#include "Engine/Core/JobSystem.hpp"
+#include <math.h>
+
+constexpr int MIN_SAMPLES_PER_JOB = 4096;
+//distance of samples with no surface anywhere, its square still fits a float
+constexpr float FAR_AWAY_DISTANCE = 1e15f;
+constexpr float FAR_AWAY_SQUARED_DISTANCE = FAR_AWAY_DISTANCE * FAR_AWAY_DISTANCE;
+
+extern JobSystem* g_theJobSystem;
+
+static void RunParallelFor(int numElements, int minElementsPerJob, const ParallelForFunction& function)
+{
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numElements, minElementsPerJob, function);
+	else
+		function(0, numElements);
+}
+
+static float GetSignedDistanceToBox(float localX, float localY, float halfWidth, float halfHeight)
+{
+	float outsideX = fabsf(localX) - halfWidth;
+	float outsideY = fabsf(localY) - halfHeight;
+	if (outsideX <= 0.f && outsideY <= 0.f)
+		return (outsideX > outsideY) ? outsideX : outsideY;
+
+	float clampedX = (outsideX > 0.f) ? outsideX : 0.f;
+	float clampedY = (outsideY > 0.f) ? outsideY : 0.f;
+	return sqrtf(clampedX * clampedX + clampedY * clampedY);
+}
+
+//exact 1D squared euclidean distance transform (Felzenszwalb and Huttenlocher), out_squaredDistances[q] is the minimum over all p of
+//(spacing * (q - p))^2 + squaredDistances[p]. It keeps the lower envelope of the parabolas rooted at the samples, samples that are
+//FAR_AWAY_SQUARED_DISTANCE or more add no parabola. The two scratch arrays need room for numSamples entries
+static void TransformSquaredDistances(const float* squaredDistances, int numSamples, float spacing, float* out_squaredDistances,
+	int* parabolaSamples, float* parabolaStarts)
+{
+	int numParabolas = 0;
+	for (int q = 0; q < numSamples; q++)
+	{
+		if (squaredDistances[q] >= FAR_AWAY_SQUARED_DISTANCE)
+			continue;
+
+		//drop the parabolas the new one lies below from where they would start, the first one starts at -infinity and is never dropped
+		float position = spacing * (float)q;
+		float start = -FAR_AWAY_SQUARED_DISTANCE;
+		while (numParabolas > 0)
+		{
+			int p = parabolaSamples[numParabolas - 1];
+			float previousPosition = spacing * (float)p;
+			start = ((squaredDistances[q] + position * position) - (squaredDistances[p] + previousPosition * previousPosition)) / (2.f * (position - previousPosition));
+			if (start > parabolaStarts[numParabolas - 1])
+				break;
+
+			numParabolas--;
+		}
+		if (numParabolas == 0)
+		{
+			start = -FAR_AWAY_SQUARED_DISTANCE;
+		}
+		parabolaSamples[numParabolas] = q;
+		parabolaStarts[numParabolas] = start;
+		numParabolas++;
+	}
+
+	int parabolaIndex = 0;
+	for (int q = 0; q < numSamples; q++)
+	{
+		if (numParabolas == 0)
+		{
+			out_squaredDistances[q] = FAR_AWAY_SQUARED_DISTANCE;
+			continue;
+		}
+
+		float position = spacing * (float)q;
+		while (parabolaIndex + 1 < numParabolas && parabolaStarts[parabolaIndex + 1] < position)
+		{
+			parabolaIndex++;
+		}
+		int p = parabolaSamples[parabolaIndex];
+		float offset = position - spacing * (float)p;
+		out_squaredDistances[q] = offset * offset + squaredDistances[p];
+	}
+}
+
+static float SampleBilinear(const std::vector<float>& samples, int sampleIndex, int rowStride, float fractionX, float fractionY)
+{
+	float bottom = samples[sampleIndex] + (samples[sampleIndex + 1] - samples[sampleIndex]) * fractionX;
+	float top = samples[sampleIndex + rowStride] + (samples[sampleIndex + rowStride + 1] - samples[sampleIndex + rowStride]) * fractionX;
+	return bottom + (top - bottom) * fractionY;
+}
+
+void SignedDistanceField::BakeFromColliders(const ColliderSet& colliders, const AABB2& bounds, float cellSize, float maxDistance)
+{
+	Vec2 boundsDimensions = bounds.m_maxs - bounds.m_mins;
+	int numSamplesX = (int)ceilf(boundsDimensions.x / cellSize) + 1;
+	int numSamplesY = (int)ceilf(boundsDimensions.y / cellSize) + 1;
+	Resize(bounds.m_mins, Vec2(cellSize, cellSize), IntVec2(numSamplesX > 2 ? numSamplesX : 2, numSamplesY > 2 ? numSamplesY : 2));
+	m_distances.assign(m_distances.size(), maxDistance);
+
+	//every job owns a band of rows and lowers them with the shapes that come within maxDistance of it, a shape only visits the
+	//samples near its bounds
+	ParallelForFunction bakeRows = [this, &colliders, maxDistance](int startRow, int endRow)
+	{
+		for (int i = 0; i < colliders.GetNumDiscs(); i++)
+		{
+			Vec2 center = colliders.GetDiscCenter(i);
+			float radius = colliders.GetDiscRadius(i);
+			AABB2 discBounds(center - Vec2(radius, radius), center + Vec2(radius, radius));
+			LowerDistancesNear(discBounds, maxDistance, startRow, endRow, [center, radius](const Vec2& point)
+			{
+				return (point - center).GetLength() - radius;
+			});
+		}
+		for (int i = 0; i < colliders.GetNumAABB2s(); i++)
+		{
+			AABB2 box = colliders.GetAABB2(i);
+			Vec2 center = box.GetCenter();
+			Vec2 halfDimensions = (box.m_maxs - box.m_mins) * 0.5f;
+			LowerDistancesNear(box, maxDistance, startRow, endRow, [center, halfDimensions](const Vec2& point)
+			{
+				return GetSignedDistanceToBox(point.x - center.x, point.y - center.y, halfDimensions.x, halfDimensions.y);
+			});
+		}
+		for (int i = 0; i < colliders.GetNumOBB2s(); i++)
+		{
+			OBB2 orientedBox = colliders.GetOBB2(i);
+			Vec2 iBasisNormal = orientedBox.m_iBasisNormal;
+			Vec2 jBasisNormal(-iBasisNormal.y, iBasisNormal.x);
+			Vec2 halfExtents(fabsf(iBasisNormal.x) * orientedBox.m_halfDimensions.x + fabsf(jBasisNormal.x) * orientedBox.m_halfDimensions.y,
+				fabsf(iBasisNormal.y) * orientedBox.m_halfDimensions.x + fabsf(jBasisNormal.y) * orientedBox.m_halfDimensions.y);
+			AABB2 orientedBoxBounds(orientedBox.m_center - halfExtents, orientedBox.m_center + halfExtents);
+			LowerDistancesNear(orientedBoxBounds, maxDistance, startRow, endRow, [orientedBox, jBasisNormal](const Vec2& point)
+			{
+				Vec2 offset = point - orientedBox.m_center;
+				return GetSignedDistanceToBox(DotProduct2D(offset, orientedBox.m_iBasisNormal), DotProduct2D(offset, jBasisNormal),
+					orientedBox.m_halfDimensions.x, orientedBox.m_halfDimensions.y);
+			});
+		}
+		for (int i = 0; i < colliders.GetNumCapsule2s(); i++)
+		{
+			Capsule2 capsule = colliders.GetCapsule2(i);
+			Vec2 boneMins((capsule.m_bone.m_start.x < capsule.m_bone.m_end.x) ? capsule.m_bone.m_start.x : capsule.m_bone.m_end.x,
+				(capsule.m_bone.m_start.y < capsule.m_bone.m_end.y) ? capsule.m_bone.m_start.y : capsule.m_bone.m_end.y);
+			Vec2 boneMaxs((capsule.m_bone.m_start.x < capsule.m_bone.m_end.x) ? capsule.m_bone.m_end.x : capsule.m_bone.m_start.x,
+				(capsule.m_bone.m_start.y < capsule.m_bone.m_end.y) ? capsule.m_bone.m_end.y : capsule.m_bone.m_start.y);
+			AABB2 capsuleBounds(boneMins - Vec2(capsule.m_radius, capsule.m_radius), boneMaxs + Vec2(capsule.m_radius, capsule.m_radius));
+			LowerDistancesNear(capsuleBounds, maxDistance, startRow, endRow, [capsule](const Vec2& point)
+			{
+				return (point - GetNearestPointOnLineSegment2D(point, capsule.m_bone)).GetLength() - capsule.m_radius;
+			});
+		}
+	};
+	RunParallelFor(m_dimensions.y, 1 + MIN_SAMPLES_PER_JOB / m_dimensions.x, bakeRows);
+	ComputeGradients();
+}
+
+void SignedDistanceField::BakeFromImage(const Image& mask, const AABB2& bounds, unsigned char solidThreshold)
+{
+	IntVec2 maskDimensions = mask.GetDimensions();
+	if (maskDimensions.x < 2 || maskDimensions.y < 2)
+	{
+		Clear();
+		return;
+	}
+
+	Vec2 boundsDimensions = bounds.m_maxs - bounds.m_mins;
+	Vec2 cellSize(boundsDimensions.x / (float)maskDimensions.x, boundsDimensions.y / (float)maskDimensions.y);
+	Resize(bounds.m_mins + cellSize * 0.5f, cellSize, maskDimensions);
+
+	//the distance transform is separable: a pass along every row and then one along every column of its result gives the squared
+	//distance to the nearest seed. It runs twice, seeded with the solid texels for the outside and with the empty ones for the inside
+	int numSamples = m_dimensions.x * m_dimensions.y;
+	std::vector<float> squaredDistancesToSolid(numSamples);
+	std::vector<float> squaredDistancesToEmpty(numSamples);
+	ParallelForFunction transformRows = [this, &mask, solidThreshold, &squaredDistancesToSolid, &squaredDistancesToEmpty](int startRow, int endRow)
+	{
+		std::vector<float> seedsToSolid(m_dimensions.x);
+		std::vector<float> seedsToEmpty(m_dimensions.x);
+		std::vector<int> parabolaSamples(m_dimensions.x);
+		std::vector<float> parabolaStarts(m_dimensions.x);
+		for (int sampleY = startRow; sampleY < endRow; sampleY++)
+		{
+			for (int sampleX = 0; sampleX < m_dimensions.x; sampleX++)
+			{
+				bool isSolid = mask.GetTexelColor(IntVec2(sampleX, sampleY)).r >= solidThreshold;
+				seedsToSolid[sampleX] = isSolid ? 0.f : FAR_AWAY_SQUARED_DISTANCE;
+				seedsToEmpty[sampleX] = isSolid ? FAR_AWAY_SQUARED_DISTANCE : 0.f;
+			}
+			int rowStart = GetSampleIndex(0, sampleY);
+			TransformSquaredDistances(seedsToSolid.data(), m_dimensions.x, m_cellSize.x, &squaredDistancesToSolid[rowStart], parabolaSamples.data(), parabolaStarts.data());
+			TransformSquaredDistances(seedsToEmpty.data(), m_dimensions.x, m_cellSize.x, &squaredDistancesToEmpty[rowStart], parabolaSamples.data(), parabolaStarts.data());
+		}
+	};
+	RunParallelFor(m_dimensions.y, 1 + MIN_SAMPLES_PER_JOB / m_dimensions.x, transformRows);
+
+	//the surface lies halfway between a solid and an empty texel center
+	float halfTexelSize = ((m_cellSize.x < m_cellSize.y) ? m_cellSize.x : m_cellSize.y) * 0.5f;
+	ParallelForFunction transformColumns = [this, halfTexelSize, &squaredDistancesToSolid, &squaredDistancesToEmpty](int startColumn, int endColumn)
+	{
+		std::vector<float> columnToSolid(m_dimensions.y);
+		std::vector<float> columnToEmpty(m_dimensions.y);
+		std::vector<float> transformedToSolid(m_dimensions.y);
+		std::vector<float> transformedToEmpty(m_dimensions.y);
+		std::vector<int> parabolaSamples(m_dimensions.y);
+		std::vector<float> parabolaStarts(m_dimensions.y);
+		for (int sampleX = startColumn; sampleX < endColumn; sampleX++)
+		{
+			for (int sampleY = 0; sampleY < m_dimensions.y; sampleY++)
+			{
+				columnToSolid[sampleY] = squaredDistancesToSolid[GetSampleIndex(sampleX, sampleY)];
+				columnToEmpty[sampleY] = squaredDistancesToEmpty[GetSampleIndex(sampleX, sampleY)];
+			}
+			TransformSquaredDistances(columnToSolid.data(), m_dimensions.y, m_cellSize.y, transformedToSolid.data(), parabolaSamples.data(), parabolaStarts.data());
+			TransformSquaredDistances(columnToEmpty.data(), m_dimensions.y, m_cellSize.y, transformedToEmpty.data(), parabolaSamples.data(), parabolaStarts.data());
+			for (int sampleY = 0; sampleY < m_dimensions.y; sampleY++)
+			{
+				//a texel is at distance 0 from the seeds of its own kind, so at most one of the two is non zero
+				bool isSolid = transformedToSolid[sampleY] == 0.f;
+				m_distances[GetSampleIndex(sampleX, sampleY)] = isSolid ? halfTexelSize - sqrtf(transformedToEmpty[sampleY]) : sqrtf(transformedToSolid[sampleY]) - halfTexelSize;
+			}
+		}
+	};
+	RunParallelFor(m_dimensions.x, 1 + MIN_SAMPLES_PER_JOB / m_dimensions.y, transformColumns);
+	ComputeGradients();
+}
+
+void SignedDistanceField::Clear()
+{
+	m_firstSamplePosition = Vec2::ZERO;
+	m_cellSize = Vec2::ZERO;
+	m_inverseCellSize = Vec2::ZERO;
+	m_dimensions = IntVec2::ZERO;
+	m_distances.clear();
+	m_gradientsX.clear();
+	m_gradientsY.clear();
+}
+
+AABB2 SignedDistanceField::GetBounds() const
+{
+	Vec2 lastSamplePosition(m_firstSamplePosition.x + m_cellSize.x * (float)(m_dimensions.x - 1), m_firstSamplePosition.y + m_cellSize.y * (float)(m_dimensions.y - 1));
+	return AABB2(m_firstSamplePosition, lastSamplePosition);
+}
+
+float SignedDistanceField::SampleDistance(const Vec2& point) const
+{
+	if (IsEmpty())
+		return FAR_AWAY_DISTANCE;
+
+	int cellX = 0;
+	int cellY = 0;
+	float fractionX = 0.f;
+	float fractionY = 0.f;
+	GetCellCoordinates(point.x, point.y, cellX, cellY, fractionX, fractionY);
+	return SampleBilinear(m_distances, GetSampleIndex(cellX, cellY), m_dimensions.x, fractionX, fractionY);
+}
+
+Vec2 SignedDistanceField::SampleGradient(const Vec2& point) const
+{
+	if (IsEmpty())
+		return Vec2::ZERO;
+
+	int cellX = 0;
+	int cellY = 0;
+	float fractionX = 0.f;
+	float fractionY = 0.f;
+	GetCellCoordinates(point.x, point.y, cellX, cellY, fractionX, fractionY);
+	int sampleIndex = GetSampleIndex(cellX, cellY);
+	return Vec2(SampleBilinear(m_gradientsX, sampleIndex, m_dimensions.x, fractionX, fractionY), SampleBilinear(m_gradientsY, sampleIndex, m_dimensions.x, fractionX, fractionY));
+}
+
+void SignedDistanceField::PushParticlesOut(float* positionsX, float* positionsY, int numParticles, float particleRadius) const
+{
+	if (IsEmpty())
+		return;
+
+	for (int i = 0; i < numParticles; i++)
+	{
+		int cellX = 0;
+		int cellY = 0;
+		float fractionX = 0.f;
+		float fractionY = 0.f;
+		if (!GetCellCoordinates(positionsX[i], positionsY[i], cellX, cellY, fractionX, fractionY))
+			continue;
+
+		int sampleIndex = GetSampleIndex(cellX, cellY);
+		float distance = SampleBilinear(m_distances, sampleIndex, m_dimensions.x, fractionX, fractionY);
+		if (distance >= particleRadius)
+			continue;
+
+		//the blended gradient is shorter than one where neighbouring samples point different ways, renormalize it so the push
+		//still ends on the surface. On a ridge between two surfaces it can cancel out, the particle then waits for the next step
+		float gradientX = SampleBilinear(m_gradientsX, sampleIndex, m_dimensions.x, fractionX, fractionY);
+		float gradientY = SampleBilinear(m_gradientsY, sampleIndex, m_dimensions.x, fractionX, fractionY);
+		float gradientLength = sqrtf(gradientX * gradientX + gradientY * gradientY);
+		if (gradientLength <= 0.f)
+			continue;
+
+		float pushDistance = (particleRadius - distance) / gradientLength;
+		positionsX[i] += gradientX * pushDistance;
+		positionsY[i] += gradientY * pushDistance;
+	}
+}
+
+void SignedDistanceField::Resize(const Vec2& firstSamplePosition, const Vec2& cellSize, IntVec2 dimensions)
+{
+	m_firstSamplePosition = firstSamplePosition;
+	m_cellSize = cellSize;
+	m_inverseCellSize = Vec2(1.f / cellSize.x, 1.f / cellSize.y);
+	m_dimensions = dimensions;
+	int numSamples = dimensions.x * dimensions.y;
+	m_distances.assign(numSamples, FAR_AWAY_DISTANCE);
+	m_gradientsX.assign(numSamples, 0.f);
+	m_gradientsY.assign(numSamples, 0.f);
+}
+
+void SignedDistanceField::LowerDistancesNear(const AABB2& shapeBounds, float maxDistance, int startRow, int endRow, const SignedDistanceFunction& signedDistance)
+{
+	int startX = (int)ceilf((shapeBounds.m_mins.x - maxDistance - m_firstSamplePosition.x) * m_inverseCellSize.x);
+	int endX = (int)floorf((shapeBounds.m_maxs.x + maxDistance - m_firstSamplePosition.x) * m_inverseCellSize.x) + 1;
+	int startY = (int)ceilf((shapeBounds.m_mins.y - maxDistance - m_firstSamplePosition.y) * m_inverseCellSize.y);
+	int endY = (int)floorf((shapeBounds.m_maxs.y + maxDistance - m_firstSamplePosition.y) * m_inverseCellSize.y) + 1;
+	startX = (startX > 0) ? startX : 0;
+	endX = (endX < m_dimensions.x) ? endX : m_dimensions.x;
+	startY = (startY > startRow) ? startY : startRow;
+	endY = (endY < endRow) ? endY : endRow;
+	for (int sampleY = startY; sampleY < endY; sampleY++)
+	{
+		for (int sampleX = startX; sampleX < endX; sampleX++)
+		{
+			Vec2 samplePosition(m_firstSamplePosition.x + m_cellSize.x * (float)sampleX, m_firstSamplePosition.y + m_cellSize.y * (float)sampleY);
+			float distance = signedDistance(samplePosition);
+			int sampleIndex = GetSampleIndex(sampleX, sampleY);
+			m_distances[sampleIndex] = (distance < m_distances[sampleIndex]) ? distance : m_distances[sampleIndex];
+		}
+	}
+}
+
+void SignedDistanceField::ComputeGradients()
+{
+	//central differences, one sided on the border
+	ParallelForFunction computeRows = [this](int startRow, int endRow)
+	{
+		for (int sampleY = startRow; sampleY < endRow; sampleY++)
+		{
+			int previousY = (sampleY > 0) ? sampleY - 1 : sampleY;
+			int nextY = (sampleY < m_dimensions.y - 1) ? sampleY + 1 : sampleY;
+			for (int sampleX = 0; sampleX < m_dimensions.x; sampleX++)
+			{
+				int previousX = (sampleX > 0) ? sampleX - 1 : sampleX;
+				int nextX = (sampleX < m_dimensions.x - 1) ? sampleX + 1 : sampleX;
+				float gradientX = (m_distances[GetSampleIndex(nextX, sampleY)] - m_distances[GetSampleIndex(previousX, sampleY)]) / (m_cellSize.x * (float)(nextX - previousX));
+				float gradientY = (m_distances[GetSampleIndex(sampleX, nextY)] - m_distances[GetSampleIndex(sampleX, previousY)]) / (m_cellSize.y * (float)(nextY - previousY));
+				float gradientLength = sqrtf(gradientX * gradientX + gradientY * gradientY);
+				float inverseGradientLength = (gradientLength > 0.f) ? 1.f / gradientLength : 0.f;
+				m_gradientsX[GetSampleIndex(sampleX, sampleY)] = gradientX * inverseGradientLength;
+				m_gradientsY[GetSampleIndex(sampleX, sampleY)] = gradientY * inverseGradientLength;
+			}
+		}
+	};
+	RunParallelFor(m_dimensions.y, 1 + MIN_SAMPLES_PER_JOB / m_dimensions.x, computeRows);
+}
+
+bool SignedDistanceField::GetCellCoordinates(float pointX, float pointY, int& out_cellX, int& out_cellY, float& out_fractionX, float& out_fractionY) const
+{
+	float gridX = (pointX - m_firstSamplePosition.x) * m_inverseCellSize.x;
+	float gridY = (pointY - m_firstSamplePosition.y) * m_inverseCellSize.y;
+	float maxGridX = (float)(m_dimensions.x - 1);
+	float maxGridY = (float)(m_dimensions.y - 1);
+	bool isInside = gridX >= 0.f && gridY >= 0.f && gridX <= maxGridX && gridY <= maxGridY;
+
+	gridX = (gridX < 0.f) ? 0.f : ((gridX > maxGridX) ? maxGridX : gridX);
+	gridY = (gridY < 0.f) ? 0.f : ((gridY > maxGridY) ? maxGridY : gridY);
+	out_cellX = (int)gridX;
+	out_cellY = (int)gridY;
+	out_cellX = (out_cellX > m_dimensions.x - 2) ? m_dimensions.x - 2 : out_cellX;
+	out_cellY = (out_cellY > m_dimensions.y - 2) ? m_dimensions.y - 2 : out_cellY;
+	out_fractionX = gridX - (float)out_cellX;
+	out_fractionY = gridY - (float)out_cellY;
+	return isInside;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "Engine/Math/AABB2.hpp"
+#include "Engine/Math/IntVec2.hpp"
+#include <vector>
+#include <functional>
+
+class ColliderSet;
+class Image;
+
+typedef std::function<float(const Vec2& point)> SignedDistanceFunction;
+
+//static obstacle baked into a grid of signed distances (negative inside) and their normalized gradients. Samples sit on the
+//corners of the cells, a particle is tested with one bilinear lookup no matter how many shapes went into the bake, and
+//everything outside the sampled area counts as empty space
+class SignedDistanceField
+{
+public:
+	//samples the minimum signed distance to every shape of the set every cellSize over the bounds. Distances are clamped to maxDistance,
+	//which keeps the bake proportional to the area near the shapes instead of samples times shapes
+	void BakeFromColliders(const ColliderSet& colliders, const AABB2& bounds, float cellSize, float maxDistance);
+	//texels with a red channel of at least solidThreshold are solid. The mask is stretched over the bounds with one sample on
+	//every texel center, the distances are exact euclidean distances between texel centers with the surface halfway between
+	void BakeFromImage(const Image& mask, const AABB2& bounds, unsigned char solidThreshold);
+	void Clear();
+
+	bool IsEmpty() const { return m_distances.empty(); }
+	//area covered by the samples, the field has no effect outside of it
+	AABB2 GetBounds() const;
+	IntVec2 GetDimensions() const { return m_dimensions; }
+	//positions outside the bounds are clamped onto them
+	float SampleDistance(const Vec2& point) const;
+	Vec2 SampleGradient(const Vec2& point) const;
+	//moves the particles that are closer than particleRadius to the surface along the gradient until they touch it
+	void PushParticlesOut(float* positionsX, float* positionsY, int numParticles, float particleRadius) const;
+
+private:
+	void Resize(const Vec2& firstSamplePosition, const Vec2& cellSize, IntVec2 dimensions);
+	//lowers the samples within maxDistance of the shape bounds in the rows [startRow, endRow) to the shape's signed distance
+	void LowerDistancesNear(const AABB2& shapeBounds, float maxDistance, int startRow, int endRow, const SignedDistanceFunction& signedDistance);
+	void ComputeGradients();
+	int GetSampleIndex(int sampleX, int sampleY) const { return sampleY * m_dimensions.x + sampleX; }
+	//cell the point falls in and the fractions across it, false if the point is outside the bounds
+	bool GetCellCoordinates(float pointX, float pointY, int& out_cellX, int& out_cellY, float& out_fractionX, float& out_fractionY) const;
+
+private:
+	Vec2 m_firstSamplePosition = Vec2::ZERO;
+	Vec2 m_cellSize = Vec2::ZERO;
+	Vec2 m_inverseCellSize = Vec2::ZERO;
+	IntVec2 m_dimensions = IntVec2::ZERO;
+	std::vector<float> m_distances;
+	std::vector<float> m_gradientsX;
+	std::vector<float> m_gradientsY;
+};
@@ -0,0 +1,40 @@
+#include <algorithm>
+#include "Game/SparseMatrix.hpp"
+
+void BlockCsrMatrix::SetPattern(int numRows, const std::vector<int>& rowStarts, const std::vector<int>& columns)
+{
+	m_numRows = numRows;
+	m_rowStarts = rowStarts;
+	m_columns = columns;
+	m_values.assign(columns.size() * 4, 0.f);
+}
+
+int BlockCsrMatrix::FindBlock(int row, int column) const
+{
+	std::vector<int>::const_iterator rowBegin = m_columns.begin() + m_rowStarts[row];
+	std::vector<int>::const_iterator rowEnd = m_columns.begin() + m_rowStarts[row + 1];
+	std::vector<int>::const_iterator found = std::lower_bound(rowBegin, rowEnd, column);
+	if (found == rowEnd || *found != column)
+		return -1;
+
+	return (int)(found - m_columns.begin());
+}
+
+void BlockCsrMatrix::MultiplyRows(const float* vector, float* out_product, int startRow, int endRow) const
+{
+	for (int row = startRow; row < endRow; row++)
+	{
+		float productX = 0.f;
+		float productY = 0.f;
+		for (int blockIndex = m_rowStarts[row]; blockIndex < m_rowStarts[row + 1]; blockIndex++)
+		{
+			const float* block = &m_values[blockIndex * 4];
+			float vectorX = vector[m_columns[blockIndex] * 2];
+			float vectorY = vector[m_columns[blockIndex] * 2 + 1];
+			productX += block[0] * vectorX + block[1] * vectorY;
+			productY += block[2] * vectorX + block[3] * vectorY;
+		}
+		out_product[row * 2] = productX;
+		out_product[row * 2 + 1] = productY;
+	}
+}
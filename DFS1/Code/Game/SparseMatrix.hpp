@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+
+//compressed sparse row matrix whose entries are 2x2 blocks, one block row and column per particle. The vectors it multiplies are
+//interleaved, x and y of row i at 2i and 2i + 1. Every row keeps its blocks sorted by column
+struct BlockCsrMatrix
+{
+	int m_numRows = 0;
+	std::vector<int> m_rowStarts; //m_numRows + 1 entries, the first block of every row
+	std::vector<int> m_columns; //column of every block
+	std::vector<float> m_values; //4 per block, row major: xx, xy, yx, yy
+
+	//takes the pattern given by rowStarts and columns, every value is 0 until it is set
+	void SetPattern(int numRows, const std::vector<int>& rowStarts, const std::vector<int>& columns);
+	int GetNumBlocks() const { return (int)m_columns.size(); }
+	//the block at row, column or -1 if it is not part of the pattern
+	int FindBlock(int row, int column) const;
+	float* GetBlock(int blockIndex) { return &m_values[blockIndex * 4]; }
+	const float* GetBlock(int blockIndex) const { return &m_values[blockIndex * 4]; }
+	//rows startRow to endRow of this * vector, rows are independent so any range can run on its own thread
+	void MultiplyRows(const float* vector, float* out_product, int startRow, int endRow) const;
+};
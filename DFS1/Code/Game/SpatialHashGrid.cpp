@@ -0,0 +1,67 @@
+#include "Game/SpatialHashGrid.hpp"
+#include "Engine/Core/JobSystem.hpp"
+#include <math.h>
+
+constexpr int MIN_PARTICLES_PER_JOB = 4096;
+//a zero cell size (e.g. from a cloth with zero length links) would make the inverse infinite and every cell coordinate undefined.
+//A larger cell than asked for only puts more particles in each bucket
+constexpr float MIN_CELL_SIZE = 0.001f;
+
+extern JobSystem* g_theJobSystem;
+
+void SpatialHashGrid::Build(const float* positionsX, const float* positionsY, int numParticles, float cellSize)
+{
+	if (!(cellSize > MIN_CELL_SIZE))
+		cellSize = MIN_CELL_SIZE;
+	m_inverseCellSize = 1.f / cellSize;
+
+	//power of two table with about twice as many buckets as particles keeps collisions rare and the hash a simple mask
+	int tableSize = 64;
+	while (tableSize < numParticles * 2)
+	{
+		tableSize *= 2;
+	}
+	m_tableSize = tableSize;
+	m_particleHashes.resize(numParticles);
+	m_sortedParticleIndices.resize(numParticles);
+	m_bucketStarts.assign(tableSize + 1, 0);
+
+	ParallelForFunction computeHashes = [this, positionsX, positionsY](int startIndex, int endIndex)
+	{
+		for (int i = startIndex; i < endIndex; i++)
+		{
+			m_particleHashes[i] = GetCellHash(GetCellCoordinate(positionsX[i]), GetCellCoordinate(positionsY[i]));
+		}
+	};
+	if (g_theJobSystem)
+		g_theJobSystem->ParallelFor(numParticles, MIN_PARTICLES_PER_JOB, computeHashes);
+	else
+		computeHashes(0, numParticles);
+
+	//counting sort, the count/prefix sum/scatter passes are single streaming loops and stay serial so the order of particles
+	//inside a bucket (and with it the order collisions get summed in) is the same every run
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_bucketStarts[m_particleHashes[i] + 1]++;
+	}
+	for (int hash = 0; hash < tableSize; hash++)
+	{
+		m_bucketStarts[hash + 1] += m_bucketStarts[hash];
+	}
+	m_bucketCursors.assign(m_bucketStarts.begin(), m_bucketStarts.end() - 1);
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_sortedParticleIndices[m_bucketCursors[m_particleHashes[i]]++] = i;
+	}
+}
+
+int SpatialHashGrid::GetCellHash(int cellX, int cellY) const
+{
+	uint32_t hash = ((uint32_t)cellX * 92837111u) ^ ((uint32_t)cellY * 689287499u);
+	return (int)(hash & (uint32_t)(m_tableSize - 1));
+}
+
+int SpatialHashGrid::GetCellCoordinate(float position) const
+{
+	return (int)floorf(position * m_inverseCellSize);
+}
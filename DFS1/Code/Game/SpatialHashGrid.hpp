@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+//uniform grid over an unbounded 2D space, cells are hashed into a fixed size table that is rebuilt from scratch every step with a
+//counting sort, so the particles of one bucket sit next to each other in m_sortedParticleIndices.
+class SpatialHashGrid
+{
+public:
+	void Build(const float* positionsX, const float* positionsY, int numParticles, float cellSize);
+	int GetCellHash(int cellX, int cellY) const;
+	int GetCellCoordinate(float position) const;
+
+	//calls function(particleIndex) for every particle in the cells overlapping the square of half size radius around the position.
+	//The radius must not be larger than the cell size. Hash collisions can add particles from far away cells so callers still have
+	//to check the distance.
+	template<typename Function>
+	void ForEachParticleNear(float positionX, float positionY, float radius, Function function) const;
+
+private:
+	float m_inverseCellSize = 1.f;
+	int m_tableSize = 0;
+	std::vector<int> m_particleHashes;
+	std::vector<int> m_bucketStarts; //particles of bucket h are m_sortedParticleIndices[m_bucketStarts[h], m_bucketStarts[h + 1])
+	std::vector<int> m_sortedParticleIndices;
+	std::vector<int> m_bucketCursors;
+};
+
+template<typename Function>
+void SpatialHashGrid::ForEachParticleNear(float positionX, float positionY, float radius, Function function) const
+{
+	if (m_tableSize == 0)
+		return;
+
+	int minCellX = GetCellCoordinate(positionX - radius);
+	int maxCellX = GetCellCoordinate(positionX + radius);
+	int minCellY = GetCellCoordinate(positionY - radius);
+	int maxCellY = GetCellCoordinate(positionY + radius);
+	int visitedHashes[9];
+	int numVisitedHashes = 0;
+	for (int cellY = minCellY; cellY <= maxCellY; cellY++)
+	{
+		for (int cellX = minCellX; cellX <= maxCellX; cellX++)
+		{
+			//two neighbouring cells can land in the same bucket, visit each bucket once
+			int hash = GetCellHash(cellX, cellY);
+			bool isVisited = false;
+			for (int i = 0; i < numVisitedHashes; i++)
+			{
+				isVisited = isVisited || (visitedHashes[i] == hash);
+			}
+			if (isVisited)
+				continue;
+
+			visitedHashes[numVisitedHashes++] = hash;
+			for (int i = m_bucketStarts[hash]; i < m_bucketStarts[hash + 1]; i++)
+			{
+				function(m_sortedParticleIndices[i]);
+			}
+		}
+	}
+}
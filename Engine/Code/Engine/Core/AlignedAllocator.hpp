@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+//std::allocator compatible allocator that returns memory aligned to the given boundary, so std::vector storage can be
+//loaded with aligned SIMD instructions and does not straddle cache lines at the start of the array.
+template<typename T, size_t Alignment = 64>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+	template<typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() = default;
+	template<typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t count)
+	{
+		//over allocate and stash the original pointer just before the aligned block
+		size_t totalBytes = count * sizeof(T) + Alignment + sizeof(void*);
+		void* rawMemory = std::malloc(totalBytes);
+		if (rawMemory == nullptr)
+			throw std::bad_alloc();
+
+		uintptr_t alignedAddress = (reinterpret_cast<uintptr_t>(rawMemory) + sizeof(void*) + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+		reinterpret_cast<void**>(alignedAddress)[-1] = rawMemory;
+		return reinterpret_cast<T*>(alignedAddress);
+	}
+
+	void deallocate(T* memory, size_t count)
+	{
+		(void)count;
+		if (memory != nullptr)
+		{
+			std::free(reinterpret_cast<void**>(memory)[-1]);
+		}
+	}
+
+	template<typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+	template<typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
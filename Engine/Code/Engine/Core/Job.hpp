@@ -4,6 +4,7 @@
 class Job
 {
 	friend class JobWorkerThread;
+	friend class JobSystem;
 public:
 	virtual ~Job() = default;
 
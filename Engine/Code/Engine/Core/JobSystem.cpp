@@ -1,5 +1,34 @@
 #include "Engine/Core/JobSystem.hpp"
 #include "Engine/Core/JobWorkerThread.hpp"
+#include "Engine/Core/Job.hpp"
+#include <atomic>
+#include <thread>
+
+class ParallelForJob : public Job
+{
+public:
+	ParallelForJob(const ParallelForFunction& rangeFunction, int startIndex, int endIndex, std::atomic<int>& numJobsRemaining)
+		:m_rangeFunction(rangeFunction), m_startIndex(startIndex), m_endIndex(endIndex), m_numJobsRemaining(numJobsRemaining)
+	{
+	}
+
+private:
+	const ParallelForFunction& m_rangeFunction;
+	int m_startIndex = 0;
+	int m_endIndex = 0;
+	std::atomic<int>& m_numJobsRemaining;
+
+private:
+	void Execute() override
+	{
+		m_rangeFunction(m_startIndex, m_endIndex);
+	}
+
+	void OnFinished() override
+	{
+		m_numJobsRemaining--;
+	}
+};
 
 JobSystem::JobSystem(const JobSystemConfig& config)
 	:m_config(config)
@@ -18,6 +47,8 @@ void JobSystem::Startup()
 
 void JobSystem::Shutdown()
 {
+	//worker threads only exit their loop once told to quit, so flag them before joining
+	CancelAllJobs();
 	DestroyAllThreads();
 }
 
@@ -36,6 +67,7 @@ void JobSystem::QueueJobs(Job* jobToExecute)
 	m_queuedJobsMutex.lock();
 	m_queuedJobs.push_back(jobToExecute);
 	m_queuedJobsMutex.unlock();
+	m_jobQueuedCondition.notify_one();
 }
 
 Job* JobSystem::ClaimJobToExecute()
@@ -54,6 +86,12 @@ Job* JobSystem::ClaimJobToExecute()
 	return jobToExecute;
 }
 
+void JobSystem::WaitForQueuedJobs(const std::atomic<bool>& isQuitting)
+{
+	std::unique_lock<std::mutex> lock(m_queuedJobsMutex);
+	m_jobQueuedCondition.wait(lock, [this, &isQuitting]() { return !m_queuedJobs.empty() || isQuitting; });
+}
+
 void JobSystem::MoveJobToFinishedQueue(Job* job)
 {
 	m_finishedJobsMutex.lock();
@@ -101,12 +139,74 @@ int JobSystem::GetNumExecutingJobs() const
 	return num;
 }
 
+void JobSystem::ParallelFor(int numElements, int minElementsPerJob, const ParallelForFunction& rangeFunction)
+{
+	if (numElements <= 0)
+		return;
+
+	if (minElementsPerJob < 1)
+		minElementsPerJob = 1;
+
+	int maxNumJobs = GetNumWorkerThreads() + 1;
+	int numJobs = (numElements + minElementsPerJob - 1) / minElementsPerJob;
+	if (numJobs > maxNumJobs)
+		numJobs = maxNumJobs;
+
+	if (numJobs <= 1)
+	{
+		rangeFunction(0, numElements);
+		return;
+	}
+
+	std::atomic<int> numJobsRemaining(numJobs);
+	std::vector<Job*> jobs;
+	jobs.reserve(numJobs);
+	int elementsPerJob = numElements / numJobs;
+	int numJobsWithExtraElement = numElements % numJobs;
+	int startIndex = 0;
+	for (int i = 0; i < numJobs; i++)
+	{
+		int endIndex = startIndex + elementsPerJob + (i < numJobsWithExtraElement ? 1 : 0);
+		Job* job = new ParallelForJob(rangeFunction, startIndex, endIndex, numJobsRemaining);
+		jobs.push_back(job);
+		QueueJobs(job);
+		startIndex = endIndex;
+	}
+
+	//help out instead of idling, then wait for any jobs still running on the workers
+	while (numJobsRemaining > 0)
+	{
+		Job* jobToExecute = ClaimJobToExecute();
+		if (jobToExecute)
+		{
+			jobToExecute->Execute();
+			MoveJobToFinishedQueue(jobToExecute);
+			jobToExecute->OnFinished();
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	RemoveJobsFromFinishedQueue(jobs);
+	for (int i = 0; i < jobs.size(); i++)
+	{
+		delete jobs[i];
+	}
+}
+
 void JobSystem::CancelAllJobs()
 {
 	for (int i = 0; i < m_workerThreads.size(); i++)
 	{
 		m_workerThreads[i]->m_isQuitting = true;
 	}
+
+	//take the queue lock so a worker between checking its flag and waiting cannot miss the wake up
+	m_queuedJobsMutex.lock();
+	m_queuedJobsMutex.unlock();
+	m_jobQueuedCondition.notify_all();
 }
 
 void JobSystem::DestroyAllThreads()
@@ -116,5 +216,29 @@ void JobSystem::DestroyAllThreads()
 		delete m_workerThreads[i];
 		m_workerThreads[i] = nullptr;
 	}
+	m_workerThreads.clear();
+}
+
+void JobSystem::RemoveJobsFromFinishedQueue(const std::vector<Job*>& jobs)
+{
+	m_finishedJobsMutex.lock();
+	for (auto iter = m_finishedJobs.begin(); iter != m_finishedJobs.end();)
+	{
+		bool isJobInList = false;
+		for (int i = 0; i < jobs.size(); i++)
+		{
+			if (*iter == jobs[i])
+			{
+				isJobInList = true;
+				break;
+			}
+		}
+
+		if (isJobInList)
+			iter = m_finishedJobs.erase(iter);
+		else
+			++iter;
+	}
+	m_finishedJobsMutex.unlock();
 }
 
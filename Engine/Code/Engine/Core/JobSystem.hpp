@@ -1,11 +1,17 @@
 #pragma once
 #include <deque>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <vector>
+#include <functional>
 
 class Job;
 class JobWorkerThread;
 
+//called with a half open [startIndex, endIndex) range of the elements a single job is responsible for
+typedef std::function<void(int startIndex, int endIndex)> ParallelForFunction;
+
 struct JobSystemConfig
 {
 	int m_numWorkerThreads = 8;
@@ -22,10 +28,17 @@ public:
 
 	void QueueJobs(Job* jobToExecute);
 	Job* ClaimJobToExecute();
+	//blocks the calling worker until a job is queued or isQuitting is set
+	void WaitForQueuedJobs(const std::atomic<bool>& isQuitting);
 	void MoveJobToFinishedQueue(Job* job);
 	Job* RetrieveFinishedJob();
 	int GetNumQueuedJobs() const;
 	int GetNumExecutingJobs() const;
+	int GetNumWorkerThreads() const { return (int)m_workerThreads.size(); }
+
+	//splits [0, numElements) into jobs of at least minElementsPerJob elements, runs them on the worker threads and returns once all
+	//of them are done. The calling thread executes queued jobs while it waits, so this acts as a barrier between successive calls.
+	void ParallelFor(int numElements, int minElementsPerJob, const ParallelForFunction& rangeFunction);
 
 	void CancelAllJobs();
 
@@ -33,6 +46,7 @@ private:
 	JobSystemConfig m_config;
 	std::deque<Job*> m_queuedJobs;
 	mutable std::mutex m_queuedJobsMutex;
+	std::condition_variable m_jobQueuedCondition;
 
 	std::vector<Job*> m_executingJobs;
 	mutable std::mutex m_executingJobsMutex;
@@ -44,4 +58,5 @@ private:
 
 private:
 	void DestroyAllThreads();
+	void RemoveJobsFromFinishedQueue(const std::vector<Job*>& jobs);
 };
\ No newline at end of file
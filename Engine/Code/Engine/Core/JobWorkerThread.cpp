@@ -2,7 +2,11 @@
 #include "Engine/Core/Job.hpp"
 #include "Engine/Core/JobSystem.hpp"
 #include "Engine/Core/EngineCommon.hpp"
-#include <chrono>
+
+//an idle worker keeps polling for a short while, since ParallelFor calls tend to come back to back, then yields, and only then
+//blocks until a job is queued. Sleeping instead would round up to the OS timer resolution, which is up to 15 ms on Windows
+constexpr int NUM_IDLE_SPINS_BEFORE_YIELD = 64;
+constexpr int NUM_IDLE_SPINS_BEFORE_WAIT = 1024;
 
 JobWorkerThread::JobWorkerThread(JobSystem* jobSystem, int workerThreadID)
 	:m_jobSystem(jobSystem), m_workerThreadID(workerThreadID)
@@ -20,6 +24,7 @@ JobWorkerThread::~JobWorkerThread()
 void JobWorkerThread::JobWorkerMain(int workerID)
 {
 	UNUSED(workerID);
+	int numIdleSpins = 0;
 	while (!m_isQuitting)
 	{
 		Job* jobToExecute = m_jobSystem->ClaimJobToExecute();
@@ -28,10 +33,21 @@ void JobWorkerThread::JobWorkerMain(int workerID)
 			jobToExecute->Execute();
 			m_jobSystem->MoveJobToFinishedQueue(jobToExecute);
 			jobToExecute->OnFinished();
+			numIdleSpins = 0;
+		}
+		else if (numIdleSpins < NUM_IDLE_SPINS_BEFORE_YIELD)
+		{
+			numIdleSpins++;
+		}
+		else if (numIdleSpins < NUM_IDLE_SPINS_BEFORE_WAIT)
+		{
+			numIdleSpins++;
+			std::this_thread::yield();
 		}
 		else
 		{
-			std::this_thread::sleep_for(std::chrono::microseconds(10));
+			m_jobSystem->WaitForQueuedJobs(m_isQuitting);
+			numIdleSpins = 0;
 		}
 	}
 }